@@ -0,0 +1,85 @@
+#ifndef ACC_HEADER_
+#define ACC_HEADER_
+
+#include "hmm.h"
+
+#ifndef MAX_CLASS
+    #define MAX_CLASS 16
+#endif
+
+typedef struct {
+    int correct_num;
+    int total_num;
+    int class_num;
+    char names[MAX_CLASS][MAX_LINE];
+    int confusion[MAX_CLASS][MAX_CLASS]; // confusion[answer][prediction]
+} Evaluation;
+
+/**
+ * @return index of name in eval->names, added if not there yet
+ */
+static int class_index(Evaluation *eval, const char *name)
+{
+    int i;
+    for (i = 0; i < eval->class_num; i++) {
+        if (strcmp(eval->names[i], name) == 0) {
+            return i;
+        }
+    }
+    if (eval->class_num >= MAX_CLASS) {
+        fprintf(stderr, "Too many classes, increase MAX_CLASS\n");
+        exit(1);
+    }
+    strcpy(eval->names[eval->class_num], name);
+    return eval->class_num++;
+}
+
+/**
+ * Compare a result file of test against the answer file
+ * @param result_file lines of "model_name likelihood"
+ * @param ans_file lines of "model_name"
+ * @param eval filled with counts and confusion matrix
+ */
+static void calc_accuracy(const char *result_file, const char *ans_file, Evaluation *eval)
+{
+    char pred[MAX_LINE] = "";
+    char ans[MAX_LINE] = "";
+    double likelihood;
+
+    memset(eval, 0, sizeof(Evaluation));
+
+    FILE *fp1, *fp2;
+    fp1 = open_or_die(result_file, "r");
+    fp2 = open_or_die(ans_file, "r");
+    while (fscanf(fp1, "%s %le", pred, &likelihood) > 0 && fscanf(fp2, "%s", ans) > 0) {
+        int a = class_index(eval, ans);
+        int p = class_index(eval, pred);
+        eval->confusion[a][p]++;
+        if (a == p) {
+            eval->correct_num++;
+        }
+        eval->total_num++;
+    }
+    fclose(fp1);
+    fclose(fp2);
+}
+
+static void dump_confusion(FILE *fp, const Evaluation *eval)
+{
+    int i, j;
+
+    fprintf(fp, "%-16s", "answer \\ pred");
+    for (j = 0; j < eval->class_num; j++) {
+        fprintf(fp, " %12.12s", eval->names[j]);
+    }
+    fprintf(fp, "\n");
+    for (i = 0; i < eval->class_num; i++) {
+        fprintf(fp, "%-16.16s", eval->names[i]);
+        for (j = 0; j < eval->class_num; j++) {
+            fprintf(fp, " %12d", eval->confusion[i][j]);
+        }
+        fprintf(fp, "\n");
+    }
+}
+
+#endif
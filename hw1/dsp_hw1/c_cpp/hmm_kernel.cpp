@@ -0,0 +1,425 @@
+#include "hmm_kernel.h"
+#include <stdio.h>
+
+/**
+ * Forward, backward, Viterbi and accumulate kernels for a discrete HMM with
+ * N states and M symbols. With N and M known at compile time the loops are
+ * fully unrolled and alpha/beta of one time step stay in registers.
+ * Hmm<0, 0, Scalar> is the generic fallback that reads the sizes at runtime.
+ *
+ * Probabilities are kept in linear domain and rescaled only when they get
+ * close to underflow (forward, backward, Viterbi), or at every step where
+ * the scaled tables are needed (accumulate).
+ */
+
+template <typename Scalar> struct ScalarTraits;
+
+template <> struct ScalarTraits<double> {
+    static double floor() { return 1e-250; }
+    static const char *name() { return "double"; }
+};
+
+template <> struct ScalarTraits<float> {
+    static float floor() { return 1e-30f; }
+    static const char *name() { return "float"; }
+};
+
+struct HmmKernel {
+    virtual ~HmmKernel() {}
+    virtual const char *name() const = 0;
+    virtual double forward(const Observation *observ, double bound) const = 0;
+    virtual double backward(const Observation *observ) const = 0;
+    virtual double viterbi(const Observation *observ, int *path) const = 0;
+    virtual double accumulate(const Observation *observ, Accumulator *acc) const = 0;
+};
+
+#ifndef PRUNE_STEP
+    #define PRUNE_STEP 8 // Steps between checks of the pruning bound
+#endif
+
+// Fold a running product of scale factors into a log once it gets small
+#define FOLD_SCALE(prod, log_sum) \
+    if ((prod) < 1e-200) { \
+        (log_sum) += log(prod); \
+        (prod) = 1; \
+    }
+
+template <int N, int M, typename Scalar>
+class Hmm : public HmmKernel {
+    static const int NS = N > 0 ? N : MAX_STATE;
+    static const int MS = M > 0 ? M : MAX_OBSERV;
+
+    int n_, m_;
+    char name_[MAX_LINE];
+    Scalar pi[NS];
+    Scalar a[NS][NS];    // a[i][j], transition i -> j
+    Scalar b[MS][NS];    // b[k][j], symbol k in state j
+
+    int n() const { return N > 0 ? N : n_; }
+    int m() const { return M > 0 ? M : m_; }
+
+    // Rescale v when it is close to underflow, accumulating the factor
+    // @return sum of v after rescaling
+    Scalar rescale(Scalar *v, double &prod, double &log_sum) const
+    {
+        Scalar sum = 0;
+        for (int i = 0; i < n(); i++) {
+            sum += v[i];
+        }
+        if (sum < ScalarTraits<Scalar>::floor() && sum > 0) {
+            Scalar inv = 1 / sum;
+            for (int i = 0; i < n(); i++) {
+                v[i] *= inv;
+            }
+            prod *= sum;
+            FOLD_SCALE(prod, log_sum);
+            return 1;
+        }
+        return sum;
+    }
+
+public:
+    explicit Hmm(const HMM *hmm) : n_(hmm->state_num), m_(hmm->observ_num)
+    {
+        if (N > 0) {
+            snprintf(name_, sizeof(name_), "Hmm<%d,%d,%s>", N, M, ScalarTraits<Scalar>::name());
+        } else {
+            snprintf(name_, sizeof(name_), "Hmm<generic,%s>", ScalarTraits<Scalar>::name());
+        }
+        for (int i = 0; i < n(); i++) {
+            pi[i] = (Scalar)hmm->initial[i];
+            for (int j = 0; j < n(); j++) {
+                a[i][j] = (Scalar)hmm->transition[i][j];
+            }
+        }
+        for (int k = 0; k < m(); k++) {
+            for (int j = 0; j < n(); j++) {
+                b[k][j] = (Scalar)hmm->observation[k][j];
+            }
+        }
+    }
+
+    const char *name() const { return name_; }
+
+    double forward(const Observation *observ, double bound) const
+    {
+        Scalar alpha[NS], next[NS];
+        double prod = 1, log_sum = 0;
+        const int *seq = observ->seq;
+
+        for (int i = 0; i < n(); i++) {
+            alpha[i] = pi[i] * b[seq[0]][i];
+        }
+
+        for (int t = 1; t < observ->seq_num; t++) {
+            const Scalar *bt = b[seq[t]];
+            for (int j = 0; j < n(); j++) {
+                Scalar accum = 0;
+                for (int i = 0; i < n(); i++) {
+                    accum += alpha[i] * a[i][j];
+                }
+                next[j] = accum * bt[j];
+            }
+            for (int j = 0; j < n(); j++) {
+                alpha[j] = next[j];
+            }
+            Scalar sum = rescale(alpha, prod, log_sum);
+
+            // The partial likelihood never increases, so once it is below
+            // the bound the final one is too
+            if (bound > -HUGE_VAL && t % PRUNE_STEP == 0 && \
+                !(log((double)sum) + log(prod) + log_sum >= bound)) {
+                return -HUGE_VAL;
+            }
+        }
+
+        Scalar prob = 0;
+        for (int i = 0; i < n(); i++) {
+            prob += alpha[i];
+        }
+        return prob > 0 ? log((double)prob) + log(prod) + log_sum : -HUGE_VAL;
+    }
+
+    double backward(const Observation *observ) const
+    {
+        Scalar beta[NS], prev[NS];
+        double prod = 1, log_sum = 0;
+        const int *seq = observ->seq;
+
+        for (int i = 0; i < n(); i++) {
+            beta[i] = 1;
+        }
+
+        for (int t = observ->seq_num - 2; t >= 0; t--) {
+            const Scalar *bt = b[seq[t+1]];
+            Scalar bb[NS];
+            for (int j = 0; j < n(); j++) {
+                bb[j] = bt[j] * beta[j];
+            }
+            for (int i = 0; i < n(); i++) {
+                Scalar accum = 0;
+                for (int j = 0; j < n(); j++) {
+                    accum += a[i][j] * bb[j];
+                }
+                prev[i] = accum;
+            }
+            for (int i = 0; i < n(); i++) {
+                beta[i] = prev[i];
+            }
+            rescale(beta, prod, log_sum);
+        }
+
+        Scalar prob = 0;
+        for (int i = 0; i < n(); i++) {
+            prob += pi[i] * b[seq[0]][i] * beta[i];
+        }
+        return prob > 0 ? log((double)prob) + log(prod) + log_sum : -HUGE_VAL;
+    }
+
+    double viterbi(const Observation *observ, int *path) const
+    {
+        Scalar delta[NS] = {}, next[NS];    // Zeroed, -Wall cannot tell n() > 0
+        unsigned char psi[MAX_SEQ][NS];
+        double prod = 1, log_sum = 0;
+        const int *seq = observ->seq;
+
+        for (int i = 0; i < n(); i++) {
+            delta[i] = pi[i] * b[seq[0]][i];
+        }
+
+        for (int t = 1; t < observ->seq_num; t++) {
+            const Scalar *bt = b[seq[t]];
+            for (int j = 0; j < n(); j++) {
+                Scalar max = delta[0] * a[0][j];
+                int arg_max = 0;
+                for (int i = 1; i < n(); i++) {
+                    Scalar tmp = delta[i] * a[i][j];
+                    if (tmp > max) {
+                        max = tmp;
+                        arg_max = i;
+                    }
+                }
+                next[j] = max * bt[j];
+                psi[t][j] = (unsigned char)arg_max;
+            }
+            for (int j = 0; j < n(); j++) {
+                delta[j] = next[j];
+            }
+            rescale(delta, prod, log_sum);
+        }
+
+        int q = 0;
+        for (int i = 1; i < n(); i++) {
+            if (delta[i] > delta[q]) {
+                q = i;
+            }
+        }
+        if (path != NULL) {
+            path[observ->seq_num-1] = q;
+            for (int t = observ->seq_num - 2; t >= 0; t--) {
+                path[t] = psi[t+1][path[t+1]];
+            }
+        }
+        return delta[q] > 0 ? log((double)delta[q]) + log(prod) + log_sum : -HUGE_VAL;
+    }
+
+    double accumulate(const Observation *observ, Accumulator *acc) const
+    {
+        Scalar alpha[MAX_SEQ][NS], beta[MAX_SEQ][NS], scale[MAX_SEQ];
+        Scalar trans[NS][NS], trans_den[NS], emit[MS][NS], emit_den[NS];
+        double prod = 1, log_sum = 0;
+        const int *seq = observ->seq;
+        const int T = observ->seq_num;
+
+        // Forward, normalized at every step: alpha[t] sums to one and
+        // scale[t] is the inverse of the normalizer
+        Scalar sum = 0;
+        for (int i = 0; i < n(); i++) {
+            alpha[0][i] = pi[i] * b[seq[0]][i];
+            sum += alpha[0][i];
+        }
+        for (int t = 0; ; t++) {
+            if (!(sum > 0)) {
+                return -HUGE_VAL;
+            }
+            scale[t] = 1 / sum;
+            prod *= sum;
+            FOLD_SCALE(prod, log_sum);
+            for (int i = 0; i < n(); i++) {
+                alpha[t][i] *= scale[t];
+            }
+            if (t == T - 1) {
+                break;
+            }
+
+            const Scalar *bt = b[seq[t+1]];
+            sum = 0;
+            for (int j = 0; j < n(); j++) {
+                Scalar accum = 0;
+                for (int i = 0; i < n(); i++) {
+                    accum += alpha[t][i] * a[i][j];
+                }
+                alpha[t+1][j] = accum * bt[j];
+                sum += alpha[t+1][j];
+            }
+        }
+
+        // Backward with the same scale factors
+        for (int i = 0; i < n(); i++) {
+            beta[T-1][i] = scale[T-1];
+        }
+        for (int t = T - 2; t >= 0; t--) {
+            const Scalar *bt = b[seq[t+1]];
+            for (int i = 0; i < n(); i++) {
+                Scalar accum = 0;
+                for (int j = 0; j < n(); j++) {
+                    accum += a[i][j] * bt[j] * beta[t+1][j];
+                }
+                beta[t][i] = accum * scale[t];
+            }
+        }
+
+        for (int i = 0; i < n(); i++) {
+            trans_den[i] = emit_den[i] = 0;
+            for (int j = 0; j < n(); j++) {
+                trans[i][j] = 0;
+            }
+        }
+        for (int k = 0; k < m(); k++) {
+            for (int j = 0; j < n(); j++) {
+                emit[k][j] = 0;
+            }
+        }
+
+        // With this scaling delta[t][i] = alpha[t][i] * beta[t][i] / scale[t]
+        // and epsilon[t][i][j] = alpha[t][i] * a[i][j] * b[o_t+1][j] * beta[t+1][j]
+        for (int t = 0; t < T; t++) {
+            Scalar inv = 1 / scale[t];
+            for (int i = 0; i < n(); i++) {
+                Scalar gamma = alpha[t][i] * beta[t][i] * inv;
+                emit[seq[t]][i] += gamma;
+                emit_den[i] += gamma;
+            }
+            if (t == 0) {
+                for (int i = 0; i < n(); i++) {
+                    acc->initial[i] += alpha[0][i] * beta[0][i] * inv;
+                }
+            }
+            if (t == T - 1) {
+                break;
+            }
+
+            const Scalar *bt = b[seq[t+1]];
+            Scalar bb[NS];
+            for (int j = 0; j < n(); j++) {
+                bb[j] = bt[j] * beta[t+1][j];
+            }
+            for (int i = 0; i < n(); i++) {
+                trans_den[i] += alpha[t][i] * beta[t][i] * inv;
+                for (int j = 0; j < n(); j++) {
+                    trans[i][j] += alpha[t][i] * a[i][j] * bb[j];
+                }
+            }
+        }
+
+        for (int i = 0; i < n(); i++) {
+            acc->transition_den[i] += trans_den[i];
+            acc->observation_den[i] += emit_den[i];
+            for (int j = 0; j < n(); j++) {
+                acc->transition[i][j] += trans[i][j];
+            }
+        }
+        for (int k = 0; k < m(); k++) {
+            for (int j = 0; j < n(); j++) {
+                acc->observation[k][j] += emit[k][j];
+            }
+        }
+
+        double log_likelihood = log(prod) + log_sum;
+        acc->seq_num++;
+        acc->log_likelihood += log_likelihood;
+        return log_likelihood;
+    }
+};
+
+template <int N, int M, typename Scalar>
+static HmmKernel *make_kernel(const HMM *hmm)
+{
+    return new Hmm<N, M, Scalar>(hmm);
+}
+
+typedef HmmKernel *(*KernelFactory)(const HMM *hmm);
+
+struct KernelEntry {
+    int state_num;
+    int observ_num;
+    KernelFactory make[2]; // [KERNEL_DOUBLE], [KERNEL_FLOAT]
+};
+
+#define KERNEL_ENTRY(n, m) { n, m, { make_kernel<n, m, double>, make_kernel<n, m, float> } }
+
+static const KernelEntry kernel_table[] = {
+    KERNEL_ENTRY(3, 6),
+    KERNEL_ENTRY(5, 6),
+    KERNEL_ENTRY(6, 6),
+    KERNEL_ENTRY(8, 6),
+#if MAX_STATE >= 16
+    KERNEL_ENTRY(16, 6),
+#endif
+};
+
+extern "C" {
+
+HmmKernel *kernel_load(const HMM *hmm, int precision)
+{
+    size_t i;
+    precision = precision == KERNEL_FLOAT ? KERNEL_FLOAT : KERNEL_DOUBLE;
+
+    for (i = 0; i < sizeof(kernel_table) / sizeof(kernel_table[0]); i++) {
+        if (kernel_table[i].state_num == hmm->state_num && kernel_table[i].observ_num == hmm->observ_num) {
+            return kernel_table[i].make[precision](hmm);
+        }
+    }
+
+    if (precision == KERNEL_FLOAT) {
+        return new Hmm<0, 0, float>(hmm);
+    }
+    return new Hmm<0, 0, double>(hmm);
+}
+
+void kernel_free(HmmKernel *kernel)
+{
+    delete kernel;
+}
+
+const char *kernel_name(const HmmKernel *kernel)
+{
+    return kernel->name();
+}
+
+double kernel_forward(const HmmKernel *kernel, const Observation *observ)
+{
+    return kernel->forward(observ, -HUGE_VAL);
+}
+
+double kernel_forward_pruned(const HmmKernel *kernel, const Observation *observ, double bound)
+{
+    return kernel->forward(observ, bound);
+}
+
+double kernel_backward(const HmmKernel *kernel, const Observation *observ)
+{
+    return kernel->backward(observ);
+}
+
+double kernel_viterbi(const HmmKernel *kernel, const Observation *observ, int *path)
+{
+    return kernel->viterbi(observ, path);
+}
+
+double kernel_accumulate(const HmmKernel *kernel, const Observation *observ, Accumulator *acc)
+{
+    return kernel->accumulate(observ, acc);
+}
+
+}
@@ -0,0 +1,68 @@
+#ifndef HMM_KERNEL_HEADER_
+#define HMM_KERNEL_HEADER_
+
+#include "hmm.h"
+#include "myhead.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KERNEL_DOUBLE 0
+#define KERNEL_FLOAT  1
+
+/**
+ * A model compiled into a kernel specialized for its (state_num, observ_num),
+ * or into the generic kernel when no specialization exists.
+ * All probabilities returned are natural logs.
+ */
+typedef struct HmmKernel HmmKernel;
+
+/**
+ * @param hmm model, copied into the kernel
+ * @param precision KERNEL_DOUBLE or KERNEL_FLOAT
+ * @return kernel, release with kernel_free
+ */
+HmmKernel *kernel_load(const HMM *hmm, int precision);
+void kernel_free(HmmKernel *kernel);
+
+/**
+ * @return e.g. "Hmm<6,6,double>" or "Hmm<generic,double>"
+ */
+const char *kernel_name(const HmmKernel *kernel);
+
+/**
+ * @return log P(O | model) by forward algorithm
+ */
+double kernel_forward(const HmmKernel *kernel, const Observation *observ);
+
+/**
+ * Forward algorithm that gives up once the partial log-likelihood, an upper
+ * bound of the final one, falls below bound
+ * @param bound e.g. best score of another model so far, -HUGE_VAL to disable
+ * @return log P(O | model), or -HUGE_VAL if pruned
+ */
+double kernel_forward_pruned(const HmmKernel *kernel, const Observation *observ, double bound);
+
+/**
+ * @return log P(O | model) by backward algorithm
+ */
+double kernel_backward(const HmmKernel *kernel, const Observation *observ);
+
+/**
+ * @param path if not NULL, receives the best state sequence
+ * @return log P(O, best path | model)
+ */
+double kernel_viterbi(const HmmKernel *kernel, const Observation *observ, int *path);
+
+/**
+ * Run forward-backward and add the expected counts of one observation to acc
+ * @return log P(O | model), -HUGE_VAL if the observation is impossible (acc untouched)
+ */
+double kernel_accumulate(const HmmKernel *kernel, const Observation *observ, Accumulator *acc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
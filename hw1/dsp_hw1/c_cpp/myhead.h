@@ -28,12 +28,25 @@ typedef struct {
     double table[MAX_SEQ][MAX_STATE][MAX_STATE];
 } Epsilon;
 
+/**
+ * Sufficient statistics of one E-step, summed over a set of sequences
+ */
+typedef struct {
+    int seq_num;
+    double log_likelihood;
+    double initial[MAX_STATE];                  // sum{delta[0][i]}
+    double transition[MAX_STATE][MAX_STATE];    // sum{epsilon[t][i][j]}, t < T-1
+    double transition_den[MAX_STATE];           // sum{delta[t][i]}, t < T-1
+    double observation[MAX_OBSERV][MAX_STATE];  // sum{delta[t][j]}, o_t = k
+    double observation_den[MAX_STATE];          // sum{delta[t][j]}
+} Accumulator;
+
 /**
  * @param array of observation
  * @param filename
  * @return number of observation
  */
-int get_data(Observation *observs, const char *filename)
+static int get_data(Observation *observs, const char *filename)
 {
     int i = 0, j, index;
     FILE *fp = open_or_die(filename, "r");
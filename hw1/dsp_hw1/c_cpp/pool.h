@@ -0,0 +1,117 @@
+#ifndef POOL_HEADER_
+#define POOL_HEADER_
+
+#include <pthread.h>
+#include <unistd.h>
+
+#ifndef MAX_THREAD
+    #define MAX_THREAD 64
+#endif
+
+typedef void (*PoolJob)(void *arg, int job);
+
+/**
+ * Fixed set of worker threads that repeatedly run a batch of numbered jobs.
+ * The calling thread takes part in every batch, so a pool of one thread
+ * runs everything inline.
+ */
+typedef struct {
+    int thread_num;
+    pthread_t threads[MAX_THREAD];
+    pthread_barrier_t start, done;
+
+    PoolJob job;
+    void *arg;
+    int job_num;
+    int next_job;
+    int stop;
+} ThreadPool;
+
+/**
+ * @return number of online processors, at least 1
+ */
+static int default_thread_num(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) {
+        return 1;
+    }
+    return n > MAX_THREAD ? MAX_THREAD : (int)n;
+}
+
+static void pool_work(ThreadPool *pool)
+{
+    int job;
+    while ((job = __sync_fetch_and_add(&pool->next_job, 1)) < pool->job_num) {
+        pool->job(pool->arg, job);
+    }
+}
+
+static void *pool_worker(void *arg)
+{
+    ThreadPool *pool = (ThreadPool *)arg;
+
+    while (1) {
+        pthread_barrier_wait(&pool->start);
+        if (pool->stop) {
+            break;
+        }
+        pool_work(pool);
+        pthread_barrier_wait(&pool->done);
+    }
+    return NULL;
+}
+
+/**
+ * @param pool
+ * @param thread_num total threads including the caller
+ */
+static void pool_init(ThreadPool *pool, int thread_num)
+{
+    int i;
+
+    if (thread_num < 1) {
+        thread_num = 1;
+    }
+    if (thread_num > MAX_THREAD) {
+        thread_num = MAX_THREAD;
+    }
+    pool->thread_num = thread_num;
+    pool->stop = 0;
+    pthread_barrier_init(&pool->start, NULL, thread_num);
+    pthread_barrier_init(&pool->done, NULL, thread_num);
+
+    for (i = 1; i < thread_num; i++) {
+        pthread_create(&pool->threads[i], NULL, pool_worker, pool);
+    }
+}
+
+/**
+ * Run job(arg, 0) ... job(arg, job_num - 1) across the pool and wait for all of them.
+ */
+static void pool_run(ThreadPool *pool, PoolJob job, void *arg, int job_num)
+{
+    pool->job = job;
+    pool->arg = arg;
+    pool->job_num = job_num;
+    pool->next_job = 0;
+
+    pthread_barrier_wait(&pool->start);
+    pool_work(pool);
+    pthread_barrier_wait(&pool->done);
+}
+
+static void pool_destroy(ThreadPool *pool)
+{
+    int i;
+
+    pool->stop = 1;
+    pthread_barrier_wait(&pool->start);
+    for (i = 1; i < pool->thread_num; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_barrier_destroy(&pool->start);
+    pthread_barrier_destroy(&pool->done);
+}
+
+#endif
@@ -0,0 +1,245 @@
+#include "hmm.h"
+#include "acc.h"
+#include <unistd.h>
+
+#ifndef MAX_KNOB
+    #define MAX_KNOB 16 // Values per knob
+#endif
+
+#ifndef MAX_CONFIG
+    #define MAX_CONFIG 1024
+#endif
+
+/**
+ * List of values of one knob, parsed from "a,b,c"
+ */
+typedef struct {
+    int num;
+    char value[MAX_KNOB][MAX_LINE];
+} Knob;
+
+typedef struct {
+    const char *precision;
+    const char *prune;
+    const char *batch;
+    const char *threads;
+    double seq_per_sec;  // Best over repeats
+    double accuracy;
+    int pareto;
+    int failed;          // Every repeat failed, not scored
+    Evaluation eval;
+} Config;
+
+Config configs[MAX_CONFIG];
+
+void parse_knob(Knob *knob, const char *list)
+{
+    char buf[MAX_LINE * 4];
+    char *token;
+
+    strncpy(buf, list, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    knob->num = 0;
+    for (token = strtok(buf, ","); token != NULL && knob->num < MAX_KNOB; token = strtok(NULL, ",")) {
+        strcpy(knob->value[knob->num++], token);
+    }
+}
+
+/**
+ * Run test once with the given configuration
+ * @return sequences per second reported by test, or 0 on failure
+ */
+double run_test(const char *test_bin, const char *modellist, const char *test_file,
+                const char *result_file, const Config *config)
+{
+    char cmd[MAX_LINE * 8], line[MAX_LINE];
+    double seq_per_sec = 0, sec;
+    int num;
+
+    snprintf(cmd, sizeof(cmd), "%s %s %s %s %s %s %s %s 2>/dev/null", test_bin, modellist,
+        test_file, result_file, config->precision, config->prune, config->batch, config->threads);
+
+    FILE *fp = popen(cmd, "r");
+    if (fp == NULL) {
+        perror(cmd);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        sscanf(line, "Scored %d sequences in %lf sec (%lf seq/s)", &num, &sec, &seq_per_sec);
+    }
+    if (pclose(fp) != 0) {
+        fprintf(stderr, "Failed: %s\n", cmd);
+        return 0;
+    }
+    return seq_per_sec;
+}
+
+/**
+ * Mark configurations that no other one beats in both accuracy and speed;
+ * failed ones are left out
+ */
+void pareto_front(Config *configs, int num)
+{
+    int i, j;
+
+    for (i = 0; i < num; i++) {
+        configs[i].pareto = !configs[i].failed;
+        for (j = 0; j < num; j++) {
+            if (!configs[j].failed && configs[j].accuracy >= configs[i].accuracy && configs[j].seq_per_sec >= configs[i].seq_per_sec && \
+                (configs[j].accuracy > configs[i].accuracy || configs[j].seq_per_sec > configs[i].seq_per_sec)) {
+                configs[i].pareto = 0;
+                break;
+            }
+        }
+    }
+}
+
+void dump_config(FILE *fp, const Config *config)
+{
+    if (config->failed) {
+        fprintf(fp, "%-9s %-7s %-7s %-8s %10s %14s\n", config->precision, config->prune, config->batch,
+            config->threads, "failed", "-");
+        return;
+    }
+    fprintf(fp, "%-9s %-7s %-7s %-8s %10.6f %14.1f%s\n", config->precision, config->prune, config->batch,
+        config->threads, config->accuracy, config->seq_per_sec, config->pareto ? "  *" : "");
+}
+
+void dump_header(FILE *fp)
+{
+    fprintf(fp, "%-9s %-7s %-7s %-8s %10s %14s\n", "precision", "prune", "batch", "threads", "accuracy", "seq/s");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4 + 1 || (argc - 5) % 2 != 0) {
+        printf("Wrong argument format\n");
+        printf("Usage: ./sweep modellist.txt testing_data.txt testing_answer.txt report.txt\n");
+        printf("           [-precision double,float] [-prune off,0,2] [-batch 16,256] [-threads 1,4]\n");
+        printf("           [-repeat 3] [-test ./test]\n");
+        exit(1);
+    }
+
+    int i, a, b, c, d, r, config_num = 0;
+    char thread_list[MAX_LINE];
+    char *ptr;
+    Knob precision, prune, batch, threads;
+
+    const char *modellist = argv[1];
+    const char *test_file = argv[2];
+    const char *ans_file = argv[3];
+    const char *report_file = argv[4];
+    const char *test_bin = "./test";
+    int repeat = 3;
+
+    snprintf(thread_list, sizeof(thread_list), "1,%ld", sysconf(_SC_NPROCESSORS_ONLN));
+    parse_knob(&precision, "double,float");
+    parse_knob(&prune, "off,0,2");
+    parse_knob(&batch, "16,256");
+    parse_knob(&threads, sysconf(_SC_NPROCESSORS_ONLN) > 1 ? thread_list : "1");
+
+    for (i = 5; i < argc; i += 2) {
+        if (strcmp(argv[i], "-precision") == 0) {
+            parse_knob(&precision, argv[i+1]);
+        } else if (strcmp(argv[i], "-prune") == 0) {
+            parse_knob(&prune, argv[i+1]);
+        } else if (strcmp(argv[i], "-batch") == 0) {
+            parse_knob(&batch, argv[i+1]);
+        } else if (strcmp(argv[i], "-threads") == 0) {
+            parse_knob(&threads, argv[i+1]);
+        } else if (strcmp(argv[i], "-repeat") == 0) {
+            repeat = strtol(argv[i+1], &ptr, 10);
+        } else if (strcmp(argv[i], "-test") == 0) {
+            test_bin = argv[i+1];
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    // Each run writes run_file, which becomes result_file only if the run
+    // succeeds, so a failed run is never scored on an older result
+    char result_file[MAX_LINE], run_file[MAX_LINE];
+    snprintf(result_file, sizeof(result_file), "%s.result", report_file);
+    snprintf(run_file, sizeof(run_file), "%s.run", report_file);
+
+    dump_header(stdout);
+    for (a = 0; a < precision.num; a++)
+    for (b = 0; b < prune.num; b++)
+    for (c = 0; c < batch.num; c++)
+    for (d = 0; d < threads.num; d++) {
+        if (config_num >= MAX_CONFIG) {
+            fprintf(stderr, "Too many configurations, increase MAX_CONFIG\n");
+            exit(1);
+        }
+        Config *config = &configs[config_num++];
+        config->precision = precision.value[a];
+        config->prune = prune.value[b];
+        config->batch = batch.value[c];
+        config->threads = threads.value[d];
+        config->seq_per_sec = 0;
+        config->failed = 1;
+        config->pareto = 0;
+
+        remove(result_file);
+        for (r = 0; r < repeat; r++) {
+            remove(run_file);
+            double seq_per_sec = run_test(test_bin, modellist, test_file, run_file, config);
+            if (seq_per_sec <= 0 || rename(run_file, result_file) != 0) {
+                continue;
+            }
+            config->failed = 0;
+            if (seq_per_sec > config->seq_per_sec) {
+                config->seq_per_sec = seq_per_sec;
+            }
+        }
+
+        if (!config->failed) {
+            calc_accuracy(result_file, ans_file, &config->eval);
+            config->accuracy = config->eval.total_num > 0 ? \
+                (double)config->eval.correct_num / config->eval.total_num : 0;
+        }
+        dump_config(stdout, config);
+    }
+    remove(result_file);
+    remove(run_file);
+
+    pareto_front(configs, config_num);
+
+    printf("Dump report to file: %s\n", report_file);
+    FILE *fp = open_or_die(report_file, "w");
+
+    fprintf(fp, "##### all configurations (* = Pareto front) #####\n");
+    dump_header(fp);
+    for (i = 0; i < config_num; i++) {
+        dump_config(fp, &configs[i]);
+    }
+
+    fprintf(fp, "\n##### Pareto front, fastest first #####\n");
+    dump_header(fp);
+    while (1) {
+        int best = -1;
+        for (i = 0; i < config_num; i++) {
+            if (configs[i].pareto == 1 && (best < 0 || configs[i].seq_per_sec > configs[best].seq_per_sec)) {
+                best = i;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        dump_config(fp, &configs[best]);
+        configs[best].pareto = 2; // Already listed
+    }
+
+    for (i = 0; i < config_num; i++) {
+        if (configs[i].failed) {
+            continue;
+        }
+        fprintf(fp, "\n##### confusion: %s %s %s %s #####\n", configs[i].precision, configs[i].prune,
+            configs[i].batch, configs[i].threads);
+        dump_confusion(fp, &configs[i].eval);
+    }
+    fclose(fp);
+
+    return 0;
+}
@@ -1,153 +1,144 @@
 #include "hmm.h"
 #include "myhead.h"
+#include "hmm_kernel.h"
+#include "pool.h"
+#include "trace.h"
 #include <math.h>
+#include <time.h>
 
-/**
- * @param hmm model
- * @param observation
- * @param delta
- * @param psi
- * @return likelihood on the observation given hmm model
- */
-double viterbi_algo(HMM *hmm, Observation *observ, Table *delta, Table *psi)
-{
-    int i, j, t, arg_max;
-    double max, tmp;
-    delta->seq_num = observ->seq_num;
-    delta->state_num = hmm->state_num;
-    psi->seq_num = observ->seq_num;
-    psi->state_num = hmm->state_num;
-
-    // Initialization
-    for (i = 0; i < hmm->state_num; i++) {
-        delta->table[0][i] = hmm->initial[i] * hmm->observation[observ->seq[0]][i]; // delta[0][i] = pi[i] * b[o_1][i]
-    }
-
-    // Recursion
-    for (t = 0; t < observ->seq_num - 1; t++) {
-        for (j = 0; j < hmm->state_num; j++) {
-            max = 0;
-
-            for (i = 0; i < hmm->state_num; i++) {
-                tmp = delta->table[t][i] * hmm->transition[i][j];
-                if (tmp > max) {
-                    arg_max = i;
-                    max = tmp;
-                }
-            }
-
-            delta->table[t+1][j] = max * hmm->observation[observ->seq[t+1]][j]; // delta[t][j] = \sum{delta[t][i] * a[i][j]} * b[t][j]
-            psi->table[t+1][j] = arg_max;
-        }
-    }
-
-    // Termination
-    double p = 0;
-    Observation q;
-    q.seq_num = observ->seq_num;
-
-    for (i = 0; i < hmm->state_num; i++) {
-        if (delta->table[observ->seq_num-1][i] > p) {
-            p = delta->table[observ->seq_num-1][i];
-            q.seq[observ->seq_num-1] = i;
-        }
-    }
-
-    // Path backtracking
-    for (t = observ->seq_num - 2; t >= 0; t--) {
-        q.seq[t] = psi->table[t+1][q.seq[t+1]]; // q[t] = psi[t+1][q[t+1]]
-    }
-
-    return p;
-}
+#ifndef MODEL_NUM
+    #define MODEL_NUM 5
+#endif
 
 /**
- * Calculate alpha by forward algorithm
- * @param hmm model
- * @param observation
- * @param alpha
+ * Scoring of a batch of sequences against every model
  */
-double forward_algo(HMM *hmm, Observation *observ, Table *alpha)
+typedef struct {
+    HmmKernel *kernels[MODEL_NUM];
+    Observation *test;
+    int test_num;
+    int batch;
+    int prune;       // Whether to prune models that cannot win
+    double margin;   // Added to the best score so far to get the pruning bound
+    int *pred;
+    double *likelihood;
+} Scoring;
+
+void score_job(void *arg, int job)
 {
-    int i, j, t;
-    alpha->seq_num = observ->seq_num;
-    alpha->state_num = hmm->state_num;
+    Scoring *s = (Scoring *)arg;
+    int i, j, arg_max;
+    int end = (job + 1) * s->batch;
+    double prob, max;
 
-    // Initialization
-    for (i = 0; i < hmm->state_num; i++) {
-        alpha->table[0][i] = hmm->initial[i] * hmm->observation[observ->seq[0]][i]; // alpha[0][i] = pi[i] * b[o_1][i]
+    if (end > s->test_num) {
+        end = s->test_num;
     }
 
-    // Induction
-    for (t = 0; t < observ->seq_num - 1; t++) {
-        for (j = 0; j < hmm->state_num; j++) {
-            double accum = 0;
-
-            for (i = 0; i < hmm->state_num; i++) {
-                accum += alpha->table[t][i] * hmm->transition[i][j];
+    trace_begin("score batch");
+    for (i = job * s->batch; i < end; i++) {
+        max = -HUGE_VAL;
+        arg_max = 0;
+        for (j = 0; j < MODEL_NUM; j++) {
+            // choose one: use forward algo. or viterbi algo.
+            if (s->prune) {
+                prob = kernel_forward_pruned(s->kernels[j], &s->test[i], max + s->margin);
+            } else {
+                prob = kernel_forward(s->kernels[j], &s->test[i]);
+            }
+            // prob = kernel_viterbi(s->kernels[j], &s->test[i], NULL);
+            if (prob > max) {
+                max = prob;
+                arg_max = j;
             }
-
-            alpha->table[t+1][j] = accum * hmm->observation[observ->seq[t+1]][j]; // alpha[t][j] = \sum{alpha[t][i] * a[i][j]} * b[t][j]
         }
+        s->pred[i] = arg_max;
+        s->likelihood[i] = max;
     }
+    trace_end("score batch");
+}
 
-    // Termination
-    double prob = 0;
-    for (i = 0; i < hmm->state_num; i++) {
-        prob += alpha->table[observ->seq_num-1][i];
-    }
-
-    return prob;
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
 }
 
 Observation test[MAX_TEST_LINE];
 
 int main(int argc, char *argv[])
 {
-    if (argc != 3 + 1) {
+    if (argc < 3 + 1 || argc > 7 + 1) {
         printf("Wrong argument format\n");
-        printf("Usage: ./test modellist.txt testing_data.txt result.txt\n");
+        printf("Usage: ./test modellist.txt testing_data.txt result.txt [double|float [off|margin [batch [threads]]]]\n");
         exit(1);
     }
 
-    int i, j, test_num, arg_max;
-    double prob, max;
+    int i, j, test_num;
     int pred[MAX_TEST_LINE];
     double likelihood[MAX_TEST_LINE];
-    Table alpha, delta, psi;
+    char *ptr;
 
     const char *modellist = argv[1];
     const char *test_file = argv[2];
     const char *result_file = argv[3];
+    const int precision = argc > 4 && strcmp(argv[4], "float") == 0 ? KERNEL_FLOAT : KERNEL_DOUBLE;
+    const int prune = argc > 5 && strcmp(argv[5], "off") != 0;
+    const double margin = prune ? strtod(argv[5], &ptr) : 0;
+    const int batch = argc > 6 ? strtol(argv[6], &ptr, 10) : 64;
+    const int thread_num = argc > 7 ? strtol(argv[7], &ptr, 10) : default_thread_num();
+
+    if (batch < 1) {
+        printf("Batch size must be positive\n");
+        exit(1);
+    }
 
-    HMM hmms[5];
-    load_models(modellist, hmms, 5);
-    dump_models(hmms, 5);
+    HMM hmms[MODEL_NUM];
+    Scoring s;
+    trace_begin("load models");
+    load_models(modellist, hmms, MODEL_NUM);
+    dump_models(hmms, MODEL_NUM);
+    for (j = 0; j < MODEL_NUM; j++) {
+        s.kernels[j] = kernel_load(&hmms[j], precision);
+    }
+    printf("Kernel: %s\n", kernel_name(s.kernels[0]));
+    trace_end("load models");
 
+    trace_begin("parse data");
     test_num = get_data(test, test_file);
+    trace_end("parse data");
 
-    for (i = 0; i < test_num; i++) {
-        max = 0;
-        for (j = 0; j < 5; j++) {
-            // choose one: use forward algo. or viterbi algo.
-            prob = forward_algo(&hmms[j], &test[i], &alpha);
-            // prob = viterbi_algo(&hmms[j], &test[i], &delta, &psi);
-            if (prob > max) {
-                max = prob;
-                arg_max = j;
-            }
-        }
-        pred[i] = arg_max;
-        likelihood[i] = max;
-    }
+    s.test = test;
+    s.test_num = test_num;
+    s.batch = batch;
+    s.prune = prune;
+    s.margin = margin;
+    s.pred = pred;
+    s.likelihood = likelihood;
+
+    ThreadPool pool;
+    pool_init(&pool, thread_num);
+    double start = now();
+    pool_run(&pool, score_job, &s, (test_num + batch - 1) / batch);
+    double elapsed = now() - start;
+    pool_destroy(&pool);
+
+    printf("Scored %d sequences in %f sec (%.1f seq/s)\n", test_num, elapsed, test_num / elapsed);
 
     printf("Dump result to file: %s\n", result_file);
+    trace_begin("output");
     FILE *fp = open_or_die(result_file, "w");
     for (i = 0; i < test_num; i++) {
         fprintf(fp, "%s ", hmms[pred[i]].model_name);
-        fprintf(fp, "%e\n", likelihood[i]);
+        fprintf(fp, "%e\n", exp(likelihood[i]));
     }
     fclose(fp);
-    
+    trace_end("output");
+
+    for (j = 0; j < MODEL_NUM; j++) {
+        kernel_free(s.kernels[j]);
+    }
+
     return 0;
 }
@@ -0,0 +1,164 @@
+#ifndef TRACE_HEADER_
+#define TRACE_HEADER_
+
+/**
+ * Timeline tracing in Chrome trace-event format.
+ *
+ * Set the environment variable TRACE_FILE to a path to enable it; the trace
+ * is written there on exit and can be opened in chrome://tracing or Perfetto.
+ * Every thread records begin/end spans into its own ring buffer, so recording
+ * takes no lock; when a buffer is full the oldest events are overwritten,
+ * and the end events left without their begin are dropped on flush.
+ * Span names must be string literals (only the pointer is stored).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef TRACE_CAPACITY
+    #define TRACE_CAPACITY 65536 // Events per thread
+#endif
+
+typedef struct {
+    const char *name;
+    long long ts;  // Nanoseconds since trace start
+    char phase;    // 'B' or 'E'
+} TraceEvent;
+
+typedef struct TraceBuffer {
+    struct TraceBuffer *next;
+    int tid;
+    unsigned long long count; // Events ever written, the buffer keeps the last TRACE_CAPACITY
+    TraceEvent events[TRACE_CAPACITY];
+} TraceBuffer;
+
+typedef struct {
+    int state;                 // 0 unknown, 1 enabled, -1 disabled
+    const char *filename;
+    struct timespec start;
+    TraceBuffer *buffers;      // Lock-free list of all thread buffers
+    int next_tid;
+} Trace;
+
+static Trace trace_global;
+static __thread TraceBuffer *trace_local;
+
+static long long trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec - trace_global.start.tv_sec) * 1000000000LL + (ts.tv_nsec - trace_global.start.tv_nsec);
+}
+
+/**
+ * Write all buffers as Chrome trace-event JSON, registered with atexit
+ */
+static void trace_flush(void)
+{
+    TraceBuffer *buf;
+    unsigned long long i, first;
+    int comma = 0, depth;
+
+    FILE *fp = fopen(trace_global.filename, "w");
+    if (fp == NULL) {
+        perror(trace_global.filename);
+        return;
+    }
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for (buf = trace_global.buffers; buf != NULL; buf = buf->next) {
+        fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            comma ? ",\n" : "", buf->tid, buf->tid == 0 ? "main" : "worker");
+        comma = 1;
+
+        first = buf->count > TRACE_CAPACITY ? buf->count - TRACE_CAPACITY : 0;
+        depth = 0;
+        for (i = first; i < buf->count; i++) {
+            const TraceEvent *e = &buf->events[i % TRACE_CAPACITY];
+            // The begin of a span that was open when the ring wrapped is lost
+            if (e->phase == 'E' && depth == 0) {
+                continue;
+            }
+            depth += e->phase == 'B' ? 1 : -1;
+            fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+                e->name, e->phase, e->ts / 1000.0, buf->tid);
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+}
+
+/**
+ * @return 1 if tracing is on, checks TRACE_FILE on first call
+ */
+static int trace_enabled(void)
+{
+    if (trace_global.state == 0) {
+        // Racing first calls all see the same environment, so they agree
+        const char *filename = getenv("TRACE_FILE");
+        if (filename == NULL || filename[0] == '\0') {
+            trace_global.state = -1;
+        } else {
+            trace_global.filename = filename;
+            clock_gettime(CLOCK_MONOTONIC, &trace_global.start);
+            if (__sync_bool_compare_and_swap(&trace_global.state, 0, 1)) {
+                atexit(trace_flush);
+            }
+        }
+    }
+    return trace_global.state > 0;
+}
+
+/**
+ * @return ring buffer of the calling thread, created and registered on first use
+ */
+static TraceBuffer *trace_buffer(void)
+{
+    TraceBuffer *buf = trace_local;
+    if (buf == NULL) {
+        buf = (TraceBuffer *)malloc(sizeof(TraceBuffer));
+        buf->count = 0;
+        buf->tid = __sync_fetch_and_add(&trace_global.next_tid, 1);
+        do {
+            buf->next = trace_global.buffers;
+        } while (!__sync_bool_compare_and_swap(&trace_global.buffers, buf->next, buf));
+        trace_local = buf;
+    }
+    return buf;
+}
+
+static void trace_event(const char *name, char phase)
+{
+    TraceBuffer *buf;
+    TraceEvent *e;
+
+    if (!trace_enabled()) {
+        return;
+    }
+    buf = trace_buffer();
+    e = &buf->events[buf->count % TRACE_CAPACITY];
+    e->name = name;
+    e->phase = phase;
+    e->ts = trace_now();
+    buf->count++;
+}
+
+/**
+ * Open a span named name on the calling thread
+ */
+static void trace_begin(const char *name)
+{
+    trace_event(name, 'B');
+}
+
+/**
+ * Close the innermost open span of the calling thread
+ */
+static void trace_end(const char *name)
+{
+    trace_event(name, 'E');
+}
+
+#endif
@@ -1,229 +1,346 @@
 #include "hmm.h"
 #include "myhead.h"
+#include "hmm_kernel.h"
+#include "pool.h"
+#include "trace.h"
 #include <math.h>
 
-/**
- * Calculate alpha by forward algorithm
- * @param hmm model
- * @param observation
- * @param alpha
- */
-void forward_algo(HMM *hmm, Observation *observ, Table *alpha)
-{
-    int i, j, t;
-    alpha->seq_num = observ->seq_num;
-    alpha->state_num = hmm->state_num;
+#ifndef TRAIN_CHUNK
+    #define TRAIN_CHUNK 256 // Sequences per job in one E-step
+#endif
 
-    // Initialization
-    for (i = 0; i < hmm->state_num; i++) {
-        alpha->table[0][i] = hmm->initial[i] * hmm->observation[observ->seq[0]][i]; // alpha[0][i] = pi[i] * b[o_1][i]
-    }
+#ifndef MAX_START
+    #define MAX_START 64
+#endif
 
-    // Induction
-    for (t = 0; t < observ->seq_num - 1; t++) {
-        for (j = 0; j < hmm->state_num; j++) {
-            double accum = 0;
+#ifndef MULTI_START_PROBE_ITER
+    #define MULTI_START_PROBE_ITER 3 // Iterations before a start can be killed
+#endif
 
-            for (i = 0; i < hmm->state_num; i++) {
-                accum += alpha->table[t][i] * hmm->transition[i][j];
-            }
+#ifndef MULTI_START_MARGIN
+    #define MULTI_START_MARGIN 0.5 // Allowed gap to the leader, in log-likelihood per sequence
+#endif
 
-            alpha->table[t+1][j] = accum * hmm->observation[observ->seq[t+1]][j]; // alpha[t][j] = \sum{alpha[t][i] * a[i][j]} * b[t][j]
-        }
-    }
+#ifndef MULTI_START_NOISE
+    #define MULTI_START_NOISE 0.5 // Relative perturbation of every initial probability
+#endif
 
-    // Termination
-    double prob = 0;
-    for (i = 0; i < hmm->state_num; i++) {
-        prob += alpha->table[observ->seq_num-1][i];
+/**
+ * @param dst
+ * @param src added into dst
+ */
+void merge_accumulator(Accumulator *dst, const Accumulator *src)
+{
+    int i, j, k;
+
+    dst->seq_num += src->seq_num;
+    dst->log_likelihood += src->log_likelihood;
+    for (i = 0; i < MAX_STATE; i++) {
+        dst->initial[i] += src->initial[i];
+        dst->transition_den[i] += src->transition_den[i];
+        dst->observation_den[i] += src->observation_den[i];
+        for (j = 0; j < MAX_STATE; j++) {
+            dst->transition[i][j] += src->transition[i][j];
+        }
+        for (k = 0; k < MAX_OBSERV; k++) {
+            dst->observation[k][i] += src->observation[k][i];
+        }
     }
-
-    return;
 }
 
 /**
- * Calculate beta by backward algorithm
+ * Re-estimate the model from accumulated statistics (M-step)
  * @param hmm model
- * @param observation
- * @param beta
+ * @param acc
  */
-void backward_algo(HMM *hmm, Observation *observ, Table *beta)
+void train_model(HMM *hmm, const Accumulator *acc)
 {
-    int i, j, t;
-    beta->seq_num = observ->seq_num;
-    beta->state_num = hmm->state_num;
+    int i, j, k;
 
-    // Initialization
-    for (i = 0; i < hmm->state_num; i++) {
-        beta->table[observ->seq_num-1][i] = 1; // beta[T][i] = 1
+    if (acc->seq_num == 0) {
+        return;
     }
 
-    // Induction
-    for (t = observ->seq_num - 2; t >= 0; t--) {
-        for (i = 0; i < hmm->state_num; i++) {
-            double accum = 0;
-
-            for (j = 0; j < hmm->state_num; j++) {
-                accum += hmm->transition[i][j] * hmm->observation[observ->seq[t+1]][j] * beta->table[t+1][j];
-            }
+    // update initial pi[i]
+    for (i = 0; i < hmm->state_num; i++) {
+        hmm->initial[i] = acc->initial[i] / acc->seq_num;
+    }
 
-            beta->table[t][i] = accum; // beta[t][i] = \sum{a[i][j] * b[t+1][j] * beta[t+1][j]}
+    // update transition a[i][j]
+    for (i = 0; i < hmm->state_num; i++) {
+        for (j = 0; j < hmm->state_num; j++) {
+            hmm->transition[i][j] = acc->transition[i][j] / acc->transition_den[i];
         }
     }
 
-    return;
+    // update observation b[k][j]
+    for (k = 0; k < hmm->observ_num; k++) {
+        for (j = 0; j < hmm->state_num; j++) {
+            hmm->observation[k][j] = acc->observation[k][j] / acc->observation_den[j];
+        }
+    }
 }
 
 /**
- * Calculate delta by multiply alpha and beta
- * @param alpha
- * @param beta
- * @param delta
+ * Scale every probability by a random factor in [1 - noise, 1 + noise]
+ * and renormalize, so zeros in the initial model stay zero
+ * @param hmm model
+ * @param seed
  */
-void calc_delta(Table *alpha, Table *beta, Table *delta)
+void perturb_model(HMM *hmm, unsigned int seed)
 {
-    int i, t;
+    int i, j, k;
     double sum;
-    delta->seq_num = alpha->seq_num;
-    delta->state_num = alpha->state_num;
 
-    for (t = 0; t < delta->seq_num; t++) {
+#define PERTURB(p) ((p) * (1.0 + MULTI_START_NOISE * (2.0 * rand_r(&seed) / RAND_MAX - 1.0)))
+
+    sum = 0;
+    for (i = 0; i < hmm->state_num; i++) {
+        hmm->initial[i] = PERTURB(hmm->initial[i]);
+        sum += hmm->initial[i];
+    }
+    for (i = 0; i < hmm->state_num; i++) {
+        hmm->initial[i] /= sum;
+    }
+
+    for (i = 0; i < hmm->state_num; i++) {
         sum = 0;
-        for (i = 0; i < delta->state_num; i++) {
-            delta->table[t][i] = alpha->table[t][i] * beta->table[t][i];
-            sum += delta->table[t][i];
+        for (j = 0; j < hmm->state_num; j++) {
+            hmm->transition[i][j] = PERTURB(hmm->transition[i][j]);
+            sum += hmm->transition[i][j];
+        }
+        for (j = 0; j < hmm->state_num; j++) {
+            hmm->transition[i][j] /= sum;
         }
+    }
 
-        // Normalization
-        for (i = 0; i < delta->state_num; i++) {
-            delta->table[t][i] /= sum;
+    for (j = 0; j < hmm->state_num; j++) {
+        sum = 0;
+        for (k = 0; k < hmm->observ_num; k++) {
+            hmm->observation[k][j] = PERTURB(hmm->observation[k][j]);
+            sum += hmm->observation[k][j];
+        }
+        for (k = 0; k < hmm->observ_num; k++) {
+            hmm->observation[k][j] /= sum;
         }
     }
 
-    return;
+#undef PERTURB
 }
 
-void baum_welch_algo(HMM *hmm, Observation *observ, Table *alpha, Table *beta, Epsilon *epsilon)
-{
-    int i, j, t;
-    double sum;
-    epsilon->seq_num = alpha->seq_num;
-    epsilon->state_num = alpha->state_num;
-
-    for (t = 0; t < epsilon->seq_num - 1; t++) {
-        sum = 0;
-        for (i = 0; i < epsilon->state_num; i++) {
-            for (j = 0; j < epsilon->state_num; j++) {
-                epsilon->table[t][i][j] = alpha->table[t][i] * \
-                    hmm->transition[i][j] * \
-                    hmm->observation[observ->seq[t+1]][j] * \
-                    beta->table[t+1][j];
-                
-                sum += epsilon->table[t][i][j];
-            }
+/**
+ * One training run from its own initial model
+ */
+typedef struct {
+    HMM hmm;
+    HmmKernel *kernel; // Compiled from hmm
+    int alive;
+    double log_likelihood; // Per sequence, from the latest E-step
+} Start;
 
-        }
+/**
+ * Shared state of an E-step over all alive starts, split into
+ * start_num * chunk_num jobs that each fill one partial accumulator
+ */
+typedef struct {
+    Start *starts;
+    int start_num;
+    Observation *train;
+    int train_num;
+    int chunk_num;
+    Accumulator *partial; // [start_num][chunk_num]
+    int score_only;
+} EStep;
+
+void estep_job(void *arg, int job)
+{
+    EStep *e = (EStep *)arg;
+    int k = job / e->chunk_num;
+    int c = job % e->chunk_num;
+    int n, end = (c + 1) * TRAIN_CHUNK;
+    Accumulator *acc = &e->partial[job];
+    double log_likelihood;
+
+    memset(acc, 0, sizeof(Accumulator));
+    if (!e->starts[k].alive) {
+        return;
+    }
+    if (end > e->train_num) {
+        end = e->train_num;
+    }
 
-        // Normalization
-        for (i = 0; i < epsilon->state_num; i++) {
-            for (j = 0; j < epsilon->state_num; j++) {
-                epsilon->table[t][i][j] /= sum;
+    trace_begin(e->score_only ? "score chunk" : "e-step chunk");
+    for (n = c * TRAIN_CHUNK; n < end; n++) {
+        if (e->score_only) {
+            log_likelihood = kernel_forward(e->starts[k].kernel, &e->train[n]);
+            if (log_likelihood > -HUGE_VAL) {
+                acc->seq_num++;
+                acc->log_likelihood += log_likelihood;
             }
+        } else {
+            kernel_accumulate(e->starts[k].kernel, &e->train[n], acc);
         }
     }
+    trace_end(e->score_only ? "score chunk" : "e-step chunk");
 }
 
-void train_model(HMM *hmm, Table *delta, Epsilon *epsilon, Observation *train, int train_num)
+/**
+ * Run an E-step for every alive start, merge the partial accumulators in
+ * chunk order (so the result does not depend on thread count), update
+ * log_likelihood and, unless score_only, re-estimate the models
+ */
+void run_estep(ThreadPool *pool, EStep *e, int score_only)
 {
-    int i, j, k, t, n;
-    double sum_delta, sum_epsilon;
-    double numerator, denominator;
+    int k, c;
+    Accumulator acc;
 
-    // update initial pi[i]
-    for (i = 0; i < hmm->state_num; i++) {
-        sum_delta = 0;
-        for (n = 0; n < train_num; n++) {
-            sum_delta += delta[n].table[0][i];
-        }
-        sum_delta /= train_num;
-        hmm->initial[i] = sum_delta;
-    }
+    e->score_only = score_only;
+    pool_run(pool, estep_job, e, e->start_num * e->chunk_num);
 
-    // update transition a[i][j]
-    for (i = 0; i < hmm->state_num; i++) {
-        for (j = 0; j < hmm->state_num; j++) {
-            sum_delta = 0;
-            sum_epsilon = 0;
-            for (n = 0; n < train_num; n++) {
-                for (t = 0; t < delta[n].seq_num - 1; t++) {
-                    sum_epsilon += epsilon[n].table[t][i][j];
-                    sum_delta += delta[n].table[t][i];
-                }
-            }
-            hmm->transition[i][j] = sum_epsilon / sum_delta;
+    trace_begin(score_only ? "select" : "m-step");
+    for (k = 0; k < e->start_num; k++) {
+        if (!e->starts[k].alive) {
+            continue;
+        }
+        memset(&acc, 0, sizeof(Accumulator));
+        for (c = 0; c < e->chunk_num; c++) {
+            merge_accumulator(&acc, &e->partial[k * e->chunk_num + c]);
+        }
+        e->starts[k].log_likelihood = acc.seq_num > 0 ? acc.log_likelihood / acc.seq_num : -HUGE_VAL;
+        if (!score_only) {
+            train_model(&e->starts[k].hmm, &acc);
+            kernel_free(e->starts[k].kernel);
+            e->starts[k].kernel = kernel_load(&e->starts[k].hmm, KERNEL_DOUBLE);
         }
     }
+    trace_end(score_only ? "select" : "m-step");
+}
 
-    // update observation b[k][j]
-    for (k = 0; k < hmm->observ_num; k++) {
-        for (j = 0; j < hmm->state_num; j++) {
-            denominator = 0;
-            numerator = 0;
-            for (n = 0; n < train_num; n++) {
-                for (t = 0; t < delta[n].seq_num; t++) {
-                    if (train[n].seq[t] == k) {
-                        numerator += delta[n].table[t][j];
-                    }
-                    denominator += delta[n].table[t][j];
-                }
-            }
-            hmm->observation[k][j] = numerator / denominator;
+/**
+ * @return index of the alive start with the highest log-likelihood
+ */
+int leader(Start *starts, int start_num)
+{
+    int k, best = -1;
+    for (k = 0; k < start_num; k++) {
+        if (starts[k].alive && (best < 0 || starts[k].log_likelihood > starts[best].log_likelihood)) {
+            best = k;
         }
     }
+    return best;
 }
 
 Observation train[MAX_TRAIN_LINE];
-Table alpha[MAX_TRAIN_LINE], beta[MAX_TRAIN_LINE], delta[MAX_TRAIN_LINE];
-Epsilon epsilon[MAX_TRAIN_LINE];
 
 int main(int argc, char *argv[])
 {
-    if (argc != 4 + 1) {
+    if (argc < 4 + 1 || argc > 6 + 1) {
         printf("Wrong argument format\n");
-        printf("Usage: ./train iteration model_init.txt seq_model_0X.txt model_0X.txt\n");
+        printf("Usage: ./train iteration model_init.txt seq_model_0X.txt model_0X.txt [starts [threads]]\n");
         exit(1);
     }
 
-    int i, n, train_num;
+    int i, k, best = 0, train_num;
     char *ptr;
 
     const int iter = strtol(argv[1], &ptr, 10);
     const char *model_init = argv[2];
     const char *train_file = argv[3];
     const char *model_file = argv[4];
+    const int start_num = argc > 5 ? strtol(argv[5], &ptr, 10) : 1;
+    const int thread_num = argc > 6 ? strtol(argv[6], &ptr, 10) : default_thread_num();
+
+    if (start_num < 1 || start_num > MAX_START) {
+        printf("Number of starts must be in [1, %d]\n", MAX_START);
+        exit(1);
+    }
 
     HMM hmm_initial;
+    trace_begin("load model");
     loadHMM(&hmm_initial, model_init);
     dumpHMM(stderr, &hmm_initial);
+    trace_end("load model");
 
+    trace_begin("parse data");
     train_num = get_data(train, train_file);
+    trace_end("parse data");
+
+    // Start 0 is model_init itself, the others are perturbed copies of it
+    Start *starts = (Start *)malloc(sizeof(Start) * start_num);
+    for (k = 0; k < start_num; k++) {
+        starts[k].hmm = hmm_initial;
+        starts[k].alive = 1;
+        starts[k].log_likelihood = -HUGE_VAL;
+        if (k > 0) {
+            perturb_model(&starts[k].hmm, k);
+        }
+        starts[k].kernel = kernel_load(&starts[k].hmm, KERNEL_DOUBLE);
+    }
+    printf("Kernel: %s\n", kernel_name(starts[0].kernel));
+
+    EStep e;
+    e.starts = starts;
+    e.start_num = start_num;
+    e.train = train;
+    e.train_num = train_num;
+    e.chunk_num = (train_num + TRAIN_CHUNK - 1) / TRAIN_CHUNK;
+    e.partial = (Accumulator *)malloc(sizeof(Accumulator) * start_num * e.chunk_num);
+
+    ThreadPool pool;
+    pool_init(&pool, thread_num);
 
     for (i = 0; i < iter; i++) {
         printf("\n##### iteration: %d #####\n", i + 1);
-        for (n = 0; n < train_num; n++) {
-            forward_algo(&hmm_initial, &train[n], &alpha[n]);
-            backward_algo(&hmm_initial, &train[n], &beta[n]);
-            calc_delta(&alpha[n], &beta[n], &delta[n]);
-            baum_welch_algo(&hmm_initial, &train[n], &alpha[n], &beta[n], &epsilon[n]);
+        trace_begin("iteration");
+        run_estep(&pool, &e, 0);
+        trace_end("iteration");
+
+        if (start_num == 1) {
+            dumpHMM(stderr, &starts[0].hmm);
+            continue;
+        }
+
+        best = leader(starts, start_num);
+        for (k = 0; k < start_num; k++) {
+            if (!starts[k].alive) {
+                continue;
+            }
+            printf("start %d: log-likelihood %f\n", k, starts[k].log_likelihood);
+
+            // Kill starts that trail the leader after the probe iterations
+            if (i + 1 >= MULTI_START_PROBE_ITER && \
+                starts[best].log_likelihood - starts[k].log_likelihood > MULTI_START_MARGIN) {
+                starts[k].alive = 0;
+                printf("start %d: killed, %f behind start %d\n", k,
+                    starts[best].log_likelihood - starts[k].log_likelihood, best);
+            }
         }
-        train_model(&hmm_initial, delta, epsilon, train, train_num);
-        dumpHMM(stderr, &hmm_initial);
     }
 
+    // Score the final models to pick among the starts, since the last E-step
+    // measured the models before update; a single start needs no pick
+    if (start_num > 1) {
+        trace_begin("final scoring");
+        run_estep(&pool, &e, 1);
+        trace_end("final scoring");
+        best = leader(starts, start_num);
+        printf("Best start: %d (log-likelihood %f)\n", best, starts[best].log_likelihood);
+    }
+
+    pool_destroy(&pool);
+
     printf("Dump HMM model to file: %s\n", model_file);
+    trace_begin("output");
     FILE *fp = open_or_die(model_file, "w");
-    dumpHMM(fp, &hmm_initial);
+    dumpHMM(fp, &starts[best].hmm);
     fclose(fp);
+    trace_end("output");
+
+    for (k = 0; k < start_num; k++) {
+        kernel_free(starts[k].kernel);
+    }
+    free(e.partial);
+    free(starts);
 
     return 0;
 }
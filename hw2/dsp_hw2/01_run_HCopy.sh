@@ -11,5 +11,14 @@ config=lib/hcopy.cfg
 training_list=scripts/training_hcopy.scp
 testing_list=scripts/testing_hcopy.scp
 
-HCopy -T 1 -C $config -S $training_list
-HCopy -T 1 -C $config -S $testing_list
+# NATIVE_FRONTEND=1 uses the multi-threaded bin/mfcc instead of HCopy
+if [ "$NATIVE_FRONTEND" = 1 ]; then
+	if [ ! -e bin/mfcc ]; then
+		cd bin/; make; cd ..
+	fi
+	bin/mfcc -C $config -S $training_list
+	bin/mfcc -C $config -S $testing_list
+else
+	HCopy -T 1 -C $config -S $training_list
+	HCopy -T 1 -C $config -S $testing_list
+fi
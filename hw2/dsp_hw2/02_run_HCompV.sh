@@ -11,6 +11,18 @@ mmf_dir=hmm
 
 data_list=scripts/training.scp
 
+# NATIVE_TRAINER set: bin/gmm_init computes the global mean and variance in
+# one multi-threaded pass and writes hmm/macros and hmm/models directly,
+# with no hmmdef or vFloors in between
+if [ -n "$NATIVE_TRAINER" ]; then
+	if [ ! -e bin/gmm_init ]; then
+		cd bin/; make; cd ..
+	fi
+	bin/gmm_init -T 2 -D -C $config -o $init_mmf -f 0.01 \
+		-m -S $data_list -M $mmf_dir $proto lib/models.lst
+	exit $?
+fi
+
 HCompV -T 2 -D -C $config -o $init_mmf -f 0.01 \
 	-m -S $data_list -M $mmf_dir $proto
 
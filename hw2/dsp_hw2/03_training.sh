@@ -12,13 +12,58 @@ model=$mmf_dir/models
 label=labels/Clean08TR.mlf
 model_list=lib/models.lst
 
+# NATIVE_TRAINER=1 re-estimates with the multi-threaded bin/gmm_embed
+# instead of HERest (same options); NATIVE_TRAINER=recipe runs every step
+# below in one bin/gmm_recipe process and only writes the final models
+if [ -n "$NATIVE_TRAINER" ] && [ ! -e bin/gmm_recipe -o ! -e bin/gmm_hed ]; then
+	cd bin/; make; cd ..
+fi
+# TIE=1 finally clusters close states and ties all mixture components into
+# a pool of shared Gaussians (lib/tie.hed), then re-estimates again. HHEd
+# writes tied-mixture (<TMIX>) states that only HTK reads, so the native
+# trainer applies it with bin/gmm_hed instead, and HHEd tying is refused
+# when NATIVE_DECODER will load the models
+if [ -n "$TIE" ] && [ -z "$NATIVE_TRAINER" ] && [ -n "$NATIVE_DECODER" ]; then
+	echo "TIE=1 with HHEd makes <TMIX> models bin/gmm_decode cannot load, set NATIVE_TRAINER too"
+	exit 1
+fi
+# FRAME_SKIP=k aligns like bin/gmm_decode -d k, natively only
+skip=
+if [ -n "$NATIVE_TRAINER" ] && [ -n "$FRAME_SKIP" ]; then
+	skip="-d $FRAME_SKIP"
+fi
+tie=
+if [ -n "$TIE" ]; then
+	tie="-h lib/tie.hed -e 3"
+fi
+if [ "$NATIVE_TRAINER" = recipe ]; then
+	bin/gmm_recipe -t 250.0 150.0 1000.0 $skip -S $data_list \
+		-H $macro -H $model -I $label -e 3 \
+		-p -h lib/sil1.hed -I labels/Clean08TR_sp.mlf -e 3 \
+		-h lib/mix2_10.hed -e 6 $tie -M $mmf_dir
+	exit $?
+fi
+# SHARDS=n splits every re-estimation pass over n processes (embed_shards.sh,
+# which LAUNCH can send to other nodes) and merges their accumulators
+reestimate() {
+	if [ -n "$SHARDS" ] && [ "$NATIVE_TRAINER" = 1 ]; then
+		./embed_shards.sh $skip "$@"
+	elif [ -n "$SHARDS" ]; then
+		EMBED=HERest ./embed_shards.sh "$@"
+	elif [ "$NATIVE_TRAINER" = 1 ]; then
+		bin/gmm_embed $skip "$@"
+	else
+		HERest "$@"
+	fi
+}
+
 #################################################
 # re-adjust mean, var
 echo "step 01 [HErest]: adjust mean, var..."
 for i in 0 1 2 ;
 do
 	echo "iteration $i"
-	HERest -C $config -I $label \
+	reestimate -C $config -I $label \
 		-t 250.0 150.0 1000.0 -S $data_list \
 		-H $macro -H $model -M $mmf_dir $model_list
 done
@@ -40,7 +85,7 @@ echo "step 03 [HErest]: adjust mean, var..."
 for i in 0 1 2 ;
 do
 	echo "iteration $i"
-	HERest -C $config -I $label \
+	reestimate -C $config -I $label \
 		-t 250.0 150.0 1000.0 -S $data_list \
 		-H $macro -H $model -M $mmf_dir $model_list
 done
@@ -55,8 +100,26 @@ HHEd -T 2 -H $macro -H $model -M $mmf_dir lib/mix2_10.hed $model_list
 echo "step 05 [HERest]: adjust mean, var..."
 for i in 0 1 2 3 4 5 ;
 do
-	HERest -C $config -I $label \
+	reestimate -C $config -I $label \
 		-t 250.0 150.0 1000.0 -S $data_list \
 		-H $macro -H $model -M $mmf_dir $model_list
 done
 
+#################################################
+# state clustering and shared Gaussian pool
+if [ -n "$TIE" ]; then
+	echo "step 06 [HHEd]: tie states and mixtures..."
+	if [ -n "$NATIVE_TRAINER" ]; then
+		bin/gmm_hed -T 2 -H $macro -H $model -M $mmf_dir lib/tie.hed $model_list
+	else
+		HHEd -T 2 -H $macro -H $model -M $mmf_dir lib/tie.hed $model_list
+	fi
+
+	echo "step 07 [HERest]: adjust mean, var..."
+	for i in 0 1 2 ;
+	do
+		reestimate -C $config -I $label \
+			-t 250.0 150.0 1000.0 -S $data_list \
+			-H $macro -H $model -M $mmf_dir $model_list
+	done
+fi
@@ -17,8 +17,46 @@ answer_mlf=labels/answer.mlf
 model_list=lib/models_sp.lst
 word_net=lib/wdnet_sp
 
-HVite -D -H $macro -H $model -S $test_data_list -C $config -w $word_net \
+# NATIVE_DECODER=1 decodes with the multi-threaded bin/gmm_decode instead
+# of HVite (same options), writes its decoding cost next to the MLF, and
+# scores with bin/gmm_results instead of HResults
+if [ -n "$NATIVE_DECODER" ] && [ ! -e bin/gmm_decode ]; then
+	cd bin/; make; cd ..
+fi
+# QUANTIZE=int8 or f16 additionally compiles the models to that precision
+# and decodes with them
+compiled=
+if [ -n "$NATIVE_DECODER" ] && [ -n "$QUANTIZE" ]; then
+	bin/gmm_compile -q $QUANTIZE -H $macro -H $model -o $model.$QUANTIZE $model_list || exit 1
+	compiled="-Q $model.$QUANTIZE"
+fi
+# FRAME_SKIP=k computes output probabilities every k-th frame only
+skip=
+if [ -n "$NATIVE_DECODER" ] && [ -n "$FRAME_SKIP" ]; then
+	skip="-d $FRAME_SKIP"
+fi
+# VAD=pad drops long silences before decoding, keeping pad frames around speech
+if [ -n "$NATIVE_DECODER" ] && [ -n "$VAD" ]; then
+	skip="$skip -V $VAD"
+fi
+recognize() {
+	if [ -n "$NATIVE_DECODER" ]; then
+		bin/gmm_decode -J ${out_mlf%.mlf}.json $compiled $skip "$@"
+	else
+		HVite "$@"
+	fi
+}
+
+score() {
+	if [ -n "$NATIVE_DECODER" ]; then
+		bin/gmm_results "$@"
+	else
+		HResults "$@"
+	fi
+}
+
+recognize -D -H $macro -H $model -S $test_data_list -C $config -w $word_net \
 	-l '*' -i $out_mlf -p 0.0 -s 0.0 $dictionary $model_list
 	
-HResults -e "???" sil -e "???" sp -I $answer_mlf $model_list \
+score -e "???" sil -e "???" sp -I $answer_mlf $model_list \
 	$out_mlf >> $out_acc
@@ -0,0 +1,306 @@
+#include "archive.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * FNV-1a
+ */
+static uint32_t hash_key(const char *key)
+{
+    uint32_t h = 2166136261u;
+    while (*key) {
+        h = (h ^ (unsigned char)*key++) * 16777619u;
+    }
+    return h;
+}
+
+void archive_key(const char *path, char *key)
+{
+    const char *base = strrchr(path, '/');
+    char *dot;
+
+    base = base != NULL ? base + 1 : path;
+    strncpy(key, base, MAX_NAME - 1);
+    key[MAX_NAME-1] = '\0';
+    dot = strrchr(key, '.');
+    if (dot != NULL && dot != key) {
+        *dot = '\0';
+    }
+}
+
+static void pad_to(FILE *fp, uint64_t *offset, int align)
+{
+    while (*offset % align != 0) {
+        fputc(0, fp);
+        (*offset)++;
+    }
+}
+
+int archive_build(const char *filename, char **files, int file_num, int flags)
+{
+    ArchiveHeader header;
+    ArchiveEntry *entry;
+    int32_t *bucket;
+    char *names, key[MAX_NAME];
+    uint64_t offset = sizeof(ArchiveHeader);
+    size_t name_size = 0, name_cap = 4096, written;
+    int i, t;
+
+    FILE *fp = fopen(filename, "wb");
+    if (fp == NULL) {
+        perror(filename);
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(ArchiveHeader));
+    fwrite(&header, sizeof(ArchiveHeader), 1, fp);
+
+    entry = (ArchiveEntry *)calloc(file_num + 1, sizeof(ArchiveEntry));
+    names = (char *)malloc(name_cap);
+    for (i = 0; i < file_num; i++) {
+        Feature feat;
+        size_t len, count;
+
+        if (htk_read(files[i], &feat) < 0) {
+            goto fail;
+        }
+        archive_key(files[i], key);
+        len = strlen(key) + 1;
+        while (name_size + len > name_cap) {
+            name_cap *= 2;
+            names = (char *)realloc(names, name_cap);
+        }
+        memcpy(names + name_size, key, len);
+
+        pad_to(fp, &offset, ARCHIVE_ALIGN);
+        entry[i].data_offset = offset;
+        entry[i].name_offset = (uint32_t)name_size;
+        entry[i].frame_num = feat.frame_num;
+        entry[i].dim = feat.dim;
+        entry[i].samp_period = feat.samp_period;
+        entry[i].parm_kind = feat.parm_kind;
+        entry[i].hash = hash_key(key);
+        name_size += len;
+
+        count = (size_t)feat.frame_num * feat.dim;
+        if (flags & ARCHIVE_HALF) {
+            uint16_t *half = (uint16_t *)malloc(sizeof(uint16_t) * count + 1);
+            for (t = 0; t < (int)count; t++) {
+                half[t] = float_to_half(feat.data[t]);
+            }
+            written = fwrite(half, sizeof(uint16_t), count, fp);
+            offset += sizeof(uint16_t) * count;
+            free(half);
+        } else {
+            written = fwrite(feat.data, sizeof(float), count, fp);
+            offset += sizeof(float) * count;
+        }
+        feature_free(&feat);
+        if (written != count) {
+            perror(filename);
+            goto fail;
+        }
+    }
+
+    // Hash table at most half full, so probes stay short
+    header.bucket_num = 16;
+    while (header.bucket_num < 2 * (uint32_t)file_num) {
+        header.bucket_num *= 2;
+    }
+    bucket = (int32_t *)malloc(sizeof(int32_t) * header.bucket_num);
+    memset(bucket, 0xff, sizeof(int32_t) * header.bucket_num);
+    for (i = 0; i < file_num; i++) {
+        uint32_t b = entry[i].hash & (header.bucket_num - 1);
+        while (bucket[b] >= 0) {
+            if (strcmp(names + entry[bucket[b]].name_offset, names + entry[i].name_offset) == 0) {
+                fprintf(stderr, "%s: utterance %s appears twice\n", filename, names + entry[i].name_offset);
+                free(bucket);
+                goto fail;
+            }
+            b = (b + 1) & (header.bucket_num - 1);
+        }
+        bucket[b] = i;
+    }
+
+    pad_to(fp, &offset, ARCHIVE_ALIGN);
+    header.entry_offset = offset;
+    written = fwrite(entry, sizeof(ArchiveEntry), file_num, fp) == (size_t)file_num;
+    offset += sizeof(ArchiveEntry) * file_num;
+    header.bucket_offset = offset;
+    written &= fwrite(bucket, sizeof(int32_t), header.bucket_num, fp) == header.bucket_num;
+    offset += sizeof(int32_t) * header.bucket_num;
+    header.name_offset = offset;
+    written &= fwrite(names, 1, name_size, fp) == name_size;
+    free(bucket);
+
+    memcpy(header.magic, ARCHIVE_MAGIC, 4);
+    header.byte_order = ARCHIVE_BYTE_ORDER;
+    header.utt_num = file_num;
+    header.flags = flags;
+    rewind(fp);
+    written &= fwrite(&header, sizeof(ArchiveHeader), 1, fp) == 1;
+    if (!written || ferror(fp)) {
+        perror(filename);
+        goto fail;
+    }
+
+    free(entry);
+    free(names);
+    if (fclose(fp) != 0) {
+        perror(filename);
+        return -1;
+    }
+    return 0;
+
+fail:
+    free(entry);
+    free(names);
+    fclose(fp);
+    remove(filename);
+    return -1;
+}
+
+int archive_open(Archive *ar, const char *filename)
+{
+    struct stat st;
+    const ArchiveHeader *h;
+    const ArchiveEntry *e;
+    size_t elem, name_size;
+    uint32_t i;
+    int fd;
+
+    memset(ar, 0, sizeof(Archive));
+    fd = open(filename, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(filename);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(ArchiveHeader)) {
+        fprintf(stderr, "%s: not a feature archive\n", filename);
+        close(fd);
+        return -1;
+    }
+    ar->size = (size_t)st.st_size;
+    ar->map = mmap(NULL, ar->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ar->map == MAP_FAILED) {
+        perror(filename);
+        ar->map = NULL;
+        return -1;
+    }
+
+    h = (const ArchiveHeader *)ar->map;
+    if (memcmp(h->magic, ARCHIVE_MAGIC, 4) != 0 || h->byte_order != ARCHIVE_BYTE_ORDER || \
+        h->bucket_num == 0 || (h->bucket_num & (h->bucket_num - 1)) != 0 || \
+        h->name_offset > ar->size || h->bucket_offset + sizeof(int32_t) * h->bucket_num > ar->size || \
+        h->entry_offset + sizeof(ArchiveEntry) * h->utt_num > ar->size) {
+        fprintf(stderr, "%s: not a feature archive of this machine\n", filename);
+        archive_close(ar);
+        return -1;
+    }
+    ar->header = h;
+    ar->entry = (const ArchiveEntry *)((const char *)ar->map + h->entry_offset);
+    ar->bucket = (const int32_t *)((const char *)ar->map + h->bucket_offset);
+    ar->names = (const char *)ar->map + h->name_offset;
+
+    // Every entry must lie in the file, so a truncated archive is rejected
+    // here rather than faulting in archive_read
+    elem = (h->flags & ARCHIVE_HALF) ? sizeof(uint16_t) : sizeof(float);
+    name_size = ar->size - h->name_offset;
+    for (i = 0; i < h->utt_num; i++) {
+        e = &ar->entry[i];
+        if (e->frame_num < 0 || e->dim < 0 || e->data_offset > ar->size || \
+            (uint64_t)e->frame_num * e->dim * elem > ar->size - e->data_offset || e->name_offset >= name_size || \
+            memchr(ar->names + e->name_offset, '\0', name_size - e->name_offset) == NULL) {
+            fprintf(stderr, "%s: utterance %u lies outside the archive, truncated?\n", filename, i);
+            archive_close(ar);
+            return -1;
+        }
+    }
+    for (i = 0; i < h->bucket_num; i++) {
+        if (ar->bucket[i] >= (int32_t)h->utt_num) {
+            fprintf(stderr, "%s: corrupt hash table\n", filename);
+            archive_close(ar);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void archive_close(Archive *ar)
+{
+    if (ar->map != NULL) {
+        munmap(ar->map, ar->size);
+    }
+    memset(ar, 0, sizeof(Archive));
+}
+
+int archive_find(const Archive *ar, const char *name)
+{
+    char key[MAX_NAME];
+    uint32_t hash, b, mask = ar->header->bucket_num - 1;
+
+    archive_key(name, key);
+    hash = hash_key(key);
+    for (b = hash & mask; ar->bucket[b] >= 0; b = (b + 1) & mask) {
+        const ArchiveEntry *e = &ar->entry[ar->bucket[b]];
+        if (e->hash == hash && strcmp(ar->names + e->name_offset, key) == 0) {
+            return ar->bucket[b];
+        }
+    }
+    return -1;
+}
+
+void archive_read(const Archive *ar, int index, Feature *feat)
+{
+    const ArchiveEntry *e = &ar->entry[index];
+    const char *data = (const char *)ar->map + e->data_offset;
+
+    feat->frame_num = e->frame_num;
+    feat->dim = e->dim;
+    feat->samp_period = e->samp_period;
+    feat->parm_kind = e->parm_kind;
+    if (ar->header->flags & ARCHIVE_HALF) {
+        const uint16_t *half = (const uint16_t *)data;
+        size_t i, count = (size_t)e->frame_num * e->dim;
+        feat->data = (float *)malloc(sizeof(float) * count + 1);
+        for (i = 0; i < count; i++) {
+            feat->data[i] = half_to_float(half[i]);
+        }
+    } else {
+        feat->data = (float *)data;
+    }
+}
+
+void archive_release(const Archive *ar, Feature *feat)
+{
+    if (ar == NULL || (ar->header->flags & ARCHIVE_HALF)) {
+        feature_free(feat);
+    } else {
+        feat->data = NULL;
+        feat->frame_num = 0;
+    }
+}
+
+int archive_load(const Archive *ar, const char *name, Feature *feat)
+{
+    int index;
+
+    if (ar == NULL) {
+        return htk_read(name, feat);
+    }
+    index = archive_find(ar, name);
+    if (index < 0) {
+        fprintf(stderr, "%s: not in the feature archive\n", name);
+        return -1;
+    }
+    archive_read(ar, index, feat);
+    return 0;
+}
@@ -0,0 +1,100 @@
+#ifndef ARCHIVE_HEADER_
+#define ARCHIVE_HEADER_
+
+#include "htk.h"
+#include <stddef.h>
+
+/**
+ * Feature archive: every utterance of a script in one file, read through
+ * mmap instead of one open/read per HTK file and pass.
+ *
+ *   header | data blocks | entries[utt_num] | buckets[bucket_num] | names
+ *
+ * Data blocks start on ARCHIVE_ALIGN byte boundaries and hold frame_num x
+ * dim floats, or halves with ARCHIVE_HALF. Buckets are an open-addressing
+ * hash table of entry indices (-1 empty) keyed by utterance name: the base
+ * name without directory and extension, so "MFCC/training/N110003.mfc" and
+ * the MLF label pattern of N110003.lab find the same entry. Everything is
+ * in machine byte order.
+ */
+
+#define ARCHIVE_MAGIC       "FAR1"
+#define ARCHIVE_BYTE_ORDER  0x01020304
+#define ARCHIVE_ALIGN       64
+#define ARCHIVE_HALF        1       // Flag: data stored as IEEE half floats
+
+typedef struct {
+    char magic[4];
+    uint32_t byte_order;
+    uint32_t utt_num;
+    uint32_t flags;
+    uint32_t bucket_num;    // Power of two
+    uint32_t reserved;
+    uint64_t entry_offset;
+    uint64_t bucket_offset;
+    uint64_t name_offset;
+} ArchiveHeader;
+
+typedef struct {
+    uint64_t data_offset;
+    uint32_t name_offset;   // Into the name table, NUL terminated
+    int32_t frame_num;
+    int32_t dim;
+    int32_t samp_period;
+    int16_t parm_kind;
+    int16_t reserved;
+    uint32_t hash;
+} ArchiveEntry;
+
+typedef struct {
+    void *map;
+    size_t size;
+    const ArchiveHeader *header;
+    const ArchiveEntry *entry;
+    const int32_t *bucket;
+    const char *names;
+} Archive;
+
+/**
+ * @param key receives the base name of path without extension, at least
+ * MAX_NAME bytes
+ */
+void archive_key(const char *path, char *key);
+
+/**
+ * Pack the HTK files of a script into filename
+ * @param flags 0 or ARCHIVE_HALF
+ * @return 0 on success, -1 on error (reported on stderr)
+ */
+int archive_build(const char *filename, char **files, int file_num, int flags);
+
+/**
+ * Map an archive read-only
+ * @return 0 on success, -1 on error (reported on stderr)
+ */
+int archive_open(Archive *ar, const char *filename);
+void archive_close(Archive *ar);
+
+/**
+ * @param name utterance name or any path with the same base name
+ * @return entry index, -1 if not found
+ */
+int archive_find(const Archive *ar, const char *name);
+
+/**
+ * Features of entry index: float archives are returned in place (zero
+ * copy, read-only), half archives are expanded into a new buffer
+ * @param feat release with archive_release
+ */
+void archive_read(const Archive *ar, int index, Feature *feat);
+void archive_release(const Archive *ar, Feature *feat);
+
+/**
+ * Features of a script entry, from the archive if ar is not NULL and from
+ * the HTK file otherwise
+ * @param feat release with archive_release
+ * @return 0 on success, -1 on error (reported on stderr)
+ */
+int archive_load(const Archive *ar, const char *name, Feature *feat);
+
+#endif
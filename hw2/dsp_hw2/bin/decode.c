@@ -0,0 +1,508 @@
+#include "decode.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+void decoder_init(Decoder *dec, const DecodeNet *net, const ModelSet *set)
+{
+    int i, n = net->node_num + 1, comp_num = 0;
+
+    memset(dec, 0, sizeof(Decoder));
+    dec->net = net;
+    dec->state_num = set->state_num;
+    dec->score = (double *)malloc(sizeof(double) * n);
+    dec->next_score = (double *)malloc(sizeof(double) * n);
+    dec->trace = (int *)malloc(sizeof(int) * n);
+    dec->next_trace = (int *)malloc(sizeof(int) * n);
+    dec->stamp = (int *)malloc(sizeof(int) * n);
+    dec->active = (int *)malloc(sizeof(int) * n);
+    dec->next_active = (int *)malloc(sizeof(int) * n);
+    dec->null_score = (double *)malloc(sizeof(double) * n);
+    dec->null_trace = (int *)malloc(sizeof(int) * n);
+    dec->null_live = (int *)malloc(sizeof(int) * n);
+    dec->select = (double *)malloc(sizeof(double) * n);
+    dec->out_prob = (double *)malloc(sizeof(double) * (set->state_num + 1));
+    dec->out_stamp = (int *)malloc(sizeof(int) * (set->state_num + 1));
+    dec->link_cap = 1024;
+    dec->links = (WordLink *)malloc(sizeof(WordLink) * dec->link_cap);
+    dec->allow = (int *)malloc(sizeof(int) * n);
+
+    // Gaussians shared by states (a pool of ~m macros) get their own cache
+    for (i = 0; i < set->state_num; i++) {
+        comp_num += set->state_list[i]->mix_num;
+    }
+    if (set->gauss_num < comp_num) {
+        dec->gauss_num = set->gauss_num;
+        dec->gauss_prob = (double *)malloc(sizeof(double) * 2 * set->gauss_num);
+        dec->gauss_stamp = (int *)malloc(sizeof(int) * 2 * set->gauss_num);
+    }
+}
+
+void decoder_free(Decoder *dec)
+{
+    free(dec->score);
+    free(dec->next_score);
+    free(dec->trace);
+    free(dec->next_trace);
+    free(dec->stamp);
+    free(dec->active);
+    free(dec->next_active);
+    free(dec->null_score);
+    free(dec->null_trace);
+    free(dec->null_live);
+    free(dec->select);
+    free(dec->out_prob);
+    free(dec->out_stamp);
+    free(dec->gauss_prob);
+    free(dec->gauss_stamp);
+    free(dec->links);
+    free(dec->block_comp);
+    free(dec->block_out);
+    free(dec->grid);
+    free(dec->anchor_prob);
+    free(dec->anchor_stamp);
+    free(dec->trail_offset);
+    free(dec->trail);
+    free(dec->allow);
+    memset(dec, 0, sizeof(Decoder));
+}
+
+void decode_result_free(DecodeResult *result)
+{
+    free(result->words);
+    memset(result, 0, sizeof(DecodeResult));
+}
+
+/**
+ * @return the k-th largest (0-based) of a[0..n), a is reordered
+ */
+static double select_largest(double *a, int n, int k)
+{
+    int lo = 0, hi = n - 1;
+
+    while (lo < hi) {
+        double pivot = a[(lo + hi) / 2], tmp;
+        int i = lo, j = hi;
+        while (i <= j) {
+            while (a[i] > pivot) {
+                i++;
+            }
+            while (a[j] < pivot) {
+                j--;
+            }
+            if (i <= j) {
+                tmp = a[i];
+                a[i] = a[j];
+                a[j] = tmp;
+                i++;
+                j--;
+            }
+        }
+        if (k <= j) {
+            hi = j;
+        } else if (k >= i) {
+            lo = i;
+        } else {
+            break;
+        }
+    }
+    return a[k];
+}
+
+/**
+ * state_log_prob through the shared Gaussian cache of frame t
+ * @param gauss_num incremented by the number of Gaussians evaluated
+ */
+static double shared_state_log_prob(Decoder *dec, const State *s, const float *x, int t, int slot,
+                                    long *gauss_num)
+{
+    int m;
+    double total = LZERO;
+    double *prob = dec->gauss_prob + (size_t)slot * dec->gauss_num;
+    int *stamp = dec->gauss_stamp + (size_t)slot * dec->gauss_num;
+
+    for (m = 0; m < s->mix_num; m++) {
+        const Gaussian *g = s->gauss[m];
+        if (s->weight[m] <= 0) {
+            continue;
+        }
+        if (stamp[g->index] != t) {
+            stamp[g->index] = t;
+            prob[g->index] = gaussian_log_prob(g, x);
+            (*gauss_num)++;
+        }
+        total = log_add(total, log(s->weight[m]) + prob[g->index]);
+    }
+    return total;
+}
+
+/**
+ * Output probability of s at frame t, x: from the compiled models, through
+ * Gaussian selection, the shared Gaussian cache or in full. The per-frame
+ * work (mapped frame, codeword, Gaussian cache) is kept in slot 0 or 1, so
+ * two frames can be scored alternately.
+ * @param gauss_num incremented by the number of Gaussians evaluated
+ */
+static double output_prob(Decoder *dec, const DecodeConfig *cfg, const State *s, const float *x, int t,
+                          int slot, long *gauss_num)
+{
+    if (cfg->quant != NULL) {
+        float *grid = dec->grid + (size_t)slot * cfg->quant->stride;
+        if (dec->grid_frame[slot] != t) {
+            dec->grid_frame[slot] = t;
+            quant_frame(cfg->quant, x, grid);
+        }
+        *gauss_num += s->mix_num;
+        return quant_state_log_prob(cfg->quant, s, grid);
+    }
+    if (cfg->gsel != NULL) {
+        if (dec->code_frame[slot] != t) {
+            dec->code_frame[slot] = t;
+            dec->code[slot] = gsel_quantize(cfg->gsel, x);
+            *gauss_num += cfg->gsel->code_num;
+        }
+        return gsel_state_log_prob(cfg->gsel, s, x, dec->code[slot], gauss_num);
+    }
+    if (dec->gauss_prob != NULL) {
+        return shared_state_log_prob(dec, s, x, t, slot, gauss_num);
+    }
+    *gauss_num += s->mix_num;
+    return state_log_prob(s, x, NULL);
+}
+
+/**
+ * Frame skipping: output probability of s at frame t from those of the
+ * computed frames around it, each computed once per state
+ * @param eval_num incremented by the output probabilities computed
+ */
+static double skipped_output_prob(Decoder *dec, const DecodeConfig *cfg, const State *s, const Feature *feat,
+                                  int t, long *eval_num, long *gauss_num)
+{
+    int k, t0, t1;
+    double w = skip_weight(t, feat->frame_num, cfg->frame_skip, cfg->skip_hold, &t0, &t1), p[2];
+
+    for (k = 0; k < (w > 0 ? 2 : 1); k++) {
+        int a = k == 0 ? t0 : t1, slot = (a / cfg->frame_skip) & 1;
+        int i = slot * dec->state_num + s->index;
+        if (dec->anchor_stamp[i] != a) {
+            dec->anchor_stamp[i] = a;
+            dec->anchor_prob[i] = output_prob(dec, cfg, s, feat->data + (size_t)a * feat->dim, a, slot, gauss_num);
+            (*eval_num)++;
+        }
+        p[k] = dec->anchor_prob[i];
+    }
+    return w > 0 ? (1 - w) * p[0] + w * p[1] : p[0];
+}
+
+/**
+ * Append the active nodes after frame t to the trail
+ */
+static void record_frame(Decoder *dec, int t)
+{
+    if (t + 2 > dec->trail_frame_cap) {
+        dec->trail_frame_cap = 2 * (t + 2);
+        dec->trail_offset = (int *)realloc(dec->trail_offset, sizeof(int) * dec->trail_frame_cap);
+    }
+    if (dec->trail_offset[t] + dec->active_num > dec->trail_cap) {
+        dec->trail_cap = 2 * (dec->trail_offset[t] + dec->active_num);
+        dec->trail = (int *)realloc(dec->trail, sizeof(int) * dec->trail_cap);
+    }
+    memcpy(dec->trail + dec->trail_offset[t], dec->active, sizeof(int) * dec->active_num);
+    dec->trail_offset[t+1] = dec->trail_offset[t] + dec->active_num;
+    dec->trail_frames = t + 1;
+}
+
+/**
+ * Offer a token of score s to emitting node j for frame t
+ */
+static void enter_emitting(Decoder *dec, int t, int j, double s, int trace)
+{
+    if (dec->stamp[j] != t) {
+        dec->stamp[j] = t;
+        dec->next_score[j] = s;
+        dec->next_trace[j] = trace;
+        dec->next_active[dec->next_num++] = j;
+    } else if (s > dec->next_score[j]) {
+        dec->next_score[j] = s;
+        dec->next_trace[j] = trace;
+    }
+}
+
+static void enter_null(Decoder *dec, int j, double s, int trace)
+{
+    if (s > dec->null_score[j]) {
+        dec->null_score[j] = s;
+        dec->null_trace[j] = trace;
+    }
+}
+
+/**
+ * Move the tokens of the emitting nodes through the null nodes, recording
+ * the word ends passed, after frame frames were consumed
+ * @param best score of the best emitting token, the reference of the beams
+ */
+static void propagate_nulls(Decoder *dec, int frame, double best, const DecodeConfig *cfg, DecodeStats *stats)
+{
+    const DecodeNet *net = dec->net;
+    int i, k, a;
+
+    for (i = 0; i < dec->live_num; i++) {
+        dec->null_score[dec->null_live[i]] = LZERO;
+    }
+    dec->live_num = 0;
+
+    for (i = 0; i < dec->active_num; i++) {
+        int n = dec->active[i];
+        for (a = net->arc_offset[n]; a < net->arc_offset[n+1]; a++) {
+            if (net->state[net->arc_to[a]] == NULL) {
+                enter_null(dec, net->arc_to[a], dec->score[n] + net->arc_prob[a], dec->trace[n]);
+            }
+        }
+    }
+
+    for (k = 0; k < net->null_num; k++) {
+        int n = net->null_order[k];
+        double s = dec->null_score[n];
+
+        if (s <= LSMALL) {
+            continue;
+        }
+        if (cfg->beam > 0 && s < best - cfg->beam) {
+            dec->null_score[n] = LZERO;
+            continue;
+        }
+        if (net->word[n] >= 0 && cfg->word_beam > 0 && s < best - cfg->word_beam) {
+            dec->null_score[n] = LZERO;
+            if (stats != NULL) {
+                stats->word_pruned++;
+            }
+            continue;
+        }
+        if (net->word[n] >= 0) {
+            WordLink *link;
+            if (dec->link_num == dec->link_cap) {
+                dec->link_cap *= 2;
+                dec->links = (WordLink *)realloc(dec->links, sizeof(WordLink) * dec->link_cap);
+            }
+            link = &dec->links[dec->link_num];
+            link->word = net->word[n];
+            link->frame = frame;
+            link->score = s;
+            link->prev = dec->null_trace[n];
+            dec->null_trace[n] = dec->link_num++;
+            if (stats != NULL) {
+                stats->word_ends++;
+            }
+        }
+        dec->null_live[dec->live_num++] = n;
+        for (a = net->arc_offset[n]; a < net->arc_offset[n+1]; a++) {
+            if (net->state[net->arc_to[a]] == NULL) {
+                enter_null(dec, net->arc_to[a], s + net->arc_prob[a], dec->null_trace[n]);
+            }
+        }
+    }
+}
+
+int decode(Decoder *dec, const Feature *feat, const DecodeConfig *cfg, DecodeResult *result,
+           DecodeStats *stats)
+{
+    const DecodeNet *net = dec->net;
+    int t, i, k, a, n, *swap_int;
+    double *swap, best = 0, threshold, beam_threshold;
+    long state_num = 0, gauss_num = 0, full_num = 0, token_num = 0, pruned_num = 0, beam_num = 0;
+
+    memset(result, 0, sizeof(DecodeResult));
+    result->score = LZERO;
+    for (n = 0; n < net->node_num; n++) {
+        dec->stamp[n] = -1;
+        dec->null_score[n] = LZERO;
+    }
+    for (i = 0; i < dec->state_num; i++) {
+        dec->out_stamp[i] = -1;
+    }
+    for (i = 0; i < 2 * dec->gauss_num; i++) {
+        dec->gauss_stamp[i] = -1;
+    }
+    dec->grid_frame[0] = dec->grid_frame[1] = -1;
+    dec->code_frame[0] = dec->code_frame[1] = -1;
+    dec->active_num = 0;
+    dec->live_num = 0;
+    dec->link_num = 0;
+    if (dec->record) {
+        dec->trail_frames = 0;
+        if (dec->trail_offset == NULL) {
+            dec->trail_frame_cap = 1024;
+            dec->trail_offset = (int *)malloc(sizeof(int) * dec->trail_frame_cap);
+        }
+        dec->trail_offset[0] = 0;
+    }
+    for (n = 0; dec->fast != NULL && n < net->node_num; n++) {
+        dec->allow[n] = -1;
+    }
+    if (cfg->table != NULL && dec->block_comp == NULL) {
+        dec->block_comp = (float *)malloc(sizeof(float) * SCORE_BLOCK * (cfg->table->comp_num + 1));
+        dec->block_out = (float *)malloc(sizeof(float) * SCORE_BLOCK * (cfg->table->state_num + 1));
+    }
+    if (cfg->quant != NULL && dec->grid == NULL) {
+        dec->grid = (float *)malloc(sizeof(float) * 2 * cfg->quant->stride);
+    }
+    if (cfg->frame_skip > 1) {
+        if (dec->anchor_prob == NULL) {
+            dec->anchor_prob = (double *)malloc(sizeof(double) * 2 * (dec->state_num + 1));
+            dec->anchor_stamp = (int *)malloc(sizeof(int) * 2 * (dec->state_num + 1));
+        }
+        for (i = 0; i < 2 * dec->state_num; i++) {
+            dec->anchor_stamp[i] = -1;
+        }
+    }
+
+    // The initial token goes through the null nodes reachable from the start
+    dec->null_score[net->start] = 0;
+    dec->null_trace[net->start] = -1;
+    propagate_nulls(dec, 0, 0, cfg, stats);
+
+    for (t = 0; t < feat->frame_num; t++) {
+        const float *x = feat->data + (size_t)t * feat->dim;
+
+        if (cfg->table != NULL && t % SCORE_BLOCK == 0) {
+            int block = feat->frame_num - t < SCORE_BLOCK ? feat->frame_num - t : SCORE_BLOCK;
+            score_frames(cfg->table, x, block, NULL, dec->block_comp, dec->block_out);
+            state_num += (long)block * cfg->table->state_num;
+            gauss_num += (long)block * cfg->table->comp_num;
+            full_num += (long)block * cfg->table->comp_num;
+        }
+
+        dec->next_num = 0;
+        for (i = 0; i < dec->active_num; i++) {
+            n = dec->active[i];
+            for (a = net->arc_offset[n]; a < net->arc_offset[n+1]; a++) {
+                if (net->state[net->arc_to[a]] != NULL) {
+                    enter_emitting(dec, t, net->arc_to[a], dec->score[n] + net->arc_prob[a], dec->trace[n]);
+                }
+            }
+        }
+        for (i = 0; i < dec->live_num; i++) {
+            n = dec->null_live[i];
+            for (a = net->arc_offset[n]; a < net->arc_offset[n+1]; a++) {
+                if (net->state[net->arc_to[a]] != NULL) {
+                    enter_emitting(dec, t, net->arc_to[a], dec->null_score[n] + net->arc_prob[a],
+                                   dec->null_trace[n]);
+                }
+            }
+        }
+
+        // Fast match: only the nodes the cheap models kept alive at t
+        if (dec->fast != NULL) {
+            const Decoder *f = dec->fast;
+            for (i = f->trail_offset[t]; t < f->trail_frames && i < f->trail_offset[t+1]; i++) {
+                dec->allow[f->trail[i]] = t;
+            }
+            for (i = k = 0; i < dec->next_num; i++) {
+                if (dec->allow[dec->next_active[i]] == t) {
+                    dec->next_active[k++] = dec->next_active[i];
+                }
+            }
+            if (stats != NULL) {
+                stats->fast_pruned += dec->next_num - k;
+            }
+            dec->next_num = k;
+        }
+
+        // Tied states share one output probability per frame
+        best = LZERO;
+        for (i = 0; i < dec->next_num; i++) {
+            const State *s;
+            n = dec->next_active[i];
+            s = net->state[n];
+            if (cfg->table != NULL) {
+                dec->out_prob[s->index] = dec->block_out[(t % SCORE_BLOCK) * cfg->table->state_num + s->index];
+            } else if (dec->out_stamp[s->index] != t) {
+                dec->out_stamp[s->index] = t;
+                if (cfg->frame_skip > 1) {
+                    dec->out_prob[s->index] = skipped_output_prob(dec, cfg, s, feat, t, &state_num, &gauss_num);
+                } else {
+                    dec->out_prob[s->index] = output_prob(dec, cfg, s, x, t, t & 1, &gauss_num);
+                    state_num++;
+                }
+                full_num += s->mix_num;
+            }
+            dec->next_score[n] += dec->out_prob[s->index];
+            if (dec->next_score[n] > best) {
+                best = dec->next_score[n];
+            }
+        }
+
+        beam_threshold = threshold = cfg->beam > 0 ? best - cfg->beam : LSMALL;
+        if (cfg->max_active > 0 && dec->next_num > cfg->max_active) {
+            double kth;
+            for (i = 0; i < dec->next_num; i++) {
+                dec->select[i] = dec->next_score[dec->next_active[i]];
+            }
+            kth = select_largest(dec->select, dec->next_num, cfg->max_active - 1);
+            if (kth > threshold) {
+                threshold = kth;
+            }
+        }
+        for (i = k = 0; i < dec->next_num; i++) {
+            n = dec->next_active[i];
+            if (dec->next_score[n] >= threshold) {
+                dec->next_active[k++] = n;
+            } else if (dec->next_score[n] < beam_threshold) {
+                beam_num++;
+            }
+        }
+        token_num += dec->next_num;
+        pruned_num += dec->next_num - k;
+        dec->next_num = k;
+
+        swap = dec->score, dec->score = dec->next_score, dec->next_score = swap;
+        swap_int = dec->trace, dec->trace = dec->next_trace, dec->next_trace = swap_int;
+        swap_int = dec->active, dec->active = dec->next_active, dec->next_active = swap_int;
+        dec->active_num = dec->next_num;
+        if (stats != NULL) {
+            stats->active_num += dec->active_num;
+            if (dec->active_num > stats->active_peak) {
+                stats->active_peak = dec->active_num;
+            }
+        }
+        if (dec->record) {
+            record_frame(dec, t);
+        }
+
+        propagate_nulls(dec, t + 1, best, cfg, stats);
+        if (dec->active_num == 0 && dec->live_num == 0) {
+            break;
+        }
+    }
+    if (stats != NULL) {
+        stats->frame_num += feat->frame_num;
+        stats->state_evals += state_num;
+        stats->gauss_evals += gauss_num;
+        stats->gauss_full += full_num;
+        stats->token_num += token_num;
+        stats->beam_pruned += beam_num;
+        stats->max_pruned += pruned_num - beam_num;
+    }
+
+    if (t < feat->frame_num || dec->null_score[net->end] <= LSMALL) {
+        return -1;
+    }
+
+    // Trace the word ends of the best path back from the end node
+    result->score = dec->null_score[net->end];
+    for (k = dec->null_trace[net->end]; k >= 0; k = dec->links[k].prev) {
+        result->word_num++;
+    }
+    result->words = (WordHyp *)malloc(sizeof(WordHyp) * (result->word_num + 1));
+    i = result->word_num;
+    for (k = dec->null_trace[net->end]; k >= 0; k = dec->links[k].prev) {
+        const WordLink *link = &dec->links[k];
+        const WordLink *prev = link->prev >= 0 ? &dec->links[link->prev] : NULL;
+        WordHyp *w = &result->words[--i];
+        w->word = link->word;
+        w->start = prev != NULL ? prev->frame : 0;
+        w->end = link->frame;
+        w->score = link->score - (prev != NULL ? prev->score : 0);
+    }
+    return 0;
+}
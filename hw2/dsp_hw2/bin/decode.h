@@ -0,0 +1,151 @@
+#ifndef DECODE_HEADER_
+#define DECODE_HEADER_
+
+#include "net.h"
+#include "gsel.h"
+#include "score.h"
+#include "quant.h"
+
+/**
+ * Viterbi token passing over a DecodeNet, like HVite. Every emitting node
+ * holds at most one token per frame; null nodes are visited in topological
+ * order between frames. Each token carries its score and the last word end
+ * on its path, kept as a linked list of word-end records, so the best path
+ * is traced back from the end node after the last frame.
+ *
+ * Tokens are pruned every frame by
+ *  - the global beam (HVite -t): more than beam below the best token,
+ *  - max-active (HVite -u): keep only the best max_active emitting tokens,
+ *  - the word-end beam (HVite -v): word ends more than word_beam below the
+ *    best token.
+ *
+ * The output probability of a state is computed at most once per frame,
+ * however many tokens enter it, and optionally through Gaussian selection.
+ * When states share Gaussians (hed.h TI of mixtures), each of those is also
+ * evaluated at most once per frame.
+ * For offline decoding, all states can instead be scored SCORE_BLOCK frames
+ * at a time as a matrix product (score.h), and the output distributions
+ * can be evaluated from 8 or 16-bit compiled models (quant.h).
+ *
+ * Frame skipping computes output probabilities only at every frame_skip-th
+ * frame, each once per state, and interpolates them for the frames in
+ * between (skip_weight), so tokens still advance every frame through the
+ * same topology.
+ *
+ * Two-pass fast match: a decoder over the same network built from cheap
+ * models (fewer mixtures, same topology) records the nodes alive at every
+ * frame; a second decoder given it as fast then only lets tokens into
+ * those nodes, so full output probabilities are computed for them alone.
+ */
+
+typedef struct {
+    double beam;        // -t, 0 disables
+    double word_beam;   // -v, 0 disables
+    int max_active;     // -u, 0 disables
+    const GaussSelect *gsel;  // NULL to evaluate every mixture
+    const ScoreTable *table;  // Batched scoring of every state, overrides gsel; NULL for active states only
+    const QuantModel *quant;  // Compiled models, overrides gsel; NULL for the float models
+    int frame_skip;     // Output probabilities every frame_skip-th frame (skip_weight), 0 or 1 for all
+    int skip_hold;      // Frames in between reuse the last computed one instead of interpolating
+} DecodeConfig;
+
+typedef struct {
+    int word;           // SLF node
+    int start, end;     // Frames [start, end)
+    double score;       // Log score of the word, language model included
+} WordHyp;
+
+typedef struct {
+    int word_num;
+    WordHyp *words;
+    double score;       // Log score of the best path
+} DecodeResult;
+
+/**
+ * Counters for tuning the beams, summed over utterances
+ */
+typedef struct {
+    long frame_num;
+    long token_num;     // Emitting tokens scored, before pruning, summed over frames
+    long active_num;    // Emitting tokens alive after pruning, summed over frames
+    int active_peak;    // Most emitting tokens alive after one frame
+    long state_evals;   // Output probabilities computed
+    long gauss_evals;   // Gaussians evaluated, codeword distances included
+    long gauss_full;    // Gaussians the same output probabilities cost without selection
+    long word_ends;     // Word-end records created
+    long beam_pruned;   // Tokens below the global beam
+    long max_pruned;    // Tokens within the beam cut by max-active
+    long word_pruned;   // Word ends within the global beam cut by the word-end beam
+    long fast_pruned;   // Tokens outside the fast-match trail
+} DecodeStats;
+
+/**
+ * Word-end record; prev is the previous word end on the path, -1 at the start
+ */
+typedef struct {
+    int word;
+    int frame;
+    double score;
+    int prev;
+} WordLink;
+
+typedef struct Decoder Decoder;
+
+/**
+ * Scratch space of one decoding thread
+ */
+struct Decoder {
+    const DecodeNet *net;
+    int state_num;
+    double *score, *next_score;   // [node_num] emitting tokens
+    int *trace, *next_trace;
+    int *stamp;                   // [node_num] frame next_score was last set
+    int *active, *next_active;    // Emitting nodes holding a token
+    int active_num, next_num;
+    double *null_score;           // [node_num] null tokens at the frame boundary
+    int *null_trace;
+    int *null_live;               // Null nodes holding a token
+    int live_num;
+    double *out_prob;             // [state_num] output probability cache
+    int *out_stamp;               // [state_num] frame out_prob was computed
+    int gauss_num;                // Gaussians of the set when states share them, else 0
+    double *gauss_prob;           // [2][gauss_num] log N(x) cache of shared Gaussians, NULL if none
+    int *gauss_stamp;             // [2][gauss_num] frame gauss_prob was computed
+    double *anchor_prob;          // [2][state_num] frame skipping: output probabilities of the
+    int *anchor_stamp;            // computed frames around t and their frames, allocated on first use
+    double *select;               // [node_num] max-active selection buffer
+    float *block_comp;            // [SCORE_BLOCK][comp_num] batched scoring, allocated on first use
+    float *block_out;             // [SCORE_BLOCK][state_num]
+    float *grid;                  // [2][stride] frame mapped for the compiled models, allocated on first use
+    int grid_frame[2];
+    int code[2], code_frame[2];   // Gaussian selection codeword of a frame
+    int link_num, link_cap;
+    WordLink *links;
+
+    // Fast match
+    int record;                   // Keep the nodes alive at every frame in trail
+    int trail_frames;
+    int *trail_offset;            // [trail_frames + 1] start of each frame in trail
+    int *trail;
+    int trail_cap, trail_frame_cap;
+    const Decoder *fast;          // Only the nodes of fast->trail may hold tokens, NULL for all
+    int *allow;                   // [node_num] frame a node was last allowed
+};
+
+/**
+ * @param set the model set net was built from, indexed by modelset_index
+ */
+void decoder_init(Decoder *dec, const DecodeNet *net, const ModelSet *set);
+void decoder_free(Decoder *dec);
+
+/**
+ * Decode all frames of feat
+ * @param result filled, release with decode_result_free
+ * @param stats counters are added here if not NULL
+ * @return 0 on success, -1 if no token reached the end of the network
+ */
+int decode(Decoder *dec, const Feature *feat, const DecodeConfig *cfg, DecodeResult *result,
+           DecodeStats *stats);
+void decode_result_free(DecodeResult *result);
+
+#endif
@@ -0,0 +1,598 @@
+#include "embed.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#ifndef MAX_THREAD
+    #define MAX_THREAD 64
+#endif
+
+/**
+ * Composite model of one utterance. Emitting states are numbered 0 .. S-1
+ * through the model sequence; model Q is the virtual end of the sentence.
+ */
+typedef struct {
+    int Q, S, T, max_mix;
+    Hmm **models;
+    const Feature *feat;
+    int *offset;          // [Q+1], composite number of each model's state 1
+    double *log_a;        // Log transition matrices of the models, concatenated
+    int *a_offset;        // [Q], start of each model's matrix in log_a
+    int *band;            // [Q][2], transp_band of each model's matrix
+    double *b;            // [T][S] log b_s(o_t), computed where beta survived
+    double *mix;          // [T][S][max_mix] mixture terms of b
+    double *beta;         // [T][S]
+    double *bent;         // [T+1][Q+1] backward probability at the entry of model q
+    const ScoreTable *table;
+    float *comp;          // [T][comp_num] batched component scores, NULL without a table
+    float *out;           // [T][state_num] batched state scores
+    int skip, hold;       // Frame skipping, see skip_weight
+    double *anchor;       // [T / skip + 1][S] log b_s of the computed frames, NULL without skipping
+    char *anchor_set;
+} Composite;
+
+#define X(c, t) ((c)->feat->data + (size_t)(t) * (c)->feat->dim)
+#define B(c, t, s) ((c)->b[(size_t)(t) * (c)->S + (s)])
+#define MIX(c, t, s) ((c)->mix + ((size_t)(t) * (c)->S + (s)) * (c)->max_mix)
+#define BETA(c, t, s) ((c)->beta[(size_t)(t) * (c)->S + (s)])
+#define BENT(c, t, q) ((c)->bent[(size_t)(t) * ((c)->Q + 1) + (q)])
+
+/**
+ * @return x + y, LZERO if either is log(0)
+ */
+static double log_mul(double x, double y)
+{
+    return x > LSMALL && y > LSMALL ? x + y : LZERO;
+}
+
+static void composite_init(Composite *c, Hmm **models, int model_num, const Feature *feat,
+                           const ScoreTable *table, int skip, int hold)
+{
+    int q, i, j, n = 0;
+
+    memset(c, 0, sizeof(Composite));
+    c->Q = model_num;
+    c->T = feat->frame_num;
+    c->models = models;
+    c->feat = feat;
+    c->max_mix = 1;
+    c->offset = (int *)malloc(sizeof(int) * (model_num + 1));
+    c->a_offset = (int *)malloc(sizeof(int) * (model_num + 1));
+    c->band = (int *)malloc(sizeof(int) * 2 * (model_num + 1));
+    for (q = 0; q < model_num; q++) {
+        const Hmm *hmm = models[q];
+        c->offset[q] = c->S;
+        c->a_offset[q] = n;
+        c->S += hmm->state_num - 2;
+        n += hmm->state_num * hmm->state_num;
+        for (j = 1; j < hmm->state_num - 1; j++) {
+            if (hmm->state[j]->mix_num > c->max_mix) {
+                c->max_mix = hmm->state[j]->mix_num;
+            }
+        }
+    }
+    c->offset[model_num] = c->S;
+
+    c->log_a = (double *)malloc(sizeof(double) * (n + 1));
+    for (q = 0; q < model_num; q++) {
+        const TransP *transp = models[q]->transp;
+        double *log_a = c->log_a + c->a_offset[q];
+        for (i = 0; i < transp->state_num * transp->state_num; i++) {
+            log_a[i] = transp->prob[i] > 0 ? log(transp->prob[i]) : LZERO;
+        }
+        transp_band(transp, &c->band[2*q], &c->band[2*q+1]);
+    }
+
+    c->b = (double *)malloc(sizeof(double) * c->T * c->S);
+    c->mix = (double *)malloc(sizeof(double) * c->T * c->S * c->max_mix);
+    c->beta = (double *)malloc(sizeof(double) * c->T * c->S);
+    c->bent = (double *)malloc(sizeof(double) * (c->T + 1) * (c->Q + 1));
+    if (skip > 1) {
+        c->skip = skip;
+        c->hold = hold;
+        c->anchor = (double *)malloc(sizeof(double) * (c->T / skip + 1) * c->S);
+        c->anchor_set = (char *)calloc((c->T / skip + 1) * c->S, 1);
+    }
+
+    // Only the states of the transcription are scored
+    if (table != NULL) {
+        char *need = (char *)calloc(table->state_num + 1, 1);
+        for (q = 0; q < model_num; q++) {
+            for (j = 1; j < models[q]->state_num - 1; j++) {
+                need[models[q]->state[j]->index] = 1;
+            }
+        }
+        c->table = table;
+        c->comp = (float *)malloc(sizeof(float) * c->T * table->comp_num);
+        c->out = (float *)malloc(sizeof(float) * c->T * table->state_num);
+        score_frames(table, feat->data, c->T, need, c->comp, c->out);
+        free(need);
+    }
+}
+
+static void composite_free(Composite *c)
+{
+    free(c->offset);
+    free(c->a_offset);
+    free(c->band);
+    free(c->log_a);
+    free(c->b);
+    free(c->mix);
+    free(c->beta);
+    free(c->bent);
+    free(c->comp);
+    free(c->out);
+    free(c->anchor);
+    free(c->anchor_set);
+}
+
+/**
+ * @param mix receives the mixture terms if not NULL
+ * @return log b(o_t) of state st
+ */
+static double frame_score(const Composite *c, int t, const State *st, double *mix)
+{
+    const float *comp;
+    int m;
+
+    if (c->table == NULL) {
+        return state_log_prob(st, X(c, t), mix);
+    }
+    comp = c->comp + (size_t)t * c->table->comp_num + c->table->comp_offset[st->index];
+    for (m = 0; mix != NULL && m < st->mix_num; m++) {
+        mix[m] = comp[m];
+    }
+    return c->out[(size_t)t * c->table->state_num + st->index];
+}
+
+/**
+ * @return log b_s at computed frame a, scored once
+ */
+static double anchor_score(Composite *c, int a, int s, const State *st)
+{
+    size_t i = (size_t)(a / c->skip) * c->S + s;
+
+    if (!c->anchor_set[i]) {
+        c->anchor[i] = frame_score(c, a, st, NULL);
+        c->anchor_set[i] = 1;
+    }
+    return c->anchor[i];
+}
+
+/**
+ * Set B and MIX of composite state s, state st of its model, at frame t;
+ * with frame skipping B is what the decoder sees and MIX stays exact
+ */
+static void composite_score(Composite *c, int t, int s, const State *st)
+{
+    int t0, t1;
+    double w;
+
+    B(c, t, s) = frame_score(c, t, st, MIX(c, t, s));
+    if (c->skip > 1) {
+        w = skip_weight(t, c->T, c->skip, c->hold, &t0, &t1);
+        if (t == t0) {
+            c->anchor[(size_t)(t / c->skip) * c->S + s] = B(c, t, s);
+            c->anchor_set[(size_t)(t / c->skip) * c->S + s] = 1;
+        } else {
+            B(c, t, s) = (1 - w) * anchor_score(c, t0, s, st) + (w > 0 ? w * anchor_score(c, t1, s, st) : 0);
+        }
+    }
+}
+
+/**
+ * @return log sum of the mixture terms, log b_s(o_t) without frame skipping
+ */
+static double mix_total(const double *mix, int mix_num)
+{
+    int m;
+    double total = LZERO;
+
+    for (m = 0; m < mix_num; m++) {
+        total = log_add(total, mix[m]);
+    }
+    return total;
+}
+
+/**
+ * Beam-pruned backward pass. Only models lo-1 .. hi can be alive at frame
+ * t, where lo and hi are the first and last models alive at t+1.
+ * @param beam 0 for no pruning
+ * @return log P(O) at the entry of the first model
+ */
+static double backward(Composite *c, double beam)
+{
+    int q, s, t, i, j, lo, hi, first;
+    int Q = c->Q, T = c->T;
+
+    for (s = 0; s < T * c->S; s++) {
+        c->beta[s] = LZERO;
+    }
+    for (s = 0; s < (T + 1) * (Q + 1); s++) {
+        c->bent[s] = LZERO;
+    }
+
+    // No frame left: only the tee models in front of the end can be skipped
+    BENT(c, T, Q) = 0;
+    lo = hi = Q;
+    for (q = Q - 1; q >= 0; q--) {
+        const Hmm *hmm = c->models[q];
+        BENT(c, T, q) = log_mul(c->log_a[c->a_offset[q] + hmm->state_num - 1], BENT(c, T, q + 1));
+        if (BENT(c, T, q) <= LSMALL) {
+            break;
+        }
+        lo = q;
+    }
+
+    for (t = T - 1; t >= 0; t--) {
+        double best = LZERO;
+
+        if (hi > Q - 1) {
+            hi = Q - 1;
+        }
+        first = lo > 0 ? lo - 1 : 0;
+
+        for (q = hi; q >= first; q--) {
+            const Hmm *hmm = c->models[q];
+            const double *a = c->log_a + c->a_offset[q];
+            const int *band = c->band + 2 * q;
+            int N = hmm->state_num, o = c->offset[q] - 1;
+            double exit = BENT(c, t + 1, q + 1);
+
+            for (i = 1; i < N - 1; i++) {
+                double v = log_mul(a[i*N+N-1], exit);
+                if (t + 1 < T) {
+                    for (j = BAND_TO_FIRST(band, i); j <= BAND_TO_LAST(band, i, N); j++) {
+                        if (BETA(c, t + 1, o + j) > LSMALL && a[i*N+j] > LSMALL) {
+                            v = log_add(v, a[i*N+j] + B(c, t + 1, o + j) + BETA(c, t + 1, o + j));
+                        }
+                    }
+                }
+                BETA(c, t, o + i) = v;
+                if (v > best) {
+                    best = v;
+                }
+            }
+        }
+        if (best <= LSMALL) {
+            return LZERO;
+        }
+
+        // Prune, then evaluate the output probabilities of the survivors
+        for (s = c->offset[first]; beam > 0 && s < c->offset[hi + 1]; s++) {
+            if (BETA(c, t, s) < best - beam) {
+                BETA(c, t, s) = LZERO;
+            }
+        }
+        for (q = first; q <= hi; q++) {
+            const Hmm *hmm = c->models[q];
+            int o = c->offset[q] - 1;
+            for (j = 1; j < hmm->state_num - 1; j++) {
+                if (BETA(c, t, o + j) > LSMALL) {
+                    composite_score(c, t, o + j, hmm->state[j]);
+                }
+            }
+        }
+
+        // Entry of every model, through its first states or its tee
+        lo = Q;
+        for (q = hi; q >= 0; q--) {
+            const Hmm *hmm = c->models[q];
+            const double *a = c->log_a + c->a_offset[q];
+            int N = hmm->state_num, o = c->offset[q] - 1;
+            double v = log_mul(a[N-1], BENT(c, t, q + 1));
+            int alive = 0;
+
+            if (q >= first) {
+                for (j = 1; j < N - 1; j++) {
+                    if (BETA(c, t, o + j) > LSMALL) {
+                        alive = 1;
+                        if (a[j] > LSMALL) {
+                            v = log_add(v, a[j] + B(c, t, o + j) + BETA(c, t, o + j));
+                        }
+                    }
+                }
+            }
+            BENT(c, t, q) = v;
+            if (v > LSMALL || alive) {
+                lo = q;
+            } else if (q < first) {
+                break;
+            }
+        }
+        for (; hi > lo; hi--) {
+            int o = c->offset[hi];
+            if (BENT(c, t, hi) > LSMALL) {
+                break;
+            }
+            for (s = o; s < c->offset[hi + 1] && BETA(c, t, s) <= LSMALL; s++);
+            if (s < c->offset[hi + 1]) {
+                break;
+            }
+        }
+    }
+    return BENT(c, 0, 0);
+}
+
+/**
+ * Forward pass over the states that survived the backward pass, adding
+ * occupancies and transition counts to acc as it goes
+ */
+static void forward_accumulate(Composite *c, double prob, Accumulator *acc)
+{
+    int q, t, i, j;
+    int Q = c->Q, S = c->S, T = c->T;
+    double *alpha = (double *)malloc(sizeof(double) * S);
+    double *prev = (double *)malloc(sizeof(double) * S);
+    double *ent = (double *)malloc(sizeof(double) * (Q + 1));
+    double *ext = (double *)malloc(sizeof(double) * (Q + 1));
+    double *ext_prev = (double *)malloc(sizeof(double) * (Q + 1));
+    double *tmp;
+
+    for (q = 0; q < Q; q++) {
+        ext_prev[q] = LZERO;
+    }
+    for (t = 0; t <= T; t++) {
+        for (q = 0; q < Q; q++) {
+            const Hmm *hmm = c->models[q];
+            const double *a = c->log_a + c->a_offset[q];
+            const int *band = c->band + 2 * q;
+            double *trans = acc->trans_acc + acc->trans_offset[hmm->transp->index];
+            int N = hmm->state_num, o = c->offset[q] - 1;
+
+            // Entered after the previous model emitted frame t-1, or through its tee
+            if (q == 0) {
+                ent[q] = t == 0 ? 0 : LZERO;
+            } else {
+                ent[q] = log_add(ext_prev[q-1], log_mul(ent[q-1], c->log_a[c->a_offset[q-1] + c->models[q-1]->state_num - 1]));
+            }
+            if (ent[q] > LSMALL && a[N-1] > LSMALL) {
+                double lp = ent[q] + a[N-1] + BENT(c, t, q + 1) - prob;
+                if (lp > MIN_LOG_EXP) {
+                    trans[N-1] += exp(lp);
+                }
+            }
+            if (t == T) {
+                continue;
+            }
+
+            ext[q] = LZERO;
+            for (j = 1; j < N - 1; j++) {
+                double beta = BETA(c, t, o + j), v, occ;
+
+                alpha[o+j] = LZERO;
+                if (beta <= LSMALL) {
+                    continue;
+                }
+                v = log_mul(ent[q], a[j]);
+                if (t > 0) {
+                    for (i = BAND_FROM_FIRST(band, j); i <= BAND_FROM_LAST(band, j, N); i++) {
+                        if (prev[o+i] > LSMALL && a[i*N+j] > LSMALL) {
+                            v = log_add(v, prev[o+i] + a[i*N+j]);
+                        }
+                    }
+                }
+                if (v <= LSMALL) {
+                    continue;
+                }
+                v += B(c, t, o + j);
+                occ = v + beta - prob;
+                if (occ < -MIN_FWD_PROB) {
+                    continue;
+                }
+                alpha[o+j] = v;
+
+                acc_state(acc, hmm->state[j], X(c, t), exp(occ), MIX(c, t, o + j),
+                          c->skip > 1 ? mix_total(MIX(c, t, o + j), hmm->state[j]->mix_num) : B(c, t, o + j));
+                if (ent[q] > LSMALL && a[j] > LSMALL) {
+                    double lp = ent[q] + a[j] + B(c, t, o + j) + beta - prob;
+                    if (lp > MIN_LOG_EXP) {
+                        trans[j] += exp(lp);
+                    }
+                }
+                for (i = BAND_FROM_FIRST(band, j); t > 0 && i <= BAND_FROM_LAST(band, j, N); i++) {
+                    if (prev[o+i] > LSMALL && a[i*N+j] > LSMALL) {
+                        double lp = prev[o+i] + a[i*N+j] + B(c, t, o + j) + beta - prob;
+                        if (lp > MIN_LOG_EXP) {
+                            trans[i*N+j] += exp(lp);
+                        }
+                    }
+                }
+            }
+
+            for (i = 1; i < N - 1; i++) {
+                if (alpha[o+i] > LSMALL && a[i*N+N-1] > LSMALL) {
+                    double lp = alpha[o+i] + a[i*N+N-1];
+                    ext[q] = log_add(ext[q], lp);
+                    lp += BENT(c, t + 1, q + 1) - prob;
+                    if (lp > MIN_LOG_EXP) {
+                        trans[i*N+N-1] += exp(lp);
+                    }
+                }
+            }
+        }
+
+        tmp = prev;
+        prev = alpha;
+        alpha = tmp;
+        tmp = ext_prev;
+        ext_prev = ext;
+        ext = tmp;
+    }
+
+    acc->log_likelihood += prob;
+    acc->frame_num += T;
+    acc->utt_num++;
+
+    free(alpha);
+    free(prev);
+    free(ent);
+    free(ext);
+    free(ext_prev);
+}
+
+double embed_accumulate(Hmm **models, int model_num, const Feature *feat, const Pruning *prune,
+                        const ScoreTable *table, int skip, int hold, Accumulator *acc)
+{
+    Composite c;
+    double beam = prune != NULL ? prune->beam : 0, prob;
+
+    if (feat->frame_num == 0 || model_num == 0) {
+        return LZERO;
+    }
+    composite_init(&c, models, model_num, feat, table, skip, hold);
+    prob = backward(&c, beam);
+    while (prob <= LSMALL && beam > 0 && prune->inc > 0 && beam + prune->inc <= prune->limit) {
+        beam += prune->inc;
+        prob = backward(&c, beam);
+    }
+    if (prob > LSMALL) {
+        forward_accumulate(&c, prob, acc);
+    }
+    composite_free(&c);
+    return prob > LSMALL ? prob : LZERO;
+}
+
+int embed_data_init(EmbedData *data, const ModelSet *set, const Mlf *mlf, char **files, int file_num,
+                    const Archive *ar)
+{
+    int n, l, fail = 0;
+
+    memset(data, 0, sizeof(EmbedData));
+    data->utt_num = file_num;
+    data->files = files;
+    data->ar = ar;
+    data->model_num = (int *)calloc(file_num + 1, sizeof(int));
+    data->models = (Hmm ***)calloc(file_num + 1, sizeof(Hmm **));
+
+    for (n = 0; n < file_num; n++) {
+        const Transcription *tr = mlf_find(mlf, files[n]);
+        if (tr == NULL) {
+            fprintf(stderr, "%s: no transcription in the label file\n", files[n]);
+            fail = 1;
+            continue;
+        }
+        data->model_num[n] = tr->label_num;
+        data->models[n] = (Hmm **)malloc(sizeof(Hmm *) * (tr->label_num + 1));
+        for (l = 0; l < tr->label_num; l++) {
+            data->models[n][l] = modelset_find(set, tr->label[l]);
+            if (data->models[n][l] == NULL) {
+                fprintf(stderr, "%s: model %s not found\n", files[n], tr->label[l]);
+                fail = 1;
+            }
+        }
+    }
+    if (fail) {
+        embed_data_free(data);
+        return -1;
+    }
+    return 0;
+}
+
+void embed_data_free(EmbedData *data)
+{
+    int n;
+    for (n = 0; n < data->utt_num; n++) {
+        free(data->models[n]);
+    }
+    free(data->models);
+    free(data->model_num);
+    memset(data, 0, sizeof(EmbedData));
+}
+
+typedef struct {
+    const ModelSet *set;
+    const EmbedData *data;
+    const Pruning *prune;
+    const ScoreTable *table;
+    int id, thread_num;
+    Accumulator *acc;
+    int fail_num;
+} Worker;
+
+static void *worker(void *arg)
+{
+    Worker *w = (Worker *)arg;
+    const EmbedData *data = w->data;
+    int n;
+
+    for (n = w->id; n < data->utt_num; n += w->thread_num) {
+        Feature feat;
+
+        if (data->feat != NULL) {
+            feat = data->feat[n];
+        } else if (archive_load(data->ar, data->files[n], &feat) < 0) {
+            w->fail_num++;
+            continue;
+        }
+        if (feat.dim != w->set->vec_size) {
+            fprintf(stderr, "%s: dimension %d, models expect %d\n", data->files[n], feat.dim, w->set->vec_size);
+            w->fail_num++;
+        } else if (embed_accumulate(data->models[n], data->model_num[n], &feat, w->prune, w->table,
+                                   data->frame_skip, data->skip_hold, w->acc) <= LSMALL) {
+            fprintf(stderr, "%s: cannot be aligned within the beam, skipped\n", data->files[n]);
+            w->fail_num++;
+        }
+        if (data->feat == NULL) {
+            archive_release(data->ar, &feat);
+        }
+    }
+    return NULL;
+}
+
+int embed_pass(const ModelSet *set, const EmbedData *data, const Pruning *prune, int thread_num,
+               Accumulator *acc)
+{
+    pthread_t thread[MAX_THREAD];
+    Worker worker_arg[MAX_THREAD];
+    ScoreTable table;
+    int i, fail_num = 0;
+
+    if (thread_num > MAX_THREAD) {
+        thread_num = MAX_THREAD;
+    }
+    if (thread_num > data->utt_num) {
+        thread_num = data->utt_num;
+    }
+    if (thread_num < 1) {
+        thread_num = 1;
+    }
+
+    if (data->batch) {
+        score_table_init(&table, set);
+    }
+    acc_reset(acc);
+    for (i = 0; i < thread_num; i++) {
+        Worker *w = &worker_arg[i];
+        w->set = set;
+        w->data = data;
+        w->prune = prune;
+        w->table = data->batch ? &table : NULL;
+        w->id = i;
+        w->thread_num = thread_num;
+        w->fail_num = 0;
+        if (i == 0) {
+            w->acc = acc;
+        } else {
+            w->acc = (Accumulator *)malloc(sizeof(Accumulator));
+            acc_init(w->acc, set);
+            pthread_create(&thread[i], NULL, worker, w);
+        }
+    }
+    worker(&worker_arg[0]);
+
+    for (i = 0; i < thread_num; i++) {
+        if (i > 0) {
+            pthread_join(thread[i], NULL);
+            acc_merge(acc, worker_arg[i].acc);
+            acc_free(worker_arg[i].acc);
+            free(worker_arg[i].acc);
+        }
+        fail_num += worker_arg[i].fail_num;
+    }
+    if (data->batch) {
+        score_table_free(&table);
+    }
+    return fail_num;
+}
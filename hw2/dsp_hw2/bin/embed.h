@@ -0,0 +1,84 @@
+#ifndef EMBED_HEADER_
+#define EMBED_HEADER_
+
+#include "gmm.h"
+#include "mlf.h"
+#include "archive.h"
+#include "score.h"
+
+/**
+ * Embedded re-estimation like HERest: every utterance is aligned against
+ * the concatenation of the models of its transcription, joined through
+ * their non-emitting entry and exit states. Models whose entry state goes
+ * straight to the exit state (tee models such as sp after sil1.hed) may
+ * be skipped without consuming a frame.
+ *
+ * The backward pass is beam pruned like HERest -t f [i l]: at every frame,
+ * states whose beta is more than f below the best one are dropped, and
+ * the forward pass only visits the states that survived. If the utterance
+ * cannot be aligned within the beam, it is retried with the beam widened
+ * by i until it exceeds l.
+ */
+
+#ifndef MIN_FWD_PROB
+    #define MIN_FWD_PROB 10.0   // Forward pass drops alpha * beta / P below exp(-10) (HTK MINFORPROB)
+#endif
+
+typedef struct {
+    double beam;     // -t f, 0 disables pruning
+    double inc;      // -t f i l, beam increment after a failure
+    double limit;    // Widest beam tried
+} Pruning;
+
+/**
+ * Training data of an embedded pass: script entries with the model
+ * sequence of their transcriptions
+ */
+typedef struct {
+    int utt_num;
+    char **files;         // Shared with the caller
+    int *model_num;       // [utt_num]
+    Hmm ***models;        // [utt_num][model_num]
+    const Archive *ar;    // Features are read from here if not NULL
+    const Feature *feat;  // [utt_num] resident features, NULL to read them every pass
+    int batch;            // Score whole utterances as a matrix product (score.h)
+    int frame_skip;       // Align with output probabilities of every frame_skip-th frame, 0 or 1 for all
+    int skip_hold;        // ... held instead of interpolated in between (skip_weight)
+} EmbedData;
+
+/**
+ * Forward-backward of frames [0, T) of feat through the composite model,
+ * adding the expected counts to acc
+ * @param models model sequence of the transcription
+ * @param table scores every state of the model set for all frames up front
+ * if not NULL, otherwise states are scored where beta survived
+ * @param skip with skip > 1, the alignment sees the output probabilities a
+ * frame-skipping decoder (decode.h) computes, so the transitions learn the
+ * same durations; mixture posteriors still come from every frame
+ * @param hold see skip_weight
+ * @return log P(O | models), LZERO if O cannot be aligned at any beam (acc untouched)
+ */
+double embed_accumulate(Hmm **models, int model_num, const Feature *feat, const Pruning *prune,
+                        const ScoreTable *table, int skip, int hold, Accumulator *acc);
+
+/**
+ * Resolve the transcription of every script entry to models of set
+ * @return 0 on success, -1 if a transcription or a model is missing
+ * (reported on stderr)
+ */
+int embed_data_init(EmbedData *data, const ModelSet *set, const Mlf *mlf, char **files, int file_num,
+                    const Archive *ar);
+void embed_data_free(EmbedData *data);
+
+/**
+ * One re-estimation pass: utterance n goes to thread n % thread_num, each
+ * thread with its own accumulator, and the accumulators are summed in
+ * thread order, so results only depend on the number of threads. With
+ * data->batch, the score table is built from set at the start of the pass.
+ * @param acc initialized for set, receives the sum
+ * @return number of utterances skipped
+ */
+int embed_pass(const ModelSet *set, const EmbedData *data, const Pruning *prune, int thread_num,
+               Accumulator *acc);
+
+#endif
@@ -0,0 +1,59 @@
+#include "archive.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Pack the HTK files of a script into one feature archive, or list one
+ */
+int main(int argc, char *argv[])
+{
+    int i, file_num, flags = 0, list = 0;
+    const char *scp = NULL, *filename = argv[argc-1];
+    char **files;
+
+    if (argc < 3 || argv[argc-1][0] == '-') {
+        printf("Wrong argument format\n");
+        printf("Usage: ./feat_archive [-h] -S train.scp archive\n");
+        printf("       ./feat_archive -l archive\n");
+        exit(1);
+    }
+    for (i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "-h") == 0) {
+            flags |= ARCHIVE_HALF;
+        } else if (strcmp(argv[i], "-l") == 0) {
+            list = 1;
+        } else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc - 1) {
+            scp = argv[++i];
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    if (list) {
+        Archive ar;
+        if (archive_open(&ar, filename) < 0) {
+            exit(1);
+        }
+        for (i = 0; i < (int)ar.header->utt_num; i++) {
+            const ArchiveEntry *e = &ar.entry[i];
+            printf("%s %d %d\n", ar.names + e->name_offset, e->frame_num, e->dim);
+        }
+        printf("%u utterances, %s, %zu bytes\n", ar.header->utt_num,
+               (ar.header->flags & ARCHIVE_HALF) ? "half" : "float", ar.size);
+        archive_close(&ar);
+        return 0;
+    }
+
+    if (scp == NULL) {
+        printf("Missing -S feature list\n");
+        exit(1);
+    }
+    files = read_list(scp, 0, &file_num);
+    if (archive_build(filename, files, file_num, flags) < 0) {
+        exit(1);
+    }
+    printf("Packed %d utterances into %s\n", file_num, filename);
+    free_list(files, file_num);
+    return 0;
+}
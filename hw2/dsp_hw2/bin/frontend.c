@@ -0,0 +1,875 @@
+#include "frontend.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+
+#ifndef M_PI
+    #define M_PI 3.14159265358979323846
+#endif
+
+#define LOG_ZERO  (-1.0e10)    // log energy of an all-zero frame
+#define MIN_LARG  2.45e-308    // smallest argument taken to log
+
+void frontend_config_default(FrontEndConfig *cfg)
+{
+    // HTK defaults, except the target kind which HCopy requires anyway
+    cfg->target_kind = PK_MFCC;
+    cfg->target_rate = 100000.0;
+    cfg->window_size = 256000.0;
+    cfg->source_rate = 0;
+    cfg->use_hamming = 1;
+    cfg->pre_emph = 0.97f;
+    cfg->num_chans = 20;
+    cfg->num_ceps = 12;
+    cfg->cep_lifter = 22;
+    cfg->lo_freq = -1;
+    cfg->hi_freq = -1;
+    cfg->raw_energy = 1;
+    cfg->e_normalize = 1;
+    cfg->e_scale = 0.1f;
+    cfg->sil_floor = 50.0f;
+    cfg->delta_window = 2;
+    cfg->acc_window = 2;
+    cfg->zmean_source = 0;
+}
+
+static int parse_bool(const char *value)
+{
+    return toupper((unsigned char)value[0]) == 'T';
+}
+
+/**
+ * Strip leading and trailing blanks in place
+ */
+static char *trim(char *s)
+{
+    char *end;
+    while (isspace((unsigned char)*s)) {
+        s++;
+    }
+    end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+    return s;
+}
+
+int frontend_config_load(FrontEndConfig *cfg, const char *filename)
+{
+    char line[MAX_NAME * 4];
+    int line_no = 0, ret = 0;
+
+    FILE *fp = fopen(filename, "r");
+    if (fp == NULL) {
+        perror(filename);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char *key, *value, *p;
+
+        line_no++;
+        if ((p = strchr(line, '#')) != NULL) {
+            *p = '\0';
+        }
+        if ((p = strchr(line, '=')) == NULL) {
+            continue;
+        }
+        *p = '\0';
+        key = trim(line);
+        value = trim(p + 1);
+        // "HPARM: TARGETKIND = ..." style module prefixes
+        if ((p = strchr(key, ':')) != NULL) {
+            key = trim(p + 1);
+        }
+
+        if (strcasecmp(key, "SOURCEFORMAT") == 0) {
+            if (strcasecmp(value, "WAV") != 0) {
+                fprintf(stderr, "%s:%d: only WAV sources are supported\n", filename, line_no);
+                ret = -1;
+            }
+        } else if (strcasecmp(key, "TARGETKIND") == 0) {
+            cfg->target_kind = parm_kind_parse(value);
+            if ((cfg->target_kind & PK_BASEMASK) != PK_MFCC || (cfg->target_kind & (PK_C | PK_K))) {
+                fprintf(stderr, "%s:%d: unsupported target kind %s\n", filename, line_no, value);
+                ret = -1;
+            }
+        } else if (strcasecmp(key, "TARGETRATE") == 0) {
+            cfg->target_rate = atof(value);
+        } else if (strcasecmp(key, "WINDOWSIZE") == 0) {
+            cfg->window_size = atof(value);
+        } else if (strcasecmp(key, "SOURCERATE") == 0) {
+            cfg->source_rate = atof(value);
+        } else if (strcasecmp(key, "USEHAMMING") == 0) {
+            cfg->use_hamming = parse_bool(value);
+        } else if (strcasecmp(key, "PREEMCOEF") == 0) {
+            cfg->pre_emph = (float)atof(value);
+        } else if (strcasecmp(key, "NUMCHANS") == 0) {
+            cfg->num_chans = atoi(value);
+        } else if (strcasecmp(key, "NUMCEPS") == 0) {
+            cfg->num_ceps = atoi(value);
+        } else if (strcasecmp(key, "CEPLIFTER") == 0) {
+            cfg->cep_lifter = atoi(value);
+        } else if (strcasecmp(key, "LOFREQ") == 0) {
+            cfg->lo_freq = (float)atof(value);
+        } else if (strcasecmp(key, "HIFREQ") == 0) {
+            cfg->hi_freq = (float)atof(value);
+        } else if (strcasecmp(key, "RAWENERGY") == 0) {
+            cfg->raw_energy = parse_bool(value);
+        } else if (strcasecmp(key, "ENORMALISE") == 0 || strcasecmp(key, "ENORMALIZE") == 0) {
+            cfg->e_normalize = parse_bool(value);
+        } else if (strcasecmp(key, "ESCALE") == 0) {
+            cfg->e_scale = (float)atof(value);
+        } else if (strcasecmp(key, "SILFLOOR") == 0) {
+            cfg->sil_floor = (float)atof(value);
+        } else if (strcasecmp(key, "DELTAWINDOW") == 0) {
+            cfg->delta_window = atoi(value);
+        } else if (strcasecmp(key, "ACCWINDOW") == 0) {
+            cfg->acc_window = atoi(value);
+        } else if (strcasecmp(key, "ZMEANSOURCE") == 0) {
+            cfg->zmean_source = parse_bool(value);
+        } else if (strcasecmp(key, "SAVECOMPRESSED") == 0 || strcasecmp(key, "SAVEWITHCRC") == 0) {
+            if (parse_bool(value)) {
+                fprintf(stderr, "%s:%d: %s is not supported\n", filename, line_no, key);
+                ret = -1;
+            }
+        } else if (strcasecmp(key, "NATURALREADORDER") == 0) {
+            // WAV data is little-endian whatever the setting
+        } else if (strcasecmp(key, "NATURALWRITEORDER") == 0) {
+            if (!parse_bool(value)) {
+                fprintf(stderr, "%s:%d: parameter files are written in machine byte order\n", filename, line_no);
+            }
+        } else {
+            fprintf(stderr, "%s:%d: ignoring %s\n", filename, line_no, key);
+        }
+    }
+    fclose(fp);
+
+    if (cfg->num_chans < 1 || cfg->num_chans > MAX_CHAN || cfg->num_ceps < 1 || cfg->num_ceps > cfg->num_chans) {
+        fprintf(stderr, "%s: need 1 <= NUMCEPS <= NUMCHANS <= %d\n", filename, MAX_CHAN);
+        ret = -1;
+    }
+    return ret;
+}
+
+static double mel(double freq)
+{
+    return 1127.0 * log(1.0 + freq / 700.0);
+}
+
+int frontend_init(FrontEnd *fe, const FrontEndConfig *cfg, int samp_period)
+{
+    int i, j, k, chan, half;
+    int kind = cfg->target_kind;
+    double fs, mel_lo, mel_hi, bin_hz;
+    double center[MAX_CHAN + 2];
+    int bin_lo, bin_hi;
+
+    memset(fe, 0, sizeof(FrontEnd));
+    fe->cfg = *cfg;
+    fe->samp_period = cfg->source_rate > 0 ? (int)cfg->source_rate : samp_period;
+    fe->frame_size = (int)(cfg->window_size / fe->samp_period);
+    fe->frame_shift = (int)(cfg->target_rate / fe->samp_period);
+    if (fe->frame_size < 2 || fe->frame_shift < 1) {
+        fprintf(stderr, "WINDOWSIZE and TARGETRATE must span at least 2 and 1 samples\n");
+        return -1;
+    }
+    if ((kind & PK_N) && !((kind & PK_E) && (kind & PK_D))) {
+        fprintf(stderr, "_N needs _E and _D\n");
+        return -1;
+    }
+
+    for (fe->fft_size = 2; fe->fft_size < fe->frame_size; fe->fft_size *= 2) {
+    }
+    half = fe->fft_size / 2;
+
+    fe->static_dim = cfg->num_ceps + ((kind & PK_0) != 0) + ((kind & PK_E) != 0);
+    fe->dim = fe->static_dim * (1 + ((kind & PK_D) != 0) + ((kind & PK_A) != 0)) - ((kind & PK_N) != 0);
+
+    if (cfg->use_hamming) {
+        fe->window = (float *)malloc(sizeof(float) * fe->frame_size);
+        for (i = 0; i < fe->frame_size; i++) {
+            fe->window[i] = (float)(0.54 - 0.46 * cos(2 * M_PI * i / (fe->frame_size - 1)));
+        }
+    }
+    fe->lifter = (float *)malloc(sizeof(float) * cfg->num_ceps);
+    for (j = 0; j < cfg->num_ceps; j++) {
+        int L = cfg->cep_lifter;
+        fe->lifter[j] = L > 0 ? (float)(1.0 + L / 2.0 * sin(M_PI * (j + 1) / L)) : 1.0f;
+    }
+    fe->dct = (float *)malloc(sizeof(float) * (cfg->num_ceps + 1) * cfg->num_chans);
+    for (j = 0; j <= cfg->num_ceps; j++) {
+        for (k = 0; k < cfg->num_chans; k++) {
+            fe->dct[j*cfg->num_chans+k] = (float)(sqrt(2.0 / cfg->num_chans) * \
+                                                  cos(M_PI * j / cfg->num_chans * (k + 0.5)));
+        }
+    }
+
+    // Mel filterbank over FFT bins 1 .. fft_size/2 - 1 (no DC, no Nyquist),
+    // channel centres equally spaced in mel, like HTK's InitFBank
+    fs = 1.0e7 / fe->samp_period;
+    bin_hz = fs / fe->fft_size;
+    mel_lo = cfg->lo_freq >= 0 ? mel(cfg->lo_freq) : 0;
+    mel_hi = cfg->hi_freq >= 0 ? mel(cfg->hi_freq) : mel(fs / 2);
+    bin_lo = cfg->lo_freq >= 0 ? (int)(cfg->lo_freq / bin_hz + 1.5) : 1;
+    bin_hi = cfg->hi_freq >= 0 ? (int)(cfg->hi_freq / bin_hz - 0.5) : half - 1;
+    if (bin_hi > half - 1) {
+        bin_hi = half - 1;
+    }
+    for (chan = 1; chan <= cfg->num_chans + 1; chan++) {
+        center[chan] = (double)chan / (cfg->num_chans + 1) * (mel_hi - mel_lo) + mel_lo;
+    }
+    center[0] = mel_lo;
+
+    fe->lo_chan = (int *)malloc(sizeof(int) * half);
+    fe->lo_weight = (float *)malloc(sizeof(float) * half);
+    for (k = 0, chan = 1; k < half; k++) {
+        double mel_k = mel(k * bin_hz);
+        if (k < bin_lo || k > bin_hi) {
+            fe->lo_chan[k] = -1;
+            fe->lo_weight[k] = 0;
+            continue;
+        }
+        while (chan <= cfg->num_chans + 1 && center[chan] < mel_k) {
+            chan++;
+        }
+        fe->lo_chan[k] = chan - 1;
+        fe->lo_weight[k] = (float)((center[chan] - mel_k) / (center[chan] - center[chan-1]));
+    }
+
+    // Twiddles of the full size; the half-size complex FFT uses every other one
+    fe->twiddle = (float *)malloc(sizeof(float) * fe->fft_size);
+    for (k = 0; k < half; k++) {
+        fe->twiddle[2*k] = (float)cos(2 * M_PI * k / fe->fft_size);
+        fe->twiddle[2*k+1] = (float)-sin(2 * M_PI * k / fe->fft_size);
+    }
+    fe->bit_reverse = (int *)malloc(sizeof(int) * half);
+    for (k = 0; k < half; k++) {
+        int r = 0;
+        for (i = 1; i < half; i <<= 1) {
+            r = (r << 1) | ((k & i) != 0);
+        }
+        fe->bit_reverse[k] = r;
+    }
+    return 0;
+}
+
+void frontend_free(FrontEnd *fe)
+{
+    free(fe->window);
+    free(fe->lifter);
+    free(fe->dct);
+    free(fe->lo_chan);
+    free(fe->lo_weight);
+    free(fe->twiddle);
+    free(fe->bit_reverse);
+    memset(fe, 0, sizeof(FrontEnd));
+}
+
+void frontend_work_init(FrontEndWork *work, const FrontEnd *fe)
+{
+    work->frame = (float *)malloc(sizeof(float) * (fe->fft_size + 2));
+    work->fbank = (float *)malloc(sizeof(float) * (fe->cfg.num_chans + 2));
+}
+
+void frontend_work_free(FrontEndWork *work)
+{
+    free(work->frame);
+    free(work->fbank);
+}
+
+int frontend_frame_num(const FrontEnd *fe, int n)
+{
+    return n < fe->frame_size ? 0 : (n - fe->frame_size) / fe->frame_shift + 1;
+}
+
+/**
+ * In-place radix-2 FFT of fft_size/2 complex points (interleaved re, im)
+ */
+static void fft_complex(const FrontEnd *fe, float *x)
+{
+    int i, j, len, n = fe->fft_size / 2;
+
+    for (i = 0; i < n; i++) {
+        j = fe->bit_reverse[i];
+        if (i < j) {
+            float re = x[2*i], im = x[2*i+1];
+            x[2*i] = x[2*j];
+            x[2*i+1] = x[2*j+1];
+            x[2*j] = re;
+            x[2*j+1] = im;
+        }
+    }
+    for (len = 2; len <= n; len <<= 1) {
+        int half = len / 2, step = fe->fft_size / len;
+        for (i = 0; i < n; i += len) {
+            float *a = x + 2 * i, *b = x + 2 * (i + half);
+            // Independent butterflies, which the compiler vectorizes
+            for (j = 0; j < half; j++) {
+                float wr = fe->twiddle[2*j*step], wi = fe->twiddle[2*j*step+1];
+                float br = b[2*j] * wr - b[2*j+1] * wi;
+                float bi = b[2*j] * wi + b[2*j+1] * wr;
+                b[2*j] = a[2*j] - br;
+                b[2*j+1] = a[2*j+1] - bi;
+                a[2*j] += br;
+                a[2*j+1] += bi;
+            }
+        }
+    }
+}
+
+/**
+ * Magnitude spectrum of fft_size real samples: packs even and odd samples
+ * into a half-size complex FFT, then separates the two halves.
+ * @param x fft_size samples, overwritten
+ * @param mag receives |X[k]| for k = 0 .. fft_size/2 - 1
+ */
+static void magnitude_spectrum(const FrontEnd *fe, float *x, float *mag)
+{
+    int k, n = fe->fft_size / 2;
+
+    fft_complex(fe, x);
+    mag[0] = fabsf(x[0] + x[1]);
+    for (k = 1; k < n; k++) {
+        float zr = x[2*k], zi = x[2*k+1];
+        float cr = x[2*(n-k)], ci = -x[2*(n-k)+1];
+        float er = 0.5f * (zr + cr), ei = 0.5f * (zi + ci);
+        float or_ = 0.5f * (zi - ci), oi = -0.5f * (zr - cr);
+        float wr = fe->twiddle[2*k], wi = fe->twiddle[2*k+1];
+        float re = er + wr * or_ - wi * oi;
+        float im = ei + wr * oi + wi * or_;
+        mag[k] = sqrtf(re * re + im * im);
+    }
+}
+
+void frontend_static(const FrontEnd *fe, FrontEndWork *work, const float *samples, float *out)
+{
+    int i, j, k;
+    int n = fe->frame_size, chans = fe->cfg.num_chans, ceps = fe->cfg.num_ceps;
+    int kind = fe->cfg.target_kind;
+    float *x = work->frame, *fbank = work->fbank;
+    float mag[fe->fft_size / 2];
+    double energy = 0;
+
+    memcpy(x, samples, sizeof(float) * n);
+    if (fe->cfg.zmean_source) {
+        double mean = 0;
+        for (i = 0; i < n; i++) {
+            mean += x[i];
+        }
+        mean /= n;
+        for (i = 0; i < n; i++) {
+            x[i] -= (float)mean;
+        }
+    }
+    if (fe->cfg.raw_energy) {
+        for (i = 0; i < n; i++) {
+            energy += (double)x[i] * x[i];
+        }
+    }
+
+    for (i = n - 1; i > 0; i--) {
+        x[i] -= fe->cfg.pre_emph * x[i-1];
+    }
+    x[0] *= 1 - fe->cfg.pre_emph;
+    if (fe->window != NULL) {
+        for (i = 0; i < n; i++) {
+            x[i] *= fe->window[i];
+        }
+    }
+    if (!fe->cfg.raw_energy) {
+        for (i = 0; i < n; i++) {
+            energy += (double)x[i] * x[i];
+        }
+    }
+    memset(x + n, 0, sizeof(float) * (fe->fft_size - n));
+
+    magnitude_spectrum(fe, x, mag);
+    memset(fbank, 0, sizeof(float) * (chans + 2));
+    for (k = 0; k < fe->fft_size / 2; k++) {
+        int chan = fe->lo_chan[k];
+        float lo;
+        if (chan < 0) {
+            continue;
+        }
+        lo = fe->lo_weight[k] * mag[k];
+        fbank[chan] += lo;
+        fbank[chan+1] += mag[k] - lo;
+    }
+    for (k = 1; k <= chans; k++) {
+        fbank[k] = logf(fbank[k] < MEL_FLOOR ? (float)MEL_FLOOR : fbank[k]);
+    }
+
+    for (j = 1; j <= ceps; j++) {
+        const float *row = fe->dct + j * chans;
+        float c = 0;
+        for (k = 0; k < chans; k++) {
+            c += row[k] * fbank[k+1];
+        }
+        out[j-1] = c * fe->lifter[j-1];
+    }
+    i = ceps;
+    if (kind & PK_0) {
+        float c0 = 0;
+        for (k = 0; k < chans; k++) {
+            c0 += fe->dct[k] * fbank[k+1];
+        }
+        out[i++] = c0;
+    }
+    if (kind & PK_E) {
+        out[i++] = energy < MIN_LARG ? (float)LOG_ZERO : (float)log(energy);
+    }
+}
+
+void frontend_normalize_energy(const FrontEndConfig *cfg, float *data, int frame_num, int dim, int col)
+{
+    int t;
+    float max = (float)LOG_ZERO, min;
+
+    for (t = 0; t < frame_num; t++) {
+        if (data[t*dim+col] > max) {
+            max = data[t*dim+col];
+        }
+    }
+    min = max - (float)(cfg->sil_floor * log(10.0) / 10.0);
+    for (t = 0; t < frame_num; t++) {
+        float e = data[t*dim+col];
+        if (e < min) {
+            e = min;
+        }
+        data[t*dim+col] = 1.0f - (max - e) * cfg->e_scale;
+    }
+}
+
+void frontend_deltas(float *data, int frame_num, int dim, int src, int dst, int width, int window)
+{
+    int t, d, k;
+    float norm = 0;
+
+    for (d = 1; d <= window; d++) {
+        norm += 2.0f * d * d;
+    }
+    for (t = 0; t < frame_num; t++) {
+        float *out = data + (size_t)t * dim + dst;
+        for (k = 0; k < width; k++) {
+            out[k] = 0;
+        }
+        for (d = 1; d <= window; d++) {
+            int ahead = t + d < frame_num ? t + d : frame_num - 1;
+            int back = t - d >= 0 ? t - d : 0;
+            const float *a = data + (size_t)ahead * dim + src;
+            const float *b = data + (size_t)back * dim + src;
+            for (k = 0; k < width; k++) {
+                out[k] += d * (a[k] - b[k]);
+            }
+        }
+        for (k = 0; k < width; k++) {
+            out[k] /= norm;
+        }
+    }
+}
+
+int frontend_process(const FrontEnd *fe, FrontEndWork *work, const float *samples, int n, Feature *feat)
+{
+    int t, k;
+    int kind = fe->cfg.target_kind, base = fe->static_dim;
+    int full = base * (1 + ((kind & PK_D) != 0) + ((kind & PK_A) != 0));
+    int T = frontend_frame_num(fe, n);
+    float *data;
+
+    if (T == 0) {
+        return -1;
+    }
+    data = (float *)malloc(sizeof(float) * T * full);
+    for (t = 0; t < T; t++) {
+        frontend_static(fe, work, samples + (size_t)t * fe->frame_shift, data + (size_t)t * full);
+    }
+
+    if ((kind & PK_E) && fe->cfg.e_normalize) {
+        frontend_normalize_energy(&fe->cfg, data, T, full, base - 1);
+    }
+    if (kind & PK_Z) {
+        // Cepstral mean subtraction; normalized energy is left alone
+        int width = fe->cfg.num_ceps + ((kind & PK_0) != 0);
+        for (k = 0; k < width; k++) {
+            double mean = 0;
+            for (t = 0; t < T; t++) {
+                mean += data[t*full+k];
+            }
+            mean /= T;
+            for (t = 0; t < T; t++) {
+                data[t*full+k] -= (float)mean;
+            }
+        }
+    }
+    if (kind & PK_D) {
+        frontend_deltas(data, T, full, 0, base, base, fe->cfg.delta_window);
+        if (kind & PK_A) {
+            frontend_deltas(data, T, full, base, 2 * base, base, fe->cfg.acc_window);
+        }
+    }
+    if (kind & PK_N) {
+        // Drop the static energy, keeping its derivatives
+        for (t = 0; t < T; t++) {
+            const float *src = data + (size_t)t * full;
+            float *dst = data + (size_t)t * (full - 1);
+            memmove(dst, src, sizeof(float) * (base - 1));
+            memmove(dst + base - 1, src + base, sizeof(float) * (full - base));
+        }
+    }
+
+    feat->frame_num = T;
+    feat->dim = fe->dim;
+    feat->samp_period = (int)fe->cfg.target_rate;
+    feat->parm_kind = (short)kind;
+    feat->data = data;
+    return 0;
+}
+
+int frontend_vad(const Feature *feat, int pad, int *keep)
+{
+    int kind = feat->parm_kind, T = feat->frame_num;
+    int base = feat->dim / (1 + ((kind & PK_D) != 0) + ((kind & PK_A) != 0));
+    double mu[2], var[2], w[2], spread;
+    char *speech;
+    int t, a, b, it, n = 0;
+
+    if ((kind & PK_N) || !(kind & (PK_E | PK_0))) {
+        fprintf(stderr, "Voice activity detection needs _E or _0 features\n");
+        return -1;
+    }
+
+    // Classes start at the extremes, as wide as half the range
+    mu[0] = mu[1] = feat->data[base-1];
+    for (t = 0; t < T; t++) {
+        double e = feat->data[(size_t)t*feat->dim+base-1];
+        mu[0] = e < mu[0] ? e : mu[0];
+        mu[1] = e > mu[1] ? e : mu[1];
+    }
+    spread = (mu[1] - mu[0]) / 2;
+    var[0] = var[1] = spread * spread + 1e-6;
+    w[0] = w[1] = 0.5;
+    for (it = 0; it < VAD_ITER; it++) {
+        double occ[2] = {0, 0}, sum[2] = {0, 0}, sq[2] = {0, 0};
+        for (t = 0; t < T; t++) {
+            double e = feat->data[(size_t)t*feat->dim+base-1], p[2], post;
+            for (a = 0; a < 2; a++) {
+                p[a] = w[a] / sqrt(var[a]) * exp(-0.5 * (e - mu[a]) * (e - mu[a]) / var[a]);
+            }
+            post = p[0] + p[1] > 0 ? p[1] / (p[0] + p[1]) : e > (mu[0] + mu[1]) / 2;
+            occ[0] += 1 - post;
+            occ[1] += post;
+            sum[0] += (1 - post) * e;
+            sum[1] += post * e;
+            sq[0] += (1 - post) * e * e;
+            sq[1] += post * e * e;
+        }
+        for (a = 0; a < 2; a++) {
+            if (occ[a] < 1) {
+                break;
+            }
+            mu[a] = sum[a] / occ[a];
+            var[a] = sq[a] / occ[a] - mu[a] * mu[a] + 1e-6;
+            w[a] = occ[a] / T;
+        }
+        if (a < 2) {
+            break;
+        }
+    }
+
+    if (mu[1] <= mu[0] || (mu[1] - mu[0]) * (mu[1] - mu[0]) < VAD_MIN_FISHER * (var[0] + var[1])) {
+        for (t = 0; t < T; t++) {
+            keep[t] = t;
+        }
+        return T;
+    }
+
+    speech = (char *)malloc(T);
+    for (t = 0; t < T; t++) {
+        double e = feat->data[(size_t)t*feat->dim+base-1];
+        double d0 = (e - mu[0]) * (e - mu[0]) / var[0] + log(var[0]) - 2 * log(w[0]);
+        double d1 = (e - mu[1]) * (e - mu[1]) / var[1] + log(var[1]) - 2 * log(w[1]);
+        speech[t] = d1 < d0 || e > mu[1];
+    }
+    for (a = 0; a < T; a = b) {
+        for (b = a; b < T && speech[b] == speech[a]; b++);
+        if (speech[a] && b - a < VAD_MIN_SPEECH) {
+            memset(speech + a, 0, b - a);
+        }
+    }
+    for (a = 0; a < T; a = b) {
+        for (b = a; b < T && speech[b] == speech[a]; b++);
+        if (!speech[a] && b - a - 2 * pad >= VAD_MIN_SIL) {
+            for (t = a; t < a + pad; t++) {
+                keep[n++] = t;
+            }
+            for (t = b - pad; t < b; t++) {
+                keep[n++] = t;
+            }
+        } else {
+            for (t = a; t < b; t++) {
+                keep[n++] = t;
+            }
+        }
+    }
+    free(speech);
+    return n;
+}
+
+int frontend_vad_map(const int *keep, int kept_num, int frame_num, int t)
+{
+    if (t <= 0) {
+        return 0;
+    }
+    return t >= kept_num ? frame_num : keep[t-1] + 1;
+}
+
+int frontend_stream_lookahead(const FrontEnd *fe)
+{
+    int kind = fe->cfg.target_kind;
+    return ((kind & PK_D) ? fe->cfg.delta_window : 0) + ((kind & PK_A) ? fe->cfg.acc_window : 0);
+}
+
+void frontend_stream_init(FrontEndStream *st, const FrontEnd *fe)
+{
+    int kind = fe->cfg.target_kind;
+
+    memset(st, 0, sizeof(FrontEndStream));
+    st->fe = fe;
+    frontend_work_init(&st->work, fe);
+    st->pcm_cap = fe->frame_size * 2;
+    st->pcm = (float *)malloc(sizeof(float) * st->pcm_cap);
+
+    // Oldest row still read: statics 2 * DELTAWINDOW back for a delta,
+    // deltas 2 * ACCWINDOW back for an acceleration
+    st->ring_size = 2 * frontend_stream_lookahead(fe) + 1;
+    st->row_dim = fe->static_dim * (1 + ((kind & PK_D) != 0) + ((kind & PK_A) != 0));
+    st->ring = (float *)calloc((size_t)st->ring_size * st->row_dim, sizeof(float));
+    st->vector = (float *)malloc(sizeof(float) * fe->dim);
+    st->mean = (double *)calloc(fe->static_dim, sizeof(double));
+    frontend_stream_reset(st);
+}
+
+void frontend_stream_free(FrontEndStream *st)
+{
+    frontend_work_free(&st->work);
+    free(st->pcm);
+    free(st->ring);
+    free(st->vector);
+    free(st->mean);
+    memset(st, 0, sizeof(FrontEndStream));
+}
+
+void frontend_stream_reset(FrontEndStream *st)
+{
+    st->pcm_len = 0;
+    st->static_num = st->delta_num = st->acc_num = st->out_num = 0;
+    st->max_energy = (float)LOG_ZERO;
+    memset(st->mean, 0, sizeof(double) * st->fe->static_dim);
+}
+
+static float *ring_row(const FrontEndStream *st, int t)
+{
+    return st->ring + (size_t)(t % st->ring_size) * st->row_dim;
+}
+
+/**
+ * Regression over ring rows, frame indices clamped to [0, last]
+ */
+static void stream_delta(const FrontEndStream *st, int t, int last, int src, int dst, int window)
+{
+    int d, k, width = st->fe->static_dim;
+    float *out = ring_row(st, t) + dst;
+    float norm = 0;
+
+    for (k = 0; k < width; k++) {
+        out[k] = 0;
+    }
+    for (d = 1; d <= window; d++) {
+        const float *a = ring_row(st, t + d < last ? t + d : last) + src;
+        const float *b = ring_row(st, t - d > 0 ? t - d : 0) + src;
+        for (k = 0; k < width; k++) {
+            out[k] += d * (a[k] - b[k]);
+        }
+        norm += 2.0f * d * d;
+    }
+    for (k = 0; k < width; k++) {
+        out[k] /= norm;
+    }
+}
+
+/**
+ * Statics of the next frame with causal energy and mean normalization
+ */
+static void stream_static(FrontEndStream *st, const float *samples)
+{
+    const FrontEnd *fe = st->fe;
+    int k, kind = fe->cfg.target_kind;
+    float *row = ring_row(st, st->static_num);
+
+    frontend_static(fe, &st->work, samples, row);
+    if ((kind & PK_E) && fe->cfg.e_normalize) {
+        float *e = row + fe->static_dim - 1;
+        float min;
+        if (*e > st->max_energy) {
+            st->max_energy = *e;
+        }
+        min = st->max_energy - (float)(fe->cfg.sil_floor * log(10.0) / 10.0);
+        *e = 1.0f - (st->max_energy - (*e < min ? min : *e)) * fe->cfg.e_scale;
+    }
+    if (kind & PK_Z) {
+        int width = fe->cfg.num_ceps + ((kind & PK_0) != 0);
+        int n = st->static_num < STREAM_MEAN_FRAMES ? st->static_num + 1 : STREAM_MEAN_FRAMES;
+        for (k = 0; k < width; k++) {
+            st->mean[k] += (row[k] - st->mean[k]) / n;
+            row[k] -= (float)st->mean[k];
+        }
+    }
+    st->static_num++;
+}
+
+/**
+ * Compute every delta and acceleration whose window is available (all of
+ * them when final) and emit the finished vectors
+ */
+static int stream_advance(FrontEndStream *st, int final, FrameSink sink, void *arg)
+{
+    const FrontEnd *fe = st->fe;
+    int kind = fe->cfg.target_kind, base = fe->static_dim;
+    int dw = (kind & PK_D) ? fe->cfg.delta_window : 0;
+    int aw = (kind & PK_A) ? fe->cfg.acc_window : 0;
+    int emitted = 0;
+
+    while (st->delta_num < st->static_num && (final || st->delta_num + dw < st->static_num)) {
+        if (kind & PK_D) {
+            stream_delta(st, st->delta_num, st->static_num - 1, 0, base, dw);
+        }
+        st->delta_num++;
+    }
+    while (st->acc_num < st->delta_num && (final || st->acc_num + aw < st->delta_num)) {
+        if (kind & PK_A) {
+            stream_delta(st, st->acc_num, st->delta_num - 1, base, 2 * base, aw);
+        }
+        st->acc_num++;
+    }
+    while (st->out_num < st->acc_num) {
+        const float *row = ring_row(st, st->out_num);
+        if (kind & PK_N) {
+            memcpy(st->vector, row, sizeof(float) * (base - 1));
+            memcpy(st->vector + base - 1, row + base, sizeof(float) * (st->row_dim - base));
+        } else {
+            memcpy(st->vector, row, sizeof(float) * st->row_dim);
+        }
+        sink(arg, st->vector);
+        st->out_num++;
+        emitted++;
+    }
+    return emitted;
+}
+
+int frontend_stream_push(FrontEndStream *st, const float *samples, int n, FrameSink sink, void *arg)
+{
+    const FrontEnd *fe = st->fe;
+    int offset = 0, emitted = 0;
+
+    if (st->pcm_len + n > st->pcm_cap) {
+        st->pcm_cap = st->pcm_len + n;
+        st->pcm = (float *)realloc(st->pcm, sizeof(float) * st->pcm_cap);
+    }
+    memcpy(st->pcm + st->pcm_len, samples, sizeof(float) * n);
+    st->pcm_len += n;
+
+    while (st->pcm_len - offset >= fe->frame_size) {
+        stream_static(st, st->pcm + offset);
+        offset += fe->frame_shift;
+        emitted += stream_advance(st, 0, sink, arg);
+    }
+    // Keep the overlap with the next frame (assumes the shift is no longer
+    // than the window, as in any usual setup)
+    if (offset > st->pcm_len) {
+        offset = st->pcm_len;
+    }
+    memmove(st->pcm, st->pcm + offset, sizeof(float) * (st->pcm_len - offset));
+    st->pcm_len -= offset;
+    return emitted;
+}
+
+int frontend_stream_finish(FrontEndStream *st, FrameSink sink, void *arg)
+{
+    int emitted = stream_advance(st, 1, sink, arg);
+    frontend_stream_reset(st);
+    return emitted;
+}
+
+static uint32_t get_le32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t get_le16(const unsigned char *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+int wav_read(const char *filename, float **samples, int *samp_period)
+{
+    unsigned char header[12], chunk[8], fmt[16];
+    int channels = 0, bits = 0, rate = 0, n, i;
+    unsigned char *raw;
+
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL) {
+        perror(filename);
+        return -1;
+    }
+    if (fread(header, 1, 12, fp) != 12 || memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) {
+        fprintf(stderr, "%s: not a RIFF WAVE file\n", filename);
+        fclose(fp);
+        return -1;
+    }
+
+    // Walk the chunks up to "data"; "fmt " must come first
+    while (fread(chunk, 1, 8, fp) == 8) {
+        uint32_t size = get_le32(chunk + 4);
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            if (size < 16 || fread(fmt, 1, 16, fp) != 16) {
+                break;
+            }
+            if (get_le16(fmt) != 1) {
+                fprintf(stderr, "%s: only PCM data is supported\n", filename);
+                fclose(fp);
+                return -1;
+            }
+            channels = get_le16(fmt + 2);
+            rate = (int)get_le32(fmt + 4);
+            bits = get_le16(fmt + 14);
+            fseek(fp, (long)(size - 16 + (size & 1)), SEEK_CUR);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (channels < 1 || bits != 16 || rate <= 0) {
+                fprintf(stderr, "%s: need 16-bit PCM with a fmt chunk before data\n", filename);
+                fclose(fp);
+                return -1;
+            }
+            n = (int)(size / (2 * channels));
+            raw = (unsigned char *)malloc((size_t)n * 2 * channels + 1);
+            n = (int)(fread(raw, 2 * channels, n, fp));
+            fclose(fp);
+
+            *samples = (float *)malloc(sizeof(float) * n + 1);
+            for (i = 0; i < n; i++) {
+                (*samples)[i] = (float)(int16_t)get_le16(raw + (size_t)i * 2 * channels);
+            }
+            free(raw);
+            *samp_period = (int)(1.0e7 / rate + 0.5);
+            return n;
+        } else {
+            fseek(fp, (long)(size + (size & 1)), SEEK_CUR);
+        }
+    }
+    fprintf(stderr, "%s: no data chunk\n", filename);
+    fclose(fp);
+    return -1;
+}
@@ -0,0 +1,232 @@
+#ifndef FRONTEND_HEADER_
+#define FRONTEND_HEADER_
+
+#include "htk.h"
+
+/**
+ * MFCC front end following HTK's HSigP/HParm, configured like HCopy
+ * (see lib/hcopy.cfg). Per frame: raw log energy, pre-emphasis, Hamming
+ * window, magnitude spectrum, triangular mel filterbank, log, DCT and
+ * cepstral liftering. Per utterance: energy normalization, zero mean
+ * cepstra (_Z), deltas (_D) and accelerations (_A).
+ */
+
+#ifndef MAX_CHAN
+    #define MAX_CHAN 64      // Mel filterbank channels
+#endif
+
+#define MEL_FLOOR   1.0     // Filterbank outputs are floored before the log
+
+typedef struct {
+    int target_kind;        // TARGETKIND, MFCC with any of _E _0 _N _D _A _Z
+    double target_rate;     // TARGETRATE, frame shift in 100ns
+    double window_size;     // WINDOWSIZE in 100ns
+    double source_rate;     // SOURCERATE in 100ns, 0 to take it from the file
+    int use_hamming;        // USEHAMMING
+    float pre_emph;         // PREEMCOEF
+    int num_chans;          // NUMCHANS
+    int num_ceps;           // NUMCEPS
+    int cep_lifter;         // CEPLIFTER
+    float lo_freq, hi_freq; // LOFREQ, HIFREQ in Hz, negative for the full band
+    int raw_energy;         // RAWENERGY, energy before pre-emphasis and window
+    int e_normalize;        // ENORMALIZE
+    float e_scale;          // ESCALE
+    float sil_floor;        // SILFLOOR in dB
+    int delta_window;       // DELTAWINDOW
+    int acc_window;         // ACCWINDOW
+    int zmean_source;       // ZMEANSOURCE, remove DC of each frame
+} FrontEndConfig;
+
+/**
+ * Analysis state for one sample rate; read-only once built, so threads
+ * may share it
+ */
+typedef struct {
+    FrontEndConfig cfg;
+    int samp_period;        // Input sample period in 100ns
+    int frame_size;         // Window length in samples
+    int frame_shift;        // Frame shift in samples
+    int fft_size;           // Power of two >= frame_size
+    int static_dim;         // Cepstra + C0 + energy
+    int dim;                // Output vector size
+    float *window;          // [frame_size] Hamming window, NULL if unused
+    float *lifter;          // [num_ceps]
+    float *dct;             // [num_ceps+1][num_chans], row 0 is C0
+    int *lo_chan;           // [fft_size/2], lower channel of each bin, -1 if unused
+    float *lo_weight;       // [fft_size/2], share of the bin going to lo_chan
+    float *twiddle;         // [fft_size/2] pairs exp(-2 pi i k / fft_size)
+    int *bit_reverse;       // [fft_size/2], the real FFT is a half-size complex one
+} FrontEnd;
+
+/**
+ * Scratch buffers for frontend_static, one per thread
+ */
+typedef struct {
+    float *frame;           // [fft_size + 2]
+    float *fbank;           // [num_chans + 2], channels are 1-based like HTK
+} FrontEndWork;
+
+void frontend_config_default(FrontEndConfig *cfg);
+
+/**
+ * Read an HTK configuration file (KEY = VALUE lines, # comments); unknown
+ * keys are reported and ignored
+ * @return 0 on success, -1 on error (reported on stderr)
+ */
+int frontend_config_load(FrontEndConfig *cfg, const char *filename);
+
+/**
+ * @param samp_period input sample period in 100ns, used unless the
+ * configuration sets SOURCERATE
+ * @return 0 on success, -1 on an unsupported configuration
+ */
+int frontend_init(FrontEnd *fe, const FrontEndConfig *cfg, int samp_period);
+void frontend_free(FrontEnd *fe);
+
+void frontend_work_init(FrontEndWork *work, const FrontEnd *fe);
+void frontend_work_free(FrontEndWork *work);
+
+/**
+ * @return number of frames HTK takes from n samples
+ */
+int frontend_frame_num(const FrontEnd *fe, int n);
+
+/**
+ * Static coefficients of one frame: c_1 .. c_N, then C0 (_0) and log
+ * energy (_E) when the target kind has them
+ * @param samples fe->frame_size samples
+ * @param out receives fe->static_dim values
+ */
+void frontend_static(const FrontEnd *fe, FrontEndWork *work, const float *samples, float *out);
+
+/**
+ * Normalize log energy in column col of frame_num rows of width dim to
+ * 1 - (max - E) * escale, with E floored sil_floor dB below the maximum
+ */
+void frontend_normalize_energy(const FrontEndConfig *cfg, float *data, int frame_num, int dim, int col);
+
+/**
+ * Regression coefficients (HTK deltas) of columns [src, src + width) into
+ * [dst, dst + width), replicating the first and last frames at the edges
+ */
+void frontend_deltas(float *data, int frame_num, int dim, int src, int dst, int width, int window);
+
+/**
+ * Whole-utterance analysis of n samples into an HTK parameter file image
+ * @param feat filled, release with feature_free
+ * @return 0 on success, -1 if there is not a single frame
+ */
+int frontend_process(const FrontEnd *fe, FrontEndWork *work, const float *samples, int n, Feature *feat);
+
+/**
+ * Voice activity detection on the log energy (_E, else C0) of an analysed
+ * utterance. A two-class Gaussian classifier is fitted to the energies by
+ * EM and labels every frame speech or non-speech; speech runs shorter than
+ * VAD_MIN_SPEECH frames are taken as clicks. Of every non-speech run, all
+ * but pad frames on either side are dropped when that leaves at least
+ * VAD_MIN_SIL frames to drop. Utterances whose two classes are not
+ * separated by VAD_MIN_FISHER (all speech or all silence) are kept whole.
+ */
+
+#ifndef VAD_MIN_SPEECH
+    #define VAD_MIN_SPEECH 5      // 50 ms at 10 ms frames
+#endif
+
+#ifndef VAD_MIN_SIL
+    #define VAD_MIN_SIL 20        // Shortest stretch worth dropping
+#endif
+
+#ifndef VAD_MIN_FISHER
+    #define VAD_MIN_FISHER 2.0    // (mu1 - mu0)^2 / (var0 + var1) of the classes
+#endif
+
+#ifndef VAD_ITER
+    #define VAD_ITER 10           // EM iterations of the classifier
+#endif
+
+/**
+ * @param keep receives the index of every kept frame, feat->frame_num
+ * entries at most, in order
+ * @return number of kept frames, -1 if feat has no energy coefficient
+ */
+int frontend_vad(const Feature *feat, int pad, int *keep);
+
+/**
+ * Position of a frame boundary of a trimmed utterance in the original one;
+ * dropped frames go to the boundary in front of them, so consecutive
+ * segments stay contiguous
+ * @param t boundary in [0, kept_num] of the trimmed utterance
+ */
+int frontend_vad_map(const int *keep, int kept_num, int frame_num, int t);
+
+/**
+ * Streaming analysis: samples are pushed in chunks of any size and every
+ * output vector is handed to a callback as soon as it is final.
+ *
+ * Deltas of frame t need statics up to t + DELTAWINDOW and accelerations
+ * need deltas up to t + ACCWINDOW, so a vector is emitted
+ * frontend_stream_lookahead() frames after its window was complete (4
+ * frames, 40 ms, for hcopy.cfg). Utterance-level normalization is replaced
+ * by causal estimates: energy is normalized by the running maximum and _Z
+ * subtracts a running mean (cumulative over the first STREAM_MEAN_FRAMES
+ * frames, then exponentially forgetting with the same time constant).
+ */
+
+#ifndef STREAM_MEAN_FRAMES
+    #define STREAM_MEAN_FRAMES 100    // 1 s at 10 ms frames
+#endif
+
+typedef void (*FrameSink)(void *arg, const float *vector);
+
+typedef struct {
+    const FrontEnd *fe;
+    FrontEndWork work;
+    float *pcm;             // Samples not yet consumed by a frame
+    int pcm_len, pcm_cap;
+    int ring_size;          // Rows of the frame ring
+    int row_dim;            // Statics, deltas, accelerations of one frame
+    float *ring;            // [ring_size][row_dim], frame t in row t % ring_size
+    float *vector;          // [fe->dim] output vector
+    int static_num;         // Frames with statics
+    int delta_num;          // Frames with deltas
+    int acc_num;            // Frames with accelerations
+    int out_num;            // Frames emitted
+    float max_energy;
+    double *mean;           // Running mean of the cepstra
+} FrontEndStream;
+
+/**
+ * @return frames a vector is held back after its window is complete
+ */
+int frontend_stream_lookahead(const FrontEnd *fe);
+
+void frontend_stream_init(FrontEndStream *st, const FrontEnd *fe);
+void frontend_stream_free(FrontEndStream *st);
+
+/**
+ * Start a new utterance
+ */
+void frontend_stream_reset(FrontEndStream *st);
+
+/**
+ * @param sink called with every vector that became final
+ * @return number of vectors emitted
+ */
+int frontend_stream_push(FrontEndStream *st, const float *samples, int n, FrameSink sink, void *arg);
+
+/**
+ * End of utterance: emit the held back vectors, replicating the last frame
+ * for their deltas like the whole-utterance analysis, and reset
+ * @return number of vectors emitted
+ */
+int frontend_stream_finish(FrontEndStream *st, FrameSink sink, void *arg);
+
+/**
+ * Read a 16-bit PCM RIFF WAVE file; multi-channel files keep channel 0
+ * @param samples receives a malloc'ed array of sample values (not rescaled)
+ * @param samp_period receives the sample period in 100ns
+ * @return number of samples, -1 on error (reported on stderr)
+ */
+int wav_read(const char *filename, float **samples, int *samp_period);
+
+#endif
@@ -0,0 +1,1123 @@
+#include "gmm.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define LOG_2PI 1.8378770664093453
+
+double log_add(double x, double y)
+{
+    double diff;
+
+    if (x < y) {
+        double tmp = x;
+        x = y;
+        y = tmp;
+    }
+    diff = y - x;
+    if (diff < MIN_LOG_EXP) {
+        return x < LSMALL ? LZERO : x;
+    }
+    return x + log1p(exp(diff));
+}
+
+Gaussian *gaussian_new(int vec_size)
+{
+    Gaussian *g = (Gaussian *)calloc(1, sizeof(Gaussian));
+    g->ref = 1;
+    g->index = -1;
+    g->vec_size = vec_size;
+    g->mean = (float *)calloc(vec_size, sizeof(float));
+    g->var = (float *)calloc(vec_size, sizeof(float));
+    g->ivar = (float *)calloc(vec_size, sizeof(float));
+    return g;
+}
+
+void gaussian_ref(Gaussian *g)
+{
+    g->ref++;
+}
+
+void gaussian_unref(Gaussian *g)
+{
+    if (g == NULL || --g->ref > 0) {
+        return;
+    }
+    free(g->name);
+    free(g->mean);
+    free(g->var);
+    free(g->ivar);
+    free(g);
+}
+
+Gaussian *gaussian_clone(const Gaussian *g)
+{
+    Gaussian *copy = gaussian_new(g->vec_size);
+    memcpy(copy->mean, g->mean, sizeof(float) * g->vec_size);
+    memcpy(copy->var, g->var, sizeof(float) * g->vec_size);
+    memcpy(copy->ivar, g->ivar, sizeof(float) * g->vec_size);
+    copy->gconst = g->gconst;
+    return copy;
+}
+
+void gaussian_update(Gaussian *g)
+{
+    int k;
+    double gconst = g->vec_size * LOG_2PI;
+
+    for (k = 0; k < g->vec_size; k++) {
+        g->ivar[k] = 1.0f / g->var[k];
+        gconst += log(g->var[k]);
+    }
+    g->gconst = (float)gconst;
+}
+
+State *state_new(int mix_num)
+{
+    State *s = (State *)calloc(1, sizeof(State));
+    s->ref = 1;
+    s->index = -1;
+    s->mix_num = mix_num;
+    s->weight = (float *)calloc(mix_num, sizeof(float));
+    s->gauss = (Gaussian **)calloc(mix_num, sizeof(Gaussian *));
+    return s;
+}
+
+void state_ref(State *s)
+{
+    s->ref++;
+}
+
+void state_unref(State *s)
+{
+    int m;
+
+    if (s == NULL || --s->ref > 0) {
+        return;
+    }
+    for (m = 0; m < s->mix_num; m++) {
+        gaussian_unref(s->gauss[m]);
+    }
+    free(s->name);
+    free(s->weight);
+    free(s->gauss);
+    free(s);
+}
+
+State *state_clone(const State *s)
+{
+    int m;
+    State *copy = state_new(s->mix_num);
+
+    for (m = 0; m < s->mix_num; m++) {
+        copy->weight[m] = s->weight[m];
+        if (s->gauss[m]->name != NULL) {
+            gaussian_ref(s->gauss[m]);
+            copy->gauss[m] = s->gauss[m];
+        } else {
+            copy->gauss[m] = gaussian_clone(s->gauss[m]);
+        }
+    }
+    return copy;
+}
+
+void state_split_mixtures(State *s, int mix_num)
+{
+    int m, k, heaviest;
+
+    if (mix_num <= s->mix_num) {
+        return;
+    }
+    s->weight = (float *)realloc(s->weight, sizeof(float) * mix_num);
+    s->gauss = (Gaussian **)realloc(s->gauss, sizeof(Gaussian *) * mix_num);
+
+    while (s->mix_num < mix_num) {
+        Gaussian *g, *copy;
+
+        heaviest = 0;
+        for (m = 1; m < s->mix_num; m++) {
+            if (s->weight[m] > s->weight[heaviest]) {
+                heaviest = m;
+            }
+        }
+
+        // Never move a Gaussian other states share
+        g = s->gauss[heaviest];
+        if (g->ref > 1 || g->name != NULL) {
+            s->gauss[heaviest] = gaussian_clone(g);
+            gaussian_unref(g);
+            g = s->gauss[heaviest];
+        }
+
+        copy = gaussian_clone(g);
+        for (k = 0; k < g->vec_size; k++) {
+            float d = 0.2f * sqrtf(g->var[k]);
+            g->mean[k] += d;
+            copy->mean[k] -= d;
+        }
+        s->weight[heaviest] /= 2;
+        s->weight[s->mix_num] = s->weight[heaviest];
+        s->gauss[s->mix_num++] = copy;
+    }
+}
+
+void state_keep_mixtures(State *s, int mix_num)
+{
+    int m, k;
+    float sum = 0;
+
+    if (mix_num >= s->mix_num) {
+        return;
+    }
+
+    // Selection sort of the heaviest mix_num to the front
+    for (k = 0; k < mix_num; k++) {
+        int heaviest = k;
+        float w;
+        Gaussian *g;
+
+        for (m = k + 1; m < s->mix_num; m++) {
+            if (s->weight[m] > s->weight[heaviest]) {
+                heaviest = m;
+            }
+        }
+        w = s->weight[k];
+        g = s->gauss[k];
+        s->weight[k] = s->weight[heaviest];
+        s->gauss[k] = s->gauss[heaviest];
+        s->weight[heaviest] = w;
+        s->gauss[heaviest] = g;
+        sum += s->weight[k];
+    }
+    for (m = mix_num; m < s->mix_num; m++) {
+        gaussian_unref(s->gauss[m]);
+    }
+    s->mix_num = mix_num;
+    for (m = 0; m < mix_num && sum > 0; m++) {
+        s->weight[m] /= sum;
+    }
+}
+
+TransP *transp_new(int state_num)
+{
+    TransP *t = (TransP *)calloc(1, sizeof(TransP));
+    t->ref = 1;
+    t->index = -1;
+    t->state_num = state_num;
+    t->prob = (float *)calloc(state_num * state_num, sizeof(float));
+    return t;
+}
+
+void transp_ref(TransP *t)
+{
+    t->ref++;
+}
+
+void transp_unref(TransP *t)
+{
+    if (t == NULL || --t->ref > 0) {
+        return;
+    }
+    free(t->name);
+    free(t->prob);
+    free(t);
+}
+
+TransP *transp_clone(const TransP *t)
+{
+    TransP *copy = transp_new(t->state_num);
+    memcpy(copy->prob, t->prob, sizeof(float) * t->state_num * t->state_num);
+    return copy;
+}
+
+void transp_set(TransP *t, int i, int j, float prob)
+{
+    int k, N = t->state_num;
+    float *row = t->prob + i * N;
+    double rest = 0;
+
+    for (k = 0; k < N; k++) {
+        if (k != j) {
+            rest += row[k];
+        }
+    }
+    for (k = 0; k < N; k++) {
+        if (k != j && rest > 0) {
+            row[k] = (float)(row[k] / rest * (1 - prob));
+        }
+    }
+    row[j] = prob;
+}
+
+void transp_band(const TransP *t, int *lo, int *hi)
+{
+    int i, j, N = t->state_num;
+
+    *lo = N;
+    *hi = -N;
+    for (i = 1; i < N - 1; i++) {
+        for (j = 1; j < N - 1; j++) {
+            if (t->prob[i*N+j] > 0) {
+                *lo = j - i < *lo ? j - i : *lo;
+                *hi = j - i > *hi ? j - i : *hi;
+            }
+        }
+    }
+}
+
+Hmm *hmm_new(const char *name, int state_num)
+{
+    Hmm *hmm = (Hmm *)calloc(1, sizeof(Hmm));
+    hmm->name = strdup(name);
+    hmm->state_num = state_num;
+    hmm->state = (State **)calloc(state_num, sizeof(State *));
+    return hmm;
+}
+
+void hmm_free(Hmm *hmm)
+{
+    int i;
+
+    if (hmm == NULL) {
+        return;
+    }
+    for (i = 0; i < hmm->state_num; i++) {
+        state_unref(hmm->state[i]);
+    }
+    transp_unref(hmm->transp);
+    free(hmm->state);
+    free(hmm->name);
+    free(hmm);
+}
+
+Hmm *hmm_clone(const Hmm *src, const char *name)
+{
+    int i;
+    Hmm *hmm = hmm_new(name, src->state_num);
+
+    for (i = 1; i < src->state_num - 1; i++) {
+        if (src->state[i]->name != NULL) {
+            state_ref(src->state[i]);
+            hmm->state[i] = src->state[i];
+        } else {
+            hmm->state[i] = state_clone(src->state[i]);
+        }
+    }
+    if (src->transp->name != NULL) {
+        transp_ref(src->transp);
+        hmm->transp = src->transp;
+    } else {
+        hmm->transp = transp_clone(src->transp);
+    }
+    return hmm;
+}
+
+void modelset_init(ModelSet *set)
+{
+    memset(set, 0, sizeof(ModelSet));
+}
+
+void modelset_free(ModelSet *set)
+{
+    int i;
+
+    for (i = 0; i < set->hmm_num; i++) {
+        hmm_free(set->hmm[i]);
+    }
+    free(set->hmm);
+    for (i = 0; i < set->macro_num; i++) {
+        void *obj = set->macros[i].obj;
+        switch (set->macros[i].type) {
+        case 'm':
+            gaussian_unref((Gaussian *)obj);
+            break;
+        case 's':
+            state_unref((State *)obj);
+            break;
+        case 't':
+            transp_unref((TransP *)obj);
+            break;
+        default:
+            free(((Vector *)obj)->name);
+            free(((Vector *)obj)->data);
+            free(obj);
+        }
+    }
+    free(set->macros);
+    free(set->var_floor);
+    free(set->gauss_list);
+    free(set->state_list);
+    free(set->transp_list);
+    modelset_init(set);
+}
+
+void modelset_add(ModelSet *set, Hmm *hmm)
+{
+    set->hmm = (Hmm **)realloc(set->hmm, sizeof(Hmm *) * (set->hmm_num + 1));
+    set->hmm[set->hmm_num++] = hmm;
+}
+
+Hmm *modelset_find(const ModelSet *set, const char *name)
+{
+    int i;
+    for (i = 0; i < set->hmm_num; i++) {
+        if (strcmp(set->hmm[i]->name, name) == 0) {
+            return set->hmm[i];
+        }
+    }
+    return NULL;
+}
+
+void modelset_add_macro(ModelSet *set, char type, const char *name, void *obj)
+{
+    char **obj_name;
+
+    switch (type) {
+    case 'm':
+        gaussian_ref((Gaussian *)obj);
+        obj_name = &((Gaussian *)obj)->name;
+        break;
+    case 's':
+        state_ref((State *)obj);
+        obj_name = &((State *)obj)->name;
+        break;
+    case 't':
+        transp_ref((TransP *)obj);
+        obj_name = &((TransP *)obj)->name;
+        break;
+    default:
+        // Vectors are owned by the table
+        obj_name = &((Vector *)obj)->name;
+    }
+    if (*obj_name != name) {
+        free(*obj_name);
+        *obj_name = strdup(name);
+    }
+
+    set->macros = (Macro *)realloc(set->macros, sizeof(Macro) * (set->macro_num + 1));
+    set->macros[set->macro_num].type = type;
+    set->macros[set->macro_num].obj = obj;
+    set->macro_num++;
+}
+
+void *modelset_find_macro(const ModelSet *set, char type, const char *name)
+{
+    int i;
+    for (i = 0; i < set->macro_num; i++) {
+        // Every macro type starts with its name
+        const Macro *macro = &set->macros[i];
+        if (macro->type == type && strcmp(*(char **)macro->obj, name) == 0) {
+            return macro->obj;
+        }
+    }
+    return NULL;
+}
+
+void modelset_tie_states(ModelSet *set, const char *macro, Hmm **hmms, const int *states, int num)
+{
+    int i;
+    State *s = hmms[0]->state[states[0]];
+
+    // A state that already is a macro is renamed, not entered twice
+    for (i = 0; i < set->macro_num && set->macros[i].obj != s; i++);
+    if (i < set->macro_num) {
+        free(s->name);
+        s->name = strdup(macro);
+    } else {
+        modelset_add_macro(set, 's', macro, s);
+    }
+    for (i = 1; i < num; i++) {
+        if (hmms[i]->state[states[i]] == s) {
+            continue;
+        }
+        state_unref(hmms[i]->state[states[i]]);
+        state_ref(s);
+        hmms[i]->state[states[i]] = s;
+    }
+}
+
+static void index_gaussian(ModelSet *set, Gaussian *g)
+{
+    if (g->index >= 0) {
+        return;
+    }
+    set->gauss_list = (Gaussian **)realloc(set->gauss_list, sizeof(Gaussian *) * (set->gauss_num + 1));
+    set->gauss_list[set->gauss_num] = g;
+    g->index = set->gauss_num++;
+}
+
+static void index_state(ModelSet *set, State *s)
+{
+    int m;
+
+    if (s->index >= 0) {
+        return;
+    }
+    set->state_list = (State **)realloc(set->state_list, sizeof(State *) * (set->state_num + 1));
+    set->state_list[set->state_num] = s;
+    s->index = set->state_num++;
+    for (m = 0; m < s->mix_num; m++) {
+        index_gaussian(set, s->gauss[m]);
+    }
+}
+
+static void index_transp(ModelSet *set, TransP *t)
+{
+    if (t->index >= 0) {
+        return;
+    }
+    set->transp_list = (TransP **)realloc(set->transp_list, sizeof(TransP *) * (set->transp_num + 1));
+    set->transp_list[set->transp_num] = t;
+    t->index = set->transp_num++;
+}
+
+static void clear_state_index(State *s)
+{
+    int m;
+    s->index = -1;
+    for (m = 0; m < s->mix_num; m++) {
+        s->gauss[m]->index = -1;
+    }
+}
+
+void modelset_index(ModelSet *set)
+{
+    int h, i;
+
+    // Clear every index first, then number objects the first time they are met
+    for (h = 0; h < set->hmm_num; h++) {
+        Hmm *hmm = set->hmm[h];
+        hmm->transp->index = -1;
+        for (i = 1; i < hmm->state_num - 1; i++) {
+            clear_state_index(hmm->state[i]);
+        }
+    }
+    for (i = 0; i < set->macro_num; i++) {
+        void *obj = set->macros[i].obj;
+        switch (set->macros[i].type) {
+        case 'm':
+            ((Gaussian *)obj)->index = -1;
+            break;
+        case 's':
+            clear_state_index((State *)obj);
+            break;
+        case 't':
+            ((TransP *)obj)->index = -1;
+            break;
+        }
+    }
+
+    // Objects of the models come first; macros no model uses go last
+    set->gauss_num = set->state_num = set->transp_num = 0;
+    for (h = 0; h < set->hmm_num; h++) {
+        Hmm *hmm = set->hmm[h];
+        index_transp(set, hmm->transp);
+        for (i = 1; i < hmm->state_num - 1; i++) {
+            index_state(set, hmm->state[i]);
+        }
+    }
+    for (i = 0; i < set->macro_num; i++) {
+        void *obj = set->macros[i].obj;
+        switch (set->macros[i].type) {
+        case 'm':
+            index_gaussian(set, (Gaussian *)obj);
+            break;
+        case 's':
+            index_state(set, (State *)obj);
+            break;
+        case 't':
+            index_transp(set, (TransP *)obj);
+            break;
+        }
+    }
+}
+
+double gaussian_log_prob(const Gaussian *g, const float *x)
+{
+    int k;
+    double sum = g->gconst;
+
+    for (k = 0; k < g->vec_size; k++) {
+        double d = x[k] - g->mean[k];
+        sum += d * d * g->ivar[k];
+    }
+    return -0.5 * sum;
+}
+
+double state_log_prob(const State *s, const float *x, double *mix_log_prob)
+{
+    int m;
+    double lp, total = LZERO;
+
+    for (m = 0; m < s->mix_num; m++) {
+        if (s->weight[m] <= 0) {
+            lp = LZERO;
+        } else {
+            lp = log(s->weight[m]) + gaussian_log_prob(s->gauss[m], x);
+        }
+        if (mix_log_prob != NULL) {
+            mix_log_prob[m] = lp;
+        }
+        total = log_add(total, lp);
+    }
+    return total;
+}
+
+double skip_weight(int t, int frame_num, int skip, int hold, int *t0, int *t1)
+{
+    *t0 = t - t % skip;
+    *t1 = *t0 + skip;
+    if (t == *t0 || hold || *t1 >= frame_num) {
+        return 0;
+    }
+    return (double)(t - *t0) / skip;
+}
+
+void welford_init(Welford *w, int vec_size)
+{
+    w->vec_size = vec_size;
+    w->frame_num = 0;
+    w->mean = (double *)calloc(vec_size, sizeof(double));
+    w->m2 = (double *)calloc(vec_size, sizeof(double));
+}
+
+void welford_free(Welford *w)
+{
+    free(w->mean);
+    free(w->m2);
+    memset(w, 0, sizeof(Welford));
+}
+
+void welford_add(Welford *w, const float *data, int frame_num)
+{
+    int t, k;
+
+    for (t = 0; t < frame_num; t++) {
+        const float *x = data + (size_t)t * w->vec_size;
+        double scale = 1.0 / ++w->frame_num;
+        for (k = 0; k < w->vec_size; k++) {
+            double delta = x[k] - w->mean[k];
+            w->mean[k] += delta * scale;
+            w->m2[k] += delta * (x[k] - w->mean[k]);
+        }
+    }
+}
+
+void welford_merge(Welford *dst, const Welford *src)
+{
+    long n = dst->frame_num + src->frame_num;
+    int k;
+
+    if (src->frame_num == 0) {
+        return;
+    }
+    for (k = 0; k < dst->vec_size; k++) {
+        double delta = src->mean[k] - dst->mean[k];
+        dst->mean[k] += delta * src->frame_num / n;
+        dst->m2[k] += src->m2[k] + delta * delta * dst->frame_num * src->frame_num / n;
+    }
+    dst->frame_num = n;
+}
+
+void acc_init(Accumulator *acc, const ModelSet *set)
+{
+    int i, n;
+
+    memset(acc, 0, sizeof(Accumulator));
+    acc->vec_size = set->vec_size;
+    acc->gauss_num = set->gauss_num;
+    acc->state_num = set->state_num;
+    acc->transp_num = set->transp_num;
+
+    acc->gauss_occ = (double *)calloc(set->gauss_num, sizeof(double));
+    acc->mean_acc = (double *)calloc((size_t)set->gauss_num * set->vec_size, sizeof(double));
+    acc->var_acc = (double *)calloc((size_t)set->gauss_num * set->vec_size, sizeof(double));
+
+    acc->weight_offset = (int *)malloc(sizeof(int) * (set->state_num + 1));
+    for (i = 0, n = 0; i < set->state_num; i++) {
+        acc->weight_offset[i] = n;
+        n += set->state_list[i]->mix_num;
+    }
+    acc->weight_offset[set->state_num] = n;
+    acc->weight_acc = (double *)calloc(n + 1, sizeof(double));
+    acc->state_occ = (double *)calloc(set->state_num + 1, sizeof(double));
+
+    acc->trans_offset = (int *)malloc(sizeof(int) * (set->transp_num + 1));
+    for (i = 0, n = 0; i < set->transp_num; i++) {
+        acc->trans_offset[i] = n;
+        n += set->transp_list[i]->state_num * set->transp_list[i]->state_num;
+    }
+    acc->trans_offset[set->transp_num] = n;
+    acc->trans_acc = (double *)calloc(n + 1, sizeof(double));
+}
+
+void acc_reset(Accumulator *acc)
+{
+    memset(acc->gauss_occ, 0, sizeof(double) * acc->gauss_num);
+    memset(acc->mean_acc, 0, sizeof(double) * acc->gauss_num * acc->vec_size);
+    memset(acc->var_acc, 0, sizeof(double) * acc->gauss_num * acc->vec_size);
+    memset(acc->weight_acc, 0, sizeof(double) * acc->weight_offset[acc->state_num]);
+    memset(acc->state_occ, 0, sizeof(double) * acc->state_num);
+    memset(acc->trans_acc, 0, sizeof(double) * acc->trans_offset[acc->transp_num]);
+    acc->log_likelihood = 0;
+    acc->frame_num = 0;
+    acc->utt_num = 0;
+}
+
+void acc_free(Accumulator *acc)
+{
+    free(acc->gauss_occ);
+    free(acc->mean_acc);
+    free(acc->var_acc);
+    free(acc->weight_offset);
+    free(acc->weight_acc);
+    free(acc->state_occ);
+    free(acc->trans_offset);
+    free(acc->trans_acc);
+    memset(acc, 0, sizeof(Accumulator));
+}
+
+void acc_merge(Accumulator *dst, const Accumulator *src)
+{
+    int i;
+
+    for (i = 0; i < src->gauss_num; i++) {
+        dst->gauss_occ[i] += src->gauss_occ[i];
+    }
+    for (i = 0; i < src->gauss_num * src->vec_size; i++) {
+        dst->mean_acc[i] += src->mean_acc[i];
+        dst->var_acc[i] += src->var_acc[i];
+    }
+    for (i = 0; i < src->weight_offset[src->state_num]; i++) {
+        dst->weight_acc[i] += src->weight_acc[i];
+    }
+    for (i = 0; i < src->state_num; i++) {
+        dst->state_occ[i] += src->state_occ[i];
+    }
+    for (i = 0; i < src->trans_offset[src->transp_num]; i++) {
+        dst->trans_acc[i] += src->trans_acc[i];
+    }
+    dst->log_likelihood += src->log_likelihood;
+    dst->frame_num += src->frame_num;
+    dst->utt_num += src->utt_num;
+}
+
+int acc_write(const Accumulator *acc, const char *filename)
+{
+    int head[5] = {ACC_MAGIC, acc->vec_size, acc->gauss_num, acc->state_num, acc->transp_num};
+    size_t gauss = (size_t)acc->gauss_num * acc->vec_size;
+    int err;
+    FILE *fp = fopen(filename, "wb");
+
+    if (fp == NULL) {
+        perror(filename);
+        return -1;
+    }
+    fwrite(head, sizeof(int), 5, fp);
+    fwrite(acc->weight_offset, sizeof(int), acc->state_num + 1, fp);
+    fwrite(acc->trans_offset, sizeof(int), acc->transp_num + 1, fp);
+    fwrite(&acc->log_likelihood, sizeof(double), 1, fp);
+    fwrite(&acc->frame_num, sizeof(long), 1, fp);
+    fwrite(&acc->utt_num, sizeof(int), 1, fp);
+    fwrite(acc->gauss_occ, sizeof(double), acc->gauss_num, fp);
+    fwrite(acc->mean_acc, sizeof(double), gauss, fp);
+    fwrite(acc->var_acc, sizeof(double), gauss, fp);
+    fwrite(acc->weight_acc, sizeof(double), acc->weight_offset[acc->state_num], fp);
+    fwrite(acc->state_occ, sizeof(double), acc->state_num, fp);
+    fwrite(acc->trans_acc, sizeof(double), acc->trans_offset[acc->transp_num], fp);
+    // A short write, e.g. a full disk, must not leave a file that looks complete
+    err = ferror(fp);
+    if (fclose(fp) != 0 || err) {
+        perror(filename);
+        remove(filename);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * dst[0 .. n) += n doubles read from fp
+ */
+static int read_add(FILE *fp, double *dst, size_t n, double *buf)
+{
+    size_t i;
+
+    if (fread(buf, sizeof(double), n, fp) != n) {
+        return 0;
+    }
+    for (i = 0; i < n; i++) {
+        dst[i] += buf[i];
+    }
+    return 1;
+}
+
+int acc_read_add(Accumulator *acc, const char *filename)
+{
+    int head[5], i, ok, utt_num;
+    int *offset = (int *)malloc(sizeof(int) * (acc->state_num + acc->transp_num + 2));
+    size_t gauss = (size_t)acc->gauss_num * acc->vec_size, size;
+    double log_likelihood, *buf;
+    long frame_num;
+    FILE *fp = fopen(filename, "rb");
+
+    if (fp == NULL) {
+        perror(filename);
+        free(offset);
+        return -1;
+    }
+    ok = fread(head, sizeof(int), 5, fp) == 5 && head[0] == ACC_MAGIC && head[1] == acc->vec_size && \
+         head[2] == acc->gauss_num && head[3] == acc->state_num && head[4] == acc->transp_num && \
+         fread(offset, sizeof(int), acc->state_num + acc->transp_num + 2, fp) == \
+             (size_t)acc->state_num + acc->transp_num + 2;
+    for (i = 0; ok && i <= acc->state_num; i++) {
+        ok = offset[i] == acc->weight_offset[i];
+    }
+    for (i = 0; ok && i <= acc->transp_num; i++) {
+        ok = offset[acc->state_num+1+i] == acc->trans_offset[i];
+    }
+    free(offset);
+    if (!ok) {
+        fprintf(stderr, "%s: not an accumulator of these models\n", filename);
+        fclose(fp);
+        return -1;
+    }
+
+    // Scratch for the largest of the arrays, gauss_num <= gauss
+    size = gauss > (size_t)acc->weight_offset[acc->state_num] ? gauss : (size_t)acc->weight_offset[acc->state_num];
+    size = size > (size_t)acc->trans_offset[acc->transp_num] ? size : (size_t)acc->trans_offset[acc->transp_num];
+    size = size > (size_t)acc->state_num ? size : (size_t)acc->state_num;
+    buf = (double *)malloc(sizeof(double) * (size + 1));
+    ok = fread(&log_likelihood, sizeof(double), 1, fp) == 1 && fread(&frame_num, sizeof(long), 1, fp) == 1 && \
+         fread(&utt_num, sizeof(int), 1, fp) == 1 && \
+         read_add(fp, acc->gauss_occ, acc->gauss_num, buf) && read_add(fp, acc->mean_acc, gauss, buf) && \
+         read_add(fp, acc->var_acc, gauss, buf) && \
+         read_add(fp, acc->weight_acc, acc->weight_offset[acc->state_num], buf) && \
+         read_add(fp, acc->state_occ, acc->state_num, buf) && \
+         read_add(fp, acc->trans_acc, acc->trans_offset[acc->transp_num], buf);
+    free(buf);
+    fclose(fp);
+    if (!ok) {
+        fprintf(stderr, "%s: truncated\n", filename);
+        return -1;
+    }
+    acc->log_likelihood += log_likelihood;
+    acc->frame_num += frame_num;
+    acc->utt_num += utt_num;
+    return 0;
+}
+
+void acc_state(Accumulator *acc, const State *s, const float *x, double occ,
+               const double *mix_log_prob, double state_log_prob)
+{
+    int m, k;
+    int dim = acc->vec_size;
+
+    acc->state_occ[s->index] += occ;
+    for (m = 0; m < s->mix_num; m++) {
+        double occ_m = s->mix_num == 1 ? occ : occ * exp(mix_log_prob[m] - state_log_prob);
+        const Gaussian *g = s->gauss[m];
+        double *mean_acc = acc->mean_acc + (size_t)g->index * dim;
+        double *var_acc = acc->var_acc + (size_t)g->index * dim;
+
+        if (occ_m <= 0) {
+            continue;
+        }
+        acc->weight_acc[acc->weight_offset[s->index] + m] += occ_m;
+        acc->gauss_occ[g->index] += occ_m;
+        for (k = 0; k < dim; k++) {
+            mean_acc[k] += occ_m * x[k];
+            var_acc[k] += occ_m * x[k] * x[k];
+        }
+    }
+}
+
+/**
+ * @param log_a receives log of the transition matrix
+ * @param band receives its band, see transp_band
+ */
+static void log_transp(const Hmm *hmm, double *log_a, int *band)
+{
+    int i, N = hmm->state_num;
+    for (i = 0; i < N * N; i++) {
+        log_a[i] = hmm->transp->prob[i] > 0 ? log(hmm->transp->prob[i]) : LZERO;
+    }
+    transp_band(hmm->transp, &band[0], &band[1]);
+}
+
+double hmm_forward(const Hmm *hmm, const Feature *feat)
+{
+    int i, j, t, band[2];
+    int N = hmm->state_num, T = feat->frame_num;
+    double *log_a, *alpha, *next, prob = LZERO;
+
+    if (T == 0) {
+        return LZERO;
+    }
+    log_a = (double *)malloc(sizeof(double) * N * N);
+    alpha = (double *)malloc(sizeof(double) * N);
+    next = (double *)malloc(sizeof(double) * N);
+    log_transp(hmm, log_a, band);
+
+    for (j = 1; j < N - 1; j++) {
+        alpha[j] = log_a[j] + state_log_prob(hmm->state[j], feat->data, NULL);
+    }
+    for (t = 1; t < T; t++) {
+        const float *x = feat->data + (size_t)t * feat->dim;
+        for (j = 1; j < N - 1; j++) {
+            double sum = LZERO;
+            for (i = BAND_FROM_FIRST(band, j); i <= BAND_FROM_LAST(band, j, N); i++) {
+                sum = log_add(sum, alpha[i] + log_a[i*N+j]);
+            }
+            next[j] = sum > LSMALL ? sum + state_log_prob(hmm->state[j], x, NULL) : LZERO;
+        }
+        memcpy(alpha + 1, next + 1, sizeof(double) * (N - 2));
+    }
+    for (i = 1; i < N - 1; i++) {
+        prob = log_add(prob, alpha[i] + log_a[i*N+N-1]);
+    }
+
+    free(log_a);
+    free(alpha);
+    free(next);
+    return prob;
+}
+
+double hmm_viterbi(const Hmm *hmm, const Feature *feat, int *path)
+{
+    int i, j, t, best, band[2];
+    int N = hmm->state_num, T = feat->frame_num;
+    double *log_a, *delta, *next, score = LZERO;
+    int *psi;
+
+    if (T == 0) {
+        return LZERO;
+    }
+    log_a = (double *)malloc(sizeof(double) * N * N);
+    delta = (double *)malloc(sizeof(double) * N);
+    next = (double *)malloc(sizeof(double) * N);
+    psi = (int *)malloc(sizeof(int) * T * N);
+    log_transp(hmm, log_a, band);
+
+    for (j = 1; j < N - 1; j++) {
+        delta[j] = log_a[j] + state_log_prob(hmm->state[j], feat->data, NULL);
+    }
+    for (t = 1; t < T; t++) {
+        const float *x = feat->data + (size_t)t * feat->dim;
+        for (j = 1; j < N - 1; j++) {
+            double max = LZERO;
+            int arg_max = 1;
+            for (i = BAND_FROM_FIRST(band, j); i <= BAND_FROM_LAST(band, j, N); i++) {
+                if (delta[i] + log_a[i*N+j] > max) {
+                    max = delta[i] + log_a[i*N+j];
+                    arg_max = i;
+                }
+            }
+            next[j] = max > LSMALL ? max + state_log_prob(hmm->state[j], x, NULL) : LZERO;
+            psi[t*N+j] = arg_max;
+        }
+        memcpy(delta + 1, next + 1, sizeof(double) * (N - 2));
+    }
+
+    best = 1;
+    for (i = 1; i < N - 1; i++) {
+        if (delta[i] + log_a[i*N+N-1] > score) {
+            score = delta[i] + log_a[i*N+N-1];
+            best = i;
+        }
+    }
+    if (path != NULL && score > LSMALL) {
+        path[T-1] = best;
+        for (t = T - 1; t > 0; t--) {
+            path[t-1] = psi[t*N+path[t]];
+        }
+    }
+
+    free(log_a);
+    free(delta);
+    free(next);
+    free(psi);
+    return score > LSMALL ? score : LZERO;
+}
+
+double hmm_accumulate(const Hmm *hmm, const Feature *feat, Accumulator *acc)
+{
+    int i, j, t, max_mix = 1, band[2];
+    int N = hmm->state_num, T = feat->frame_num;
+    double prob = LZERO;
+    double *log_a, *b, *mix, *alpha, *beta;
+
+    if (T == 0) {
+        return LZERO;
+    }
+    for (j = 1; j < N - 1; j++) {
+        if (hmm->state[j]->mix_num > max_mix) {
+            max_mix = hmm->state[j]->mix_num;
+        }
+    }
+
+    log_a = (double *)malloc(sizeof(double) * N * N);
+    b = (double *)malloc(sizeof(double) * T * N);
+    mix = (double *)malloc(sizeof(double) * T * N * max_mix);
+    alpha = (double *)malloc(sizeof(double) * T * N);
+    beta = (double *)malloc(sizeof(double) * T * N);
+    log_transp(hmm, log_a, band);
+
+#define X(t) (feat->data + (size_t)(t) * feat->dim)
+#define MIX(t, j) (mix + ((size_t)(t) * N + (j)) * max_mix)
+
+    for (t = 0; t < T; t++) {
+        for (j = 1; j < N - 1; j++) {
+            b[t*N+j] = state_log_prob(hmm->state[j], X(t), MIX(t, j));
+        }
+    }
+
+    // Forward
+    for (j = 1; j < N - 1; j++) {
+        alpha[j] = log_a[j] + b[j];
+    }
+    for (t = 1; t < T; t++) {
+        for (j = 1; j < N - 1; j++) {
+            double sum = LZERO;
+            for (i = BAND_FROM_FIRST(band, j); i <= BAND_FROM_LAST(band, j, N); i++) {
+                sum = log_add(sum, alpha[(t-1)*N+i] + log_a[i*N+j]);
+            }
+            alpha[t*N+j] = sum > LSMALL ? sum + b[t*N+j] : LZERO;
+        }
+    }
+    for (i = 1; i < N - 1; i++) {
+        prob = log_add(prob, alpha[(T-1)*N+i] + log_a[i*N+N-1]);
+    }
+
+    if (prob > LSMALL) {
+        double *trans = acc->trans_acc + acc->trans_offset[hmm->transp->index];
+
+        // Backward
+        for (i = 1; i < N - 1; i++) {
+            beta[(T-1)*N+i] = log_a[i*N+N-1];
+        }
+        for (t = T - 2; t >= 0; t--) {
+            for (i = 1; i < N - 1; i++) {
+                double sum = LZERO;
+                for (j = BAND_TO_FIRST(band, i); j <= BAND_TO_LAST(band, i, N); j++) {
+                    sum = log_add(sum, log_a[i*N+j] + b[(t+1)*N+j] + beta[(t+1)*N+j]);
+                }
+                beta[t*N+i] = sum;
+            }
+        }
+
+        // Occupancy of the state, alpha * beta / P; acc_state splits it over
+        // the mixtures by their share of b
+        for (t = 0; t < T; t++) {
+            for (j = 1; j < N - 1; j++) {
+                double occ = alpha[t*N+j] + beta[t*N+j] - prob;
+                if (occ > MIN_LOG_EXP) {
+                    acc_state(acc, hmm->state[j], X(t), exp(occ), MIX(t, j), b[t*N+j]);
+                }
+            }
+        }
+
+        // Transitions
+        for (j = 1; j < N - 1; j++) {
+            trans[j] += exp(alpha[j] + beta[j] - prob);
+        }
+        for (t = 0; t < T - 1; t++) {
+            for (i = 1; i < N - 1; i++) {
+                if (alpha[t*N+i] < LSMALL) {
+                    continue;
+                }
+                for (j = BAND_TO_FIRST(band, i); j <= BAND_TO_LAST(band, i, N); j++) {
+                    double lp = alpha[t*N+i] + log_a[i*N+j] + b[(t+1)*N+j] + beta[(t+1)*N+j] - prob;
+                    if (lp > MIN_LOG_EXP) {
+                        trans[i*N+j] += exp(lp);
+                    }
+                }
+            }
+        }
+        for (i = 1; i < N - 1; i++) {
+            trans[i*N+N-1] += exp(alpha[(T-1)*N+i] + log_a[i*N+N-1] - prob);
+        }
+
+        acc->log_likelihood += prob;
+        acc->frame_num += T;
+        acc->utt_num++;
+    }
+
+#undef X
+#undef MIX
+
+    free(log_a);
+    free(b);
+    free(mix);
+    free(alpha);
+    free(beta);
+    return prob > LSMALL ? prob : LZERO;
+}
+
+void modelset_update(ModelSet *set, const Accumulator *acc)
+{
+    int g, s, n, i, j, k, m;
+    int dim = set->vec_size;
+
+    for (g = 0; g < set->gauss_num; g++) {
+        Gaussian *gauss = set->gauss_list[g];
+        double occ = acc->gauss_occ[g];
+        const double *mean_acc = acc->mean_acc + (size_t)g * dim;
+        const double *var_acc = acc->var_acc + (size_t)g * dim;
+
+        if (occ < MIN_OCC) {
+            continue;
+        }
+        for (k = 0; k < dim; k++) {
+            double mean = mean_acc[k] / occ;
+            double var = var_acc[k] / occ - mean * mean;
+            if (set->var_floor != NULL && var < set->var_floor[k]) {
+                var = set->var_floor[k];
+            }
+            if (var <= 0) {
+                var = 1e-6;
+            }
+            gauss->mean[k] = (float)mean;
+            gauss->var[k] = (float)var;
+        }
+        gaussian_update(gauss);
+    }
+
+    for (s = 0; s < set->state_num; s++) {
+        State *state = set->state_list[s];
+        const double *weight_acc = acc->weight_acc + acc->weight_offset[s];
+        double occ = acc->state_occ[s], sum = 0;
+
+        if (occ <= 0 || state->mix_num == 1) {
+            continue;
+        }
+        for (m = 0; m < state->mix_num; m++) {
+            state->weight[m] = (float)(weight_acc[m] / occ);
+            if (state->weight[m] < MIN_WEIGHT) {
+                state->weight[m] = MIN_WEIGHT;
+            }
+            sum += state->weight[m];
+        }
+        for (m = 0; m < state->mix_num; m++) {
+            state->weight[m] = (float)(state->weight[m] / sum);
+        }
+    }
+
+    for (n = 0; n < set->transp_num; n++) {
+        TransP *transp = set->transp_list[n];
+        const double *trans = acc->trans_acc + acc->trans_offset[n];
+        int N = transp->state_num;
+
+        for (i = 0; i < N - 1; i++) {
+            double sum = 0;
+            for (j = 0; j < N; j++) {
+                sum += trans[i*N+j];
+            }
+            if (sum <= 0) {
+                continue;
+            }
+            for (j = 0; j < N; j++) {
+                transp->prob[i*N+j] = (float)(trans[i*N+j] / sum);
+            }
+        }
+    }
+}
@@ -0,0 +1,327 @@
+#ifndef GMM_HEADER_
+#define GMM_HEADER_
+
+#include "htk.h"
+
+/**
+ * Continuous-density HMMs with diagonal-covariance Gaussian-mixture
+ * emissions, laid out like HTK models: state 0 is the non-emitting entry
+ * state, state N-1 the non-emitting exit state, transitions are an N x N
+ * matrix of linear probabilities.
+ *
+ * Gaussians, states and transition matrices are reference counted so that
+ * models can share them (HTK ~m, ~s and ~t macros). A non-NULL name means
+ * the object is a macro and is written as such.
+ */
+
+#define LZERO   (-1.0e10)   // log(0)
+#define LSMALL  (-0.5e10)   // anything below is treated as log(0)
+#define MIN_LOG_EXP (-23.0) // log-add ignores terms smaller than exp(-23)
+
+#ifndef MIN_OCC
+    #define MIN_OCC 3.0     // occupancy needed to re-estimate a Gaussian (HERest -u default)
+#endif
+
+#ifndef MIN_WEIGHT
+    #define MIN_WEIGHT 1.0e-5 // mixture weight floor (HTK MINMIX)
+#endif
+
+typedef struct {
+    char *name;       // ~m macro name, NULL if private
+    int ref;
+    int index;        // Position in the model set, see modelset_index
+    int vec_size;
+    float *mean;
+    float *var;       // Diagonal covariance
+    float *ivar;      // 1 / var
+    float gconst;     // log((2 pi)^n |var|)
+} Gaussian;
+
+typedef struct {
+    char *name;       // ~s macro name, NULL if private
+    int ref;
+    int index;
+    int mix_num;
+    float *weight;
+    Gaussian **gauss;
+} State;
+
+typedef struct {
+    char *name;       // ~t macro name, NULL if private
+    int ref;
+    int index;
+    int state_num;
+    float *prob;      // [state_num][state_num]
+} TransP;
+
+/**
+ * Named mean (~u) or variance (~v) vector. References from Gaussians are
+ * expanded into private copies when loading.
+ */
+typedef struct {
+    char *name;
+    int size;
+    float *data;
+} Vector;
+
+/**
+ * Entry of the macro table of a model set, which holds a reference to obj
+ */
+typedef struct {
+    char type;        // 'm' Gaussian, 's' State, 't' TransP, 'u'/'v' Vector
+    void *obj;
+} Macro;
+
+typedef struct {
+    char *name;       // ~h name
+    int state_num;    // Including entry and exit states
+    State **state;    // [state_num], state[0] and state[state_num-1] are NULL
+    TransP *transp;
+} Hmm;
+
+typedef struct {
+    int vec_size;
+    int parm_kind;
+    float *var_floor;     // ~v "varFloor1", NULL if none
+    int hmm_num;
+    Hmm **hmm;
+    int macro_num;
+    Macro *macros;        // In definition order
+
+    // Filled by modelset_index
+    int gauss_num, state_num, transp_num;
+    Gaussian **gauss_list;
+    State **state_list;
+    TransP **transp_list;
+} ModelSet;
+
+double log_add(double x, double y);
+
+Gaussian *gaussian_new(int vec_size);
+void gaussian_ref(Gaussian *g);
+void gaussian_unref(Gaussian *g);
+/**
+ * @return private copy of g (no macro name)
+ */
+Gaussian *gaussian_clone(const Gaussian *g);
+/**
+ * Recompute ivar and gconst after mean or var changed
+ */
+void gaussian_update(Gaussian *g);
+
+State *state_new(int mix_num);
+void state_ref(State *s);
+void state_unref(State *s);
+/**
+ * @return private copy of s; Gaussians that are macros stay shared
+ */
+State *state_clone(const State *s);
+/**
+ * Split the heaviest mixture component until s has mix_num components,
+ * like HHEd MU: the copies get half the weight and means moved by
+ * +/- 0.2 standard deviations
+ */
+void state_split_mixtures(State *s, int mix_num);
+/**
+ * Drop all but the mix_num heaviest mixture components of s and
+ * renormalize their weights, for cheap fast-match models
+ */
+void state_keep_mixtures(State *s, int mix_num);
+
+TransP *transp_new(int state_num);
+void transp_ref(TransP *t);
+void transp_unref(TransP *t);
+TransP *transp_clone(const TransP *t);
+/**
+ * Set a_ij and rescale the rest of row i so it still sums to one, like HHEd AT
+ */
+void transp_set(TransP *t, int i, int j, float prob);
+/**
+ * Topology of a transition matrix: every non-zero a_ij between emitting
+ * states has lo <= j - i <= hi. A left-to-right (Bakis) model that only
+ * loops or advances has lo = 0, hi = 1, so the forward, backward and
+ * Viterbi kernels visit O(N * (hi - lo + 1)) transitions per frame
+ * instead of N^2; an ergodic matrix spans every row. Without emitting
+ * transitions (a tee model's lone state without a loop), hi < lo.
+ */
+void transp_band(const TransP *t, int *lo, int *hi);
+
+// Emitting states of an N-state model that reach state j, and that state i
+// reaches, within band = {lo, hi}: loop from the first to the last inclusive
+#define BAND_FROM_FIRST(band, j)   ((j) - (band)[1] > 1 ? (j) - (band)[1] : 1)
+#define BAND_FROM_LAST(band, j, N) ((j) - (band)[0] < (N) - 2 ? (j) - (band)[0] : (N) - 2)
+#define BAND_TO_FIRST(band, i)     ((i) + (band)[0] > 1 ? (i) + (band)[0] : 1)
+#define BAND_TO_LAST(band, i, N)   ((i) + (band)[1] < (N) - 2 ? (i) + (band)[1] : (N) - 2)
+
+Hmm *hmm_new(const char *name, int state_num);
+void hmm_free(Hmm *hmm);
+/**
+ * @return copy of src named name; macros stay shared, everything else is copied
+ */
+Hmm *hmm_clone(const Hmm *src, const char *name);
+
+void modelset_init(ModelSet *set);
+void modelset_free(ModelSet *set);
+void modelset_add(ModelSet *set, Hmm *hmm);
+/**
+ * @return model named name, NULL if not found
+ */
+Hmm *modelset_find(const ModelSet *set, const char *name);
+/**
+ * Add a macro named name of the given type; the set takes a reference to
+ * obj and sets its name
+ */
+void modelset_add_macro(ModelSet *set, char type, const char *name, void *obj);
+/**
+ * @return macro object of the given type, NULL if not found
+ */
+void *modelset_find_macro(const ModelSet *set, char type, const char *name);
+/**
+ * Make every listed state share the first one, like HHEd TI
+ * @param macro name of the new ~s macro; a first state that already is a
+ * macro is renamed
+ * @param hmms models owning the states
+ * @param states state index (1 .. N-2) in each model
+ * @param num number of states
+ */
+void modelset_tie_states(ModelSet *set, const char *macro, Hmm **hmms, const int *states, int num);
+/**
+ * Number every distinct Gaussian, state and transition matrix of the set
+ * and fill the *_list arrays, so shared objects are counted once.
+ * Call again after changing the structure of the set.
+ */
+void modelset_index(ModelSet *set);
+
+/**
+ * @return log N(x; mean, var)
+ */
+double gaussian_log_prob(const Gaussian *g, const float *x);
+
+/**
+ * @param mix_log_prob if not NULL, receives log(w_m) + log N_m(x) per mixture
+ * @return log b_j(x)
+ */
+double state_log_prob(const State *s, const float *x, double *mix_log_prob);
+
+/**
+ * Frame skipping: output probabilities are only computed at frames that
+ * are multiples of skip; a frame in between takes those of the computed
+ * frames around it, linearly interpolated, or the previous one with hold
+ * @param t0 receives the computed frame at or before t
+ * @param t1 receives the next computed frame
+ * @return weight of frame t1, 0 if t is computed, with hold, or when no
+ * computed frame follows
+ */
+double skip_weight(int t, int frame_num, int skip, int hold, int *t0, int *t1);
+
+/**
+ * Global mean and variance of feature vectors by Welford's update, which
+ * stays accurate where sum x^2 / n - mean^2 cancels. Statistics of
+ * disjoint data merge exactly (Chan et al.), so threads or processes can
+ * each take part of the frames.
+ */
+typedef struct {
+    int vec_size;
+    long frame_num;
+    double *mean;          // [vec_size]
+    double *m2;            // [vec_size], sum of squared deviations from mean
+} Welford;
+
+void welford_init(Welford *w, int vec_size);
+void welford_free(Welford *w);
+/**
+ * Add the frame_num vectors of data, frame-major
+ */
+void welford_add(Welford *w, const float *data, int frame_num);
+/**
+ * dst += src
+ */
+void welford_merge(Welford *dst, const Welford *src);
+
+/**
+ * Sufficient statistics for re-estimating a model set
+ */
+typedef struct {
+    int vec_size;
+    int gauss_num, state_num, transp_num;
+    double *gauss_occ;     // [gauss_num]
+    double *mean_acc;      // [gauss_num][vec_size], sum L x
+    double *var_acc;       // [gauss_num][vec_size], sum L x^2
+    int *weight_offset;    // [state_num], start of the state's mixtures in weight_acc
+    double *weight_acc;    // per (state, mixture) occupancy
+    double *state_occ;     // [state_num]
+    int *trans_offset;     // [transp_num], start of the matrix in trans_acc
+    double *trans_acc;     // per transition matrix [N][N] counts
+    double log_likelihood;
+    long frame_num;
+    int utt_num;
+} Accumulator;
+
+/**
+ * @param set indexed with modelset_index
+ */
+void acc_init(Accumulator *acc, const ModelSet *set);
+void acc_reset(Accumulator *acc);
+void acc_free(Accumulator *acc);
+/**
+ * dst += src
+ */
+void acc_merge(Accumulator *dst, const Accumulator *src);
+/**
+ * Accumulator files let the E-step run on several processes or machines
+ * over slices of the training data (HERest -p): each writes its sums, and
+ * the M-step runs on their total. The file holds the layout of the model
+ * set it was collected for, followed by the raw sums as doubles.
+ */
+
+#ifndef ACC_MAGIC
+    #define ACC_MAGIC 0x41434331    // "ACC1"
+#endif
+
+/**
+ * @return 0 on success, -1 on error (reported on stderr)
+ */
+int acc_write(const Accumulator *acc, const char *filename);
+
+/**
+ * acc += the sums of an accumulator file
+ * @return 0 on success, -1 on error or if the file was collected for a
+ * model set of another layout (reported on stderr); acc is incomplete
+ * after a truncated file
+ */
+int acc_read_add(Accumulator *acc, const char *filename);
+
+/**
+ * Add occupancy occ of emitting state s at frame x, split over its
+ * mixtures by their posterior
+ * @param mix_log_prob log(w_m) + log N_m(x) per mixture
+ * @param state_log_prob log b_j(x)
+ */
+void acc_state(Accumulator *acc, const State *s, const float *x, double occ,
+               const double *mix_log_prob, double state_log_prob);
+
+/**
+ * Forward-backward of one model over frames [0, T) of feat, adding the
+ * expected counts to acc (isolated-unit training, like HRest)
+ * @return log P(O | hmm), LZERO if O cannot be generated (acc untouched)
+ */
+double hmm_accumulate(const Hmm *hmm, const Feature *feat, Accumulator *acc);
+
+/**
+ * @return log P(O | hmm) by forward algorithm
+ */
+double hmm_forward(const Hmm *hmm, const Feature *feat);
+
+/**
+ * @param path if not NULL, receives the emitting state (1 .. N-2) per frame
+ * @return log P(O, best path | hmm)
+ */
+double hmm_viterbi(const Hmm *hmm, const Feature *feat, int *path);
+
+/**
+ * Re-estimate every Gaussian, mixture weight and transition matrix with
+ * enough occupancy (M-step). Variances are floored by set->var_floor.
+ */
+void modelset_update(ModelSet *set, const Accumulator *acc);
+
+#endif
@@ -0,0 +1,158 @@
+#include "gmm.h"
+#include "mmf.h"
+#include "archive.h"
+#include "quant.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/**
+ * Model compilation for gmm_decode -Q: quantize the output distributions
+ * of the models to int8 (default) or f16 and write them to one file.
+ *
+ * With -S, every state is scored on every frame of the files with the
+ * float and the compiled models, and the log-likelihood error, the frames
+ * whose best state changes and the time per frame of both are reported.
+ * The word-accuracy change is measured by gmm_decode -Q ... -I.
+ */
+int main(int argc, char *argv[])
+{
+    int i, n, s, t, model_num, file_num = 0, type = QUANT_INT8;
+    const char *scp = NULL, *archive = NULL, *out = NULL, *hmmlist = argv[argc-1];
+    char **names;
+    ModelSet set;
+    QuantModel quant;
+
+    if (argc < 4 || argv[argc-1][0] == '-') {
+        printf("Wrong argument format\n");
+        printf("Usage: ./gmm_compile [-q int8|f16] [-S test.scp [-a archive]] -H macros -H models -o compiled hmmlist\n");
+        exit(1);
+    }
+    for (i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "-q") == 0) {
+            i++;
+            if (strcmp(argv[i], "int8") == 0) {
+                type = QUANT_INT8;
+            } else if (strcmp(argv[i], "f16") == 0) {
+                type = QUANT_F16;
+            } else {
+                printf("Unknown -q type %s, expected int8 or f16\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "-S") == 0) {
+            scp = argv[++i];
+        } else if (strcmp(argv[i], "-a") == 0) {
+            archive = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0) {
+            out = argv[++i];
+        } else if (strcmp(argv[i], "-H") == 0) {
+            i++;
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            exit(1);
+        }
+    }
+    if (out == NULL) {
+        printf("Missing -o output file\n");
+        exit(1);
+    }
+
+    modelset_init(&set);
+    mmf_load_args(&set, argc, argv);
+    names = read_list(hmmlist, 0, &model_num);
+    for (n = 0; n < model_num; n++) {
+        if (modelset_find(&set, names[n]) == NULL) {
+            printf("Model %s of %s not found\n", names[n], hmmlist);
+            exit(1);
+        }
+    }
+    free_list(names, model_num);
+
+    quant_build(&quant, &set, type);
+    if (quant_write(&quant, out) < 0) {
+        exit(1);
+    }
+    printf("%s: %d states, %d Gaussians as %s, %ld bytes of means and precisions (%ld as floats)\n",
+           out, quant.state_num, quant.comp_num, type == QUANT_INT8 ? "int8" : "f16", quant_bytes(&quant),
+           (long)quant.comp_num * set.vec_size * 2 * sizeof(float));
+
+    if (scp != NULL) {
+        Archive archive_map, *ar = NULL;
+        char **files = read_list(scp, 0, &file_num);
+        double *exact = (double *)malloc(sizeof(double) * (set.state_num + 1));
+        double *approx = (double *)malloc(sizeof(double) * (set.state_num + 1));
+        float *u = (float *)malloc(sizeof(float) * quant.stride);
+        double sum_err = 0, max_err = 0, float_sec = 0, quant_sec = 0, start;
+        long frames = 0, changed = 0, evals = 0;
+
+        if (archive != NULL) {
+            if (archive_open(&archive_map, archive) < 0) {
+                exit(1);
+            }
+            ar = &archive_map;
+        }
+        for (n = 0; n < file_num; n++) {
+            Feature feat;
+            if (archive_load(ar, files[n], &feat) < 0) {
+                continue;
+            }
+            if (feat.dim != set.vec_size) {
+                fprintf(stderr, "%s: dimension %d, models expect %d\n", files[n], feat.dim, set.vec_size);
+                archive_release(ar, &feat);
+                continue;
+            }
+            for (t = 0; t < feat.frame_num; t++) {
+                const float *x = feat.data + (size_t)t * feat.dim;
+                int best_exact = 0, best_approx = 0;
+
+                start = now();
+                for (s = 0; s < set.state_num; s++) {
+                    exact[s] = state_log_prob(set.state_list[s], x, NULL);
+                }
+                float_sec += now() - start;
+                start = now();
+                quant_frame(&quant, x, u);
+                for (s = 0; s < set.state_num; s++) {
+                    approx[s] = quant_state_log_prob(&quant, set.state_list[s], u);
+                }
+                quant_sec += now() - start;
+
+                for (s = 0; s < set.state_num; s++) {
+                    double err = fabs(approx[s] - exact[s]);
+                    sum_err += err;
+                    max_err = err > max_err ? err : max_err;
+                    best_exact = exact[s] > exact[best_exact] ? s : best_exact;
+                    best_approx = approx[s] > approx[best_approx] ? s : best_approx;
+                }
+                evals += set.state_num;
+                changed += best_exact != best_approx;
+                frames++;
+            }
+            archive_release(ar, &feat);
+        }
+        printf("%ld frames: log likelihood error %.4f on average, %.4f at most; best state changed "
+               "on %.2f%% of frames\n", frames, evals > 0 ? sum_err / evals : 0, max_err,
+               frames > 0 ? 100.0 * changed / frames : 0);
+        printf("All states per frame: %.2f usec with float models, %.2f usec compiled\n",
+               frames > 0 ? 1e6 * float_sec / frames : 0, frames > 0 ? 1e6 * quant_sec / frames : 0);
+        free(exact);
+        free(approx);
+        free(u);
+        free_list(files, file_num);
+        if (ar != NULL) {
+            archive_close(&archive_map);
+        }
+    }
+
+    quant_free(&quant);
+    modelset_free(&set);
+    return 0;
+}
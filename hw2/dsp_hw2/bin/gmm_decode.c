@@ -0,0 +1,993 @@
+#include "gmm.h"
+#include "mmf.h"
+#include "net.h"
+#include "decode.h"
+#include "lattice.h"
+#include "archive.h"
+#include "mlf.h"
+#include "frontend.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#ifndef GSEL_TOP
+    #define GSEL_TOP 3    // Default -k, shortlist length of Gaussian selection
+#endif
+
+#ifndef MAX_THREAD
+    #define MAX_THREAD 64
+#endif
+
+#ifndef FAST_BEAM_SCALE
+    #define FAST_BEAM_SCALE 2.0    // Default -y as a multiple of -t
+#endif
+
+/**
+ * Cost of one utterance, for the -J report
+ */
+typedef struct {
+    DecodeStats stats, fast_stats;
+    double speech_sec;
+    int frame_num, kept_num;    // Frames of the file and after voice activity detection
+    double load_sec, fast_sec, decode_sec, lattice_sec;    // Wall time per phase
+    int fallback;               // Decoded again without the fast-match trail
+} UttStats;
+
+/**
+ * Shared by the workers, which take utterances by atomically bumping next;
+ * results are kept per utterance and written in script order
+ */
+typedef struct {
+    const DecodeNet *net;
+    const ModelSet *set;
+    const DecodeConfig *cfg;
+    const DecodeNet *fast_net;    // Fast-match first pass, NULL for one pass
+    const ModelSet *fast_set;
+    const DecodeConfig *fast_cfg;
+    const Archive *ar;
+    char **files;
+    int file_num;
+    int next;
+    DecodeResult *result;    // [file_num]
+    Lattice *lat;            // [file_num] word lattices, NULL if not wanted
+    const float *pair;       // Word pairs of the network, for the lattices
+    const char **out_word;
+    double lm_scale, penalty, lat_beam;
+    int *status;             // [file_num] 0 decoded, -1 failed
+    int *samp_period;        // [file_num]
+    UttStats *utt;           // [file_num]
+    int vad_pad;             // Padding frames of voice activity detection, 0 decodes every frame
+    DecodeStats stats, fast_stats;
+    double speech_sec;
+    long frame_num, kept_num;
+    int fallback_num;        // Utterances the fast-match trail failed
+    pthread_mutex_t lock;
+} Job;
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void stats_add(DecodeStats *dst, const DecodeStats *src)
+{
+    dst->frame_num += src->frame_num;
+    dst->token_num += src->token_num;
+    dst->active_num += src->active_num;
+    if (src->active_peak > dst->active_peak) {
+        dst->active_peak = src->active_peak;
+    }
+    dst->state_evals += src->state_evals;
+    dst->gauss_evals += src->gauss_evals;
+    dst->gauss_full += src->gauss_full;
+    dst->word_ends += src->word_ends;
+    dst->beam_pruned += src->beam_pruned;
+    dst->max_pruned += src->max_pruned;
+    dst->word_pruned += src->word_pruned;
+    dst->fast_pruned += src->fast_pruned;
+}
+
+static void stats_print(const char *title, const DecodeStats *s)
+{
+    if (s->frame_num == 0) {
+        return;
+    }
+    printf("%s: %.1f active states, %.1f output probabilities, %.1f Gaussians "
+           "(%.1f without selection), %.2f word ends per frame\n", title,
+           (double)s->active_num / s->frame_num, (double)s->state_evals / s->frame_num,
+           (double)s->gauss_evals / s->frame_num, (double)s->gauss_full / s->frame_num,
+           (double)s->word_ends / s->frame_num);
+}
+
+/**
+ * Per-frame costs and the share of tokens each pruning stage removed, as
+ * the members of a JSON object
+ */
+static void json_stats(FILE *fp, const DecodeStats *s, const char *indent)
+{
+    double frames = s->frame_num > 0 ? s->frame_num : 1;
+    double tokens = s->token_num + s->fast_pruned > 0 ? s->token_num + s->fast_pruned : 1;
+    double ends = s->word_ends + s->word_pruned > 0 ? s->word_ends + s->word_pruned : 1;
+
+    fprintf(fp, "%s\"frames\": %ld,\n", indent, s->frame_num);
+    fprintf(fp, "%s\"per_frame\": {\"tokens\": %.2f, \"active\": %.2f, \"states\": %.2f, "
+            "\"gaussians\": %.2f, \"gaussians_full\": %.2f, \"word_ends\": %.3f},\n", indent,
+            s->token_num / frames, s->active_num / frames, s->state_evals / frames,
+            s->gauss_evals / frames, s->gauss_full / frames, s->word_ends / frames);
+    fprintf(fp, "%s\"active_peak\": %d,\n", indent, s->active_peak);
+    fprintf(fp, "%s\"pruned\": {\"fast_match\": %.4f, \"beam\": %.4f, \"max_active\": %.4f, "
+            "\"word_beam\": %.4f}", indent, s->fast_pruned / tokens, s->beam_pruned / tokens,
+            s->max_pruned / tokens, s->word_pruned / ends);
+}
+
+static void json_string(FILE *fp, const char *str)
+{
+    fputc('"', fp);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') {
+            fputc('\\', fp);
+        }
+        fputc(*str, fp);
+    }
+    fputc('"', fp);
+}
+
+/**
+ * Copy of the kept frames of src
+ */
+static void feature_trim(const Feature *src, const int *keep, int kept_num, Feature *dst)
+{
+    int t;
+
+    *dst = *src;
+    dst->frame_num = kept_num;
+    dst->data = (float *)malloc(sizeof(float) * kept_num * src->dim);
+    for (t = 0; t < kept_num; t++) {
+        memcpy(dst->data + (size_t)t * src->dim, src->data + (size_t)keep[t] * src->dim, sizeof(float) * src->dim);
+    }
+}
+
+static void *worker(void *arg)
+{
+    Job *job = (Job *)arg;
+    Decoder dec, fast;
+    DecodeResult fast_result;
+    DecodeStats stats, fast_stats;
+    double sec = 0, t0, t1;
+    long frame_num = 0, kept_num = 0;
+    int n, i, fallback_num = 0;
+
+    memset(&stats, 0, sizeof(DecodeStats));
+    memset(&fast_stats, 0, sizeof(DecodeStats));
+    decoder_init(&dec, job->net, job->set);
+    if (job->fast_net != NULL) {
+        decoder_init(&fast, job->fast_net, job->fast_set);
+        fast.record = 1;
+        dec.fast = &fast;
+    }
+    while ((n = __sync_fetch_and_add(&job->next, 1)) < job->file_num) {
+        Feature feat, trimmed, *in = &feat;
+        UttStats *u = &job->utt[n];
+        int *keep = NULL;
+
+        memset(u, 0, sizeof(UttStats));
+        job->status[n] = -1;
+        t0 = now();
+        if (archive_load(job->ar, job->files[n], &feat) < 0) {
+            continue;
+        }
+        u->frame_num = u->kept_num = feat.frame_num;
+        if (job->vad_pad > 0) {
+            // Long non-speech runs never reach the decoder
+            keep = (int *)malloc(sizeof(int) * feat.frame_num);
+            u->kept_num = frontend_vad(&feat, job->vad_pad, keep);
+            if (u->kept_num > 0 && u->kept_num < feat.frame_num) {
+                feature_trim(&feat, keep, u->kept_num, &trimmed);
+                in = &trimmed;
+            }
+        }
+        t1 = now();
+        u->load_sec = t1 - t0;
+        if (feat.dim != job->set->vec_size) {
+            fprintf(stderr, "%s: dimension %d, models expect %d\n", job->files[n], feat.dim, job->set->vec_size);
+        } else if (u->kept_num < 0) {
+            fprintf(stderr, "%s: no energy coefficient for voice activity detection\n", job->files[n]);
+        } else {
+            if (job->fast_net != NULL) {
+                decode(&fast, in, job->fast_cfg, &fast_result, &u->fast_stats);
+                decode_result_free(&fast_result);
+                t0 = t1;
+                t1 = now();
+                u->fast_sec = t1 - t0;
+            }
+            job->status[n] = decode(&dec, in, job->cfg, &job->result[n], &u->stats);
+            if (job->status[n] < 0 && job->fast_net != NULL) {
+                // The trail lost every path to the end, decode without it
+                dec.fast = NULL;
+                job->status[n] = decode(&dec, in, job->cfg, &job->result[n], &u->stats);
+                dec.fast = &fast;
+                u->fallback = 1;
+                fallback_num++;
+            }
+            t0 = t1;
+            t1 = now();
+            u->decode_sec = t1 - t0;
+            if (job->status[n] < 0) {
+                fprintf(stderr, "%s: no token reached the end of the network\n", job->files[n]);
+            } else if (job->lat != NULL) {
+                // The word-end records only last until the next decode
+                Lattice *lat = &job->lat[n];
+                char name[MAX_NAME];
+                if (lat_build(lat, &dec, job->pair, job->out_word, job->lm_scale, job->penalty,
+                              job->lat_beam, in->frame_num) == 0) {
+                    archive_key(job->files[n], name);
+                    lat->name = strdup(name);
+                    lat->samp_period = feat.samp_period;
+                    for (i = 0; in != &feat && i < lat->node_num; i++) {
+                        lat->node[i].frame = frontend_vad_map(keep, in->frame_num, feat.frame_num, lat->node[i].frame);
+                    }
+                }
+                u->lattice_sec = now() - t1;
+            }
+            // Times of the trimmed utterance back to the file's
+            for (i = 0; in != &feat && job->status[n] == 0 && i < job->result[n].word_num; i++) {
+                WordHyp *w = &job->result[n].words[i];
+                w->start = frontend_vad_map(keep, in->frame_num, feat.frame_num, w->start);
+                w->end = frontend_vad_map(keep, in->frame_num, feat.frame_num, w->end);
+            }
+        }
+        if (in != &feat) {
+            feature_free(&trimmed);
+        }
+        free(keep);
+        frame_num += u->frame_num;
+        kept_num += u->kept_num > 0 ? u->kept_num : 0;
+        stats_add(&stats, &u->stats);
+        stats_add(&fast_stats, &u->fast_stats);
+        job->samp_period[n] = feat.samp_period;
+        u->speech_sec = feat.frame_num * feat.samp_period * 1e-7;
+        sec += u->speech_sec;
+        archive_release(job->ar, &feat);
+    }
+    decoder_free(&dec);
+    if (job->fast_net != NULL) {
+        decoder_free(&fast);
+    }
+
+    pthread_mutex_lock(&job->lock);
+    stats_add(&job->stats, &stats);
+    stats_add(&job->fast_stats, &fast_stats);
+    job->speech_sec += sec;
+    job->frame_num += frame_num;
+    job->kept_num += kept_num;
+    job->fallback_num += fallback_num;
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+/**
+ * Decode every file of job with thread_num threads
+ * @return elapsed seconds
+ */
+static double run(Job *job, int thread_num)
+{
+    pthread_t thread[MAX_THREAD];
+    double start = now();
+    int i;
+
+    pthread_mutex_init(&job->lock, NULL);
+    for (i = 1; i < thread_num; i++) {
+        pthread_create(&thread[i], NULL, worker, job);
+    }
+    worker(job);
+    for (i = 1; i < thread_num; i++) {
+        pthread_join(thread[i], NULL);
+    }
+    pthread_mutex_destroy(&job->lock);
+    return now() - start;
+}
+
+static int ignored(const char *word, char **ignore, int ignore_num)
+{
+    int i;
+    for (i = 0; i < ignore_num; i++) {
+        if (strcmp(word, ignore[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Word errors of the decoded files against ref, the -e words left out on
+ * both sides as with HResults -e "???" word; failed files count as empty
+ */
+static void score_job(const Job *job, const Mlf *ref, const char **out_word, char **ignore, int ignore_num,
+                      ErrorCount *count)
+{
+    char **r = NULL, **h = NULL;
+    int n, i, r_num, h_num;
+
+    memset(count, 0, sizeof(ErrorCount));
+    for (n = 0; n < job->file_num; n++) {
+        const Transcription *tr = mlf_find(ref, job->files[n]);
+        const DecodeResult *res = &job->result[n];
+        if (tr == NULL) {
+            fprintf(stderr, "%s: no reference transcription\n", job->files[n]);
+            continue;
+        }
+        r = (char **)realloc(r, sizeof(char *) * (tr->label_num + 1));
+        h = (char **)realloc(h, sizeof(char *) * (res->word_num + 1));
+        for (i = r_num = 0; i < tr->label_num; i++) {
+            if (!ignored(tr->label[i], ignore, ignore_num)) {
+                r[r_num++] = tr->label[i];
+            }
+        }
+        for (i = h_num = 0; job->status[n] == 0 && i < res->word_num; i++) {
+            const char *w = out_word[res->words[i].word];
+            if (!ignored(w, ignore, ignore_num)) {
+                h[h_num++] = (char *)w;
+            }
+        }
+        mlf_align(r, r_num, h, h_num, count);
+    }
+    free(r);
+    free(h);
+}
+
+/**
+ * Write the n best word sequences of lat as one MLF entry, "///" between them
+ */
+static void write_nbest(FILE *fp, const Lattice *lat, double lm_scale, double penalty, int n)
+{
+    LatPath *path = (LatPath *)calloc(n, sizeof(LatPath));
+    int found = lat_nbest(lat, lm_scale, penalty, n, path);
+    int k, i;
+
+    for (k = 0; k < found; k++) {
+        if (k > 0) {
+            fprintf(fp, "///\n");
+        }
+        for (i = 0; i < path[k].word_num; i++) {
+            fprintf(fp, "%ld %ld %s %f\n", (long)path[k].start[i] * lat->samp_period,
+                    (long)path[k].end[i] * lat->samp_period, lat->vocab[path[k].word[i]], path[k].word_score[i]);
+        }
+        lat_path_free(&path[k]);
+    }
+    fprintf(fp, ".\n");
+    free(path);
+}
+
+/**
+ * Wall time of the stages of main and the accuracies for the -J report
+ */
+typedef struct {
+    double model_sec, net_sec, setup_sec, decode_sec, output_sec;
+    int thread_num;
+    const ErrorCount *count;       // NULL without -I
+    const ErrorCount *one_pass;    // Float pass at every frame next to the approximate one, NULL if not run
+    double one_pass_sec;
+} Report;
+
+static void json_count(FILE *fp, const char *key, const ErrorCount *c)
+{
+    int N = c->ref_num > 0 ? c->ref_num : 1;
+    fprintf(fp, "  \"%s\": {\"corr\": %.2f, \"acc\": %.2f, \"H\": %d, \"D\": %d, \"S\": %d, "
+            "\"I\": %d, \"N\": %d},\n", key, 100.0 * c->hit / N, 100.0 * (c->hit - c->ins) / N,
+            c->hit, c->del, c->sub, c->ins, c->ref_num);
+}
+
+/**
+ * Decoding cost per utterance and in total as JSON, to tune the beams by
+ * measured cost against accuracy
+ */
+static void write_report(const char *filename, const Job *job, const Report *r)
+{
+    FILE *fp = open_or_die(filename, "w");
+    const DecodeConfig *cfg = job->cfg;
+    char name[MAX_NAME];
+    double busy = 0;
+    int n, fail_num = 0;
+
+    for (n = 0; n < job->file_num; n++) {
+        const UttStats *u = &job->utt[n];
+        busy += u->load_sec + u->fast_sec + u->decode_sec + u->lattice_sec;
+        fail_num += job->status[n] < 0;
+    }
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"config\": {\"beam\": %g, \"word_beam\": %g, \"max_active\": %d, \"penalty\": %g, "
+            "\"lm_scale\": %g, \"gsel_codewords\": %d, \"batch\": %d, \"compiled\": \"%s\", \"fast_match\": %d",
+            cfg->beam, cfg->word_beam, cfg->max_active, job->penalty, job->lm_scale,
+            cfg->gsel != NULL ? cfg->gsel->code_num : 0, cfg->table != NULL,
+            cfg->quant == NULL ? "none" : cfg->quant->type == QUANT_INT8 ? "int8" : "f16", job->fast_net != NULL);
+    if (job->fast_net != NULL) {
+        fprintf(fp, ", \"fast_beam\": %g", job->fast_cfg->beam);
+    }
+    if (cfg->frame_skip > 1) {
+        fprintf(fp, ", \"frame_skip\": %d, \"skip_hold\": %d", cfg->frame_skip, cfg->skip_hold);
+    }
+    if (job->vad_pad > 0) {
+        fprintf(fp, ", \"vad_pad\": %d", job->vad_pad);
+    }
+    fprintf(fp, "},\n");
+    fprintf(fp, "  \"threads\": %d,\n  \"files\": %d,\n  \"failed\": %d,\n", r->thread_num, job->file_num, fail_num);
+    if (job->fast_net != NULL) {
+        fprintf(fp, "  \"fast_fallbacks\": %d,\n", job->fallback_num);
+    }
+    fprintf(fp, "  \"speech_sec\": %.3f,\n", job->speech_sec);
+    if (job->vad_pad > 0) {
+        fprintf(fp, "  \"vad_frames\": {\"total\": %ld, \"kept\": %ld},\n", job->frame_num, job->kept_num);
+    }
+    fprintf(fp, "  \"rtf\": %.5f,\n", job->speech_sec > 0 ? r->decode_sec / job->speech_sec : 0);
+    fprintf(fp, "  \"rtf_per_thread\": %.5f,\n", job->speech_sec > 0 ? busy / job->speech_sec : 0);
+    fprintf(fp, "  \"wall_sec\": {\"load_models\": %.4f, \"build_network\": %.4f, \"setup\": %.4f, "
+            "\"decode\": %.4f, \"write_output\": %.4f},\n",
+            r->model_sec, r->net_sec, r->setup_sec, r->decode_sec, r->output_sec);
+    if (r->count != NULL) {
+        json_count(fp, "accuracy", r->count);
+    }
+    if (r->one_pass != NULL) {
+        json_count(fp, "one_pass_accuracy", r->one_pass);
+        fprintf(fp, "  \"one_pass_decode_sec\": %.4f,\n", r->one_pass_sec);
+    }
+    if (job->fast_net != NULL) {
+        fprintf(fp, "  \"fast_pass\": {\n");
+        json_stats(fp, &job->fast_stats, "    ");
+        fprintf(fp, "\n  },\n");
+    }
+    json_stats(fp, &job->stats, "  ");
+    fprintf(fp, ",\n");
+
+    // Thread time of every phase, summed over the utterances
+    fprintf(fp, "  \"utterances\": [\n");
+    for (n = 0; n < job->file_num; n++) {
+        const UttStats *u = &job->utt[n];
+        double sec = u->load_sec + u->fast_sec + u->decode_sec + u->lattice_sec;
+
+        archive_key(job->files[n], name);
+        fprintf(fp, "    {\"name\": ");
+        json_string(fp, name);
+        fprintf(fp, ", \"status\": %d, \"speech_sec\": %.3f, \"rtf\": %.5f, \"kept_frames\": %d,\n",
+                job->status[n], u->speech_sec, u->speech_sec > 0 ? sec / u->speech_sec : 0, u->kept_num);
+        if (job->status[n] == 0) {
+            fprintf(fp, "     \"score\": %.4f, \"words\": %d,\n", job->result[n].score, job->result[n].word_num);
+        }
+        fprintf(fp, "     \"phase_sec\": {\"load\": %.5f, \"fast_pass\": %.5f, \"decode\": %.5f, "
+                "\"lattice\": %.5f},\n", u->load_sec, u->fast_sec, u->decode_sec, u->lattice_sec);
+        if (job->fast_net != NULL) {
+            fprintf(fp, "     \"fast_pass\": {\"fallback\": %d, ", u->fallback);
+            json_stats(fp, &u->fast_stats, "");
+            fprintf(fp, "},\n");
+        }
+        json_stats(fp, &u->stats, "     ");
+        fprintf(fp, "}%s\n", n + 1 < job->file_num ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+}
+
+static void count_print(const char *title, const ErrorCount *c)
+{
+    int N = c->ref_num > 0 ? c->ref_num : 1;
+    printf("%s: %%Corr=%.2f, Acc=%.2f [H=%d, D=%d, S=%d, I=%d, N=%d]\n", title,
+           100.0 * c->hit / N, 100.0 * (c->hit - c->ins) / N, c->hit, c->del, c->sub, c->ins, c->ref_num);
+}
+
+/**
+ * Token-passing recognizer, a multi-threaded replacement for "HVite -H
+ * macros -H models -S scp -C config -w wdnet -l '*' -i out.mlf -p 0.0
+ * -s 0.0 dict hmmlist". -C, -D and -T are accepted and ignored, so the
+ * HVite command line of 04_testing.sh works unchanged; the output MLF is
+ * read by HResults. -g enables Gaussian selection with a codebook of that
+ * many codewords built from the models, -k sets the shortlist length; -b
+ * instead scores every state in blocks of frames as a matrix product.
+ *
+ * Fast match: -F loads cheap models of the same topology (e.g. the 1-mixture
+ * hmm0 models), or -m derives them by keeping the heaviest mixtures of the
+ * full ones. A first pass with beam -y over the cheap models picks the
+ * states alive at each frame, and the full models only score those. -y
+ * must be wider than -t, since the cheap models score the right path
+ * lower; it defaults to FAST_BEAM_SCALE times -t. A file whose second pass
+ * finds no path to the end is decoded again without the trail. With
+ * -I reference labels, the files are also decoded in one full pass and
+ * the word accuracies of both are reported as HResults computes them.
+ *
+ * Lattices: -n writes the N best distinct word sequences of each file to
+ * the MLF, separated by "///" as HVite -n does; -z writes an SLF lattice
+ * dir/name.lat per file and -c appends all of them to one binary cache,
+ * for lat_rescore. -r prunes the lattices to paths within that beam of the
+ * best one.
+ *
+ * Compiled models: -q int8 or -q f16 quantizes the means and precisions
+ * of the output distributions at startup, -Q loads ones written by
+ * gmm_compile. With -I, the files are also decoded with the float models
+ * for the accuracy change.
+ *
+ * Frame skipping: -d k computes output probabilities at every k-th frame
+ * only and interpolates them in between, -dh k holds the last one instead.
+ * Models re-estimated with the same option (gmm_embed, gmm_recipe) match
+ * it best. With -I, the files are also decoded scoring every frame, for
+ * the accuracy and time it trades.
+ *
+ * Voice activity detection: -V pad drops long non-speech runs, found on
+ * the energy coefficient by frontend_vad, before decoding and keeps pad
+ * frames of silence on either side of the speech. Word and lattice times
+ * refer to the untrimmed file; the dropped frames join the word in front
+ * of them. With -I, the files are also decoded whole.
+ *
+ * -J writes the decoding cost as JSON: real-time factor, tokens, active
+ * states and Gaussians per frame, the share of tokens each pruning stage
+ * removed and the wall time of every phase, per utterance and in total.
+ */
+int main(int argc, char *argv[])
+{
+    int i, n, file_num, model_num, fail_num = 0, code_num = 0, top = GSEL_TOP;
+    int thread_num = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const char *scp = NULL, *wdnet = NULL, *out_mlf = NULL, *archive = NULL, *label_dir = "*";
+    const char *dict_file = argv[argc-2], *list = argv[argc-1];
+    double penalty = 0, lm_scale = 1, start;
+    DecodeConfig cfg = {0, 0, 0, NULL, NULL, NULL, 1, 0}, fast_cfg, float_cfg;
+    QuantModel quant;
+    const char *quant_type = NULL, *quant_file = NULL;
+    GaussSelect gsel;
+    ScoreTable table, fast_table;
+    ModelSet fast_set;
+    DecodeNet fast_net;
+    int fast;
+    double elapsed;
+    int batch = 0, vad_pad = 0, fast_mix = 0, fast_file_num = 0, ignore_num = 0, nbest = 1;
+    double fast_beam = -1, lat_beam = 0;
+    const char *lat_dir = NULL, *lat_cache = NULL, *report_file = NULL;
+    double setup_start;
+    ErrorCount count, full_count;
+    Report report;
+    const char *ref_mlf = NULL;
+    char **names, name[MAX_NAME];
+    char **fast_file = (char **)calloc(argc, sizeof(char *)), **ignore = (char **)calloc(argc, sizeof(char *));
+    const char **out_word;
+    ModelSet set;
+    Dict dict;
+    Slf slf;
+    DecodeNet net;
+    Archive archive_map;
+    FILE *fp;
+    Job job;
+
+    if (argc < 7 || argv[argc-1][0] == '-' || argv[argc-2][0] == '-') {
+        printf("Wrong argument format\n");
+        printf("Usage: ./gmm_decode [-j threads] [-t beam] [-v wordbeam] [-u maxactive] [-p penalty] "
+               "[-s lmscale] [-g codewords [-k top] | -b] [-q int8|f16 | -Q compiled] [-d k | -dh k] [-V pad] [-F mmf ... | -m mixes] [-y fastbeam > beam] "
+               "[-I ref.mlf [-e ??? word ...]] [-n N] [-z latdir] [-c cache] [-r latbeam] [-J stats.json] [-a archive] [-l dir] -H macros -H models -S test.scp "
+               "-w wdnet -i out.mlf dict hmmlist\n");
+        exit(1);
+    }
+    for (i = 1; i < argc - 2; i++) {
+        if (strcmp(argv[i], "-j") == 0) {
+            thread_num = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            cfg.beam = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-v") == 0) {
+            cfg.word_beam = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-u") == 0) {
+            cfg.max_active = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-p") == 0) {
+            penalty = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            lm_scale = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-g") == 0) {
+            code_num = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-k") == 0) {
+            top = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0) {
+            batch = 1;
+        } else if (strcmp(argv[i], "-q") == 0) {
+            quant_type = argv[++i];
+        } else if (strcmp(argv[i], "-Q") == 0) {
+            quant_file = argv[++i];
+        } else if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "-dh") == 0) {
+            cfg.skip_hold = argv[i][2] == 'h';
+            cfg.frame_skip = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-V") == 0) {
+            vad_pad = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-F") == 0) {
+            fast_file[fast_file_num++] = argv[++i];
+        } else if (strcmp(argv[i], "-m") == 0) {
+            fast_mix = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-y") == 0) {
+            fast_beam = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-I") == 0) {
+            ref_mlf = argv[++i];
+        } else if (strcmp(argv[i], "-n") == 0) {
+            nbest = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-z") == 0) {
+            lat_dir = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0) {
+            lat_cache = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0) {
+            lat_beam = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-J") == 0) {
+            report_file = argv[++i];
+        } else if (strcmp(argv[i], "-e") == 0 && i + 2 < argc - 2) {
+            i++;
+            ignore[ignore_num++] = argv[++i];
+        } else if (strcmp(argv[i], "-S") == 0) {
+            scp = argv[++i];
+        } else if (strcmp(argv[i], "-w") == 0) {
+            wdnet = argv[++i];
+        } else if (strcmp(argv[i], "-i") == 0) {
+            out_mlf = argv[++i];
+        } else if (strcmp(argv[i], "-l") == 0) {
+            label_dir = argv[++i];
+        } else if (strcmp(argv[i], "-a") == 0) {
+            archive = argv[++i];
+        } else if (strcmp(argv[i], "-H") == 0 || strcmp(argv[i], "-C") == 0 || strcmp(argv[i], "-T") == 0) {
+            i++;
+        } else if (strcmp(argv[i], "-D") == 0) {
+            continue;
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            exit(1);
+        }
+    }
+    if (scp == NULL || wdnet == NULL || out_mlf == NULL) {
+        printf("Missing -S test list, -w word network or -i output file\n");
+        exit(1);
+    }
+
+    memset(&report, 0, sizeof(Report));
+    start = now();
+    modelset_init(&set);
+    mmf_load_args(&set, argc, argv);
+    names = read_list(list, 0, &model_num);
+    for (n = 0; n < model_num; n++) {
+        if (modelset_find(&set, names[n]) == NULL) {
+            printf("Model %s of %s not found\n", names[n], list);
+            exit(1);
+        }
+    }
+    free_list(names, model_num);
+
+    report.model_sec = now() - start;
+
+    start = now();
+    if (dict_load(&dict, dict_file) < 0 || slf_load(&slf, wdnet) < 0 || \
+        net_build(&net, &slf, &dict, &set, lm_scale, penalty) < 0) {
+        exit(1);
+    }
+    report.net_sec = now() - start;
+    printf("Network: %d words, %d emitting and %d null nodes, %d arcs\n",
+           slf.node_num, net.emit_num, net.null_num, net.arc_offset[net.node_num]);
+
+    setup_start = now();
+    if (batch) {
+        score_table_init(&table, &set);
+        cfg.table = &table;
+    } else if (code_num > 0) {
+        start = now();
+        gsel_build(&gsel, &set, code_num, top);
+        cfg.gsel = &gsel;
+        printf("Gaussian selection: %d codewords, shortlists of %d, built in %.2f sec\n",
+               gsel.code_num, gsel.top, now() - start);
+    }
+
+    if (cfg.frame_skip > 1 && batch) {
+        printf("-b scores every frame, it cannot be used with -d\n");
+        exit(1);
+    }
+
+    // Compiled models replace the float output distributions
+    if (quant_file != NULL || quant_type != NULL) {
+        if (batch) {
+            printf("-b scores the float models, it cannot be used with -q or -Q\n");
+            exit(1);
+        }
+        if (quant_file != NULL) {
+            if (quant_read(&quant, quant_file, &set) < 0) {
+                exit(1);
+            }
+        } else if (strcmp(quant_type, "int8") == 0 || strcmp(quant_type, "f16") == 0) {
+            quant_build(&quant, &set, strcmp(quant_type, "int8") == 0 ? QUANT_INT8 : QUANT_F16);
+        } else {
+            printf("Unknown -q type %s, expected int8 or f16\n", quant_type);
+            exit(1);
+        }
+        cfg.quant = &quant;
+        printf("Compiled models: %s, %ld bytes of means and precisions (%ld as floats)\n",
+               quant.type == QUANT_INT8 ? "int8" : "f16", quant_bytes(&quant),
+               (long)quant.comp_num * set.vec_size * 2 * sizeof(float));
+    }
+
+    // Cheap models of the same topology for the first pass
+    fast = fast_file_num > 0 || fast_mix > 0;
+    if (fast) {
+        modelset_init(&fast_set);
+        if (fast_file_num == 0) {
+            mmf_load_args(&fast_set, argc, argv);
+        }
+        for (i = 0; i < fast_file_num; i++) {
+            if (mmf_load(&fast_set, fast_file[i]) < 0) {
+                exit(1);
+            }
+        }
+        for (i = 0; fast_mix > 0 && i < fast_set.state_num; i++) {
+            state_keep_mixtures(fast_set.state_list[i], fast_mix);
+        }
+        modelset_index(&fast_set);
+        if (net_build(&fast_net, &slf, &dict, &fast_set, lm_scale, penalty) < 0) {
+            exit(1);
+        }
+        if (fast_net.node_num != net.node_num || fast_net.emit_num != net.emit_num) {
+            printf("Fast-match models need the topology of the full models\n");
+            exit(1);
+        }
+        fast_cfg = cfg;
+        fast_cfg.beam = fast_beam >= 0 ? fast_beam : FAST_BEAM_SCALE * cfg.beam;
+        if (fast_cfg.beam > 0 && (cfg.beam == 0 || fast_cfg.beam <= cfg.beam)) {
+            fprintf(stderr, "Warning: fast-match beam %g is not wider than the beam %g, "
+                    "the first pass may lose the best path\n", fast_cfg.beam, cfg.beam);
+        }
+        fast_cfg.gsel = NULL;
+        fast_cfg.table = NULL;
+        fast_cfg.quant = NULL;
+        if (batch) {
+            score_table_init(&fast_table, &fast_set);
+            fast_cfg.table = &fast_table;
+        }
+        printf("Fast match: %d Gaussians in the first pass, %d in the full models\n",
+               fast_set.gauss_num, set.gauss_num);
+    }
+
+    report.setup_sec = now() - setup_start;
+
+    // Words are written as the output symbol of their first pronunciation
+    out_word = (const char **)calloc(slf.node_num + 1, sizeof(char *));
+    for (n = 0; n < slf.node_num; n++) {
+        if (slf.word[n] != NULL && dict_find(&dict, slf.word[n], &i) > 0) {
+            out_word[n] = dict.pron[i].out;
+        }
+    }
+
+    memset(&job, 0, sizeof(Job));
+    if (archive != NULL) {
+        if (archive_open(&archive_map, archive) < 0) {
+            exit(1);
+        }
+        job.ar = &archive_map;
+    }
+
+    job.files = read_list(scp, 0, &file_num);
+    job.file_num = file_num;
+    job.net = &net;
+    job.set = &set;
+    job.cfg = &cfg;
+    if (fast) {
+        job.fast_net = &fast_net;
+        job.fast_set = &fast_set;
+        job.fast_cfg = &fast_cfg;
+    }
+    job.result = (DecodeResult *)calloc(file_num + 1, sizeof(DecodeResult));
+    job.status = (int *)calloc(file_num + 1, sizeof(int));
+    job.samp_period = (int *)calloc(file_num + 1, sizeof(int));
+    job.utt = (UttStats *)calloc(file_num + 1, sizeof(UttStats));
+    job.lm_scale = lm_scale;
+    job.penalty = penalty;
+    job.vad_pad = vad_pad;
+    if (nbest > 1 || lat_dir != NULL || lat_cache != NULL) {
+        job.lat = (Lattice *)calloc(file_num + 1, sizeof(Lattice));
+        job.pair = slf_word_pairs(&slf);
+        job.out_word = out_word;
+        job.lat_beam = lat_beam;
+    }
+
+    if (thread_num < 1) {
+        thread_num = 1;
+    }
+    if (thread_num > MAX_THREAD) {
+        thread_num = MAX_THREAD;
+    }
+    if (thread_num > file_num && file_num > 0) {
+        thread_num = file_num;
+    }
+
+    elapsed = run(&job, thread_num);
+    report.decode_sec = elapsed;
+    report.thread_num = thread_num;
+
+    start = now();
+
+    // HVite -l dir -i out.mlf: one "dir/name.rec" entry per decoded file
+    fp = open_or_die(out_mlf, "w");
+    fprintf(fp, "#!MLF!#\n");
+    for (n = 0; n < file_num; n++) {
+        DecodeResult *r = &job.result[n];
+        if (job.status[n] < 0) {
+            fail_num++;
+            continue;
+        }
+        archive_key(job.files[n], name);
+        fprintf(fp, "\"%s/%s.rec\"\n", label_dir, name);
+        if (nbest > 1 && job.lat[n].node_num > 0) {
+            write_nbest(fp, &job.lat[n], lm_scale, penalty, nbest);
+            continue;
+        }
+        for (i = 0; i < r->word_num; i++) {
+            const WordHyp *w = &r->words[i];
+            fprintf(fp, "%ld %ld %s %f\n", (long)w->start * job.samp_period[n], (long)w->end * job.samp_period[n],
+                    out_word[w->word], w->score);
+        }
+        fprintf(fp, ".\n");
+    }
+    fclose(fp);
+
+    if (job.lat != NULL) {
+        FILE *cache = lat_cache != NULL ? open_or_die(lat_cache, "wb") : NULL;
+        char path[MAX_NAME * 2];
+        long arc_num = 0;
+        int lat_num = 0;
+        for (n = 0; n < file_num; n++) {
+            Lattice *lat = &job.lat[n];
+            if (lat->node_num == 0) {
+                continue;
+            }
+            if (lat_dir != NULL) {
+                snprintf(path, sizeof(path), "%s/%s.lat", lat_dir, lat->name);
+                lat_write_slf(lat, path);
+            }
+            if (cache != NULL) {
+                lat_cache_write(cache, lat);
+            }
+            lat_num++;
+            arc_num += lat->arc_num;
+        }
+        if (cache != NULL) {
+            fclose(cache);
+        }
+        printf("Lattices: %d with %.1f arcs on average, beam %g\n", lat_num,
+               lat_num > 0 ? (double)arc_num / lat_num : 0, lat_beam);
+    }
+
+    report.output_sec = now() - start;
+
+    printf("Decoded %d/%d files (%.1f sec of speech) in %.2f sec with %d threads, "
+           "real-time factor %.4f (%.4f per thread)\n",
+           file_num - fail_num, file_num, job.speech_sec, elapsed, thread_num,
+           job.speech_sec > 0 ? elapsed / job.speech_sec : 0,
+           job.speech_sec > 0 ? elapsed * thread_num / job.speech_sec : 0);
+    stats_print(fast ? "Fast match pass" : "Decoding", fast ? &job.fast_stats : &job.stats);
+    if (fast) {
+        stats_print("Full model pass", &job.stats);
+        printf("Fast match: %d files decoded again without the trail\n", job.fallback_num);
+    }
+    if (vad_pad > 0) {
+        printf("Voice activity detection: kept %ld of %ld frames (%.1f%%), padding %d\n", job.kept_num,
+               job.frame_num, job.frame_num > 0 ? 100.0 * job.kept_num / job.frame_num : 0, vad_pad);
+    }
+
+    if (ref_mlf != NULL) {
+        Mlf ref;
+        if (mlf_load(&ref, ref_mlf) < 0) {
+            exit(1);
+        }
+        score_job(&job, &ref, out_word, ignore, ignore_num, &count);
+        count_print(fast ? "Two-pass WORD" : cfg.quant != NULL ? "Compiled-model WORD" : \
+                    cfg.frame_skip > 1 ? "Frame-skip WORD" : vad_pad > 0 ? "Trimmed WORD" : "WORD", &count);
+        report.count = &count;
+
+        // The same files in one full pass with the float models at every
+        // frame, for the accuracy the fast match, the compiled models or
+        // frame skipping or voice activity detection cost
+        if (fast || cfg.quant != NULL || cfg.frame_skip > 1 || vad_pad > 0) {
+            Job full = job;
+            double full_elapsed;
+            float_cfg = cfg;
+            float_cfg.quant = NULL;
+            float_cfg.frame_skip = 1;
+            full.cfg = &float_cfg;
+            full.fast_net = NULL;
+            full.lat = NULL;
+            full.vad_pad = 0;
+            full.next = 0;
+            memset(&full.stats, 0, sizeof(DecodeStats));
+            memset(&full.fast_stats, 0, sizeof(DecodeStats));
+            full.result = (DecodeResult *)calloc(file_num + 1, sizeof(DecodeResult));
+            full.status = (int *)calloc(file_num + 1, sizeof(int));
+            full.utt = (UttStats *)calloc(file_num + 1, sizeof(UttStats));
+            full_elapsed = run(&full, thread_num);
+            score_job(&full, &ref, out_word, ignore, ignore_num, &full_count);
+            count_print(cfg.quant != NULL ? "Float one-pass WORD" : cfg.frame_skip > 1 && !fast ? \
+                        "Every-frame WORD" : vad_pad > 0 && !fast ? "Untrimmed WORD" : "One-pass WORD", &full_count);
+            stats_print("One pass", &full.stats);
+            if (fast) {
+                printf("Fast match: accuracy %+.2f, Gaussians per frame %.1f + %.1f vs %.1f, time %.2f vs %.2f sec\n",
+                       100.0 * ((count.hit - count.ins) - (full_count.hit - full_count.ins)) / \
+                           (count.ref_num > 0 ? count.ref_num : 1),
+                       (double)job.fast_stats.gauss_evals / job.fast_stats.frame_num,
+                       (double)job.stats.gauss_evals / job.stats.frame_num,
+                       (double)full.stats.gauss_evals / full.stats.frame_num, elapsed, full_elapsed);
+            }
+            if (cfg.quant != NULL) {
+                printf("Compiled models: accuracy %+.2f, time %.2f vs %.2f sec\n",
+                       100.0 * ((count.hit - count.ins) - (full_count.hit - full_count.ins)) / \
+                           (count.ref_num > 0 ? count.ref_num : 1), elapsed, full_elapsed);
+            }
+            if (cfg.frame_skip > 1) {
+                printf("Frame skipping %d (%s): accuracy %+.2f, Gaussians per frame %.1f vs %.1f, "
+                       "real-time factor %.4f vs %.4f\n", cfg.frame_skip, cfg.skip_hold ? "hold" : "interpolated",
+                       100.0 * ((count.hit - count.ins) - (full_count.hit - full_count.ins)) / \
+                           (count.ref_num > 0 ? count.ref_num : 1),
+                       (double)job.stats.gauss_evals / job.stats.frame_num,
+                       (double)full.stats.gauss_evals / full.stats.frame_num,
+                       job.speech_sec > 0 ? elapsed / job.speech_sec : 0,
+                       job.speech_sec > 0 ? full_elapsed / job.speech_sec : 0);
+            }
+            if (vad_pad > 0) {
+                printf("Voice activity detection: accuracy %+.2f, frames %ld vs %ld, "
+                       "real-time factor %.4f vs %.4f\n",
+                       100.0 * ((count.hit - count.ins) - (full_count.hit - full_count.ins)) / \
+                           (count.ref_num > 0 ? count.ref_num : 1), job.kept_num, job.frame_num,
+                       job.speech_sec > 0 ? elapsed / job.speech_sec : 0,
+                       job.speech_sec > 0 ? full_elapsed / job.speech_sec : 0);
+            }
+            for (n = 0; n < file_num; n++) {
+                decode_result_free(&full.result[n]);
+            }
+            free(full.result);
+            free(full.status);
+            free(full.utt);
+            report.one_pass = &full_count;
+            report.one_pass_sec = full_elapsed;
+        }
+        mlf_free(&ref);
+    }
+    if (report_file != NULL) {
+        write_report(report_file, &job, &report);
+    }
+
+    for (n = 0; n < file_num; n++) {
+        decode_result_free(&job.result[n]);
+    }
+    free(job.result);
+    free(job.status);
+    free(job.samp_period);
+    free(job.utt);
+    if (job.lat != NULL) {
+        for (n = 0; n < file_num; n++) {
+            lat_free(&job.lat[n]);
+        }
+        free(job.lat);
+        free((float *)job.pair);
+    }
+    free(out_word);
+    free(fast_file);
+    free(ignore);
+    free_list(job.files, file_num);
+    if (job.ar != NULL) {
+        archive_close(&archive_map);
+    }
+    if (cfg.gsel != NULL) {
+        gsel_free(&gsel);
+    }
+    if (cfg.table != NULL) {
+        score_table_free(&table);
+    }
+    if (cfg.quant != NULL) {
+        quant_free(&quant);
+    }
+    if (fast) {
+        if (fast_cfg.table != NULL) {
+            score_table_free(&fast_table);
+        }
+        net_free(&fast_net);
+        modelset_free(&fast_set);
+    }
+    net_free(&net);
+    slf_free(&slf);
+    dict_free(&dict);
+    modelset_free(&set);
+    return fail_num > 0;
+}
@@ -0,0 +1,189 @@
+#include "gmm.h"
+#include "mmf.h"
+#include "embed.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static int is_number(const char *s)
+{
+    char *end;
+    strtod(s, &end);
+    return end != s && *end == '\0';
+}
+
+/**
+ * Embedded Baum-Welch re-estimation, a multi-threaded replacement for
+ * "HERest -C config -I mlf -t f [i l] -S scp -H macros -H models -M dir
+ * hmmlist". -C and -T are accepted and ignored, so the HERest command
+ * lines of 03_training.sh work unchanged; -i runs several passes in one
+ * process, -b scores utterances as a matrix product (score.h). -d k (or
+ * -dh k) aligns with the output probabilities of every k-th frame, as
+ * gmm_decode -d k (-dh k) decodes, so the models match that decoder.
+ *
+ * Parallel mode like HERest -p: with -p n > 0 the process only runs the
+ * E-step over its slice of the training list and writes the sums to
+ * dir/HERn.acc; -p 0 then reads the accumulator files listed by -S (no
+ * labels needed), adds them up and runs the M-step. scripts/embed_shards.sh
+ * launches the slices as local processes, or through a cluster's job
+ * command.
+ */
+int main(int argc, char *argv[])
+{
+    int i, n, file_num, model_num, iter = 1, part = -1, binary = 0, batch = 0, frame_skip = 1, skip_hold = 0, fail_num;
+    int thread_num = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const char *scp = NULL, *mlf_file = NULL, *archive = NULL, *out_dir = NULL, *list = argv[argc-1];
+    Pruning prune = {0, 0, 0};
+    char **files, **names, path[MAX_NAME * 2];
+    ModelSet set;
+    Mlf mlf;
+    Archive archive_map, *ar = NULL;
+    EmbedData data;
+    Accumulator acc;
+
+    if (argc < 6 || argv[argc-1][0] == '-') {
+        printf("Wrong argument format\n");
+        printf("Usage: ./gmm_embed [-i iteration] [-j threads] [-t f [i l]] [-b] [-d k | -dh k] [-p n] -I labels.mlf -H macros -H models "
+               "-S train.scp [-a archive] [-M dir [-B]] hmmlist\n");
+        exit(1);
+    }
+    for (i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "-i") == 0) {
+            iter = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-j") == 0) {
+            thread_num = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            prune.beam = atof(argv[++i]);
+            if (i + 2 < argc - 1 && is_number(argv[i+1]) && is_number(argv[i+2])) {
+                prune.inc = atof(argv[++i]);
+                prune.limit = atof(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "-I") == 0) {
+            mlf_file = argv[++i];
+        } else if (strcmp(argv[i], "-S") == 0) {
+            scp = argv[++i];
+        } else if (strcmp(argv[i], "-M") == 0) {
+            out_dir = argv[++i];
+        } else if (strcmp(argv[i], "-B") == 0) {
+            binary = MMF_BINARY;
+        } else if (strcmp(argv[i], "-b") == 0) {
+            batch = 1;
+        } else if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "-dh") == 0) {
+            skip_hold = argv[i][2] == 'h';
+            frame_skip = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-p") == 0) {
+            part = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-a") == 0) {
+            archive = argv[++i];
+        } else if (strcmp(argv[i], "-H") == 0 || strcmp(argv[i], "-C") == 0 || strcmp(argv[i], "-T") == 0) {
+            i++;
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            exit(1);
+        }
+    }
+    if (scp == NULL || (mlf_file == NULL && part != 0)) {
+        printf("Missing -S training list or -I label file\n");
+        exit(1);
+    }
+    if (part > 0 && (out_dir == NULL || iter != 1)) {
+        printf("-p %d writes one pass of accumulators to the -M directory\n", part);
+        exit(1);
+    }
+
+    modelset_init(&set);
+    mmf_load_args(&set, argc, argv);
+
+    names = read_list(list, 0, &model_num);
+    for (n = 0; n < model_num; n++) {
+        if (modelset_find(&set, names[n]) == NULL) {
+            printf("Model %s of %s not found\n", names[n], list);
+            exit(1);
+        }
+    }
+    free_list(names, model_num);
+
+    if (part == 0) {
+        // Merge: the M-step over the sums of every slice
+        double start = now();
+        acc_init(&acc, &set);
+        files = read_list(scp, 0, &file_num);
+        for (n = 0; n < file_num; n++) {
+            if (acc_read_add(&acc, files[n]) < 0) {
+                exit(1);
+            }
+        }
+        modelset_update(&set, &acc);
+        printf("merged %d accumulators: %d files, %ld frames in %.2f sec, average log prob per frame = %f\n",
+            file_num, acc.utt_num, acc.frame_num, now() - start,
+            acc.frame_num > 0 ? acc.log_likelihood / acc.frame_num : LZERO);
+        if (out_dir != NULL && mmf_save_dir(&set, out_dir, binary) < 0) {
+            exit(1);
+        }
+        acc_free(&acc);
+        free_list(files, file_num);
+        modelset_free(&set);
+        return 0;
+    }
+
+    if (mlf_load(&mlf, mlf_file) < 0) {
+        exit(1);
+    }
+
+    if (archive != NULL) {
+        if (archive_open(&archive_map, archive) < 0) {
+            exit(1);
+        }
+        ar = &archive_map;
+    }
+
+    files = read_list(scp, 0, &file_num);
+    if (embed_data_init(&data, &set, &mlf, files, file_num, ar) < 0) {
+        exit(1);
+    }
+    data.batch = batch;
+    data.frame_skip = frame_skip;
+    data.skip_hold = skip_hold;
+
+    acc_init(&acc, &set);
+    for (i = 0; i < iter; i++) {
+        double start = now();
+        fail_num = embed_pass(&set, &data, &prune, thread_num, &acc);
+        if (part > 0) {
+            snprintf(path, sizeof(path), "%s/HER%d.acc", out_dir, part);
+            if (acc_write(&acc, path) < 0) {
+                exit(1);
+            }
+            printf("slice %d: %d/%d files (%d skipped) in %.2f sec, accumulators written to %s\n",
+                part, acc.utt_num, file_num, fail_num, now() - start, path);
+            out_dir = NULL;
+            break;
+        }
+        modelset_update(&set, &acc);
+        printf("iteration %d: %d/%d files (%d skipped) in %.2f sec, average log prob per frame = %f\n",
+            i + 1, acc.utt_num, file_num, fail_num, now() - start,
+            acc.frame_num > 0 ? acc.log_likelihood / acc.frame_num : LZERO);
+    }
+
+    if (out_dir != NULL && mmf_save_dir(&set, out_dir, binary) < 0) {
+        exit(1);
+    }
+
+    acc_free(&acc);
+    embed_data_free(&data);
+    free_list(files, file_num);
+    if (ar != NULL) {
+        archive_close(ar);
+    }
+    mlf_free(&mlf);
+    modelset_free(&set);
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "gmm.h"
+#include "mmf.h"
+#include "hed.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Native replacement for "HHEd -H macros -H models -M dir edit.hed
+ * hmmlist": apply the edit script with hed_apply and write dir/macros and
+ * dir/models. Unlike HHEd, mixture tying (JO + TI of .mix items) keeps
+ * plain states with ~m macros, which every tool of this directory can
+ * read back. Without the statistics of a re-estimation pass, the
+ * clustering commands count every state 1.
+ */
+int main(int argc, char *argv[])
+{
+    int n, model_num, binary = 0;
+    const char *out_dir = NULL, *hed = argv[argc-2], *list = argv[argc-1];
+    char **names;
+    ModelSet set;
+
+    if (argc < 7 || argv[argc-1][0] == '-' || argv[argc-2][0] == '-') {
+        printf("Wrong argument format\n");
+        printf("Usage: ./gmm_hed -H macros -H models -M dir [-B] edit.hed hmmlist\n");
+        exit(1);
+    }
+    for (n = 1; n < argc - 2; n++) {
+        if (strcmp(argv[n], "-M") == 0) {
+            out_dir = argv[++n];
+        } else if (strcmp(argv[n], "-B") == 0) {
+            binary = MMF_BINARY;
+        } else if (strcmp(argv[n], "-H") == 0 || strcmp(argv[n], "-T") == 0) {
+            n++;
+        } else {
+            printf("Unknown option: %s\n", argv[n]);
+            exit(1);
+        }
+    }
+    if (out_dir == NULL) {
+        printf("Missing -M output directory\n");
+        exit(1);
+    }
+
+    modelset_init(&set);
+    mmf_load_args(&set, argc, argv);
+    names = read_list(list, 0, &model_num);
+    for (n = 0; n < model_num; n++) {
+        if (modelset_find(&set, names[n]) == NULL) {
+            printf("Model %s of %s not found\n", names[n], list);
+            exit(1);
+        }
+    }
+    free_list(names, model_num);
+
+    if (hed_apply(&set, hed, NULL) < 0) {
+        exit(1);
+    }
+    printf("%s: %d states, %d Gaussians\n", hed, set.state_num, set.gauss_num);
+    if (mmf_save_dir(&set, out_dir, binary) < 0) {
+        exit(1);
+    }
+    modelset_free(&set);
+    return 0;
+}
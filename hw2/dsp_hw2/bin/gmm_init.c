@@ -0,0 +1,196 @@
+#include "gmm.h"
+#include "mmf.h"
+#include "hed.h"
+#include "archive.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#ifndef MAX_THREAD
+    #define MAX_THREAD 64
+#endif
+
+/**
+ * Shared by the workers; file n goes to thread n % thread_num, each thread
+ * with its own statistics, and they are merged in thread order, so results
+ * only depend on the number of threads
+ */
+typedef struct {
+    char **files;
+    int file_num;
+    const Archive *ar;
+    int thread_num;
+    Welford *part;           // [thread_num]
+    int *status;             // [thread_num] 0 ok, -1 a file failed
+} Job;
+
+typedef struct {
+    Job *job;
+    int id;
+} Worker;
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void *worker(void *arg)
+{
+    Worker *w = (Worker *)arg;
+    Job *job = w->job;
+    Welford *stats = &job->part[w->id];
+    int n;
+
+    for (n = w->id; n < job->file_num; n += job->thread_num) {
+        Feature feat;
+        if (archive_load(job->ar, job->files[n], &feat) < 0) {
+            job->status[w->id] = -1;
+            continue;
+        }
+        if (feat.dim != stats->vec_size) {
+            fprintf(stderr, "%s: dimension %d, the prototype expects %d\n", job->files[n], feat.dim, stats->vec_size);
+            job->status[w->id] = -1;
+        } else {
+            welford_add(stats, feat.data, feat.frame_num);
+        }
+        archive_release(job->ar, &feat);
+    }
+    return NULL;
+}
+
+/**
+ * Flat start in one pass over the training data, a multi-threaded
+ * replacement for "HCompV -C config -o hmmdef -f 0.01 -m -S scp -M dir
+ * proto" followed by macro and models_1mixsil. The global mean and
+ * variance are accumulated per thread with Welford's update and merged;
+ * every state of proto gets them, and dir/macros (~o and the ~v varFloor1
+ * of -f times the global variance) and dir/models (a copy of proto for
+ * every model of hmmlist, the 3 state sil for sil) are written directly.
+ * -C, -T, -o, -D and -m are accepted and ignored, so the HCompV command
+ * line of 02_run_HCompV.sh only needs hmmlist appended.
+ */
+int main(int argc, char *argv[])
+{
+    int i, file_num, name_num, binary = 0, fail = 0;
+    int thread_num = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const char *scp = NULL, *archive = NULL, *out_dir = NULL;
+    const char *proto_file = argv[argc-2], *list = argv[argc-1];
+    double floor_scale = VAR_FLOOR_SCALE, start = now();
+    pthread_t thread[MAX_THREAD];
+    Worker workers[MAX_THREAD];
+    char **names;
+    ModelSet proto_set, set;
+    Archive archive_map;
+    Job job;
+
+    if (argc < 7 || argv[argc-1][0] == '-' || argv[argc-2][0] == '-') {
+        printf("Wrong argument format\n");
+        printf("Usage: ./gmm_init [-j threads] [-f scale] -S train.scp [-a archive] -M dir [-B] proto hmmlist\n");
+        exit(1);
+    }
+    for (i = 1; i < argc - 2; i++) {
+        if (strcmp(argv[i], "-j") == 0) {
+            thread_num = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0) {
+            floor_scale = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-S") == 0) {
+            scp = argv[++i];
+        } else if (strcmp(argv[i], "-a") == 0) {
+            archive = argv[++i];
+        } else if (strcmp(argv[i], "-M") == 0) {
+            out_dir = argv[++i];
+        } else if (strcmp(argv[i], "-B") == 0) {
+            binary = MMF_BINARY;
+        } else if (strcmp(argv[i], "-C") == 0 || strcmp(argv[i], "-T") == 0 || strcmp(argv[i], "-o") == 0) {
+            i++;
+        } else if (strcmp(argv[i], "-D") != 0 && strcmp(argv[i], "-m") != 0) {
+            printf("Unknown option: %s\n", argv[i]);
+            exit(1);
+        }
+    }
+    if (scp == NULL || out_dir == NULL) {
+        printf("Missing -S training list or -M output directory\n");
+        exit(1);
+    }
+
+    modelset_init(&proto_set);
+    if (mmf_load(&proto_set, proto_file) < 0 || proto_set.hmm_num == 0) {
+        fprintf(stderr, "%s: no prototype model\n", proto_file);
+        exit(1);
+    }
+
+    memset(&job, 0, sizeof(Job));
+    if (archive != NULL) {
+        if (archive_open(&archive_map, archive) < 0) {
+            exit(1);
+        }
+        job.ar = &archive_map;
+    }
+    job.files = read_list(scp, 0, &file_num);
+    job.file_num = file_num;
+
+    if (thread_num > MAX_THREAD) {
+        thread_num = MAX_THREAD;
+    }
+    if (thread_num > file_num) {
+        thread_num = file_num;
+    }
+    if (thread_num < 1) {
+        thread_num = 1;
+    }
+    job.thread_num = thread_num;
+    job.part = (Welford *)malloc(sizeof(Welford) * thread_num);
+    job.status = (int *)calloc(thread_num, sizeof(int));
+    for (i = 0; i < thread_num; i++) {
+        welford_init(&job.part[i], proto_set.vec_size);
+        workers[i].job = &job;
+        workers[i].id = i;
+    }
+    for (i = 1; i < thread_num; i++) {
+        pthread_create(&thread[i], NULL, worker, &workers[i]);
+    }
+    worker(&workers[0]);
+    for (i = 1; i < thread_num; i++) {
+        pthread_join(thread[i], NULL);
+    }
+    for (i = 0; i < thread_num; i++) {
+        fail |= job.status[i];
+        if (i > 0) {
+            welford_merge(&job.part[0], &job.part[i]);
+        }
+    }
+    if (fail) {
+        exit(1);
+    }
+    if (job.part[0].frame_num == 0) {
+        fprintf(stderr, "No training frames for the flat start\n");
+        exit(1);
+    }
+
+    modelset_init(&set);
+    names = read_list(list, 0, &name_num);
+    hed_flat_start(&set, proto_set.hmm[0], proto_set.parm_kind, &job.part[0], floor_scale, names, name_num);
+    if (mmf_save_dir(&set, out_dir, binary) < 0) {
+        exit(1);
+    }
+    printf("flat start: %d models from %s over %ld frames of %d files in %.2f sec with %d threads\n",
+           name_num, proto_file, job.part[0].frame_num, file_num, now() - start, thread_num);
+
+    for (i = 0; i < thread_num; i++) {
+        welford_free(&job.part[i]);
+    }
+    free(job.part);
+    free(job.status);
+    free_list(names, name_num);
+    free_list(job.files, file_num);
+    if (job.ar != NULL) {
+        archive_close(&archive_map);
+    }
+    modelset_free(&set);
+    modelset_free(&proto_set);
+    return 0;
+}
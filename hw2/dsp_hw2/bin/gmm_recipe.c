@@ -0,0 +1,335 @@
+#include "gmm.h"
+#include "mmf.h"
+#include "hed.h"
+#include "embed.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+
+/**
+ * Everything the recipe keeps in memory between steps
+ */
+typedef struct {
+    ModelSet set;
+    Mlf mlf;
+    int have_mlf;
+    int file_num;
+    char **files;
+    Feature *feats;         // [file_num], loaded once
+    const Archive *ar;
+    Pruning prune;
+    int thread_num;
+    int binary;
+    int batch;              // Matrix-product scoring (-b)
+    int frame_skip;         // Alignment with frame skipping (-d k, -dh k)
+    int skip_hold;
+    int stale;              // Models or labels changed since data/acc were built
+    EmbedData data;
+    Accumulator acc;
+} Recipe;
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static int is_number(const char *s)
+{
+    char *end;
+    strtod(s, &end);
+    return end != s && *end == '\0';
+}
+
+/**
+ * @return number of values after -t at argv[i]: f, or f i l
+ */
+static int prune_args(int argc, char *argv[], int i)
+{
+    return i + 3 < argc && is_number(argv[i+2]) && is_number(argv[i+3]) ? 3 : 1;
+}
+
+/**
+ * Drop the pass data built for the previous model structure
+ */
+static void invalidate(Recipe *r)
+{
+    if (!r->stale) {
+        embed_data_free(&r->data);
+        acc_free(&r->acc);
+        r->stale = 1;
+    }
+}
+
+/**
+ * HCompV -f 0.01 -m followed by macro and models_1mixsil: every state of
+ * proto gets the global mean and variance of the training data, the
+ * variance floor is a fraction of the global variance, and every model of
+ * hmmlist is a copy of proto except for the 3 state sil
+ */
+static int flat_start(Recipe *r, const char *proto_file, const char *list)
+{
+    ModelSet proto_set;
+    Welford stats;
+    int n, name_num;
+    char **names;
+
+    modelset_init(&proto_set);
+    if (mmf_load(&proto_set, proto_file) < 0 || proto_set.hmm_num == 0) {
+        fprintf(stderr, "%s: no prototype model\n", proto_file);
+        modelset_free(&proto_set);
+        return -1;
+    }
+
+    welford_init(&stats, proto_set.vec_size);
+    for (n = 0; n < r->file_num; n++) {
+        const Feature *feat = &r->feats[n];
+        if (feat->dim != stats.vec_size) {
+            fprintf(stderr, "%s: dimension %d, %s expects %d\n", r->files[n], feat->dim, proto_file, stats.vec_size);
+            welford_free(&stats);
+            modelset_free(&proto_set);
+            return -1;
+        }
+        welford_add(&stats, feat->data, feat->frame_num);
+    }
+    if (stats.frame_num == 0) {
+        fprintf(stderr, "No training frames for the flat start\n");
+        welford_free(&stats);
+        modelset_free(&proto_set);
+        return -1;
+    }
+
+    invalidate(r);
+    modelset_free(&r->set);
+    modelset_init(&r->set);
+    names = read_list(list, 0, &name_num);
+    hed_flat_start(&r->set, proto_set.hmm[0], proto_set.parm_kind, &stats, VAR_FLOOR_SCALE, names, name_num);
+    printf("flat start: %d models from %s over %ld frames\n", name_num, proto_file, stats.frame_num);
+
+    free_list(names, name_num);
+    welford_free(&stats);
+    modelset_free(&proto_set);
+    return 0;
+}
+
+/**
+ * spmodel_gen: append sp, a copy of the middle state of sil
+ */
+static int add_sp(Recipe *r)
+{
+    const Hmm *sil = modelset_find(&r->set, "sil");
+
+    if (sil == NULL || sil->state_num < 4) {
+        fprintf(stderr, "No sil model with a state 3 to build sp from\n");
+        return -1;
+    }
+    if (modelset_find(&r->set, "sp") != NULL) {
+        fprintf(stderr, "The models already have sp\n");
+        return -1;
+    }
+    invalidate(r);
+    modelset_add(&r->set, hed_sp_model(sil));
+    modelset_index(&r->set);
+    return 0;
+}
+
+/**
+ * iter embedded re-estimation passes with the current labels
+ */
+static int reestimate(Recipe *r, int iter)
+{
+    int i, fail_num;
+
+    if (!r->have_mlf || r->set.hmm_num == 0) {
+        fprintf(stderr, "-e needs models (-f or -H) and labels (-I) first\n");
+        return -1;
+    }
+    if (r->stale) {
+        if (embed_data_init(&r->data, &r->set, &r->mlf, r->files, r->file_num, r->ar) < 0) {
+            return -1;
+        }
+        r->data.feat = r->feats;
+        r->data.batch = r->batch;
+        r->data.frame_skip = r->frame_skip;
+        r->data.skip_hold = r->skip_hold;
+        acc_init(&r->acc, &r->set);
+        r->stale = 0;
+    }
+    for (i = 0; i < iter; i++) {
+        double start = now();
+        fail_num = embed_pass(&r->set, &r->data, &r->prune, r->thread_num, &r->acc);
+        modelset_update(&r->set, &r->acc);
+        printf("  pass %d: %d/%d files (%d skipped) in %.2f sec, average log prob per frame = %f\n",
+            i + 1, r->acc.utt_num, r->file_num, fail_num, now() - start,
+            r->acc.frame_num > 0 ? r->acc.log_likelihood / r->acc.frame_num : LZERO);
+    }
+    return 0;
+}
+
+/**
+ * Apply an HHEd script; the statistics of the last pass, if still
+ * current, drive its clustering commands
+ */
+static int edit(Recipe *r, const char *hed)
+{
+    int ret = hed_apply(&r->set, hed, r->stale ? NULL : &r->acc);
+
+    invalidate(r);
+    printf("edit: %s, %d states, %d Gaussians\n", hed, r->set.state_num, r->set.gauss_num);
+    return ret;
+}
+
+static void usage(void)
+{
+    printf("Wrong argument format\n");
+    printf("Usage: ./gmm_recipe [-j threads] [-t f [i l]] [-a archive] [-b] [-d k | -dh k] [-B] -S train.scp step ...\n");
+    printf("Steps run in command line order on models kept in memory:\n");
+    printf("  -f proto hmmlist    flat start (HCompV -f 0.01 -m, macro, models_1mixsil)\n");
+    printf("  -H mmf              load models instead\n");
+    printf("  -I labels.mlf       transcriptions for the following passes\n");
+    printf("  -e n                n embedded re-estimation passes (HERest)\n");
+    printf("  -p                  add sp from the middle state of sil (spmodel_gen)\n");
+    printf("  -h edit.hed         apply an HHEd script (MU, AT, TI, NC, TC, JO)\n");
+    printf("  -r n edit.hed k     n times: apply edit.hed, then k passes\n");
+    printf("  -M dir              checkpoint dir/macros and dir/models\n");
+    exit(1);
+}
+
+/**
+ * The model building part of 02_run_HCompV.sh and 03_training.sh in one
+ * process: models, labels and features stay in memory from the flat start
+ * to the last mixture split, and MMFs are only written where -M asks for
+ * a checkpoint.
+ */
+int main(int argc, char *argv[])
+{
+    Recipe r;
+    Archive archive_map;
+    const char *scp = NULL, *archive = NULL;
+    double start = now();
+    int i, n, ret = 0;
+
+    if (argc < 4) {
+        usage();
+    }
+    memset(&r, 0, sizeof(Recipe));
+    modelset_init(&r.set);
+    r.thread_num = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    r.stale = 1;
+
+    // Settings apply to every step wherever they appear
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+            scp = argv[++i];
+        } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            archive = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            r.thread_num = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            n = prune_args(argc, argv, i);
+            r.prune.beam = atof(argv[i+1]);
+            if (n == 3) {
+                r.prune.inc = atof(argv[i+2]);
+                r.prune.limit = atof(argv[i+3]);
+            }
+            i += n;
+        } else if (strcmp(argv[i], "-B") == 0) {
+            r.binary = MMF_BINARY;
+        } else if (strcmp(argv[i], "-b") == 0) {
+            r.batch = 1;
+        } else if ((strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "-dh") == 0) && i + 1 < argc) {
+            r.skip_hold = argv[i][2] == 'h';
+            r.frame_skip = atoi(argv[++i]);
+        }
+    }
+    if (scp == NULL) {
+        printf("Missing -S training list\n");
+        exit(1);
+    }
+    if (archive != NULL) {
+        if (archive_open(&archive_map, archive) < 0) {
+            exit(1);
+        }
+        r.ar = &archive_map;
+    }
+
+    r.files = read_list(scp, 0, &r.file_num);
+    r.feats = (Feature *)calloc(r.file_num + 1, sizeof(Feature));
+    for (n = 0; n < r.file_num; n++) {
+        if (archive_load(r.ar, r.files[n], &r.feats[n]) < 0) {
+            exit(1);
+        }
+    }
+    printf("%d training files in memory\n", r.file_num);
+
+    for (i = 1; i < argc && ret == 0; i++) {
+        const char *opt = argv[i];
+
+        if (strcmp(opt, "-S") == 0 || strcmp(opt, "-a") == 0 || strcmp(opt, "-j") == 0 || \
+            strcmp(opt, "-d") == 0 || strcmp(opt, "-dh") == 0) {
+            i++;
+        } else if (strcmp(opt, "-t") == 0) {
+            i += prune_args(argc, argv, i);
+        } else if (strcmp(opt, "-B") == 0 || strcmp(opt, "-b") == 0) {
+            continue;
+        } else if (strcmp(opt, "-f") == 0 && i + 2 < argc) {
+            ret = flat_start(&r, argv[i+1], argv[i+2]);
+            i += 2;
+        } else if (strcmp(opt, "-H") == 0 && i + 1 < argc) {
+            invalidate(&r);
+            ret = mmf_load(&r.set, argv[++i]);
+            modelset_index(&r.set);
+        } else if (strcmp(opt, "-I") == 0 && i + 1 < argc) {
+            invalidate(&r);
+            if (r.have_mlf) {
+                mlf_free(&r.mlf);
+            }
+            r.have_mlf = 0;
+            ret = mlf_load(&r.mlf, argv[++i]);
+            r.have_mlf = ret == 0;
+        } else if (strcmp(opt, "-e") == 0 && i + 1 < argc) {
+            printf("re-estimate: %s passes\n", argv[i+1]);
+            ret = reestimate(&r, atoi(argv[++i]));
+        } else if (strcmp(opt, "-p") == 0) {
+            printf("add sp\n");
+            ret = add_sp(&r);
+        } else if (strcmp(opt, "-h") == 0 && i + 1 < argc) {
+            ret = edit(&r, argv[++i]);
+        } else if (strcmp(opt, "-r") == 0 && i + 3 < argc) {
+            int round, rounds = atoi(argv[i+1]), iter = atoi(argv[i+3]);
+            for (round = 0; round < rounds && ret == 0; round++) {
+                ret = edit(&r, argv[i+2]);
+                if (ret == 0) {
+                    ret = reestimate(&r, iter);
+                }
+            }
+            i += 3;
+        } else if (strcmp(opt, "-M") == 0 && i + 1 < argc) {
+            printf("checkpoint: %s\n", argv[i+1]);
+            mkdir(argv[i+1], 0777);
+            ret = mmf_save_dir(&r.set, argv[++i], r.binary);
+        } else {
+            printf("Unknown option: %s\n", opt);
+            usage();
+        }
+    }
+    printf("%s in %.2f sec\n", ret == 0 ? "Done" : "Failed", now() - start);
+
+    invalidate(&r);
+    for (n = 0; n < r.file_num; n++) {
+        archive_release(r.ar, &r.feats[n]);
+    }
+    free(r.feats);
+    free_list(r.files, r.file_num);
+    if (r.ar != NULL) {
+        archive_close(&archive_map);
+    }
+    if (r.have_mlf) {
+        mlf_free(&r.mlf);
+    }
+    modelset_free(&r.set);
+    return ret != 0;
+}
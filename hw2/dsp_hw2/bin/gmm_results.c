@@ -0,0 +1,217 @@
+#include "mlf.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+
+#ifndef MAX_THREAD
+    #define MAX_THREAD 64
+#endif
+
+/**
+ * Shared by the workers; utterance n of the recognized MLF goes to thread
+ * n % thread_num, each thread with its own counts, and they are summed in
+ * thread order
+ */
+typedef struct {
+    const Mlf *ref, *rec;
+    char **from, **to;         // -e pairs, to[i] is NULL for "???"
+    int map_num;
+    int thread_num;
+    ErrorCount *count;         // [thread_num]
+    int *sent_hit;             // [thread_num] utterances without any error
+    int *sent_num;             // [thread_num] utterances scored
+} Job;
+
+typedef struct {
+    Job *job;
+    int id;
+} Worker;
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/**
+ * Apply the -e equivalences to the labels of tr
+ * @return number of labels left in out
+ */
+static int map_labels(const Job *job, const Transcription *tr, char **out)
+{
+    int i, k, num = 0;
+
+    for (i = 0; i < tr->label_num; i++) {
+        char *label = tr->label[i];
+        for (k = 0; k < job->map_num && strcmp(label, job->from[k]) != 0; k++);
+        if (k == job->map_num) {
+            out[num++] = label;
+        } else if (job->to[k] != NULL) {
+            out[num++] = job->to[k];
+        }
+    }
+    return num;
+}
+
+static void *worker(void *arg)
+{
+    Worker *w = (Worker *)arg;
+    Job *job = w->job;
+    char **r = NULL, **h = NULL;
+    int n;
+
+    for (n = w->id; n < job->rec->trans_num; n += job->thread_num) {
+        const Transcription *hyp = &job->rec->trans[n];
+        const Transcription *tr = mlf_find(job->ref, hyp->name);
+        ErrorCount c;
+        if (tr == NULL) {
+            fprintf(stderr, "%s: no reference transcription\n", hyp->name);
+            continue;
+        }
+        r = (char **)realloc(r, sizeof(char *) * (tr->label_num + 1));
+        h = (char **)realloc(h, sizeof(char *) * (hyp->label_num + 1));
+        memset(&c, 0, sizeof(ErrorCount));
+        mlf_align(r, map_labels(job, tr, r), h, map_labels(job, hyp, h), &c);
+
+        job->count[w->id].ref_num += c.ref_num;
+        job->count[w->id].hit += c.hit;
+        job->count[w->id].sub += c.sub;
+        job->count[w->id].del += c.del;
+        job->count[w->id].ins += c.ins;
+        job->sent_hit[w->id] += c.sub == 0 && c.del == 0 && c.ins == 0;
+        job->sent_num[w->id]++;
+    }
+    free(r);
+    free(h);
+    return NULL;
+}
+
+/**
+ * Word and sentence accuracy of a recognized MLF, a multi-threaded
+ * replacement for "HResults -e ??? sil -e ??? sp -I ref.mlf hmmlist
+ * rec.mlf". Utterances are aligned independently by mlf_align, so they are
+ * spread over the threads. -e s t replaces label t by s on both sides, and
+ * leaves it out when s is "???". Either MLF may be a binary cache; -c
+ * writes one of ref.mlf, so later runs can pass it to -I instead. hmmlist
+ * is only there for HResults compatibility.
+ */
+int main(int argc, char *argv[])
+{
+    int i, map_num = 0, sent_hit = 0, sent_num = 0;
+    int thread_num = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const char *ref_file = NULL, *cache = NULL, *rec_file = argv[argc-1];
+    char **from = (char **)calloc(argc, sizeof(char *)), **to = (char **)calloc(argc, sizeof(char *));
+    double start = now(), load_time;
+    pthread_t thread[MAX_THREAD];
+    Worker workers[MAX_THREAD];
+    ErrorCount total;
+    Mlf ref, rec;
+    Job job;
+    time_t t;
+    int N;
+
+    if (argc < 5 || argv[argc-1][0] == '-' || argv[argc-2][0] == '-') {
+        printf("Wrong argument format\n");
+        printf("Usage: ./gmm_results [-j threads] [-e new old ...] [-c cache] -I ref.mlf hmmlist rec.mlf\n");
+        exit(1);
+    }
+    for (i = 1; i < argc - 2; i++) {
+        if (strcmp(argv[i], "-j") == 0) {
+            thread_num = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-e") == 0 && i + 2 < argc - 2) {
+            to[map_num] = strcmp(argv[i+1], "???") == 0 ? NULL : argv[i+1];
+            from[map_num++] = argv[i+2];
+            i += 2;
+        } else if (strcmp(argv[i], "-c") == 0) {
+            cache = argv[++i];
+        } else if (strcmp(argv[i], "-I") == 0) {
+            ref_file = argv[++i];
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            exit(1);
+        }
+    }
+    if (ref_file == NULL) {
+        printf("Missing -I reference MLF\n");
+        exit(1);
+    }
+
+    if (mlf_load(&ref, ref_file) < 0 || mlf_load(&rec, rec_file) < 0) {
+        exit(1);
+    }
+    if (cache != NULL && mlf_write_cache(&ref, cache) < 0) {
+        exit(1);
+    }
+    load_time = now() - start;
+
+    if (thread_num > MAX_THREAD) {
+        thread_num = MAX_THREAD;
+    }
+    if (thread_num > rec.trans_num) {
+        thread_num = rec.trans_num;
+    }
+    if (thread_num < 1) {
+        thread_num = 1;
+    }
+    memset(&job, 0, sizeof(Job));
+    job.ref = &ref;
+    job.rec = &rec;
+    job.from = from;
+    job.to = to;
+    job.map_num = map_num;
+    job.thread_num = thread_num;
+    job.count = (ErrorCount *)calloc(thread_num, sizeof(ErrorCount));
+    job.sent_hit = (int *)calloc(thread_num, sizeof(int));
+    job.sent_num = (int *)calloc(thread_num, sizeof(int));
+    for (i = 0; i < thread_num; i++) {
+        workers[i].job = &job;
+        workers[i].id = i;
+    }
+    for (i = 1; i < thread_num; i++) {
+        pthread_create(&thread[i], NULL, worker, &workers[i]);
+    }
+    worker(&workers[0]);
+    for (i = 1; i < thread_num; i++) {
+        pthread_join(thread[i], NULL);
+    }
+
+    memset(&total, 0, sizeof(ErrorCount));
+    for (i = 0; i < thread_num; i++) {
+        total.ref_num += job.count[i].ref_num;
+        total.hit += job.count[i].hit;
+        total.sub += job.count[i].sub;
+        total.del += job.count[i].del;
+        total.ins += job.count[i].ins;
+        sent_hit += job.sent_hit[i];
+        sent_num += job.sent_num[i];
+    }
+
+    t = time(NULL);
+    N = total.ref_num > 0 ? total.ref_num : 1;
+    printf("====================== HTK Results Analysis =======================\n");
+    printf("  Date: %s", ctime(&t));
+    printf("  Ref : %s\n", ref_file);
+    printf("  Rec : %s\n", rec_file);
+    printf("------------------------ Overall Results --------------------------\n");
+    printf("SENT: %%Correct=%.2f [H=%d, S=%d, N=%d]\n",
+           100.0 * sent_hit / (sent_num > 0 ? sent_num : 1), sent_hit, sent_num - sent_hit, sent_num);
+    printf("WORD: %%Corr=%.2f, Acc=%.2f [H=%d, D=%d, S=%d, I=%d, N=%d]\n",
+           100.0 * total.hit / N, 100.0 * (total.hit - total.ins) / N,
+           total.hit, total.del, total.sub, total.ins, total.ref_num);
+    printf("===================================================================\n");
+    fprintf(stderr, "gmm_results: %d utterances in %.3f sec (MLFs loaded in %.3f sec) with %d threads\n",
+            sent_num, now() - start, load_time, thread_num);
+
+    free(job.count);
+    free(job.sent_hit);
+    free(job.sent_num);
+    free(from);
+    free(to);
+    mlf_free(&ref);
+    mlf_free(&rec);
+    return 0;
+}
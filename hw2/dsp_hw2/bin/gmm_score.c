@@ -0,0 +1,99 @@
+#include "gmm.h"
+#include "mmf.h"
+#include "archive.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Isolated-unit recognition: score every file against every model in the
+ * list and report the best one, by Viterbi (default) or forward (-f)
+ */
+int main(int argc, char *argv[])
+{
+    int i, j, n, file_num, model_num, forward = 0;
+    const char *scp = NULL, *archive = NULL, *result_file = NULL, *hmmlist = argv[argc-1];
+    char **files, **names;
+    ModelSet set;
+    Hmm **hmms;
+    FILE *fp;
+    Archive archive_map, *ar = NULL;
+
+    if (argc < 4 || argv[argc-1][0] == '-') {
+        printf("Wrong argument format\n");
+        printf("Usage: ./gmm_score [-f] -H macros -H models -S test.scp [-a archive] [-o result.txt] hmmlist\n");
+        exit(1);
+    }
+    for (i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "-f") == 0) {
+            forward = 1;
+        } else if (strcmp(argv[i], "-S") == 0) {
+            scp = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0) {
+            result_file = argv[++i];
+        } else if (strcmp(argv[i], "-a") == 0) {
+            archive = argv[++i];
+        } else if (strcmp(argv[i], "-H") == 0) {
+            i++;
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            exit(1);
+        }
+    }
+    if (scp == NULL) {
+        printf("Missing -S test list\n");
+        exit(1);
+    }
+
+    modelset_init(&set);
+    mmf_load_args(&set, argc, argv);
+
+    names = read_list(hmmlist, 0, &model_num);
+    hmms = (Hmm **)malloc(sizeof(Hmm *) * model_num);
+    for (j = 0; j < model_num; j++) {
+        hmms[j] = modelset_find(&set, names[j]);
+        if (hmms[j] == NULL) {
+            printf("Model %s not found\n", names[j]);
+            exit(1);
+        }
+    }
+
+    fp = result_file != NULL ? open_or_die(result_file, "w") : stdout;
+    if (archive != NULL) {
+        if (archive_open(&archive_map, archive) < 0) {
+            exit(1);
+        }
+        ar = &archive_map;
+    }
+
+    files = read_list(scp, 0, &file_num);
+    for (n = 0; n < file_num; n++) {
+        Feature feat;
+        double score, best_score = LZERO;
+        int best = -1;
+
+        if (archive_load(ar, files[n], &feat) < 0) {
+            exit(1);
+        }
+        for (j = 0; j < model_num; j++) {
+            score = forward ? hmm_forward(hmms[j], &feat) : hmm_viterbi(hmms[j], &feat, NULL);
+            if (score > best_score) {
+                best_score = score;
+                best = j;
+            }
+        }
+        fprintf(fp, "%s %s %e\n", files[n], best >= 0 ? names[best] : "!NULL", best_score);
+        archive_release(ar, &feat);
+    }
+    if (fp != stdout) {
+        fclose(fp);
+    }
+
+    free(hmms);
+    free_list(names, model_num);
+    free_list(files, file_num);
+    if (ar != NULL) {
+        archive_close(ar);
+    }
+    modelset_free(&set);
+    return 0;
+}
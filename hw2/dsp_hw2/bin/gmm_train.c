@@ -0,0 +1,106 @@
+#include "gmm.h"
+#include "mmf.h"
+#include "archive.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Baum-Welch re-estimation of one model from isolated examples, like HRest:
+ * every file in the script is one complete token of the model.
+ */
+int main(int argc, char *argv[])
+{
+    int i, n, file_num, iter = 1, binary = 0;
+    const char *scp = NULL, *archive = NULL, *out_dir = NULL, *name = argv[argc-1];
+    char **files;
+    ModelSet set;
+    Hmm *hmm;
+    Feature *feats;
+    Accumulator acc;
+    Archive archive_map, *ar = NULL;
+
+    if (argc < 4 || argv[argc-1][0] == '-') {
+        printf("Wrong argument format\n");
+        printf("Usage: ./gmm_train [-i iteration] -H macros -H models -S train.scp [-a archive] [-M dir [-B]] model_name\n");
+        exit(1);
+    }
+    for (i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "-i") == 0) {
+            iter = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-S") == 0) {
+            scp = argv[++i];
+        } else if (strcmp(argv[i], "-M") == 0) {
+            out_dir = argv[++i];
+        } else if (strcmp(argv[i], "-B") == 0) {
+            binary = MMF_BINARY;
+        } else if (strcmp(argv[i], "-a") == 0) {
+            archive = argv[++i];
+        } else if (strcmp(argv[i], "-H") == 0) {
+            i++;
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            exit(1);
+        }
+    }
+    if (scp == NULL) {
+        printf("Missing -S training list\n");
+        exit(1);
+    }
+
+    modelset_init(&set);
+    mmf_load_args(&set, argc, argv);
+
+    hmm = modelset_find(&set, name);
+    if (hmm == NULL) {
+        printf("Model %s not found\n", name);
+        exit(1);
+    }
+
+    if (archive != NULL) {
+        if (archive_open(&archive_map, archive) < 0) {
+            exit(1);
+        }
+        ar = &archive_map;
+    }
+
+    files = read_list(scp, 0, &file_num);
+    feats = (Feature *)calloc(file_num, sizeof(Feature));
+    for (n = 0; n < file_num; n++) {
+        if (archive_load(ar, files[n], &feats[n]) < 0) {
+            exit(1);
+        }
+        if (feats[n].dim != set.vec_size) {
+            printf("%s: dimension %d, models expect %d\n", files[n], feats[n].dim, set.vec_size);
+            exit(1);
+        }
+    }
+
+    acc_init(&acc, &set);
+    for (i = 0; i < iter; i++) {
+        acc_reset(&acc);
+        for (n = 0; n < file_num; n++) {
+            if (hmm_accumulate(hmm, &feats[n], &acc) <= LSMALL) {
+                printf("%s: cannot be generated by %s, skipped\n", files[n], name);
+            }
+        }
+        modelset_update(&set, &acc);
+        printf("iteration %d: %d/%d files, average log prob per frame %f\n", i + 1, acc.utt_num, file_num,
+            acc.frame_num > 0 ? acc.log_likelihood / acc.frame_num : LZERO);
+    }
+
+    if (out_dir != NULL && mmf_save_dir(&set, out_dir, binary) < 0) {
+        exit(1);
+    }
+
+    acc_free(&acc);
+    for (n = 0; n < file_num; n++) {
+        archive_release(ar, &feats[n]);
+    }
+    free(feats);
+    free_list(files, file_num);
+    if (ar != NULL) {
+        archive_close(ar);
+    }
+    modelset_free(&set);
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include "gsel.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static double distance(const GaussSelect *gs, const float *a, const float *b)
+{
+    int k;
+    double sum = 0;
+
+    for (k = 0; k < gs->vec_size; k++) {
+        double d = a[k] - b[k];
+        sum += d * d * gs->weight[k];
+    }
+    return sum;
+}
+
+int gsel_quantize(const GaussSelect *gs, const float *x)
+{
+    int c, best = 0;
+    double d, min = HUGE_VAL;
+
+    for (c = 0; c < gs->code_num; c++) {
+        d = distance(gs, x, gs->code + (size_t)c * gs->vec_size);
+        if (d < min) {
+            min = d;
+            best = c;
+        }
+    }
+    return best;
+}
+
+/**
+ * k-means of the Gaussian means, starting from evenly spaced Gaussians
+ */
+static void train_codebook(GaussSelect *gs, const ModelSet *set)
+{
+    int i, c, k, it, dim = gs->vec_size;
+    double *sum = (double *)malloc(sizeof(double) * gs->code_num * dim);
+    int *count = (int *)malloc(sizeof(int) * gs->code_num);
+
+    for (c = 0; c < gs->code_num; c++) {
+        const Gaussian *g = set->gauss_list[(long)c * set->gauss_num / gs->code_num];
+        memcpy(gs->code + (size_t)c * dim, g->mean, sizeof(float) * dim);
+    }
+    for (it = 0; it < GSEL_ITERATION; it++) {
+        memset(sum, 0, sizeof(double) * gs->code_num * dim);
+        memset(count, 0, sizeof(int) * gs->code_num);
+        for (i = 0; i < set->gauss_num; i++) {
+            const float *mean = set->gauss_list[i]->mean;
+            c = gsel_quantize(gs, mean);
+            count[c]++;
+            for (k = 0; k < dim; k++) {
+                sum[c * dim + k] += mean[k];
+            }
+        }
+        for (c = 0; c < gs->code_num; c++) {
+            // An empty cluster keeps its codeword
+            for (k = 0; k < dim && count[c] > 0; k++) {
+                gs->code[c * dim + k] = (float)(sum[c * dim + k] / count[c]);
+            }
+        }
+    }
+    free(sum);
+    free(count);
+}
+
+void gsel_build(GaussSelect *gs, const ModelSet *set, int code_num, int top)
+{
+    int c, s, m, k, i, dim = set->vec_size;
+    double *lp = NULL;
+    char *used = NULL;
+
+    memset(gs, 0, sizeof(GaussSelect));
+    gs->vec_size = dim;
+    gs->code_num = code_num < set->gauss_num ? code_num : set->gauss_num;
+    gs->top = top;
+    gs->state_num = set->state_num;
+    gs->code = (float *)malloc(sizeof(float) * gs->code_num * dim);
+    gs->weight = (float *)calloc(dim, sizeof(float));
+    gs->list = (short *)malloc(sizeof(short) * gs->code_num * gs->state_num * top);
+    gs->rest = (float *)malloc(sizeof(float) * gs->code_num * gs->state_num);
+
+    for (i = 0; i < set->gauss_num; i++) {
+        for (k = 0; k < dim; k++) {
+            gs->weight[k] += set->gauss_list[i]->ivar[k] / set->gauss_num;
+        }
+    }
+    train_codebook(gs, set);
+
+    for (c = 0; c < gs->code_num; c++) {
+        const float *code = gs->code + (size_t)c * dim;
+        for (s = 0; s < gs->state_num; s++) {
+            const State *st = set->state_list[s];
+            short *list = gs->list + ((size_t)c * gs->state_num + s) * top;
+            double rest = LZERO;
+
+            lp = (double *)realloc(lp, sizeof(double) * st->mix_num);
+            used = (char *)realloc(used, st->mix_num);
+            state_log_prob(st, code, lp);
+            memset(used, 0, st->mix_num);
+
+            // Best top mixtures at the codeword by selection
+            for (k = 0; k < top; k++) {
+                int best = -1;
+                for (m = 0; m < st->mix_num; m++) {
+                    if (!used[m] && st->weight[m] > 0 && (best < 0 || lp[m] > lp[best])) {
+                        best = m;
+                    }
+                }
+                list[k] = (short)best;
+                if (best >= 0) {
+                    used[best] = 1;
+                }
+            }
+            for (m = 0; m < st->mix_num; m++) {
+                if (!used[m]) {
+                    rest = log_add(rest, lp[m]);
+                }
+            }
+            gs->rest[(size_t)c * gs->state_num + s] = (float)rest;
+        }
+    }
+    free(lp);
+    free(used);
+}
+
+void gsel_free(GaussSelect *gs)
+{
+    free(gs->code);
+    free(gs->weight);
+    free(gs->list);
+    free(gs->rest);
+    memset(gs, 0, sizeof(GaussSelect));
+}
+
+double gsel_state_log_prob(const GaussSelect *gs, const State *s, const float *x, int code, long *gauss_num)
+{
+    const short *list = gs->list + ((size_t)code * gs->state_num + s->index) * gs->top;
+    double total = gs->rest[(size_t)code * gs->state_num + s->index];
+    int k, m;
+
+    for (k = 0; k < gs->top && list[k] >= 0; k++) {
+        m = list[k];
+        total = log_add(total, log(s->weight[m]) + gaussian_log_prob(s->gauss[m], x));
+    }
+    *gauss_num += k;
+    return total;
+}
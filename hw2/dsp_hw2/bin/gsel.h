@@ -0,0 +1,50 @@
+#ifndef GSEL_HEADER_
+#define GSEL_HEADER_
+
+#include "gmm.h"
+
+/**
+ * Gaussian selection with a vector-quantized codebook, after Bocchieri.
+ * The means of all Gaussians of a model set are clustered into codewords.
+ * For every (codeword, state) pair, the mixtures scoring best at the
+ * codeword form a shortlist; the others are approximated by their log
+ * density at the codeword, summed once when the codebook is built.
+ *
+ * A frame is quantized with one nearest-codeword search, then a state
+ * costs only its shortlist instead of all its mixtures.
+ */
+
+#ifndef GSEL_ITERATION
+    #define GSEL_ITERATION 10   // k-means passes over the Gaussian means
+#endif
+
+typedef struct {
+    int vec_size;
+    int code_num;        // Codewords
+    int top;             // Shortlist length
+    int state_num;       // Indexed states of the model set
+    float *code;         // [code_num][vec_size] codewords
+    float *weight;       // [vec_size] distance weight, mean inverse variance
+    short *list;         // [code_num][state_num][top] mixture numbers, -1 past the end
+    float *rest;         // [code_num][state_num] log sum of the mixtures left out, LZERO if none
+} GaussSelect;
+
+/**
+ * Build a codebook of code_num codewords with shortlists of top mixtures
+ * @param set indexed by modelset_index
+ */
+void gsel_build(GaussSelect *gs, const ModelSet *set, int code_num, int top);
+void gsel_free(GaussSelect *gs);
+
+/**
+ * @return codeword nearest to x
+ */
+int gsel_quantize(const GaussSelect *gs, const float *x);
+
+/**
+ * Approximate state_log_prob of s at x, which quantizes to code
+ * @param gauss_num incremented by the number of Gaussians evaluated
+ */
+double gsel_state_log_prob(const GaussSelect *gs, const State *s, const float *x, int code, long *gauss_num);
+
+#endif
@@ -0,0 +1,804 @@
+#include "hed.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <fnmatch.h>
+
+#ifndef MAX_ITEM_TEXT
+    #define MAX_ITEM_TEXT 4096
+#endif
+
+static const float sil_transp[5][5] = {
+    { 0, 1.0, 0,   0,   0   },
+    { 0, 0.6, 0.4, 0,   0   },
+    { 0, 0,   0.6, 0.4, 0   },
+    { 0, 0,   0,   0.7, 0.3 },
+    { 0, 0,   0,   0,   0   },
+};
+
+static const float sp_transp[3][3] = {
+    { 0, 1.0, 0   },
+    { 0, 0.5, 0.5 },
+    { 0, 0,   0   },
+};
+
+Hmm *hed_silence_model(const Hmm *proto)
+{
+    int i;
+    Hmm *sil = hmm_new("sil", 5);
+
+    for (i = 1; i < 4; i++) {
+        sil->state[i] = state_clone(proto->state[1]);
+    }
+    sil->transp = transp_new(5);
+    memcpy(sil->transp->prob, sil_transp, sizeof(sil_transp));
+    return sil;
+}
+
+Hmm *hed_sp_model(const Hmm *sil)
+{
+    Hmm *sp = hmm_new("sp", 3);
+
+    sp->state[1] = state_clone(sil->state[sil->state_num / 2]);
+    sp->transp = transp_new(3);
+    memcpy(sp->transp->prob, sp_transp, sizeof(sp_transp));
+    return sp;
+}
+
+void hed_flat_start(ModelSet *set, Hmm *proto, int parm_kind, const Welford *stats, double floor_scale,
+                    char **names, int name_num)
+{
+    int n, j, m, k, dim = stats->vec_size;
+
+    set->vec_size = dim;
+    set->parm_kind = parm_kind;
+    set->var_floor = (float *)malloc(sizeof(float) * dim);
+    for (k = 0; k < dim; k++) {
+        set->var_floor[k] = (float)(floor_scale * stats->m2[k] / stats->frame_num);
+    }
+    for (j = 1; j < proto->state_num - 1; j++) {
+        const State *s = proto->state[j];
+        for (m = 0; m < s->mix_num; m++) {
+            Gaussian *g = s->gauss[m];
+            for (k = 0; k < dim; k++) {
+                g->mean[k] = (float)stats->mean[k];
+                g->var[k] = (float)(stats->m2[k] / stats->frame_num);
+            }
+            gaussian_update(g);
+        }
+    }
+    for (n = 0; n < name_num; n++) {
+        if (strcmp(names[n], "sil") == 0) {
+            modelset_add(set, hed_silence_model(proto));
+        } else {
+            modelset_add(set, hmm_clone(proto, names[n]));
+        }
+    }
+    modelset_index(set);
+}
+
+/**
+ * Items of an item list: a model and an emitting state (0-based like
+ * Hmm.state), or state -1 for the transition matrix
+ */
+typedef struct {
+    int num, cap;
+    Hmm **hmm;
+    int *state;
+    int mix_items;    // Items ending in .mix
+} ItemList;
+
+static void add_item(ItemList *items, Hmm *hmm, int state)
+{
+    if (items->num == items->cap) {
+        items->cap = items->cap > 0 ? items->cap * 2 : 16;
+        items->hmm = (Hmm **)realloc(items->hmm, sizeof(Hmm *) * items->cap);
+        items->state = (int *)realloc(items->state, sizeof(int) * items->cap);
+    }
+    items->hmm[items->num] = hmm;
+    items->state[items->num] = state;
+    items->num++;
+}
+
+static void free_items(ItemList *items)
+{
+    free(items->hmm);
+    free(items->state);
+    memset(items, 0, sizeof(ItemList));
+}
+
+/**
+ * @param set integer set like "2-4" or "2,3,6-8", without brackets
+ * @return whether n is a member
+ */
+static int in_int_set(const char *set, int n)
+{
+    while (*set) {
+        char *end;
+        long lo = strtol(set, &end, 10), hi = lo;
+        if (end == set) {
+            return 0;
+        }
+        if (*end == '-') {
+            set = end + 1;
+            hi = strtol(set, &end, 10);
+        }
+        if (n >= lo && n <= hi) {
+            return 1;
+        }
+        set = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Expand one item such as sil.state[2-4].mix or (sil,sp).transP
+ * @return 0 on success, -1 on a syntax error
+ */
+static int parse_item(ModelSet *set, char *item, ItemList *items)
+{
+    char *field, *names[64], *p;
+    char set_text[MAX_ITEM_TEXT] = "";
+    int name_num = 0, is_state, mix = 0, h, n, j;
+
+    // Model name patterns, a single one or a parenthesized list
+    if (*item == '(') {
+        char *close = strchr(item, ')');
+        if (close == NULL || close[1] != '.') {
+            return -1;
+        }
+        *close = '\0';
+        field = close + 2;
+        for (p = strtok(item + 1, ","); p != NULL && name_num < 64; p = strtok(NULL, ",")) {
+            names[name_num++] = p;
+        }
+    } else {
+        field = strchr(item, '.');
+        if (field == NULL) {
+            return -1;
+        }
+        *field++ = '\0';
+        names[name_num++] = item;
+    }
+
+    if (strcmp(field, "transP") == 0) {
+        is_state = 0;
+    } else if (strncmp(field, "state[", 6) == 0 && (p = strchr(field, ']')) != NULL && \
+               (p[1] == '\0' || strcmp(p + 1, ".mix") == 0)) {
+        is_state = 1;
+        mix = p[1] != '\0';
+        n = (int)(p - field - 6);
+        if (n >= MAX_ITEM_TEXT) {
+            return -1;
+        }
+        memcpy(set_text, field + 6, n);
+        set_text[n] = '\0';
+    } else {
+        return -1;
+    }
+
+    for (h = 0; h < set->hmm_num; h++) {
+        Hmm *hmm = set->hmm[h];
+        for (n = 0; n < name_num && fnmatch(names[n], hmm->name, 0) != 0; n++);
+        if (n == name_num) {
+            continue;
+        }
+        if (!is_state) {
+            add_item(items, hmm, -1);
+            continue;
+        }
+        for (j = 2; j < hmm->state_num; j++) {
+            if (in_int_set(set_text, j)) {
+                add_item(items, hmm, j - 1);
+                items->mix_items += mix;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Expand an item list {item,item,...}; commas inside parentheses separate
+ * model names, not items
+ * @return 0 on success, -1 on a syntax error
+ */
+static int parse_item_list(ModelSet *set, char *text, ItemList *items)
+{
+    char *p, *start;
+    int depth = 0;
+
+    if (*text != '{' || text[strlen(text)-1] != '}') {
+        return -1;
+    }
+    text[strlen(text)-1] = '\0';
+    for (start = p = text + 1; ; p++) {
+        if (*p == '(') {
+            depth++;
+        } else if (*p == ')') {
+            depth--;
+        } else if ((*p == ',' && depth == 0) || *p == '\0') {
+            int end = *p == '\0';
+            *p = '\0';
+            if (parse_item(set, start, items) < 0) {
+                return -1;
+            }
+            if (end) {
+                return 0;
+            }
+            start = p + 1;
+        }
+    }
+}
+
+/**
+ * Next whitespace separated token; an item list is returned whole, with
+ * its blanks removed
+ * @return 0 on success, -1 at the end of the text
+ */
+static int next_token(const char **text, char *token)
+{
+    const char *p = *text;
+    int n = 0;
+
+    while (*p && isspace((unsigned char)*p)) {
+        p++;
+    }
+    if (*p == '\0') {
+        return -1;
+    }
+    if (*p == '{') {
+        while (*p && *p != '}' && n < MAX_ITEM_TEXT - 2) {
+            if (!isspace((unsigned char)*p)) {
+                token[n++] = *p;
+            }
+            p++;
+        }
+        if (*p == '}') {
+            token[n++] = *p++;
+        }
+    } else {
+        while (*p && !isspace((unsigned char)*p) && n < MAX_ITEM_TEXT - 1) {
+            token[n++] = *p++;
+        }
+    }
+    token[n] = '\0';
+    *text = p;
+    return 0;
+}
+
+/**
+ * @return whether items [0, i) already hold the object of item i
+ */
+static int seen_before(const ItemList *items, int i)
+{
+    int k;
+    for (k = 0; k < i; k++) {
+        if (items->state[i] < 0 ? items->hmm[k]->transp == items->hmm[i]->transp : \
+            items->state[k] >= 0 && items->hmm[k]->state[items->state[k]] == items->hmm[i]->state[items->state[i]]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static char *read_text(const char *filename)
+{
+    char *text;
+    long size;
+    FILE *fp = fopen(filename, "rb");
+
+    if (fp == NULL) {
+        perror(filename);
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    rewind(fp);
+    text = (char *)malloc(size + 1);
+    size = (long)fread(text, 1, size, fp);
+    text[size] = '\0';
+    fclose(fp);
+    return text;
+}
+
+/**
+ * Distinct states of a state item list
+ * @param of receives, per item, the position of its state in the result
+ * @return number of distinct states, stored in states
+ */
+static int distinct_states(const ItemList *items, State **states, int *of)
+{
+    int i, k, num = 0;
+
+    for (i = 0; i < items->num; i++) {
+        State *s = items->hmm[i]->state[items->state[i]];
+        for (k = 0; k < num && states[k] != s; k++);
+        if (k == num) {
+            states[num++] = s;
+        }
+        of[i] = k;
+    }
+    return num;
+}
+
+/**
+ * @return occupancy of s from acc, 1 without statistics
+ */
+static double state_occ(const State *s, const Accumulator *acc)
+{
+    return acc != NULL ? acc->state_occ[s->index] : 1;
+}
+
+static double gauss_distance(const Gaussian *a, const Gaussian *b)
+{
+    int k;
+    double sum = 0;
+
+    for (k = 0; k < a->vec_size; k++) {
+        double d = a->mean[k] - b->mean[k];
+        sum += d * d / sqrt((double)a->var[k] * b->var[k]);
+    }
+    return sqrt(sum / a->vec_size);
+}
+
+static double state_distance(const State *a, const State *b)
+{
+    int i, j;
+    double sum = 0, weight = 0;
+
+    for (i = 0; i < a->mix_num; i++) {
+        for (j = 0; j < b->mix_num; j++) {
+            double w = (double)a->weight[i] * b->weight[j];
+            sum += w * gauss_distance(a->gauss[i], b->gauss[j]);
+            weight += w;
+        }
+    }
+    return weight > 0 ? sum / weight : 0;
+}
+
+/**
+ * NC (max_cluster > 0) or TC (threshold) on the states of items
+ */
+static void cluster_states(ModelSet *set, const char *macro, const ItemList *items, int max_cluster,
+                          double threshold, const Accumulator *acc)
+{
+    int i, j, a, b, c, num, cluster_num, tied = 0;
+    State **states = (State **)malloc(sizeof(State *) * items->num);
+    int *of = (int *)malloc(sizeof(int) * items->num);
+    int *label, *alive;
+    double *dist;
+    Hmm **hmms = (Hmm **)malloc(sizeof(Hmm *) * items->num);
+    int *pos = (int *)malloc(sizeof(int) * items->num);
+    char name[MAX_NAME];
+
+    num = distinct_states(items, states, of);
+    label = (int *)malloc(sizeof(int) * num);
+    alive = (int *)malloc(sizeof(int) * num);
+    dist = (double *)malloc(sizeof(double) * num * num);
+    for (i = 0; i < num; i++) {
+        label[i] = i;
+        alive[i] = 1;
+        for (j = 0; j < i; j++) {
+            dist[i*num+j] = dist[j*num+i] = state_distance(states[i], states[j]);
+        }
+    }
+
+    // dist holds the distance of clusters by the furthest members
+    for (cluster_num = num; cluster_num > 1; cluster_num--) {
+        a = b = -1;
+        for (i = 0; i < num; i++) {
+            for (j = i + 1; alive[i] && j < num; j++) {
+                if (alive[j] && (a < 0 || dist[i*num+j] < dist[a*num+b])) {
+                    a = i;
+                    b = j;
+                }
+            }
+        }
+        if (max_cluster > 0 ? cluster_num <= max_cluster : dist[a*num+b] > threshold) {
+            break;
+        }
+        for (c = 0; c < num; c++) {
+            if (dist[b*num+c] > dist[a*num+c]) {
+                dist[a*num+c] = dist[c*num+a] = dist[b*num+c];
+            }
+            if (label[c] == b) {
+                label[c] = a;
+            }
+        }
+        alive[b] = 0;
+    }
+
+    // Tie each cluster of two or more states to its most occupied member
+    for (c = 0; c < num; c++) {
+        int best = -1, member_num = 0, n = 0;
+        if (!alive[c]) {
+            continue;
+        }
+        for (i = 0; i < num; i++) {
+            if (label[i] == c) {
+                member_num++;
+                if (best < 0 || state_occ(states[i], acc) > state_occ(states[best], acc)) {
+                    best = i;
+                }
+            }
+        }
+        if (member_num < 2) {
+            continue;
+        }
+        for (i = 0; i < items->num; i++) {
+            if (of[i] == best) {
+                hmms[n] = items->hmm[i];
+                pos[n++] = items->state[i];
+                break;
+            }
+        }
+        for (i = 0; i < items->num; i++) {
+            if (label[of[i]] == c && of[i] != best) {
+                hmms[n] = items->hmm[i];
+                pos[n++] = items->state[i];
+            }
+        }
+        snprintf(name, MAX_NAME, "%s%d", macro, ++tied);
+        modelset_tie_states(set, name, hmms, pos, n);
+    }
+
+    free(states);
+    free(of);
+    free(label);
+    free(alive);
+    free(dist);
+    free(hmms);
+    free(pos);
+}
+
+/**
+ * Occupancy and moments of a cluster of Gaussians
+ */
+typedef struct {
+    double occ;
+    double *sum, *sqr;    // [vec_size] sum L x, sum L x^2
+    double log_det;       // sum_k log v_k
+} Moments;
+
+static double moments_log_det(const Moments *a, const Moments *b, const float *var_floor, int n)
+{
+    int k;
+    double occ = a->occ + (b != NULL ? b->occ : 0), log_det = 0;
+
+    for (k = 0; k < n; k++) {
+        double mean = (a->sum[k] + (b != NULL ? b->sum[k] : 0)) / occ;
+        double var = (a->sqr[k] + (b != NULL ? b->sqr[k] : 0)) / occ - mean * mean;
+        if (var_floor != NULL && var < var_floor[k]) {
+            var = var_floor[k];
+        }
+        log_det += log(var > 1e-6 ? var : 1e-6);
+    }
+    return log_det;
+}
+
+static double merge_cost(const Moments *a, const Moments *b, const float *var_floor, int n)
+{
+    return 0.5 * ((a->occ + b->occ) * moments_log_det(a, b, var_floor, n) - a->occ * a->log_det - \
+                  b->occ * b->log_det);
+}
+
+/**
+ * TI of mixture items after JO size minw
+ */
+static void pool_gaussians(ModelSet *set, const char *macro, const ItemList *items, int size,
+                          double min_weight, const Accumulator *acc)
+{
+    int i, j, k, m, a, b, num, gauss_num = 0, gauss_cap = 64, pool_num = 0, dim = set->vec_size;
+    State **states = (State **)malloc(sizeof(State *) * items->num);
+    int *of = (int *)malloc(sizeof(int) * items->num);
+    Gaussian **gauss = (Gaussian **)malloc(sizeof(Gaussian *) * gauss_cap);
+    Moments *mo;
+    int *label, *near, *pool_of;
+    double *near_cost;
+    Gaussian **pool;
+    char name[MAX_NAME];
+
+    // Number the distinct Gaussians through their index, -2 - number, and
+    // take their occupancy before the numbers are overwritten
+    num = distinct_states(items, states, of);
+    mo = (Moments *)calloc(gauss_cap, sizeof(Moments));
+    for (i = 0; i < num; i++) {
+        for (m = 0; m < states[i]->mix_num; m++) {
+            Gaussian *g = states[i]->gauss[m];
+            if (g->index > -2) {
+                if (gauss_num == gauss_cap) {
+                    gauss_cap *= 2;
+                    gauss = (Gaussian **)realloc(gauss, sizeof(Gaussian *) * gauss_cap);
+                    mo = (Moments *)realloc(mo, sizeof(Moments) * gauss_cap);
+                }
+                memset(&mo[gauss_num], 0, sizeof(Moments));
+                mo[gauss_num].occ = acc != NULL ? acc->gauss_occ[g->index] : 0;
+                gauss[gauss_num] = g;
+                g->index = -2 - gauss_num++;
+            }
+            if (acc == NULL) {
+                mo[-2 - g->index].occ += states[i]->weight[m];
+            }
+        }
+    }
+
+    label = (int *)malloc(sizeof(int) * gauss_num);
+    near = (int *)malloc(sizeof(int) * gauss_num);
+    near_cost = (double *)malloc(sizeof(double) * gauss_num);
+    pool_of = (int *)malloc(sizeof(int) * gauss_num);
+    for (i = 0; i < gauss_num; i++) {
+        Moments *x = &mo[i];
+        const Gaussian *g = gauss[i];
+        label[i] = i;
+        x->occ = x->occ > MIN_WEIGHT ? x->occ : MIN_WEIGHT;
+        x->sum = (double *)malloc(sizeof(double) * dim);
+        x->sqr = (double *)malloc(sizeof(double) * dim);
+        for (k = 0; k < dim; k++) {
+            x->sum[k] = x->occ * g->mean[k];
+            x->sqr[k] = x->occ * ((double)g->var[k] + (double)g->mean[k] * g->mean[k]);
+        }
+        x->log_det = moments_log_det(x, NULL, set->var_floor, dim);
+    }
+
+    // Greedy merging; near[i] is the cheapest partner of cluster i
+    for (i = 0; i < gauss_num; i++) {
+        near[i] = -1;
+        for (j = 0; j < gauss_num; j++) {
+            double cost = j != i ? merge_cost(&mo[i], &mo[j], set->var_floor, dim) : 0;
+            if (j != i && (near[i] < 0 || cost < near_cost[i])) {
+                near[i] = j;
+                near_cost[i] = cost;
+            }
+        }
+    }
+    for (num = gauss_num; num > (size > 0 ? size : 1); num--) {
+        a = -1;
+        for (i = 0; i < gauss_num; i++) {
+            if (label[i] == i && near[i] >= 0 && (a < 0 || near_cost[i] < near_cost[a])) {
+                a = i;
+            }
+        }
+        b = near[a];
+        mo[a].occ += mo[b].occ;
+        for (k = 0; k < dim; k++) {
+            mo[a].sum[k] += mo[b].sum[k];
+            mo[a].sqr[k] += mo[b].sqr[k];
+        }
+        mo[a].log_det = moments_log_det(&mo[a], NULL, set->var_floor, dim);
+        for (i = 0; i < gauss_num; i++) {
+            if (label[i] == b) {
+                label[i] = a;
+            }
+        }
+
+        // New partners for a and for the clusters that pointed at a or b;
+        // the others may now prefer a
+        near[a] = -1;
+        for (i = 0; i < gauss_num; i++) {
+            double cost;
+            if (label[i] != i || i == a) {
+                continue;
+            }
+            cost = merge_cost(&mo[a], &mo[i], set->var_floor, dim);
+            if (near[a] < 0 || cost < near_cost[a]) {
+                near[a] = i;
+                near_cost[a] = cost;
+            }
+            if (near[i] == a || near[i] == b) {
+                near[i] = -1;
+                for (j = 0; j < gauss_num; j++) {
+                    double c = j != i && label[j] == j ? merge_cost(&mo[i], &mo[j], set->var_floor, dim) : 0;
+                    if (j != i && label[j] == j && (near[i] < 0 || c < near_cost[i])) {
+                        near[i] = j;
+                        near_cost[i] = c;
+                    }
+                }
+            } else if (cost < near_cost[i]) {
+                near[i] = a;
+                near_cost[i] = cost;
+            }
+        }
+    }
+
+    // The clusters become ~m macros
+    pool = (Gaussian **)malloc(sizeof(Gaussian *) * num);
+    for (i = 0; i < gauss_num; i++) {
+        Gaussian *g;
+        if (label[i] != i) {
+            continue;
+        }
+        g = gaussian_new(dim);
+        for (k = 0; k < dim; k++) {
+            double mean = mo[i].sum[k] / mo[i].occ;
+            double var = mo[i].sqr[k] / mo[i].occ - mean * mean;
+            if (set->var_floor != NULL && var < set->var_floor[k]) {
+                var = set->var_floor[k];
+            }
+            g->mean[k] = (float)mean;
+            g->var[k] = (float)(var > 1e-6 ? var : 1e-6);
+        }
+        gaussian_update(g);
+        snprintf(name, MAX_NAME, "%s%d", macro, pool_num + 1);
+        modelset_add_macro(set, 'm', name, g);
+        gaussian_unref(g);
+        pool_of[i] = pool_num;
+        pool[pool_num++] = g;
+    }
+
+    // Every state sums the weights of its components per pool member
+    num = distinct_states(items, states, of);
+    for (i = 0; i < num; i++) {
+        State *s = states[i];
+        float *weight = (float *)calloc(pool_num, sizeof(float));
+        float sum = 0;
+        int mix_num = 0;
+
+        for (m = 0; m < s->mix_num; m++) {
+            weight[pool_of[label[-2 - s->gauss[m]->index]]] += s->weight[m];
+        }
+        for (m = 0; m < s->mix_num; m++) {
+            gaussian_unref(s->gauss[m]);
+        }
+        for (j = 0; j < pool_num; j++) {
+            if (weight[j] > 0) {
+                mix_num++;
+            }
+        }
+        s->weight = (float *)realloc(s->weight, sizeof(float) * mix_num);
+        s->gauss = (Gaussian **)realloc(s->gauss, sizeof(Gaussian *) * mix_num);
+        s->mix_num = 0;
+        for (j = 0; j < pool_num; j++) {
+            if (weight[j] > 0) {
+                s->weight[s->mix_num] = weight[j] > min_weight * MIN_WEIGHT ? weight[j] : \
+                                        (float)(min_weight * MIN_WEIGHT);
+                sum += s->weight[s->mix_num];
+                gaussian_ref(pool[j]);
+                s->gauss[s->mix_num++] = pool[j];
+            }
+        }
+        for (m = 0; m < s->mix_num; m++) {
+            s->weight[m] /= sum;
+        }
+        free(weight);
+    }
+
+    for (i = 0; i < gauss_num; i++) {
+        free(mo[i].sum);
+        free(mo[i].sqr);
+    }
+    free(mo);
+    free(states);
+    free(of);
+    free(gauss);
+    free(label);
+    free(near);
+    free(near_cost);
+    free(pool_of);
+    free(pool);
+}
+
+/**
+ * @return the macro name argument without its quotes
+ */
+static char *unquote(char *macro)
+{
+    size_t len = strlen(macro);
+    if (len >= 2 && macro[0] == '"' && macro[len-1] == '"') {
+        macro[len-1] = '\0';
+        macro++;
+    }
+    return macro;
+}
+
+int hed_apply(ModelSet *set, const char *filename, const Accumulator *acc)
+{
+    char cmd[MAX_ITEM_TEXT], arg[3][MAX_ITEM_TEXT], list[MAX_ITEM_TEXT];
+    const char *p;
+    char *text = read_text(filename);
+    int i, k, arg_num, pool_size = 0, ret = 0;
+    double pool_min_weight = 1;
+
+    if (text == NULL) {
+        return -1;
+    }
+    if (acc != NULL && (acc->state_num != set->state_num || acc->gauss_num != set->gauss_num)) {
+        acc = NULL;
+    }
+
+    p = text;
+    while (ret == 0 && next_token(&p, cmd) == 0) {
+        ItemList items;
+
+        if (strcmp(cmd, "MU") == 0 || strcmp(cmd, "TI") == 0) {
+            arg_num = 1;
+        } else if (strcmp(cmd, "AT") == 0) {
+            arg_num = 3;
+        } else if (strcmp(cmd, "NC") == 0 || strcmp(cmd, "TC") == 0 || strcmp(cmd, "JO") == 0) {
+            arg_num = 2;
+        } else {
+            fprintf(stderr, "%s: HHEd command %s is not supported\n", filename, cmd);
+            ret = -1;
+            break;
+        }
+        for (k = 0; k < arg_num; k++) {
+            if (next_token(&p, arg[k]) < 0) {
+                break;
+            }
+        }
+        if (strcmp(cmd, "JO") == 0) {
+            pool_size = k == arg_num ? atoi(arg[0]) : 0;
+            pool_min_weight = k == arg_num ? atof(arg[1]) : 0;
+            if (pool_size < 1 || pool_min_weight < 0) {
+                fprintf(stderr, "%s: bad JO command\n", filename);
+                ret = -1;
+            }
+            continue;
+        }
+        memset(&items, 0, sizeof(ItemList));
+        if (k < arg_num || next_token(&p, list) < 0 || parse_item_list(set, list, &items) < 0) {
+            fprintf(stderr, "%s: bad %s command\n", filename, cmd);
+            free_items(&items);
+            ret = -1;
+            break;
+        }
+
+        if (cmd[0] == 'M') {
+            int plus = arg[0][0] == '+', mix_num = atoi(arg[0] + plus);
+            for (i = 0; i < items.num; i++) {
+                State *s;
+                if (items.state[i] < 0 || seen_before(&items, i)) {
+                    continue;
+                }
+                s = items.hmm[i]->state[items.state[i]];
+                state_split_mixtures(s, plus ? s->mix_num + mix_num : mix_num);
+            }
+        } else if (cmd[0] == 'A') {
+            int from = atoi(arg[0]) - 1, to = atoi(arg[1]) - 1;
+            float prob = (float)atof(arg[2]);
+            for (i = 0; i < items.num; i++) {
+                TransP *t = items.hmm[i]->transp;
+                if (items.state[i] >= 0 || seen_before(&items, i)) {
+                    continue;
+                }
+                if (from < 0 || to < 0 || from >= t->state_num || to >= t->state_num) {
+                    fprintf(stderr, "%s: AT %s %s outside the %d states of %s\n", filename, arg[0], arg[1],
+                            t->state_num, items.hmm[i]->name);
+                    ret = -1;
+                    break;
+                }
+                transp_set(t, from, to, prob);
+            }
+        } else {
+            char *macro = unquote(cmd[0] == 'T' && cmd[1] == 'I' ? arg[0] : arg[1]);
+            for (i = 0; i < items.num && items.state[i] >= 0; i++);
+            if (items.num == 0 || i < items.num || (items.mix_items > 0 && items.mix_items < items.num)) {
+                fprintf(stderr, "%s: %s %s needs a list of states, or of their mixtures\n", filename, cmd, macro);
+                ret = -1;
+            } else if (cmd[0] == 'N' && atoi(arg[0]) < 1) {
+                fprintf(stderr, "%s: NC %s needs at least 1 cluster\n", filename, arg[0]);
+                ret = -1;
+            } else if (cmd[1] == 'C') {
+                cluster_states(set, macro, &items, cmd[0] == 'N' ? atoi(arg[0]) : 0, atof(arg[0]), acc);
+            } else if (items.mix_items > 0) {
+                pool_gaussians(set, macro, &items, pool_size, pool_min_weight, acc);
+            } else {
+                modelset_tie_states(set, macro, items.hmm, items.state, items.num);
+            }
+        }
+        free_items(&items);
+
+        // Statistics describe the structure they were collected for
+        if (cmd[0] != 'A') {
+            acc = NULL;
+            modelset_index(set);
+        }
+    }
+
+    free(text);
+    modelset_index(set);
+    return ret;
+}
@@ -0,0 +1,84 @@
+#ifndef HED_HEADER_
+#define HED_HEADER_
+
+#include "gmm.h"
+
+/**
+ * Model set edits of the training recipe, in memory: the silence and short
+ * pause models of models_1mixsil and spmodel_gen, and the HHEd commands
+ * used by the lib .hed scripts.
+ */
+
+/**
+ * @return 5 states (3 emitting) silence model, every state a copy of the
+ * first emitting state of proto
+ */
+Hmm *hed_silence_model(const Hmm *proto);
+
+/**
+ * @return 3 states (1 emitting) short pause model, its state a copy of the
+ * middle state of sil
+ */
+Hmm *hed_sp_model(const Hmm *sil);
+
+#ifndef VAR_FLOOR_SCALE
+    #define VAR_FLOOR_SCALE 0.01    // HCompV -f: variance floor relative to the global variance
+#endif
+
+/**
+ * Flat start, HCompV -f scale -m followed by macro and models_1mixsil:
+ * every state of proto gets the global mean and variance of stats, the
+ * variance floor of set is floor_scale times the global variance, and set
+ * receives a copy of proto for every name, the 3 state hed_silence_model
+ * for sil
+ * @param set initialized and empty, indexed on return
+ * @param proto its Gaussians are overwritten
+ */
+void hed_flat_start(ModelSet *set, Hmm *proto, int parm_kind, const Welford *stats, double floor_scale,
+                    char **names, int name_num);
+
+/**
+ * Run an HHEd edit script on set. Supported commands:
+ *
+ *   MU [+]n itemlist      mixture splitting to n, or by n, components
+ *   AT i j prob itemlist  set a transition and renormalize the row
+ *   TI macro itemlist     tie states into ~s macro
+ *   NC n macro itemlist   cluster states into n clusters, tie each as macro<i>
+ *   TC f macro itemlist   cluster states while clusters are closer than f
+ *   JO size minw          pool size for TI of mixtures
+ *   TI macro mixlist      tie the mixture components of .mix items into a
+ *                         pool of JO size shared Gaussians, ~m macro<i>
+ *
+ * Item lists look like {sil.state[2-4].mix}, {(sil,sp).transP} or
+ * {sil.state[3],sp.state[2]}; model names may use * and ? wildcards and
+ * states are numbered like HTK (2 .. N-1). States a model does not have
+ * are skipped like HHEd does. A state or matrix shared by several items
+ * is edited once per command.
+ *
+ * NC and TC merge the closest pair of clusters, by the largest distance
+ * between their members (furthest neighbour), and tie each cluster of two
+ * or more states to its member with the largest occupancy. The distance of
+ * two states is the weighted average of
+ *   sqrt(1/n sum_k (m1_k - m2_k)^2 / sqrt(v1_k v2_k))
+ * over their pairs of mixture components.
+ *
+ * TI of mixtures merges the pair of Gaussians losing the least log
+ * likelihood, n_ab log|V_ab| - n_a log|V_a| - n_b log|V_b| with moment-
+ * matched V_ab, until JO size are left. Unlike HHEd, which turns the
+ * states into tied-mixture (<TMIX>) ones, each state keeps its own weights
+ * over the pool members its components went to, so the models stay plain
+ * HTK MMFs with ~m macros, and the decoder scores each member once per
+ * frame however many states use it. Weights are floored at minw * MIN_WEIGHT.
+ * Models tied by HHEd itself cannot be loaded by mmf_load, which does not
+ * read <TMIX> states; gmm_hed applies a script here instead.
+ *
+ * @param acc statistics of the last re-estimation pass of set, or NULL;
+ * the occupancies weigh the clustering until a command changes the
+ * structure of set, otherwise every state counts 1 and every Gaussian the
+ * weights it gets from its states
+ * @param set indexed again when the script changed its structure
+ * @return 0 on success, -1 on error (reported on stderr)
+ */
+int hed_apply(ModelSet *set, const char *filename, const Accumulator *acc);
+
+#endif
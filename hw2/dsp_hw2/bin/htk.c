@@ -0,0 +1,275 @@
+#include "htk.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+static const char *base_kinds[] = {
+    "WAVEFORM", "LPC", "LPREFC", "LPCEPSTRA", "LPDELCEP", "IREFC",
+    "MFCC", "FBANK", "MELSPEC", "USER", "DISCRETE", "PLP",
+};
+
+static const struct {
+    char code;
+    int mask;
+} qualifiers[] = {
+    { 'E', PK_E }, { 'N', PK_N }, { 'D', PK_D }, { 'A', PK_A }, { 'C', PK_C },
+    { 'Z', PK_Z }, { 'K', PK_K }, { '0', PK_0 },
+};
+
+#define COUNT(a) (int)(sizeof(a) / sizeof(a[0]))
+
+FILE *open_or_die(const char *filename, const char *mode)
+{
+    FILE *fp = fopen(filename, mode);
+    if (fp == NULL) {
+        perror(filename);
+        exit(1);
+    }
+    return fp;
+}
+
+static uint32_t swap32(uint32_t x)
+{
+    return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+
+static uint16_t swap16(uint16_t x)
+{
+    return (uint16_t)((x >> 8) | (x << 8));
+}
+
+int htk_read(const char *filename, Feature *feat)
+{
+    int32_t n_samples, samp_period;
+    int16_t samp_size, parm_kind;
+    long size;
+    int i, swap = 0;
+
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL) {
+        perror(filename);
+        return -1;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    if (fread(&n_samples, 4, 1, fp) != 1 || fread(&samp_period, 4, 1, fp) != 1 || \
+        fread(&samp_size, 2, 1, fp) != 1 || fread(&parm_kind, 2, 1, fp) != 1) {
+        fprintf(stderr, "%s: truncated header\n", filename);
+        fclose(fp);
+        return -1;
+    }
+
+    // HTK files are big-endian unless written with NATURALWRITEORDER,
+    // so take whichever byte order makes the header match the file size
+    if ((long)n_samples * samp_size + 12 != size) {
+        swap = 1;
+        n_samples = (int32_t)swap32((uint32_t)n_samples);
+        samp_period = (int32_t)swap32((uint32_t)samp_period);
+        samp_size = (int16_t)swap16((uint16_t)samp_size);
+        parm_kind = (int16_t)swap16((uint16_t)parm_kind);
+        if ((long)n_samples * samp_size + 12 != size) {
+            fprintf(stderr, "%s: not an HTK parameter file\n", filename);
+            fclose(fp);
+            return -1;
+        }
+    }
+    if (parm_kind & PK_C) {
+        fprintf(stderr, "%s: compressed parameter files are not supported\n", filename);
+        fclose(fp);
+        return -1;
+    }
+
+    feat->frame_num = n_samples;
+    feat->dim = samp_size / 4;
+    feat->samp_period = samp_period;
+    feat->parm_kind = parm_kind;
+    feat->data = (float *)malloc(sizeof(float) * n_samples * feat->dim + 1);
+
+    if (fread(feat->data, sizeof(float), (size_t)n_samples * feat->dim, fp) != (size_t)n_samples * feat->dim) {
+        fprintf(stderr, "%s: truncated data\n", filename);
+        free(feat->data);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    if (swap) {
+        uint32_t *p = (uint32_t *)feat->data;
+        for (i = 0; i < n_samples * feat->dim; i++) {
+            p[i] = swap32(p[i]);
+        }
+    }
+    return 0;
+}
+
+int htk_write(const char *filename, const Feature *feat)
+{
+    int32_t n_samples = feat->frame_num, samp_period = feat->samp_period;
+    int16_t samp_size = (int16_t)(feat->dim * 4), parm_kind = feat->parm_kind;
+    int err;
+
+    FILE *fp = fopen(filename, "wb");
+    if (fp == NULL) {
+        perror(filename);
+        return -1;
+    }
+    fwrite(&n_samples, 4, 1, fp);
+    fwrite(&samp_period, 4, 1, fp);
+    fwrite(&samp_size, 2, 1, fp);
+    fwrite(&parm_kind, 2, 1, fp);
+    fwrite(feat->data, sizeof(float), (size_t)feat->frame_num * feat->dim, fp);
+    err = ferror(fp);
+    if (fclose(fp) != 0 || err) {
+        perror(filename);
+        remove(filename);
+        return -1;
+    }
+    return 0;
+}
+
+void feature_free(Feature *feat)
+{
+    free(feat->data);
+    feat->data = NULL;
+    feat->frame_num = 0;
+}
+
+int parm_kind_parse(const char *name)
+{
+    int i, j, kind = -1;
+    const char *q = strchr(name, '_');
+    size_t len = q ? (size_t)(q - name) : strlen(name);
+
+    for (i = 0; i < COUNT(base_kinds); i++) {
+        if (strlen(base_kinds[i]) == len && strncmp(base_kinds[i], name, len) == 0) {
+            kind = i;
+        }
+    }
+    if (kind < 0) {
+        return -1;
+    }
+
+    while (q != NULL && q[1] != '\0') {
+        for (j = 0; j < COUNT(qualifiers); j++) {
+            if (q[1] == qualifiers[j].code) {
+                kind |= qualifiers[j].mask;
+            }
+        }
+        q = strchr(q + 1, '_');
+    }
+    return kind;
+}
+
+void parm_kind_name(int kind, char *name)
+{
+    int j, base = kind & PK_BASEMASK;
+
+    strcpy(name, base < COUNT(base_kinds) ? base_kinds[base] : "ANON");
+    for (j = 0; j < COUNT(qualifiers); j++) {
+        if (kind & qualifiers[j].mask) {
+            size_t len = strlen(name);
+            name[len] = '_';
+            name[len+1] = qualifiers[j].code;
+            name[len+2] = '\0';
+        }
+    }
+}
+
+char **read_list(const char *filename, int column, int *num)
+{
+    char line[MAX_NAME * 4], first[MAX_NAME * 2], second[MAX_NAME * 2];
+    int cap = 1024, n = 0, fields;
+    char **list = (char **)malloc(sizeof(char *) * cap);
+
+    FILE *fp = open_or_die(filename, "r");
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        fields = sscanf(line, "%s %s", first, second);
+        if (fields < column + 1) {
+            continue;
+        }
+        if (n == cap) {
+            cap *= 2;
+            list = (char **)realloc(list, sizeof(char *) * cap);
+        }
+        list[n++] = strdup(column == 0 ? first : second);
+    }
+    fclose(fp);
+
+    *num = n;
+    return list;
+}
+
+void free_list(char **list, int num)
+{
+    int i;
+    for (i = 0; i < num; i++) {
+        free(list[i]);
+    }
+    free(list);
+}
+
+uint16_t float_to_half(float f)
+{
+    union { float f; uint32_t u; } v = { f };
+    uint32_t sign = (v.u >> 16) & 0x8000;
+    int exp = (int)((v.u >> 23) & 0xff) - 127 + 15;
+    uint32_t mant = v.u & 0x7fffff;
+
+    if (((v.u >> 23) & 0xff) == 0xff) {
+        return (uint16_t)(sign | 0x7c00 | (mant ? 0x200 : 0));
+    }
+    if (exp >= 31) {
+        return (uint16_t)(sign | 0x7c00);
+    }
+    if (exp <= 0) {
+        // Subnormal: shift in the implicit bit, round to nearest even
+        uint32_t shift = 14 - exp, half, rest;
+        if (exp < -10) {
+            return (uint16_t)sign;
+        }
+        mant |= 0x800000;
+        half = mant >> shift;
+        rest = mant & ((1u << shift) - 1);
+        if (rest > (1u << (shift - 1)) || (rest == (1u << (shift - 1)) && (half & 1))) {
+            half++;
+        }
+        return (uint16_t)(sign | half);
+    }
+    {
+        uint32_t h = sign | ((uint32_t)exp << 10) | (mant >> 13);
+        uint32_t rest = mant & 0x1fff;
+        // A carry out of the mantissa correctly bumps the exponent
+        if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) {
+            h++;
+        }
+        return (uint16_t)h;
+    }
+}
+
+float half_to_float(uint16_t h)
+{
+    union { float f; uint32_t u; } v;
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    int exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+
+    if (exp == 0x1f) {
+        v.u = sign | 0x7f800000 | (mant << 13);
+    } else if (exp != 0) {
+        v.u = sign | ((uint32_t)(exp - 15 + 127) << 23) | (mant << 13);
+    } else if (mant == 0) {
+        v.u = sign;
+    } else {
+        // Subnormal: normalize the mantissa
+        exp = 1;
+        while (!(mant & 0x400)) {
+            mant <<= 1;
+            exp--;
+        }
+        v.u = sign | ((uint32_t)(exp - 15 + 127) << 23) | ((mant & 0x3ff) << 13);
+    }
+    return v.f;
+}
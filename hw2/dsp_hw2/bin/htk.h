@@ -0,0 +1,87 @@
+#ifndef HTK_HEADER_
+#define HTK_HEADER_
+
+#include <stdio.h>
+#include <stdint.h>
+
+/**
+ * HTK parameter kinds, see "Parameter Kinds" in the HTK book
+ */
+#define PK_WAVEFORM  0
+#define PK_LPC       1
+#define PK_MFCC      6
+#define PK_FBANK     7
+#define PK_USER      9
+#define PK_BASEMASK  077
+
+#define PK_E  0000100   // log energy
+#define PK_N  0000200   // absolute energy suppressed
+#define PK_D  0000400   // delta coefficients
+#define PK_A  0001000   // acceleration coefficients
+#define PK_C  0002000   // compressed
+#define PK_Z  0004000   // zero mean
+#define PK_K  0010000   // CRC checksum
+#define PK_0  0020000   // 0th cepstral coefficient
+
+#ifndef MAX_NAME
+    #define MAX_NAME 256
+#endif
+
+/**
+ * Feature vectors of one utterance, frame-major
+ */
+typedef struct {
+    int frame_num;
+    int dim;
+    int samp_period;   // in 100ns units
+    short parm_kind;
+    float *data;       // [frame_num][dim]
+} Feature;
+
+/**
+ * @param filename HTK parameter file, in either byte order
+ * @param feat filled, release with feature_free
+ * @return 0 on success, -1 on error (reported on stderr)
+ */
+int htk_read(const char *filename, Feature *feat);
+
+/**
+ * Write an uncompressed HTK parameter file in machine byte order
+ * (NATURALWRITEORDER=TRUE)
+ * @return 0 on success, -1 on error
+ */
+int htk_write(const char *filename, const Feature *feat);
+
+void feature_free(Feature *feat);
+
+/**
+ * @param name e.g. "MFCC_Z_E_D_A"
+ * @return parameter kind code, -1 if the base kind is unknown
+ */
+int parm_kind_parse(const char *name);
+
+/**
+ * @param kind parameter kind code
+ * @param name receives e.g. "MFCC_Z_E_D_A", at least MAX_NAME bytes
+ */
+void parm_kind_name(int kind, char *name);
+
+/**
+ * Read a script file (one file name per line, or "src dst" pairs for HCopy)
+ * @param filename
+ * @param column 0 for the first name on each line, 1 for the second
+ * @param num receives number of lines
+ * @return array of malloc'ed names, release with free_list
+ */
+char **read_list(const char *filename, int column, int *num);
+void free_list(char **list, int num);
+
+FILE *open_or_die(const char *filename, const char *mode);
+
+/**
+ * IEEE half precision, rounded to nearest even; overflow goes to infinity
+ */
+uint16_t float_to_half(float f);
+float half_to_float(uint16_t h);
+
+#endif
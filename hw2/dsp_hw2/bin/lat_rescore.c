@@ -0,0 +1,226 @@
+#include "lattice.h"
+#include "mlf.h"
+#include "archive.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static int ignored(const char *word, char **ignore, int ignore_num)
+{
+    int i;
+    for (i = 0; i < ignore_num; i++) {
+        if (strcmp(word, ignore[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Rescore the lattices of gmm_decode with new weights, like HLRescore:
+ * -s and -p set the grammar scale and word insertion penalty, -w replaces
+ * the grammar weights by those of another word network (paths it does not
+ * accept are dropped). Writes the best (-n: N best) word sequences of each
+ * lattice to an MLF and, with -I reference labels, reports the word
+ * accuracy as HResults computes it, so weights can be tuned without
+ * decoding again.
+ *
+ * Lattices come from a binary cache (gmm_decode -c) or a list of SLF files
+ * (gmm_decode -z).
+ */
+int main(int argc, char *argv[])
+{
+    int i, k, n, nbest = 1, lat_num = 0, fail_num = 0, ignore_num = 0, file_num = 0, next = 0;
+    const char *cache = NULL, *scp = NULL, *wdnet = NULL, *out_mlf = NULL, *ref_mlf = NULL, *label_dir = "*";
+    double lm_scale = 1, penalty = 0, start;
+    char **ignore = (char **)calloc(argc, sizeof(char *));
+    char **r = NULL, **h = NULL, **files = NULL;
+    float *pair = NULL;
+    FILE *in, *fp;
+    LatPath *path;
+    Slf slf;
+    Mlf ref;
+    ErrorCount count;
+
+    if (argc < 4) {
+        printf("Wrong argument format\n");
+        printf("Usage: ./lat_rescore [-s lmscale] [-p penalty] [-w wdnet] [-n N] "
+               "[-I ref.mlf [-e ??? word ...]] [-l dir] -i out.mlf (-c cache | -S lat.scp)\n");
+        exit(1);
+    }
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            lm_scale = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            penalty = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            wdnet = argv[++i];
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            nbest = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-I") == 0 && i + 1 < argc) {
+            ref_mlf = argv[++i];
+        } else if (strcmp(argv[i], "-e") == 0 && i + 2 < argc) {
+            i++;
+            ignore[ignore_num++] = argv[++i];
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            label_dir = argv[++i];
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            out_mlf = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            cache = argv[++i];
+        } else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+            scp = argv[++i];
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            exit(1);
+        }
+    }
+    if (out_mlf == NULL || (cache == NULL) == (scp == NULL)) {
+        printf("Missing -i output file, or not exactly one of -c cache and -S list\n");
+        exit(1);
+    }
+    if (nbest < 1) {
+        nbest = 1;
+    }
+
+    if (wdnet != NULL) {
+        if (slf_load(&slf, wdnet) < 0) {
+            exit(1);
+        }
+        pair = slf_word_pairs(&slf);
+    }
+    if (ref_mlf != NULL && mlf_load(&ref, ref_mlf) < 0) {
+        exit(1);
+    }
+    memset(&count, 0, sizeof(ErrorCount));
+
+    // Lattices are read one at a time, from the cache or the list
+    in = cache != NULL ? open_or_die(cache, "rb") : NULL;
+    if (scp != NULL) {
+        files = read_list(scp, 0, &file_num);
+    }
+    path = (LatPath *)calloc(nbest, sizeof(LatPath));
+    fp = open_or_die(out_mlf, "w");
+    fprintf(fp, "#!MLF!#\n");
+
+    start = now();
+    for (;;) {
+        Lattice lat, composed;
+        const Lattice *use = &lat;
+        int found;
+
+        if (in != NULL) {
+            int status = lat_cache_read(in, &lat);
+            if (status <= 0) {
+                if (status < 0) {
+                    fail_num++;
+                }
+                break;
+            }
+        } else {
+            if (next == file_num) {
+                break;
+            }
+            if (lat_read_slf(&lat, files[next++]) < 0) {
+                fail_num++;
+                continue;
+            }
+            if (lat.name == NULL) {
+                char name[MAX_NAME];
+                archive_key(files[next-1], name);
+                lat.name = strdup(name);
+            }
+        }
+        lat_num++;
+
+        if (pair != NULL) {
+            if (lat_compose(&composed, &lat, &slf, pair) < 0) {
+                fail_num++;
+                lat_free(&lat);
+                continue;
+            }
+            use = &composed;
+        }
+
+        found = lat_nbest(use, lm_scale, penalty, nbest, path);
+        fprintf(fp, "\"%s/%s.rec\"\n", label_dir, use->name);
+        for (k = 0; k < found; k++) {
+            if (k > 0) {
+                fprintf(fp, "///\n");
+            }
+            for (i = 0; i < path[k].word_num; i++) {
+                fprintf(fp, "%ld %ld %s %f\n", (long)path[k].start[i] * use->samp_period,
+                        (long)path[k].end[i] * use->samp_period, use->vocab[path[k].word[i]],
+                        path[k].word_score[i]);
+            }
+        }
+        fprintf(fp, ".\n");
+
+        // The best path against the reference, -e words left out on both sides
+        if (ref_mlf != NULL) {
+            const Transcription *tr = mlf_find(&ref, use->name);
+            int r_num = 0, h_num = 0;
+            if (tr == NULL) {
+                fprintf(stderr, "%s: no reference transcription\n", use->name);
+            } else {
+                r = (char **)realloc(r, sizeof(char *) * (tr->label_num + 1));
+                h = (char **)realloc(h, sizeof(char *) * (found > 0 ? path[0].word_num + 1 : 1));
+                for (i = 0; i < tr->label_num; i++) {
+                    if (!ignored(tr->label[i], ignore, ignore_num)) {
+                        r[r_num++] = tr->label[i];
+                    }
+                }
+                for (i = 0; found > 0 && i < path[0].word_num; i++) {
+                    char *w = use->vocab[path[0].word[i]];
+                    if (!ignored(w, ignore, ignore_num)) {
+                        h[h_num++] = w;
+                    }
+                }
+                mlf_align(r, r_num, h, h_num, &count);
+            }
+        }
+
+        for (k = 0; k < found; k++) {
+            lat_path_free(&path[k]);
+        }
+        if (use == &composed) {
+            lat_free(&composed);
+        }
+        lat_free(&lat);
+    }
+    fclose(fp);
+
+    printf("Rescored %d lattices in %.3f sec (scale %g, penalty %g%s%s), %d failed\n",
+           lat_num, now() - start, lm_scale, penalty, wdnet != NULL ? ", network " : "",
+           wdnet != NULL ? wdnet : "", fail_num);
+    if (ref_mlf != NULL) {
+        n = count.ref_num > 0 ? count.ref_num : 1;
+        printf("WORD: %%Corr=%.2f, Acc=%.2f [H=%d, D=%d, S=%d, I=%d, N=%d]\n",
+               100.0 * count.hit / n, 100.0 * (count.hit - count.ins) / n,
+               count.hit, count.del, count.sub, count.ins, count.ref_num);
+        mlf_free(&ref);
+    }
+
+    if (in != NULL) {
+        fclose(in);
+    }
+    if (files != NULL) {
+        free_list(files, file_num);
+    }
+    if (pair != NULL) {
+        free(pair);
+        slf_free(&slf);
+    }
+    free(path);
+    free(ignore);
+    free(r);
+    free(h);
+    return fail_num > 0;
+}
@@ -0,0 +1,733 @@
+#include "lattice.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef LAT_MAX_EXPAND
+    #define LAT_MAX_EXPAND 200000    // Partial paths lat_nbest may expand per best path
+#endif
+
+static double arc_score(const Lattice *lat, const LatArc *a, double lm_scale, double penalty)
+{
+    return a->ac + lm_scale * a->lm + (lat->node[a->end].word >= 0 ? penalty : 0);
+}
+
+/**
+ * Best scores from the start to every node and from every node to the end
+ * @return best path score, LZERO if the end is unreachable
+ */
+static double forward_backward(const Lattice *lat, double lm_scale, double penalty, double *fwd, double *bwd)
+{
+    int i;
+
+    for (i = 0; i < lat->node_num; i++) {
+        fwd[i] = bwd[i] = LZERO;
+    }
+    if (lat->node_num == 0) {
+        return LZERO;
+    }
+    fwd[0] = 0;
+    bwd[lat->node_num - 1] = 0;
+    for (i = 0; i < lat->arc_num; i++) {
+        const LatArc *a = &lat->arc[i];
+        double s = fwd[a->start] + arc_score(lat, a, lm_scale, penalty);
+        if (fwd[a->start] > LSMALL && s > fwd[a->end]) {
+            fwd[a->end] = s;
+        }
+    }
+    for (i = lat->arc_num - 1; i >= 0; i--) {
+        const LatArc *a = &lat->arc[i];
+        double s = bwd[a->end] + arc_score(lat, a, lm_scale, penalty);
+        if (bwd[a->end] > LSMALL && s > bwd[a->start]) {
+            bwd[a->start] = s;
+        }
+    }
+    return fwd[lat->node_num - 1];
+}
+
+/**
+ * Drop the arcs of no path within beam of the best one and the nodes left
+ * without arcs, keeping the order of both
+ */
+static void prune(Lattice *lat, double lm_scale, double penalty, double beam)
+{
+    double *fwd = (double *)malloc(sizeof(double) * (lat->node_num + 1));
+    double *bwd = (double *)malloc(sizeof(double) * (lat->node_num + 1));
+    int *map = (int *)malloc(sizeof(int) * (lat->node_num + 1));
+    double best = forward_backward(lat, lm_scale, penalty, fwd, bwd);
+    int i, n, k;
+
+    for (n = 0; n < lat->node_num; n++) {
+        map[n] = -1;
+    }
+    map[0] = map[lat->node_num - 1] = 0;
+    for (i = k = 0; i < lat->arc_num; i++) {
+        const LatArc *a = &lat->arc[i];
+        double s = fwd[a->start] + arc_score(lat, a, lm_scale, penalty) + bwd[a->end];
+        if (fwd[a->start] <= LSMALL || bwd[a->end] <= LSMALL || (beam > 0 && s < best - beam)) {
+            continue;
+        }
+        map[a->start] = map[a->end] = 0;
+        lat->arc[k++] = *a;
+    }
+    lat->arc_num = k;
+    for (n = k = 0; n < lat->node_num; n++) {
+        if (map[n] >= 0) {
+            map[n] = k;
+            lat->node[k++] = lat->node[n];
+        }
+    }
+    lat->node_num = k;
+    for (i = 0; i < lat->arc_num; i++) {
+        lat->arc[i].start = map[lat->arc[i].start];
+        lat->arc[i].end = map[lat->arc[i].end];
+    }
+    free(fwd);
+    free(bwd);
+    free(map);
+}
+
+static void add_arc(Lattice *lat, int *arc_cap, int start, int end, double ac, double lm)
+{
+    LatArc *a;
+    if (lat->arc_num == *arc_cap) {
+        *arc_cap = *arc_cap > 0 ? *arc_cap * 2 : 256;
+        lat->arc = (LatArc *)realloc(lat->arc, sizeof(LatArc) * *arc_cap);
+    }
+    a = &lat->arc[lat->arc_num++];
+    a->start = start;
+    a->end = end;
+    a->ac = (float)ac;
+    a->lm = (float)lm;
+}
+
+/**
+ * @return index of word in the vocabulary of lat, added if missing
+ */
+static int vocab_add(Lattice *lat, const char *word)
+{
+    int i;
+    for (i = 0; i < lat->vocab_num; i++) {
+        if (strcmp(lat->vocab[i], word) == 0) {
+            return i;
+        }
+    }
+    lat->vocab = (char **)realloc(lat->vocab, sizeof(char *) * (lat->vocab_num + 1));
+    lat->vocab[lat->vocab_num] = strdup(word);
+    return lat->vocab_num++;
+}
+
+int lat_build(Lattice *lat, const Decoder *dec, const float *pair, const char **out_word,
+              double lm_scale, double penalty, double beam, int frame_num)
+{
+    const Slf *slf = dec->net->slf;
+    const WordLink *links = dec->links;
+    int w = slf->node_num + 2, begin = SLF_BEGIN(slf), finish = SLF_FINISH(slf);
+    int i, k, f, arc_cap = 0, end = dec->link_num + 1;
+    int *offset = (int *)calloc(frame_num + 2, sizeof(int));
+    int *by_frame = (int *)malloc(sizeof(int) * (dec->link_num + 1));
+    int *fill = (int *)malloc(sizeof(int) * (frame_num + 2));
+    int *vocab = (int *)malloc(sizeof(int) * (slf->node_num + 1));
+
+    memset(lat, 0, sizeof(Lattice));
+    for (i = 0; i < slf->node_num; i++) {
+        vocab[i] = slf->word[i] != NULL ? vocab_add(lat, out_word[i] != NULL ? out_word[i] : slf->word[i]) : -1;
+    }
+
+    // Node 0 is the start, node i + 1 word end i, the last node the end
+    lat->node_num = dec->link_num + 2;
+    lat->node = (LatNode *)malloc(sizeof(LatNode) * lat->node_num);
+    lat->node[0].frame = 0;
+    lat->node[0].word = -1;
+    for (i = 0; i < dec->link_num; i++) {
+        lat->node[i+1].frame = links[i].frame;
+        lat->node[i+1].word = vocab[links[i].word];
+    }
+    lat->node[end].frame = frame_num;
+    lat->node[end].word = -1;
+
+    // Word ends by frame, in creation order
+    for (i = 0; i < dec->link_num; i++) {
+        offset[links[i].frame + 1]++;
+    }
+    for (f = 0; f <= frame_num; f++) {
+        offset[f+1] += offset[f];
+    }
+    memcpy(fill, offset, sizeof(int) * (frame_num + 2));
+    for (i = 0; i < dec->link_num; i++) {
+        by_frame[fill[links[i].frame]++] = i;
+    }
+
+    // A word end follows every word end at its start frame the grammar allows;
+    // its acoustic score is what its own history left after the grammar weight
+    for (i = 0; i < dec->link_num; i++) {
+        const WordLink *r = &links[i];
+        const WordLink *prev = r->prev >= 0 ? &links[r->prev] : NULL;
+        int s = prev != NULL ? prev->frame : 0;
+        int from = prev != NULL ? prev->word : begin;
+        double lm = pair[(size_t)from * w + r->word];
+        double ac = r->score - (prev != NULL ? prev->score : 0) - lm_scale * lm - (prev != NULL ? penalty : 0);
+
+        if (s == 0 && pair[(size_t)begin * w + r->word] > LSMALL) {
+            add_arc(lat, &arc_cap, 0, i + 1, ac, pair[(size_t)begin * w + r->word]);
+        }
+        for (k = offset[s]; k < offset[s+1] && by_frame[k] < i; k++) {
+            const WordLink *p = &links[by_frame[k]];
+            lm = pair[(size_t)p->word * w + r->word];
+            if (lm > LSMALL) {
+                add_arc(lat, &arc_cap, by_frame[k] + 1, i + 1, ac, lm);
+            }
+        }
+    }
+    for (k = offset[frame_num]; k < offset[frame_num+1]; k++) {
+        double lm = pair[(size_t)links[by_frame[k]].word * w + finish];
+        if (lm > LSMALL) {
+            add_arc(lat, &arc_cap, by_frame[k] + 1, end, 0, lm);
+        }
+    }
+    free(offset);
+    free(by_frame);
+    free(fill);
+    free(vocab);
+
+    prune(lat, lm_scale, penalty, beam);
+    if (lat->arc_num == 0) {
+        lat_free(lat);
+        return -1;
+    }
+    return 0;
+}
+
+void lat_free(Lattice *lat)
+{
+    int i;
+    for (i = 0; i < lat->vocab_num; i++) {
+        free(lat->vocab[i]);
+    }
+    free(lat->vocab);
+    free(lat->name);
+    free(lat->node);
+    free(lat->arc);
+    memset(lat, 0, sizeof(Lattice));
+}
+
+/**
+ * Arcs grouped by start node
+ * @param offset [node_num + 1] receives the first of each node in order
+ * @param order [arc_num] receives the arc indices
+ */
+static void arcs_by_start(const Lattice *lat, int *offset, int *order)
+{
+    int i, n;
+    int *fill = (int *)malloc(sizeof(int) * (lat->node_num + 1));
+
+    memset(offset, 0, sizeof(int) * (lat->node_num + 1));
+    for (i = 0; i < lat->arc_num; i++) {
+        offset[lat->arc[i].start + 1]++;
+    }
+    for (n = 0; n < lat->node_num; n++) {
+        offset[n+1] += offset[n];
+    }
+    memcpy(fill, offset, sizeof(int) * (lat->node_num + 1));
+    for (i = 0; i < lat->arc_num; i++) {
+        order[fill[lat->arc[i].start]++] = i;
+    }
+    free(fill);
+}
+
+static int compare_arc(const void *a, const void *b)
+{
+    const LatArc *x = (const LatArc *)a, *y = (const LatArc *)b;
+    if (x->end != y->end) {
+        return x->end - y->end;
+    }
+    return x->start - y->start;
+}
+
+/**
+ * Node of the composed lattice: a lattice node paired with a node of the
+ * new network (SLF_BEGIN / SLF_FINISH at the sentence start and end)
+ */
+typedef struct {
+    int node, slf;
+    int id;
+} Pair;
+
+int lat_compose(Lattice *out, const Lattice *lat, const Slf *slf, const float *pair)
+{
+    int w = slf->node_num + 2, last = lat->node_num - 1;
+    int i, j, k, n, to, pair_num = 0, pair_cap = 256, arc_cap = 0;
+    int *offset = (int *)malloc(sizeof(int) * (lat->node_num + 1));
+    int *order = (int *)malloc(sizeof(int) * (lat->arc_num + 1));
+    int *first = (int *)malloc(sizeof(int) * (lat->node_num + 1));    // First pair of each lattice node
+    int *next = NULL;
+    Pair *p = (Pair *)malloc(sizeof(Pair) * pair_cap);
+    char *live = NULL;
+    int *id = NULL;
+    Lattice tmp;
+
+    memset(out, 0, sizeof(Lattice));
+    memset(&tmp, 0, sizeof(Lattice));
+    arcs_by_start(lat, offset, order);
+    for (n = 0; n < lat->node_num; n++) {
+        first[n] = -1;
+    }
+    next = (int *)malloc(sizeof(int) * pair_cap);
+    p[0].node = 0;
+    p[0].slf = SLF_BEGIN(slf);
+    next[0] = -1;
+    first[0] = 0;
+    pair_num = 1;
+
+    // Expand forward; arcs of tmp refer to pair indices for now
+    for (n = 0; n < lat->node_num; n++) {
+        for (i = first[n]; i >= 0; i = next[i]) {
+            int from = p[i].slf;
+            for (k = offset[n]; k < offset[n+1]; k++) {
+                const LatArc *a = &lat->arc[order[k]];
+                const char *word = lat->node[a->end].word >= 0 ? lat->vocab[lat->node[a->end].word] : NULL;
+                // The sentence end pairs with the network end, a word with its nodes
+                int lo = a->end == last ? SLF_FINISH(slf) : 0;
+                int hi = a->end == last ? SLF_FINISH(slf) : slf->node_num - 1;
+                for (to = lo; to <= hi; to++) {
+                    double lm = pair[(size_t)from * w + to];
+                    if (lm <= LSMALL || (a->end != last && \
+                        (word == NULL || slf->word[to] == NULL || strcmp(slf->word[to], word) != 0))) {
+                        continue;
+                    }
+                    for (j = first[a->end]; j >= 0 && p[j].slf != to; j = next[j]) {
+                    }
+                    if (j < 0) {
+                        if (pair_num == pair_cap) {
+                            pair_cap *= 2;
+                            p = (Pair *)realloc(p, sizeof(Pair) * pair_cap);
+                            next = (int *)realloc(next, sizeof(int) * pair_cap);
+                        }
+                        j = pair_num++;
+                        p[j].node = a->end;
+                        p[j].slf = to;
+                        next[j] = first[a->end];
+                        first[a->end] = j;
+                    }
+                    add_arc(&tmp, &arc_cap, i, j, a->ac, lm);
+                }
+            }
+        }
+    }
+
+    // Keep the pairs that reach the sentence end, numbered in lattice order
+    live = (char *)calloc(pair_num + 1, 1);
+    id = (int *)malloc(sizeof(int) * (pair_num + 1));
+    for (j = first[last]; j >= 0; j = next[j]) {
+        live[j] = p[j].slf == SLF_FINISH(slf);
+    }
+    for (i = tmp.arc_num - 1; i >= 0; i--) {
+        if (live[tmp.arc[i].end]) {
+            live[tmp.arc[i].start] = 1;
+        }
+    }
+    if (!live[0]) {
+        fprintf(stderr, "%s: no path of the lattice is accepted by the network\n", lat->name != NULL ? lat->name : "lattice");
+        goto fail;
+    }
+    out->node = (LatNode *)malloc(sizeof(LatNode) * (pair_num + 1));
+    for (n = 0; n < lat->node_num; n++) {
+        for (j = first[n]; j >= 0; j = next[j]) {
+            id[j] = -1;
+            if (live[j]) {
+                id[j] = out->node_num;
+                out->node[out->node_num++] = lat->node[n];
+            }
+        }
+    }
+    out->arc = (LatArc *)malloc(sizeof(LatArc) * (tmp.arc_num + 1));
+    for (i = 0; i < tmp.arc_num; i++) {
+        if (live[tmp.arc[i].start] && live[tmp.arc[i].end]) {
+            out->arc[out->arc_num] = tmp.arc[i];
+            out->arc[out->arc_num].start = id[tmp.arc[i].start];
+            out->arc[out->arc_num].end = id[tmp.arc[i].end];
+            out->arc_num++;
+        }
+    }
+    qsort(out->arc, out->arc_num, sizeof(LatArc), compare_arc);
+
+    out->name = lat->name != NULL ? strdup(lat->name) : NULL;
+    out->samp_period = lat->samp_period;
+    out->vocab_num = lat->vocab_num;
+    out->vocab = (char **)malloc(sizeof(char *) * (lat->vocab_num + 1));
+    for (i = 0; i < lat->vocab_num; i++) {
+        out->vocab[i] = strdup(lat->vocab[i]);
+    }
+    free(tmp.arc);
+    free(offset);
+    free(order);
+    free(first);
+    free(next);
+    free(p);
+    free(live);
+    free(id);
+    return 0;
+
+fail:
+    free(tmp.arc);
+    free(offset);
+    free(order);
+    free(first);
+    free(next);
+    free(p);
+    free(live);
+    free(id);
+    lat_free(out);
+    return -1;
+}
+
+/**
+ * Partial path of the A* search, linked back to the one it extends
+ */
+typedef struct {
+    int node;
+    int prev;
+    double score;       // From the start to node
+} Partial;
+
+/**
+ * Max-heap of partial paths by score + the best completion
+ */
+typedef struct {
+    int num, cap;
+    int *item;
+    double *key;
+} Heap;
+
+static void heap_push(Heap *h, int item, double key)
+{
+    int i = h->num++;
+    if (h->num > h->cap) {
+        h->cap = h->cap > 0 ? h->cap * 2 : 256;
+        h->item = (int *)realloc(h->item, sizeof(int) * h->cap);
+        h->key = (double *)realloc(h->key, sizeof(double) * h->cap);
+    }
+    while (i > 0 && h->key[(i-1)/2] < key) {
+        h->item[i] = h->item[(i-1)/2];
+        h->key[i] = h->key[(i-1)/2];
+        i = (i - 1) / 2;
+    }
+    h->item[i] = item;
+    h->key[i] = key;
+}
+
+static int heap_pop(Heap *h)
+{
+    int top = h->item[0], i = 0, c, item;
+    double key;
+
+    h->num--;
+    item = h->item[h->num];
+    key = h->key[h->num];
+    while ((c = 2 * i + 1) < h->num) {
+        if (c + 1 < h->num && h->key[c+1] > h->key[c]) {
+            c++;
+        }
+        if (h->key[c] <= key) {
+            break;
+        }
+        h->item[i] = h->item[c];
+        h->key[i] = h->key[c];
+        i = c;
+    }
+    h->item[i] = item;
+    h->key[i] = key;
+    return top;
+}
+
+static int same_words(const LatPath *a, const LatPath *b)
+{
+    return a->word_num == b->word_num && memcmp(a->word, b->word, sizeof(int) * a->word_num) == 0;
+}
+
+int lat_nbest(const Lattice *lat, double lm_scale, double penalty, int n, LatPath *path)
+{
+    double *fwd = (double *)malloc(sizeof(double) * (lat->node_num + 1));
+    double *bwd = (double *)malloc(sizeof(double) * (lat->node_num + 1));
+    int *offset = (int *)malloc(sizeof(int) * (lat->node_num + 1));
+    int *order = (int *)malloc(sizeof(int) * (lat->arc_num + 1));
+    int part_num = 0, part_cap = 256, found = 0, expand = 0, i, k, last = lat->node_num - 1;
+    Partial *part = (Partial *)malloc(sizeof(Partial) * part_cap);
+    Heap heap;
+
+    memset(&heap, 0, sizeof(Heap));
+    if (n <= 0 || forward_backward(lat, lm_scale, penalty, fwd, bwd) <= LSMALL) {
+        goto done;
+    }
+    arcs_by_start(lat, offset, order);
+
+    // The backward scores are exact, so complete paths pop out best first
+    part[0].node = 0;
+    part[0].prev = -1;
+    part[0].score = 0;
+    part_num = 1;
+    heap_push(&heap, 0, bwd[0]);
+    while (heap.num > 0 && found < n && expand < (long)LAT_MAX_EXPAND * n) {
+        int cur = heap_pop(&heap);
+        int node = part[cur].node;
+
+        if (node == last) {
+            LatPath *lp = &path[found];
+            int len = 0;
+            for (i = part[cur].prev; i > 0; i = part[i].prev) {
+                len++;
+            }
+            lp->word_num = len;
+            lp->word = (int *)malloc(sizeof(int) * (len + 1));
+            lp->start = (int *)malloc(sizeof(int) * (len + 1));
+            lp->end = (int *)malloc(sizeof(int) * (len + 1));
+            lp->word_score = (double *)malloc(sizeof(double) * (len + 1));
+            lp->score = part[cur].score;
+            for (i = part[cur].prev; i > 0; i = part[i].prev) {
+                len--;
+                lp->word[len] = lat->node[part[i].node].word;
+                lp->start[len] = lat->node[part[part[i].prev].node].frame;
+                lp->end[len] = lat->node[part[i].node].frame;
+                lp->word_score[len] = part[i].score - part[part[i].prev].score;
+            }
+            for (k = 0; k < found && !same_words(&path[k], lp); k++) {
+            }
+            if (k < found) {
+                lat_path_free(lp);
+            } else {
+                found++;
+            }
+            continue;
+        }
+
+        expand++;
+        for (k = offset[node]; k < offset[node+1]; k++) {
+            const LatArc *a = &lat->arc[order[k]];
+            double s = part[cur].score + arc_score(lat, a, lm_scale, penalty);
+            if (bwd[a->end] <= LSMALL) {
+                continue;
+            }
+            if (part_num == part_cap) {
+                part_cap *= 2;
+                part = (Partial *)realloc(part, sizeof(Partial) * part_cap);
+            }
+            part[part_num].node = a->end;
+            part[part_num].prev = cur;
+            part[part_num].score = s;
+            heap_push(&heap, part_num++, s + bwd[a->end]);
+        }
+    }
+
+done:
+    free(fwd);
+    free(bwd);
+    free(offset);
+    free(order);
+    free(part);
+    free(heap.item);
+    free(heap.key);
+    return found;
+}
+
+void lat_path_free(LatPath *path)
+{
+    free(path->word);
+    free(path->start);
+    free(path->end);
+    free(path->word_score);
+    memset(path, 0, sizeof(LatPath));
+}
+
+int lat_write_slf(const Lattice *lat, const char *filename)
+{
+    int i;
+    double period = lat->samp_period * 1e-7;
+    FILE *fp = fopen(filename, "w");
+
+    if (fp == NULL) {
+        perror(filename);
+        return -1;
+    }
+    fprintf(fp, "VERSION=1.0\n");
+    if (lat->name != NULL) {
+        fprintf(fp, "UTTERANCE=%s\n", lat->name);
+    }
+    fprintf(fp, "# samp_period=%d\n", lat->samp_period);
+    fprintf(fp, "N=%d L=%d\n", lat->node_num, lat->arc_num);
+    for (i = 0; i < lat->node_num; i++) {
+        const LatNode *n = &lat->node[i];
+        fprintf(fp, "I=%d t=%.2f W=%s\n", i, n->frame * period, n->word >= 0 ? lat->vocab[n->word] : "!NULL");
+    }
+    for (i = 0; i < lat->arc_num; i++) {
+        const LatArc *a = &lat->arc[i];
+        fprintf(fp, "J=%d S=%d E=%d a=%.4f l=%.4f\n", i, a->start, a->end, a->ac, a->lm);
+    }
+    fclose(fp);
+    return 0;
+}
+
+int lat_read_slf(Lattice *lat, const char *filename)
+{
+    char line[MAX_NAME * 4], value[MAX_NAME * 2];
+    double *time = NULL;
+    int i, j;
+
+    FILE *fp = fopen(filename, "r");
+    if (fp == NULL) {
+        perror(filename);
+        return -1;
+    }
+
+    memset(lat, 0, sizeof(Lattice));
+    lat->samp_period = 100000;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (slf_field(line, "I", value) != NULL) {
+            int n = atoi(value);
+            if (n < 0 || n >= lat->node_num || slf_field(line, "W", value) == NULL) {
+                fprintf(stderr, "%s: bad node line: %s\n", filename, line);
+                goto fail;
+            }
+            lat->node[n].word = strcmp(value, "!NULL") == 0 ? -1 : vocab_add(lat, value);
+            time[n] = slf_field(line, "t", value) != NULL ? atof(value) : 0;
+        } else if (slf_field(line, "J", value) != NULL) {
+            LatArc *a;
+            j = atoi(value);
+            if (j < 0 || j >= lat->arc_num || slf_field(line, "S", value) == NULL) {
+                fprintf(stderr, "%s: bad link line: %s\n", filename, line);
+                goto fail;
+            }
+            a = &lat->arc[j];
+            a->start = atoi(value);
+            if (slf_field(line, "E", value) == NULL) {
+                fprintf(stderr, "%s: bad link line: %s\n", filename, line);
+                goto fail;
+            }
+            a->end = atoi(value);
+            a->ac = slf_field(line, "a", value) != NULL ? (float)atof(value) : 0;
+            a->lm = slf_field(line, "l", value) != NULL ? (float)atof(value) : 0;
+            if (a->start < 0 || a->start >= a->end || a->end >= lat->node_num) {
+                fprintf(stderr, "%s: link %d is out of node order\n", filename, j);
+                goto fail;
+            }
+        } else if (slf_field(line, "N", value) != NULL) {
+            lat->node_num = atoi(value);
+            lat->node = (LatNode *)calloc(lat->node_num + 1, sizeof(LatNode));
+            time = (double *)calloc(lat->node_num + 1, sizeof(double));
+            if (slf_field(line, "L", value) == NULL) {
+                fprintf(stderr, "%s: N= without L=\n", filename);
+                goto fail;
+            }
+            lat->arc_num = atoi(value);
+            lat->arc = (LatArc *)calloc(lat->arc_num + 1, sizeof(LatArc));
+        } else if (slf_field(line, "UTTERANCE", value) != NULL) {
+            free(lat->name);
+            lat->name = strdup(value);
+        } else if (slf_field(line, "samp_period", value) != NULL) {
+            lat->samp_period = atoi(value);
+        }
+    }
+    fclose(fp);
+    fp = NULL;
+
+    if (lat->node_num < 2 || lat->node[0].word >= 0 || lat->node[lat->node_num-1].word >= 0) {
+        fprintf(stderr, "%s: needs !NULL start and end nodes first and last\n", filename);
+        goto fail;
+    }
+    for (i = 0; i < lat->node_num; i++) {
+        lat->node[i].frame = (int)floor(time[i] * 1e7 / lat->samp_period + 0.5);
+    }
+    qsort(lat->arc, lat->arc_num, sizeof(LatArc), compare_arc);
+    free(time);
+    return 0;
+
+fail:
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    free(time);
+    lat_free(lat);
+    return -1;
+}
+
+static void write_string(FILE *fp, const char *s)
+{
+    int len = s != NULL ? (int)strlen(s) : 0;
+    fwrite(&len, sizeof(int), 1, fp);
+    fwrite(s, 1, len, fp);
+}
+
+/**
+ * @return 0 on success, -1 on a truncated file
+ */
+static int read_string(FILE *fp, char **s)
+{
+    int len;
+    if (fread(&len, sizeof(int), 1, fp) != 1 || len < 0 || len > MAX_NAME * 16) {
+        return -1;
+    }
+    *s = (char *)malloc(len + 1);
+    if (fread(*s, 1, len, fp) != (size_t)len) {
+        return -1;
+    }
+    (*s)[len] = '\0';
+    return 0;
+}
+
+void lat_cache_write(FILE *fp, const Lattice *lat)
+{
+    int i, magic = LAT_MAGIC;
+
+    fwrite(&magic, sizeof(int), 1, fp);
+    write_string(fp, lat->name);
+    fwrite(&lat->samp_period, sizeof(int), 1, fp);
+    fwrite(&lat->vocab_num, sizeof(int), 1, fp);
+    for (i = 0; i < lat->vocab_num; i++) {
+        write_string(fp, lat->vocab[i]);
+    }
+    fwrite(&lat->node_num, sizeof(int), 1, fp);
+    fwrite(&lat->arc_num, sizeof(int), 1, fp);
+    fwrite(lat->node, sizeof(LatNode), lat->node_num, fp);
+    fwrite(lat->arc, sizeof(LatArc), lat->arc_num, fp);
+}
+
+int lat_cache_read(FILE *fp, Lattice *lat)
+{
+    int i, magic, vocab_num;
+
+    memset(lat, 0, sizeof(Lattice));
+    if (fread(&magic, sizeof(int), 1, fp) != 1) {
+        return 0;
+    }
+    if (magic != LAT_MAGIC) {
+        fprintf(stderr, "Not a lattice cache\n");
+        return -1;
+    }
+    if (read_string(fp, &lat->name) < 0 || fread(&lat->samp_period, sizeof(int), 1, fp) != 1 || \
+        fread(&vocab_num, sizeof(int), 1, fp) != 1 || vocab_num < 0) {
+        goto fail;
+    }
+    lat->vocab = (char **)calloc(vocab_num + 1, sizeof(char *));
+    lat->vocab_num = vocab_num;
+    for (i = 0; i < lat->vocab_num; i++) {
+        if (read_string(fp, &lat->vocab[i]) < 0) {
+            goto fail;
+        }
+    }
+    if (fread(&lat->node_num, sizeof(int), 1, fp) != 1 || fread(&lat->arc_num, sizeof(int), 1, fp) != 1 || \
+        lat->node_num < 0 || lat->arc_num < 0) {
+        goto fail;
+    }
+    lat->node = (LatNode *)malloc(sizeof(LatNode) * (lat->node_num + 1));
+    lat->arc = (LatArc *)malloc(sizeof(LatArc) * (lat->arc_num + 1));
+    if (fread(lat->node, sizeof(LatNode), lat->node_num, fp) != (size_t)lat->node_num || \
+        fread(lat->arc, sizeof(LatArc), lat->arc_num, fp) != (size_t)lat->arc_num) {
+        goto fail;
+    }
+    return 1;
+
+fail:
+    fprintf(stderr, "Truncated lattice cache\n");
+    lat_free(lat);
+    return -1;
+}
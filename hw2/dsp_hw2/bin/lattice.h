@@ -0,0 +1,97 @@
+#ifndef LATTICE_HEADER_
+#define LATTICE_HEADER_
+
+#include "decode.h"
+
+/**
+ * Word lattices of decoded utterances, so new grammar weights, scales and
+ * penalties can be tried without decoding the acoustics again.
+ *
+ * A lattice is built from the word-end records of a decode: every word end
+ * within the beams becomes a node, and is linked to every word end at its
+ * start frame that the grammar allows in front of it (the word-pair
+ * approximation: a word's acoustic score only depends on its start time).
+ * Arcs keep the acoustic score and the grammar weight l apart; an arc
+ * scores ac + lm_scale * l, plus penalty if it ends in a word. Node 0 is the sentence start, the last node the sentence end,
+ * and nodes are in topological order.
+ *
+ * Lattices are written as HTK SLF files (HLRescore and HResults read them)
+ * or appended to a binary cache for fast reloading.
+ */
+
+#ifndef LAT_MAGIC
+    #define LAT_MAGIC 0x4c415431     // "LAT1"
+#endif
+
+typedef struct {
+    int frame;          // End time of the word in frames
+    int word;           // Index into vocab, -1 for the start and end nodes
+} LatNode;
+
+typedef struct {
+    int start, end;
+    float ac;           // Acoustic log likelihood of the end node's word
+    float lm;           // Grammar log weight l of the arc
+} LatArc;
+
+typedef struct {
+    char *name;         // Utterance name
+    int samp_period;    // Frame period in 100ns units
+    int vocab_num;
+    char **vocab;
+    int node_num, arc_num;
+    LatNode *node;
+    LatArc *arc;        // Sorted by end node
+} Lattice;
+
+typedef struct {
+    int word_num;
+    int *word;          // Indices into vocab
+    int *start, *end;   // Frames
+    double *word_score; // Score of the arc into each word
+    double score;
+} LatPath;
+
+/**
+ * Build the lattice of the last decode of dec. Arcs on no path within beam
+ * of the best one are dropped. name and samp_period are left to the caller.
+ * @param pair word-pair table of the network, see slf_word_pairs
+ * @param out_word output symbol of every SLF node
+ * @param beam lattice beam, 0 keeps every arc
+ * @return 0 on success, -1 if no word end reached the sentence end
+ */
+int lat_build(Lattice *lat, const Decoder *dec, const float *pair, const char **out_word,
+              double lm_scale, double penalty, double beam, int frame_num);
+void lat_free(Lattice *lat);
+
+/**
+ * Rescore lat against a new word network: the result only keeps paths
+ * whose word sequence slf accepts, with its l= weights
+ * @return 0 on success, -1 if no path of lat is accepted
+ */
+int lat_compose(Lattice *out, const Lattice *lat, const Slf *slf, const float *pair);
+
+/**
+ * The n best paths with distinct word sequences, best first
+ * @param path receives up to n paths, release each with lat_path_free
+ * @return number of paths found
+ */
+int lat_nbest(const Lattice *lat, double lm_scale, double penalty, int n, LatPath *path);
+void lat_path_free(LatPath *path);
+
+/**
+ * @return 0 on success, -1 on error (reported on stderr)
+ */
+int lat_write_slf(const Lattice *lat, const char *filename);
+int lat_read_slf(Lattice *lat, const char *filename);
+
+/**
+ * Binary cache: lattices one after the other, each starting with LAT_MAGIC
+ */
+void lat_cache_write(FILE *fp, const Lattice *lat);
+/**
+ * @return 1 if a lattice was read, 0 at the end of the file, -1 on error
+ */
+int lat_cache_read(FILE *fp, Lattice *lat);
+
+#endif
@@ -1,5 +1,5 @@
-#include "stdio.h"
-#include "stdlib.h"
+#include "mmf.h"
+#include <stdlib.h>
 
 
 /***********************************************************/
@@ -21,6 +21,8 @@
 /*        a more global usability                          */
 /*        - <VECSIZE>  and  <PARAMETER_TYPE>               */
 /*      - output file name also input parameter            */
+/*      - vFloors parsed and the macro file written by the */
+/*        MMF library (mmf.h) instead of copied byte-wise  */
 /*                                                         */
 /***********************************************************/
 
@@ -40,33 +42,31 @@
 
 int main(int argc, char *argv[])
 {
-	FILE *fp;
-	FILE *outfile;
-	char c;
-	
-	if(argc != 5)
-	{	printf("Usage: %s VECSIZE PARAMETER_TYPE infile outfile\n", argv[0]);
-		exit(1);
-	}
-	
-	if ( (fp = fopen(argv[3], "r")) == NULL)
-	{
-		fprintf(stderr, "cannot open file %s!\n", argv[3]);
-		exit(-1);
-	}
-	if ( (outfile = fopen(argv[4], "w")) == NULL)
-	{
-		fprintf(stderr, "cannot open file %s!\n", argv[4]);
-		exit(-1);
-	}
-	
-	fprintf(outfile, "~o\n<STREAMINFO> 1 %s\n", argv[1]);
-	fprintf(outfile, "<VECSIZE> %s\n", argv[1]);
-	fprintf(outfile, "<NULLD>\n<%s>\n", argv[2]);	
-	while((c=getc(fp))!=EOF)
-		fprintf(outfile,"%c",c);
-	
-	fclose(fp);
-	fclose(outfile);
-	return(0);
+    ModelSet set;
+
+    if (argc != 5) {
+        printf("Usage: %s VECSIZE PARAMETER_TYPE infile outfile\n", argv[0]);
+        exit(1);
+    }
+
+    modelset_init(&set);
+    if (mmf_load(&set, argv[3]) < 0) {
+        exit(1);
+    }
+    set.vec_size = atoi(argv[1]);
+    set.parm_kind = parm_kind_parse(argv[2]);
+    if (set.parm_kind < 0) {
+        fprintf(stderr, "unknown parameter kind %s\n", argv[2]);
+        exit(1);
+    }
+    if (set.var_floor == NULL) {
+        fprintf(stderr, "%s has no ~v varFloor1\n", argv[3]);
+        exit(1);
+    }
+
+    if (mmf_save(&set, argv[4], MMF_GLOBAL) < 0) {
+        exit(1);
+    }
+    modelset_free(&set);
+    return 0;
 }
@@ -0,0 +1,214 @@
+#include "frontend.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#ifndef MAX_THREAD
+    #define MAX_THREAD 64
+#endif
+
+/**
+ * Shared by the workers, which take files by atomically bumping next
+ */
+typedef struct {
+    const FrontEndConfig *cfg;
+    int chunk;             // Streaming chunk in samples, 0 for whole files
+    char **src, **dst;
+    int file_num;
+    int next;
+    int fail_num;
+    double sample_sec;     // Audio processed, for the summary
+    pthread_mutex_t lock;
+} Job;
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/**
+ * FrameSink collecting the streamed vectors of one file
+ */
+static void append_frame(void *arg, const float *vector)
+{
+    Feature *feat = (Feature *)arg;
+    feat->data = (float *)realloc(feat->data, sizeof(float) * (feat->frame_num + 1) * feat->dim);
+    memcpy(feat->data + (size_t)feat->frame_num * feat->dim, vector, sizeof(float) * feat->dim);
+    feat->frame_num++;
+}
+
+/**
+ * Push the samples in chunks through the streaming analysis
+ */
+static int stream_file(const FrontEnd *fe, const float *samples, int n, int chunk, Feature *feat)
+{
+    FrontEndStream st;
+    int i;
+
+    memset(feat, 0, sizeof(Feature));
+    feat->dim = fe->dim;
+    feat->samp_period = (int)fe->cfg.target_rate;
+    feat->parm_kind = (short)fe->cfg.target_kind;
+
+    frontend_stream_init(&st, fe);
+    for (i = 0; i < n; i += chunk) {
+        frontend_stream_push(&st, samples + i, i + chunk < n ? chunk : n - i, append_frame, feat);
+    }
+    frontend_stream_finish(&st, append_frame, feat);
+    frontend_stream_free(&st);
+    return feat->frame_num > 0 ? 0 : -1;
+}
+
+static void *worker(void *arg)
+{
+    Job *job = (Job *)arg;
+    FrontEnd fe;
+    FrontEndWork work;
+    int i, n, samp_period, current = 0, fail = 0;
+    double sec = 0;
+
+    // Rebuilt only when the sample rate changes between files
+    memset(&fe, 0, sizeof(FrontEnd));
+    memset(&work, 0, sizeof(FrontEndWork));
+
+    while ((i = __sync_fetch_and_add(&job->next, 1)) < job->file_num) {
+        float *samples;
+        Feature feat;
+
+        n = wav_read(job->src[i], &samples, &samp_period);
+        if (n < 0) {
+            fail++;
+            continue;
+        }
+        if (samp_period != current) {
+            frontend_work_free(&work);
+            frontend_free(&fe);
+            if (frontend_init(&fe, job->cfg, samp_period) < 0) {
+                free(samples);
+                fail++;
+                current = 0;
+                continue;
+            }
+            frontend_work_init(&work, &fe);
+            current = samp_period;
+        }
+
+        if ((job->chunk > 0 ? stream_file(&fe, samples, n, job->chunk, &feat) : \
+                              frontend_process(&fe, &work, samples, n, &feat)) < 0) {
+            fprintf(stderr, "%s: shorter than one window\n", job->src[i]);
+            fail++;
+        } else {
+            if (htk_write(job->dst[i], &feat) < 0) {
+                fail++;
+            }
+            feature_free(&feat);
+        }
+        sec += n * fe.samp_period * 1e-7;
+        free(samples);
+    }
+
+    frontend_work_free(&work);
+    frontend_free(&fe);
+
+    pthread_mutex_lock(&job->lock);
+    job->fail_num += fail;
+    job->sample_sec += sec;
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+/**
+ * Native replacement for "HCopy -C config -S scp": converts WAV files to
+ * HTK parameter files, one utterance per thread at a time. With -s, files
+ * go through the streaming analysis in chunks of that many samples.
+ */
+int main(int argc, char *argv[])
+{
+    int i, n, thread_num = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const char *config = NULL, *scp = NULL;
+    char *src[1], *dst[1];
+    FrontEndConfig cfg;
+    pthread_t thread[MAX_THREAD];
+    Job job;
+    double start;
+
+    if (argc < 3) {
+        printf("Wrong argument format\n");
+        printf("Usage: ./mfcc [-C config] [-j threads] [-s chunk] (-S hcopy.scp | src.wav dst.mfc)\n");
+        exit(1);
+    }
+
+    memset(&job, 0, sizeof(Job));
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-C") == 0 && i + 1 < argc) {
+            config = argv[++i];
+        } else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+            scp = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            job.chunk = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            thread_num = atoi(argv[++i]);
+        } else if (argv[i][0] != '-' && i + 1 < argc && scp == NULL) {
+            src[0] = argv[i];
+            dst[0] = argv[i+1];
+            job.src = src;
+            job.dst = dst;
+            job.file_num = 1;
+            i++;
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    frontend_config_default(&cfg);
+    if (config != NULL && frontend_config_load(&cfg, config) < 0) {
+        exit(1);
+    }
+    if (scp != NULL) {
+        job.src = read_list(scp, 0, &job.file_num);
+        job.dst = read_list(scp, 1, &n);
+        if (n != job.file_num) {
+            fprintf(stderr, "%s: every line needs a source and a target\n", scp);
+            exit(1);
+        }
+    }
+    if (job.file_num == 0) {
+        printf("Nothing to do\n");
+        exit(1);
+    }
+
+    if (thread_num < 1) {
+        thread_num = 1;
+    }
+    if (thread_num > MAX_THREAD) {
+        thread_num = MAX_THREAD;
+    }
+    if (thread_num > job.file_num) {
+        thread_num = job.file_num;
+    }
+
+    job.cfg = &cfg;
+    pthread_mutex_init(&job.lock, NULL);
+    start = now();
+    for (i = 1; i < thread_num; i++) {
+        pthread_create(&thread[i], NULL, worker, &job);
+    }
+    worker(&job);
+    for (i = 1; i < thread_num; i++) {
+        pthread_join(thread[i], NULL);
+    }
+    pthread_mutex_destroy(&job.lock);
+
+    printf("Converted %d files (%.1f sec of audio) in %.2f sec with %d threads\n",
+           job.file_num - job.fail_num, job.sample_sec, now() - start, thread_num);
+    if (scp != NULL) {
+        free_list(job.src, job.file_num);
+        free_list(job.dst, job.file_num);
+    }
+    return job.fail_num > 0;
+}
@@ -0,0 +1,397 @@
+#include "mlf.h"
+#include "archive.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+static int is_number(const char *s)
+{
+    if (*s == '-') {
+        s++;
+    }
+    if (*s == '\0') {
+        return 0;
+    }
+    for (; *s; s++) {
+        if (!isdigit((unsigned char)*s)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Names and labels while a text MLF is read, as offsets into a growing
+ * text block
+ */
+typedef struct {
+    char *text;
+    int text_size, text_cap;
+    int trans_num, trans_cap;
+    int *name_off;         // [trans_cap]
+    int *label_start;      // [trans_cap + 1]
+    int label_num, label_cap;
+    int *label_off;        // [label_cap]
+} Builder;
+
+static int add_text(Builder *b, const char *str)
+{
+    int len = (int)strlen(str) + 1, off = b->text_size;
+
+    while (b->text_size + len > b->text_cap) {
+        b->text_cap *= 2;
+        b->text = (char *)realloc(b->text, b->text_cap);
+    }
+    memcpy(b->text + off, str, len);
+    b->text_size += len;
+    return off;
+}
+
+static void add_trans(Builder *b, const char *name)
+{
+    if (b->trans_num == b->trans_cap) {
+        b->trans_cap *= 2;
+        b->name_off = (int *)realloc(b->name_off, sizeof(int) * b->trans_cap);
+        b->label_start = (int *)realloc(b->label_start, sizeof(int) * (b->trans_cap + 1));
+    }
+    b->name_off[b->trans_num] = add_text(b, name);
+    b->label_start[b->trans_num++] = b->label_num;
+}
+
+static void add_label(Builder *b, const char *label)
+{
+    if (b->label_num == b->label_cap) {
+        b->label_cap *= 2;
+        b->label_off = (int *)realloc(b->label_off, sizeof(int) * b->label_cap);
+    }
+    b->label_off[b->label_num++] = add_text(b, label);
+}
+
+static void builder_free(Builder *b)
+{
+    free(b->text);
+    free(b->name_off);
+    free(b->label_start);
+    free(b->label_off);
+}
+
+static unsigned hash_name(const char *s)
+{
+    unsigned h = 2166136261u;    // FNV-1a
+    for (; *s; s++) {
+        h = (h ^ (unsigned char)*s) * 16777619u;
+    }
+    return h;
+}
+
+/**
+ * Turn the offsets of b into mlf, which takes over the text, and index the
+ * names
+ * @return 0 on success, -1 if an utterance appears twice
+ */
+static int finish(Mlf *mlf, Builder *b, const char *filename)
+{
+    int i, n;
+
+    memset(mlf, 0, sizeof(Mlf));
+    mlf->text = b->text;
+    mlf->text_size = b->text_size;
+    b->text = NULL;
+    mlf->trans_num = b->trans_num;
+    mlf->label_total = b->label_num;
+    mlf->trans = (Transcription *)malloc(sizeof(Transcription) * (b->trans_num + 1));
+    mlf->labels = (char **)malloc(sizeof(char *) * (b->label_num + 1));
+    for (i = 0; i < b->label_num; i++) {
+        mlf->labels[i] = mlf->text + b->label_off[i];
+    }
+
+    for (mlf->hash_size = 16; mlf->hash_size < 2 * b->trans_num; mlf->hash_size *= 2);
+    mlf->hash = (int *)malloc(sizeof(int) * mlf->hash_size);
+    memset(mlf->hash, -1, sizeof(int) * mlf->hash_size);
+    for (n = 0; n < b->trans_num; n++) {
+        Transcription *tr = &mlf->trans[n];
+        tr->name = mlf->text + b->name_off[n];
+        tr->label = mlf->labels + b->label_start[n];
+        tr->label_num = b->label_start[n+1] - b->label_start[n];
+
+        for (i = hash_name(tr->name) & (mlf->hash_size - 1); mlf->hash[i] >= 0; i = (i + 1) & (mlf->hash_size - 1)) {
+            if (strcmp(mlf->trans[mlf->hash[i]].name, tr->name) == 0) {
+                fprintf(stderr, "%s: utterance %s appears twice\n", filename, tr->name);
+                mlf_free(mlf);
+                return -1;
+            }
+        }
+        mlf->hash[i] = n;
+    }
+    return 0;
+}
+
+/**
+ * Whether the offsets read from a cache lie in its text, so that finish can
+ * trust them: every name and label starts inside the text, which ends with
+ * a terminator, and the label runs of the utterances tile the label list
+ */
+static int cache_valid(const Builder *b)
+{
+    int i;
+
+    if ((b->trans_num > 0 || b->label_num > 0) && (b->text_size == 0 || b->text[b->text_size-1] != '\0')) {
+        return 0;
+    }
+    for (i = 0; i < b->trans_num; i++) {
+        if (b->name_off[i] < 0 || b->name_off[i] >= b->text_size || b->label_start[i] > b->label_start[i+1]) {
+            return 0;
+        }
+    }
+    if (b->label_start[0] != 0 || b->label_start[b->trans_num] != b->label_num) {
+        return 0;
+    }
+    for (i = 0; i < b->label_num; i++) {
+        if (b->label_off[i] < 0 || b->label_off[i] >= b->text_size) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int load_cache(Mlf *mlf, FILE *fp, const char *filename)
+{
+    int head[3], ok;
+    long pos, size;
+    Builder b;
+
+    memset(&b, 0, sizeof(Builder));
+    ok = fread(head, sizeof(int), 3, fp) == 3 && head[0] >= 0 && head[1] >= 0 && head[2] >= 0;
+    // The counts must fit in what is left of the file before anything is
+    // allocated for them
+    pos = ftell(fp);
+    size = fseek(fp, 0, SEEK_END) == 0 ? ftell(fp) : -1;
+    ok = ok && pos >= 0 && size >= pos && fseek(fp, pos, SEEK_SET) == 0 && \
+         (long)sizeof(int) * (2L * head[0] + 1 + head[1]) + head[2] <= size - pos;
+    if (ok) {
+        b.trans_num = head[0];
+        b.label_num = head[1];
+        b.text_size = head[2];
+        b.name_off = (int *)malloc(sizeof(int) * ((size_t)b.trans_num + 1));
+        b.label_start = (int *)malloc(sizeof(int) * ((size_t)b.trans_num + 1));
+        b.label_off = (int *)malloc(sizeof(int) * ((size_t)b.label_num + 1));
+        b.text = (char *)malloc((size_t)b.text_size + 1);
+        ok = b.name_off != NULL && b.label_start != NULL && b.label_off != NULL && b.text != NULL && \
+             fread(b.name_off, sizeof(int), b.trans_num, fp) == (size_t)b.trans_num && \
+             fread(b.label_start, sizeof(int), (size_t)b.trans_num + 1, fp) == (size_t)b.trans_num + 1 && \
+             fread(b.label_off, sizeof(int), b.label_num, fp) == (size_t)b.label_num && \
+             fread(b.text, 1, b.text_size, fp) == (size_t)b.text_size;
+    }
+    fclose(fp);
+    if (!ok) {
+        fprintf(stderr, "%s: truncated\n", filename);
+        builder_free(&b);
+        return -1;
+    }
+    b.text[b.text_size] = '\0';
+    if (!cache_valid(&b)) {
+        fprintf(stderr, "%s: not an MLF cache\n", filename);
+        builder_free(&b);
+        return -1;
+    }
+    ok = finish(mlf, &b, filename);
+    builder_free(&b);
+    return ok;
+}
+
+int mlf_load(Mlf *mlf, const char *filename)
+{
+    char line[MAX_NAME * 4], key[MAX_NAME], token[3][MAX_NAME * 2];
+    int i, magic, open = 0, line_num = 0;
+    Builder b;
+    FILE *fp;
+
+    memset(mlf, 0, sizeof(Mlf));
+    fp = fopen(filename, "rb");
+    if (fp == NULL) {
+        perror(filename);
+        return -1;
+    }
+    if (fread(&magic, sizeof(int), 1, fp) == 1 && magic == MLF_MAGIC) {
+        return load_cache(mlf, fp, filename);
+    }
+    rewind(fp);
+
+    b.text_cap = 1 << 16;
+    b.text = (char *)malloc(b.text_cap);
+    b.text_size = 0;
+    b.trans_cap = 1024;
+    b.trans_num = 0;
+    b.name_off = (int *)malloc(sizeof(int) * b.trans_cap);
+    b.label_start = (int *)malloc(sizeof(int) * (b.trans_cap + 1));
+    b.label_cap = 8192;
+    b.label_num = 0;
+    b.label_off = (int *)malloc(sizeof(int) * b.label_cap);
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        int fields = sscanf(line, "%s %s %s", token[0], token[1], token[2]);
+
+        line_num++;
+        if (fields < 1) {
+            continue;
+        }
+        if (!open) {
+            char *pattern = token[0], *end;
+
+            if (line_num == 1 && strcmp(pattern, "#!MLF!#") == 0) {
+                continue;
+            }
+            if (*pattern != '"' || (end = strrchr(pattern + 1, '"')) == NULL) {
+                fprintf(stderr, "%s:%d: label file pattern expected\n", filename, line_num);
+                goto fail;
+            }
+            *end = '\0';
+            archive_key(pattern + 1, key);
+            add_trans(&b, key);
+            open = 1;
+        } else if (strcmp(token[0], ".") == 0) {
+            open = 0;
+        } else {
+            // Skip the start and end times in front of the name
+            for (i = 0; i < 2 && i < fields - 1 && is_number(token[i]); i++);
+            add_label(&b, token[i]);
+        }
+    }
+    fclose(fp);
+    if (open) {
+        fprintf(stderr, "%s: last transcription is not terminated by \".\"\n", filename);
+        builder_free(&b);
+        return -1;
+    }
+    b.label_start[b.trans_num] = b.label_num;
+    i = finish(mlf, &b, filename);
+    builder_free(&b);
+    return i;
+
+fail:
+    fclose(fp);
+    builder_free(&b);
+    return -1;
+}
+
+int mlf_write_cache(const Mlf *mlf, const char *filename)
+{
+    int head[4] = {MLF_MAGIC, mlf->trans_num, mlf->label_total, mlf->text_size};
+    int i, off, err;
+    FILE *fp = fopen(filename, "wb");
+
+    if (fp == NULL) {
+        perror(filename);
+        return -1;
+    }
+    fwrite(head, sizeof(int), 4, fp);
+    for (i = 0; i < mlf->trans_num; i++) {
+        off = (int)(mlf->trans[i].name - mlf->text);
+        fwrite(&off, sizeof(int), 1, fp);
+    }
+    for (i = 0; i <= mlf->trans_num; i++) {
+        off = i < mlf->trans_num ? (int)(mlf->trans[i].label - mlf->labels) : mlf->label_total;
+        fwrite(&off, sizeof(int), 1, fp);
+    }
+    for (i = 0; i < mlf->label_total; i++) {
+        off = (int)(mlf->labels[i] - mlf->text);
+        fwrite(&off, sizeof(int), 1, fp);
+    }
+    fwrite(mlf->text, 1, mlf->text_size, fp);
+    err = ferror(fp);
+    if (fclose(fp) != 0 || err) {
+        perror(filename);
+        remove(filename);
+        return -1;
+    }
+    return 0;
+}
+
+void mlf_free(Mlf *mlf)
+{
+    free(mlf->trans);
+    free(mlf->labels);
+    free(mlf->text);
+    free(mlf->hash);
+    memset(mlf, 0, sizeof(Mlf));
+}
+
+const Transcription *mlf_find(const Mlf *mlf, const char *name)
+{
+    char key[MAX_NAME];
+    int i;
+
+    if (mlf->hash_size == 0) {
+        return NULL;
+    }
+    archive_key(name, key);
+    for (i = hash_name(key) & (mlf->hash_size - 1); mlf->hash[i] >= 0; i = (i + 1) & (mlf->hash_size - 1)) {
+        if (strcmp(mlf->trans[mlf->hash[i]].name, key) == 0) {
+            return &mlf->trans[mlf->hash[i]];
+        }
+    }
+    return NULL;
+}
+
+void mlf_align(char **ref, int ref_num, char **hyp, int hyp_num, ErrorCount *count)
+{
+    int i, j, w = hyp_num + 1;
+    int *cost = (int *)malloc(sizeof(int) * (ref_num + 1) * w);
+    char *move = (char *)malloc((ref_num + 1) * w);
+
+    // move: 'h' hit, 's' substitution, 'd' deletion, 'i' insertion
+    for (i = 0; i <= ref_num; i++) {
+        for (j = 0; j <= hyp_num; j++) {
+            int c, best;
+            char m;
+            if (i == 0 && j == 0) {
+                cost[0] = 0;
+                move[0] = 0;
+                continue;
+            }
+            best = 1 << 30;
+            m = 0;
+            if (i > 0 && j > 0) {
+                int same = strcmp(ref[i-1], hyp[j-1]) == 0;
+                c = cost[(i-1) * w + j - 1] + (same ? 0 : 10);
+                if (c < best) {
+                    best = c;
+                    m = same ? 'h' : 's';
+                }
+            }
+            if (i > 0 && (c = cost[(i-1) * w + j] + 7) < best) {
+                best = c;
+                m = 'd';
+            }
+            if (j > 0 && (c = cost[i * w + j - 1] + 7) < best) {
+                best = c;
+                m = 'i';
+            }
+            cost[i * w + j] = best;
+            move[i * w + j] = m;
+        }
+    }
+
+    count->ref_num += ref_num;
+    for (i = ref_num, j = hyp_num; i > 0 || j > 0;) {
+        switch (move[i * w + j]) {
+        case 'h':
+            count->hit++;
+            i--, j--;
+            break;
+        case 's':
+            count->sub++;
+            i--, j--;
+            break;
+        case 'd':
+            count->del++;
+            i--;
+            break;
+        default:
+            count->ins++;
+            j--;
+            break;
+        }
+    }
+    free(cost);
+    free(move);
+}
@@ -0,0 +1,77 @@
+#ifndef MLF_HEADER_
+#define MLF_HEADER_
+
+#include "htk.h"
+
+/**
+ * HTK master label files: "#!MLF!#", then per utterance a quoted label
+ * file pattern followed by one label per line and a terminating ".".
+ * Label lines may carry start and end times and a score
+ * ("[start [end]] name [score]"); only the name is kept.
+ *
+ * Transcriptions are looked up by utterance name, the base name without
+ * directory and extension (see archive_key), so "*" patterns match any
+ * directory, through a hash index built when loading. Names and labels
+ * are kept in one text block, which is also the body of the binary cache
+ * (mlf_write_cache) that mlf_load reads instead of a text MLF.
+ */
+
+#ifndef MLF_MAGIC
+    #define MLF_MAGIC 0x4d4c4631    // "MLF1", binary cache
+#endif
+
+typedef struct {
+    char *name;           // Utterance name
+    int label_num;
+    char **label;
+} Transcription;
+
+typedef struct {
+    int trans_num;
+    Transcription *trans; // In file order
+    int label_total;
+    char **labels;        // [label_total], the labels of every transcription one after another
+    char *text;           // Names and labels, each NUL-terminated
+    int text_size;
+    int hash_size;        // Power of two, at least twice trans_num
+    int *hash;            // [hash_size] index into trans by name, -1 for an empty slot
+} Mlf;
+
+/**
+ * Load a text MLF, or a binary cache written by mlf_write_cache
+ * @return 0 on success, -1 on error (reported on stderr)
+ */
+int mlf_load(Mlf *mlf, const char *filename);
+void mlf_free(Mlf *mlf);
+
+/**
+ * Binary cache: MLF_MAGIC, trans_num, label_total and text_size, then the
+ * text offset of every name, the first label of every transcription
+ * (trans_num + 1 entries), the text offset of every label and the text,
+ * as int32 in native byte order
+ * @return 0 on success, -1 on error (reported on stderr)
+ */
+int mlf_write_cache(const Mlf *mlf, const char *filename);
+
+/**
+ * @param name utterance name or any path with the same base name
+ * @return transcription, NULL if not found
+ */
+const Transcription *mlf_find(const Mlf *mlf, const char *name);
+
+/**
+ * Word errors of a recognized label sequence against the reference
+ */
+typedef struct {
+    int ref_num;      // N
+    int hit, sub, del, ins;
+} ErrorCount;
+
+/**
+ * Align hyp to ref by minimum cost like HResults (substitution 10,
+ * deletion and insertion 7) and add the counts to count;
+ * Corr = hit / N, Acc = (hit - ins) / N
+ */
+void mlf_align(char **ref, int ref_num, char **hyp, int hyp_num, ErrorCount *count);
+
+#endif
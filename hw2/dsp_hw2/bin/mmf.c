@@ -0,0 +1,1106 @@
+#include "mmf.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdint.h>
+
+#define MMF_MAGIC       "MMF\001"  // Binary cache
+#define MMF_MAGIC_SIZE  4
+
+#ifndef MAX_TOKEN
+    #define MAX_TOKEN 1024
+#endif
+
+/**
+ * Whitespace separated tokens of an MMF; "<KEY>" keywords are matched
+ * case-insensitively and quoted names lose their quotes
+ */
+typedef struct {
+    FILE *fp;
+    const char *filename;
+    int line;
+    int pushed;
+    char token[MAX_TOKEN];
+} Scanner;
+
+static int next_token(Scanner *sc)
+{
+    int c, n = 0;
+
+    if (sc->pushed) {
+        sc->pushed = 0;
+        return 1;
+    }
+    do {
+        c = getc(sc->fp);
+        if (c == '\n') {
+            sc->line++;
+        }
+    } while (c != EOF && isspace(c));
+    if (c == EOF) {
+        sc->token[0] = '\0';
+        return 0;
+    }
+
+    if (c == '"') {
+        while ((c = getc(sc->fp)) != EOF && c != '"' && n < MAX_TOKEN - 1) {
+            sc->token[n++] = (char)c;
+        }
+    } else if (c == '<') {
+        // Keywords may be glued to the next one, e.g. "<VECSIZE> 39<NULLD><MFCC_D_A_Z_E>"
+        sc->token[n++] = (char)c;
+        while ((c = getc(sc->fp)) != EOF && c != '>' && n < MAX_TOKEN - 2) {
+            sc->token[n++] = (char)c;
+        }
+        sc->token[n++] = '>';
+    } else {
+        do {
+            sc->token[n++] = (char)c;
+            c = getc(sc->fp);
+        } while (c != EOF && !isspace(c) && c != '<' && n < MAX_TOKEN - 1);
+        if (c != EOF) {
+            ungetc(c, sc->fp);
+        }
+    }
+    sc->token[n] = '\0';
+    return 1;
+}
+
+static void push_back(Scanner *sc)
+{
+    sc->pushed = 1;
+}
+
+static int is_key(const Scanner *sc, const char *key)
+{
+    return strcasecmp(sc->token, key) == 0;
+}
+
+static int parse_error(const Scanner *sc, const char *expect)
+{
+    fprintf(stderr, "%s:%d: expected %s, got '%s'\n", sc->filename, sc->line, expect, sc->token);
+    return -1;
+}
+
+static int read_int(Scanner *sc, int *value)
+{
+    char *end;
+    if (!next_token(sc)) {
+        return parse_error(sc, "integer");
+    }
+    *value = (int)strtol(sc->token, &end, 10);
+    return *end == '\0' ? 0 : parse_error(sc, "integer");
+}
+
+static int read_float(Scanner *sc, float *value)
+{
+    char *end;
+    if (!next_token(sc)) {
+        return parse_error(sc, "number");
+    }
+    *value = strtof(sc->token, &end);
+    return *end == '\0' ? 0 : parse_error(sc, "number");
+}
+
+static int read_vector(Scanner *sc, float *v, int size)
+{
+    int k;
+    for (k = 0; k < size; k++) {
+        if (read_float(sc, &v[k]) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Parse global options (~o body, or options inside <BEGINHMM>) until a
+ * token that is not an option, which is pushed back
+ */
+static int parse_options(Scanner *sc, ModelSet *set)
+{
+    int n, k;
+
+    while (next_token(sc)) {
+        if (is_key(sc, "<STREAMINFO>")) {
+            if (read_int(sc, &n) < 0) {
+                return -1;
+            }
+            for (k = 0; k < n; k++) {
+                int width;
+                if (read_int(sc, &width) < 0) {
+                    return -1;
+                }
+            }
+        } else if (is_key(sc, "<VECSIZE>")) {
+            if (read_int(sc, &set->vec_size) < 0) {
+                return -1;
+            }
+        } else if (is_key(sc, "<NULLD>") || is_key(sc, "<DIAGC>")) {
+            continue;
+        } else if (sc->token[0] == '<' && !is_key(sc, "<BEGINHMM>") && !is_key(sc, "<NUMSTATES>")) {
+            char name[MAX_TOKEN];
+            int kind;
+            strcpy(name, sc->token + 1);
+            name[strlen(name) - 1] = '\0';
+            kind = parm_kind_parse(name);
+            if (kind < 0) {
+                push_back(sc);
+                return 0;
+            }
+            set->parm_kind = kind;
+        } else {
+            push_back(sc);
+            return 0;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Read the quoted name after a "~x" macro reference
+ * @return macro object, NULL if undefined (reported)
+ */
+static void *parse_reference(Scanner *sc, const ModelSet *set, char type)
+{
+    void *obj;
+
+    if (!next_token(sc)) {
+        parse_error(sc, "macro name");
+        return NULL;
+    }
+    obj = modelset_find_macro(set, type, sc->token);
+    if (obj == NULL) {
+        fprintf(stderr, "%s:%d: undefined macro ~%c \"%s\"\n", sc->filename, sc->line, type, sc->token);
+    }
+    return obj;
+}
+
+/**
+ * Parse "<KEY> n v_1 .. v_n" into a new vector; *size gives the expected
+ * size if positive and receives the size read
+ */
+static float *parse_vector(Scanner *sc, const char *key, int *size)
+{
+    int n;
+    float *v;
+
+    if (!next_token(sc) || !is_key(sc, key) || read_int(sc, &n) < 0 || n <= 0 || (*size > 0 && n != *size)) {
+        parse_error(sc, key);
+        return NULL;
+    }
+    v = (float *)malloc(sizeof(float) * n);
+    if (read_vector(sc, v, n) < 0) {
+        free(v);
+        return NULL;
+    }
+    *size = n;
+    return v;
+}
+
+/**
+ * Parse a mean or variance vector, or a ~u / ~v reference which is copied
+ * @param size expected size, 0 if not known yet
+ */
+static float *parse_vector_or_ref(Scanner *sc, const ModelSet *set, const char *key, char type, int *size)
+{
+    char ref[3] = { '~', type, '\0' };
+    Vector *vec;
+    float *v;
+
+    if (!next_token(sc)) {
+        parse_error(sc, key);
+        return NULL;
+    }
+    if (strcmp(sc->token, ref) != 0) {
+        push_back(sc);
+        return parse_vector(sc, key, size);
+    }
+
+    vec = (Vector *)parse_reference(sc, set, type);
+    if (vec == NULL) {
+        return NULL;
+    }
+    if (*size > 0 && vec->size != *size) {
+        parse_error(sc, "vector macro of the right size");
+        return NULL;
+    }
+    v = (float *)malloc(sizeof(float) * vec->size);
+    memcpy(v, vec->data, sizeof(float) * vec->size);
+    *size = vec->size;
+    return v;
+}
+
+/**
+ * Parse "<MEAN> n ... <VARIANCE> n ... [<GCONST> g]"
+ */
+static Gaussian *parse_gaussian(Scanner *sc, ModelSet *set)
+{
+    int n = 0;
+    float *mean, *var;
+    Gaussian *g;
+
+    mean = parse_vector_or_ref(sc, set, "<MEAN>", 'u', &n);
+    if (mean == NULL) {
+        return NULL;
+    }
+    var = parse_vector_or_ref(sc, set, "<VARIANCE>", 'v', &n);
+    if (var == NULL) {
+        free(mean);
+        return NULL;
+    }
+    if (set->vec_size == 0) {
+        set->vec_size = n;
+    }
+    g = gaussian_new(n);
+    memcpy(g->mean, mean, sizeof(float) * n);
+    memcpy(g->var, var, sizeof(float) * n);
+    free(mean);
+    free(var);
+    gaussian_update(g);
+
+    // The stored gconst is recomputed anyway
+    if (next_token(sc)) {
+        float gconst;
+        if (is_key(sc, "<GCONST>")) {
+            if (read_float(sc, &gconst) < 0) {
+                gaussian_unref(g);
+                return NULL;
+            }
+        } else {
+            push_back(sc);
+        }
+    }
+    return g;
+}
+
+/**
+ * Parse a Gaussian definition or a ~m reference to one
+ */
+static Gaussian *parse_gaussian_or_ref(Scanner *sc, ModelSet *set)
+{
+    Gaussian *g;
+
+    if (!next_token(sc)) {
+        parse_error(sc, "<MEAN>");
+        return NULL;
+    }
+    if (strcmp(sc->token, "~m") != 0) {
+        push_back(sc);
+        return parse_gaussian(sc, set);
+    }
+    g = (Gaussian *)parse_reference(sc, set, 'm');
+    if (g != NULL) {
+        gaussian_ref(g);
+    }
+    return g;
+}
+
+/**
+ * Parse one state body after "<STATE> i"
+ */
+static State *parse_state(Scanner *sc, ModelSet *set)
+{
+    int mix_num = 1, m;
+    State *s;
+
+    if (!next_token(sc)) {
+        parse_error(sc, "state");
+        return NULL;
+    }
+    if (is_key(sc, "<NUMMIXES>")) {
+        if (read_int(sc, &mix_num) < 0) {
+            return NULL;
+        }
+    } else {
+        push_back(sc);
+    }
+
+    s = state_new(mix_num);
+    if (mix_num == 1) {
+        s->weight[0] = 1;
+    }
+    for (m = 0; m < mix_num; m++) {
+        int index = m + 1;
+        float weight = 1;
+
+        if (!next_token(sc)) {
+            break;
+        }
+        if (is_key(sc, "<MIXTURE>")) {
+            if (read_int(sc, &index) < 0 || read_float(sc, &weight) < 0) {
+                state_unref(s);
+                return NULL;
+            }
+            if (index < 1 || index > mix_num || s->gauss[index-1] != NULL) {
+                parse_error(sc, "mixture index");
+                state_unref(s);
+                return NULL;
+            }
+        } else if (mix_num > 1) {
+            // Fewer <MIXTURE> than <NUMMIXES>
+            push_back(sc);
+            break;
+        } else {
+            push_back(sc);
+        }
+        s->weight[index-1] = weight;
+        s->gauss[index-1] = parse_gaussian_or_ref(sc, set);
+        if (s->gauss[index-1] == NULL) {
+            state_unref(s);
+            return NULL;
+        }
+    }
+    for (m = 0; m < mix_num; m++) {
+        if (s->gauss[m] == NULL) {
+            // HTK omits mixtures whose weight was floored away
+            s->gauss[m] = gaussian_new(set->vec_size);
+            for (int k = 0; k < set->vec_size; k++) {
+                s->gauss[m]->var[k] = 1;
+            }
+            gaussian_update(s->gauss[m]);
+            s->weight[m] = 0;
+        }
+    }
+    return s;
+}
+
+/**
+ * Parse a state definition or a ~s reference to one
+ */
+static State *parse_state_or_ref(Scanner *sc, ModelSet *set)
+{
+    State *s;
+
+    if (!next_token(sc)) {
+        parse_error(sc, "state");
+        return NULL;
+    }
+    if (strcmp(sc->token, "~s") != 0) {
+        push_back(sc);
+        return parse_state(sc, set);
+    }
+    s = (State *)parse_reference(sc, set, 's');
+    if (s != NULL) {
+        state_ref(s);
+    }
+    return s;
+}
+
+/**
+ * Parse "<TRANSP> n ..." or a ~t reference
+ */
+static TransP *parse_transp(Scanner *sc, const ModelSet *set)
+{
+    int n;
+    TransP *t;
+
+    if (!next_token(sc)) {
+        parse_error(sc, "<TRANSP>");
+        return NULL;
+    }
+    if (strcmp(sc->token, "~t") == 0) {
+        t = (TransP *)parse_reference(sc, set, 't');
+        if (t != NULL) {
+            transp_ref(t);
+        }
+        return t;
+    }
+    if (!is_key(sc, "<TRANSP>") || read_int(sc, &n) < 0) {
+        parse_error(sc, "<TRANSP>");
+        return NULL;
+    }
+    t = transp_new(n);
+    if (read_vector(sc, t->prob, n * n) < 0) {
+        transp_unref(t);
+        return NULL;
+    }
+    return t;
+}
+
+static Hmm *parse_hmm(Scanner *sc, ModelSet *set, const char *name)
+{
+    int N, i;
+    Hmm *hmm;
+
+    if (!next_token(sc) || !is_key(sc, "<BEGINHMM>")) {
+        parse_error(sc, "<BEGINHMM>");
+        return NULL;
+    }
+    if (parse_options(sc, set) < 0) {
+        return NULL;
+    }
+    if (!next_token(sc) || !is_key(sc, "<NUMSTATES>") || read_int(sc, &N) < 0) {
+        parse_error(sc, "<NUMSTATES>");
+        return NULL;
+    }
+
+    hmm = hmm_new(name, N);
+    while (next_token(sc)) {
+        if (is_key(sc, "<STATE>")) {
+            if (read_int(sc, &i) < 0 || i < 2 || i > N - 1) {
+                parse_error(sc, "state index");
+                hmm_free(hmm);
+                return NULL;
+            }
+            state_unref(hmm->state[i-1]);
+            hmm->state[i-1] = parse_state_or_ref(sc, set);
+            if (hmm->state[i-1] == NULL) {
+                hmm_free(hmm);
+                return NULL;
+            }
+        } else if (is_key(sc, "<TRANSP>") || strcmp(sc->token, "~t") == 0) {
+            push_back(sc);
+            transp_unref(hmm->transp);
+            hmm->transp = parse_transp(sc, set);
+            if (hmm->transp == NULL || hmm->transp->state_num != N) {
+                parse_error(sc, "transition matrix matching <NUMSTATES>");
+                hmm_free(hmm);
+                return NULL;
+            }
+        } else if (is_key(sc, "<ENDHMM>")) {
+            break;
+        } else {
+            parse_error(sc, "<STATE>, <TRANSP> or <ENDHMM>");
+            hmm_free(hmm);
+            return NULL;
+        }
+    }
+
+    for (i = 1; i < N - 1; i++) {
+        if (hmm->state[i] == NULL) {
+            fprintf(stderr, "%s: model %s has no state %d\n", sc->filename, name, i + 1);
+            hmm_free(hmm);
+            return NULL;
+        }
+    }
+    if (hmm->transp == NULL) {
+        fprintf(stderr, "%s: model %s has no <TRANSP>\n", sc->filename, name);
+        hmm_free(hmm);
+        return NULL;
+    }
+    return hmm;
+}
+
+/**
+ * Parse the body of "~type name" and add it to the macro table
+ */
+static int parse_macro(Scanner *sc, ModelSet *set, char type)
+{
+    char name[MAX_TOKEN];
+    void *obj = NULL;
+
+    if (!next_token(sc)) {
+        return parse_error(sc, "macro name");
+    }
+    strcpy(name, sc->token);
+    if (modelset_find_macro(set, type, name) != NULL) {
+        fprintf(stderr, "%s:%d: macro ~%c \"%s\" defined twice\n", sc->filename, sc->line, type, name);
+        return -1;
+    }
+
+    switch (type) {
+    case 'm':
+        obj = parse_gaussian(sc, set);
+        break;
+    case 's':
+        obj = parse_state(sc, set);
+        break;
+    case 't':
+        obj = parse_transp(sc, set);
+        break;
+    case 'u':
+    case 'v': {
+        int size = 0;
+        float *data = parse_vector(sc, type == 'u' ? "<MEAN>" : "<VARIANCE>", &size);
+        Vector *vec;
+        if (data == NULL) {
+            return -1;
+        }
+        if (type == 'v' && strcmp(name, "varFloor1") == 0) {
+            // Kept apart since it floors re-estimated variances
+            free(set->var_floor);
+            set->var_floor = data;
+            if (set->vec_size == 0) {
+                set->vec_size = size;
+            }
+            return 0;
+        }
+        vec = (Vector *)calloc(1, sizeof(Vector));
+        vec->size = size;
+        vec->data = data;
+        obj = vec;
+        break;
+    }
+    }
+    if (obj == NULL) {
+        return -1;
+    }
+
+    modelset_add_macro(set, type, name, obj);
+    switch (type) {
+    case 'm':
+        gaussian_unref((Gaussian *)obj);
+        break;
+    case 's':
+        state_unref((State *)obj);
+        break;
+    case 't':
+        transp_unref((TransP *)obj);
+        break;
+    }
+    return 0;
+}
+
+static int load_binary(ModelSet *set, FILE *fp, const char *filename);
+
+int mmf_load(ModelSet *set, const char *filename)
+{
+    Scanner sc;
+    char name[MAX_TOKEN];
+    char magic[MMF_MAGIC_SIZE];
+    int ret = 0;
+
+    memset(&sc, 0, sizeof(Scanner));
+    sc.filename = filename;
+    sc.line = 1;
+    sc.fp = fopen(filename, "rb");
+    if (sc.fp == NULL) {
+        perror(filename);
+        return -1;
+    }
+
+    if (fread(magic, 1, MMF_MAGIC_SIZE, sc.fp) == MMF_MAGIC_SIZE && memcmp(magic, MMF_MAGIC, MMF_MAGIC_SIZE) == 0) {
+        ret = load_binary(set, sc.fp, filename);
+        fclose(sc.fp);
+        if (ret == 0) {
+            modelset_index(set);
+        }
+        return ret;
+    }
+    rewind(sc.fp);
+
+    while (ret == 0 && next_token(&sc)) {
+        if (strcmp(sc.token, "~o") == 0) {
+            ret = parse_options(&sc, set);
+        } else if (strlen(sc.token) == 2 && sc.token[0] == '~' && strchr("msuvt", sc.token[1]) != NULL) {
+            ret = parse_macro(&sc, set, sc.token[1]);
+        } else if (strcmp(sc.token, "~h") == 0) {
+            Hmm *hmm;
+            if (!next_token(&sc)) {
+                ret = parse_error(&sc, "model name");
+                break;
+            }
+            strcpy(name, sc.token);
+            hmm = parse_hmm(&sc, set, name);
+            if (hmm == NULL) {
+                ret = -1;
+                break;
+            }
+            if (modelset_find(set, name) != NULL) {
+                fprintf(stderr, "%s: model %s defined twice\n", filename, name);
+                hmm_free(hmm);
+                ret = -1;
+                break;
+            }
+            modelset_add(set, hmm);
+        } else {
+            ret = parse_error(&sc, "~o, ~h or a ~m, ~s, ~t, ~u, ~v macro");
+        }
+    }
+    fclose(sc.fp);
+
+    if (ret == 0) {
+        modelset_index(set);
+    }
+    return ret;
+}
+
+static void write_vector(FILE *fp, const float *v, int size)
+{
+    int k;
+    for (k = 0; k < size; k++) {
+        fprintf(fp, " %e", v[k]);
+    }
+    fprintf(fp, "\n");
+}
+
+static void write_gaussian(FILE *fp, const Gaussian *g)
+{
+    fprintf(fp, "<MEAN> %d\n", g->vec_size);
+    write_vector(fp, g->mean, g->vec_size);
+    fprintf(fp, "<VARIANCE> %d\n", g->vec_size);
+    write_vector(fp, g->var, g->vec_size);
+    fprintf(fp, "<GCONST> %e\n", g->gconst);
+}
+
+static void write_state(FILE *fp, const State *s)
+{
+    int m;
+
+    if (s->mix_num > 1) {
+        fprintf(fp, "<NUMMIXES> %d\n", s->mix_num);
+    }
+    for (m = 0; m < s->mix_num; m++) {
+        if (s->mix_num > 1) {
+            fprintf(fp, "<MIXTURE> %d %e\n", m + 1, s->weight[m]);
+        }
+        if (s->gauss[m]->name != NULL) {
+            fprintf(fp, "~m \"%s\"\n", s->gauss[m]->name);
+        } else {
+            write_gaussian(fp, s->gauss[m]);
+        }
+    }
+}
+
+static void write_transp(FILE *fp, const TransP *t)
+{
+    int i;
+
+    fprintf(fp, "<TRANSP> %d\n", t->state_num);
+    for (i = 0; i < t->state_num; i++) {
+        write_vector(fp, t->prob + i * t->state_num, t->state_num);
+    }
+}
+
+static void write_options(FILE *fp, const ModelSet *set)
+{
+    char kind[MAX_NAME];
+
+    parm_kind_name(set->parm_kind, kind);
+    fprintf(fp, "~o\n<STREAMINFO> 1 %d\n<VECSIZE> %d<NULLD><%s><DIAGC>\n", set->vec_size, set->vec_size, kind);
+}
+
+/**
+ * Write the macros of one type, so every macro is defined before use
+ */
+static void write_macros(FILE *fp, const ModelSet *set, char type)
+{
+    int i;
+
+    for (i = 0; i < set->macro_num; i++) {
+        const Macro *macro = &set->macros[i];
+        if (macro->type != type) {
+            continue;
+        }
+        fprintf(fp, "~%c \"%s\"\n", type, *(char **)macro->obj);
+        switch (type) {
+        case 'm':
+            write_gaussian(fp, (const Gaussian *)macro->obj);
+            break;
+        case 's':
+            write_state(fp, (const State *)macro->obj);
+            break;
+        case 't':
+            write_transp(fp, (const TransP *)macro->obj);
+            break;
+        default: {
+            const Vector *vec = (const Vector *)macro->obj;
+            fprintf(fp, "%s %d\n", type == 'u' ? "<MEAN>" : "<VARIANCE>", vec->size);
+            write_vector(fp, vec->data, vec->size);
+        }
+        }
+    }
+}
+
+static int save_binary(const ModelSet *set, FILE *fp, int what);
+
+int mmf_save(const ModelSet *set, const char *filename, int what)
+{
+    int h, i, err;
+
+    FILE *fp = fopen(filename, (what & MMF_BINARY) ? "wb" : "w");
+    if (fp == NULL) {
+        perror(filename);
+        return -1;
+    }
+
+    if (what & MMF_BINARY) {
+        save_binary(set, fp, what);
+    } else {
+        write_options(fp, set);
+        if (what & MMF_GLOBAL) {
+            if (set->var_floor != NULL) {
+                fprintf(fp, "~v \"varFloor1\"\n<VARIANCE> %d\n", set->vec_size);
+                write_vector(fp, set->var_floor, set->vec_size);
+            }
+            write_macros(fp, set, 'u');
+            write_macros(fp, set, 'v');
+        }
+
+        if (what & MMF_HMMS) {
+            write_macros(fp, set, 'm');
+            write_macros(fp, set, 's');
+            write_macros(fp, set, 't');
+            for (h = 0; h < set->hmm_num; h++) {
+                const Hmm *hmm = set->hmm[h];
+                fprintf(fp, "~h \"%s\"\n<BEGINHMM>\n<NUMSTATES> %d\n", hmm->name, hmm->state_num);
+                for (i = 1; i < hmm->state_num - 1; i++) {
+                    fprintf(fp, "<STATE> %d\n", i + 1);
+                    if (hmm->state[i]->name != NULL) {
+                        fprintf(fp, "~s \"%s\"\n", hmm->state[i]->name);
+                    } else {
+                        write_state(fp, hmm->state[i]);
+                    }
+                }
+                if (hmm->transp->name != NULL) {
+                    fprintf(fp, "~t \"%s\"\n", hmm->transp->name);
+                } else {
+                    write_transp(fp, hmm->transp);
+                }
+                fprintf(fp, "<ENDHMM>\n");
+            }
+        }
+    }
+
+    err = ferror(fp);
+    if (fclose(fp) != 0 || err) {
+        perror(filename);
+        remove(filename);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Binary cache: MMF_MAGIC, then int32 fields in native byte order
+ *
+ *   vec_size parm_kind has_var_floor [var_floor]
+ *   gauss_num  { name mean[vec_size] var[vec_size] }
+ *   state_num  { name mix_num weight[mix_num] gauss_index[mix_num] }
+ *   transp_num { name N prob[N*N] }
+ *   hmm_num    { name N transp_index state_index[N-2] }
+ *   macro_num  { type index | type name size data[size] }
+ *
+ * where a name is its length (0 for none) and the bytes, and indices refer
+ * to the lists of this file. It is only meant to be read back on the same
+ * machine, so nothing is swapped.
+ */
+
+static void put_int(FILE *fp, int value)
+{
+    int32_t v = value;
+    fwrite(&v, sizeof(v), 1, fp);
+}
+
+static void put_name(FILE *fp, const char *name)
+{
+    int len = name == NULL ? 0 : (int)strlen(name);
+    put_int(fp, len);
+    fwrite(name, 1, len, fp);
+}
+
+static int save_binary(const ModelSet *set, FILE *fp, int what)
+{
+    int i, m, macro_num = 0;
+    int hmms = (what & MMF_HMMS) != 0, global = (what & MMF_GLOBAL) != 0;
+
+    fwrite(MMF_MAGIC, 1, MMF_MAGIC_SIZE, fp);
+    put_int(fp, set->vec_size);
+    put_int(fp, set->parm_kind);
+    put_int(fp, global && set->var_floor != NULL);
+    if (global && set->var_floor != NULL) {
+        fwrite(set->var_floor, sizeof(float), set->vec_size, fp);
+    }
+
+    put_int(fp, hmms ? set->gauss_num : 0);
+    for (i = 0; hmms && i < set->gauss_num; i++) {
+        const Gaussian *g = set->gauss_list[i];
+        put_name(fp, g->name);
+        fwrite(g->mean, sizeof(float), g->vec_size, fp);
+        fwrite(g->var, sizeof(float), g->vec_size, fp);
+    }
+    put_int(fp, hmms ? set->state_num : 0);
+    for (i = 0; hmms && i < set->state_num; i++) {
+        const State *s = set->state_list[i];
+        put_name(fp, s->name);
+        put_int(fp, s->mix_num);
+        fwrite(s->weight, sizeof(float), s->mix_num, fp);
+        for (m = 0; m < s->mix_num; m++) {
+            put_int(fp, s->gauss[m]->index);
+        }
+    }
+    put_int(fp, hmms ? set->transp_num : 0);
+    for (i = 0; hmms && i < set->transp_num; i++) {
+        const TransP *t = set->transp_list[i];
+        put_name(fp, t->name);
+        put_int(fp, t->state_num);
+        fwrite(t->prob, sizeof(float), t->state_num * t->state_num, fp);
+    }
+    put_int(fp, hmms ? set->hmm_num : 0);
+    for (i = 0; hmms && i < set->hmm_num; i++) {
+        const Hmm *hmm = set->hmm[i];
+        put_name(fp, hmm->name);
+        put_int(fp, hmm->state_num);
+        put_int(fp, hmm->transp->index);
+        for (m = 1; m < hmm->state_num - 1; m++) {
+            put_int(fp, hmm->state[m]->index);
+        }
+    }
+
+    for (i = 0; i < set->macro_num; i++) {
+        int vector = strchr("uv", set->macros[i].type) != NULL;
+        macro_num += vector ? global : hmms;
+    }
+    put_int(fp, macro_num);
+    for (i = 0; i < set->macro_num; i++) {
+        const Macro *macro = &set->macros[i];
+        switch (macro->type) {
+        case 'm':
+        case 's':
+        case 't':
+            if (hmms) {
+                fputc(macro->type, fp);
+                put_int(fp, macro->type == 'm' ? ((const Gaussian *)macro->obj)->index : \
+                            macro->type == 's' ? ((const State *)macro->obj)->index : \
+                                                 ((const TransP *)macro->obj)->index);
+            }
+            break;
+        default:
+            if (global) {
+                const Vector *vec = (const Vector *)macro->obj;
+                fputc(macro->type, fp);
+                put_name(fp, vec->name);
+                put_int(fp, vec->size);
+                fwrite(vec->data, sizeof(float), vec->size, fp);
+            }
+        }
+    }
+    return 0;
+}
+
+static int get_int(FILE *fp, int *value)
+{
+    int32_t v;
+    if (fread(&v, sizeof(v), 1, fp) != 1) {
+        return -1;
+    }
+    *value = v;
+    return 0;
+}
+
+static int get_floats(FILE *fp, float *v, int size)
+{
+    return fread(v, sizeof(float), size, fp) == (size_t)size ? 0 : -1;
+}
+
+/**
+ * @param name receives a malloc'ed name, NULL if none
+ */
+static int get_name(FILE *fp, char **name)
+{
+    int len;
+
+    *name = NULL;
+    if (get_int(fp, &len) < 0 || len < 0 || len >= MAX_TOKEN) {
+        return -1;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    *name = (char *)malloc(len + 1);
+    if (fread(*name, 1, len, fp) != (size_t)len) {
+        free(*name);
+        *name = NULL;
+        return -1;
+    }
+    (*name)[len] = '\0';
+    return 0;
+}
+
+/**
+ * @return 0 if 0 <= index < num
+ */
+static int check_index(int index, int num)
+{
+    return index >= 0 && index < num ? 0 : -1;
+}
+
+static int load_binary(ModelSet *set, FILE *fp, const char *filename)
+{
+    int i, m, n, has_floor, vec_size, parm_kind;
+    int gauss_num = 0, state_num = 0, transp_num = 0, hmm_num, macro_num;
+    Gaussian **gauss = NULL;
+    State **state = NULL;
+    TransP **transp = NULL;
+    int ret = -1;
+
+    if (get_int(fp, &vec_size) < 0 || get_int(fp, &parm_kind) < 0 || get_int(fp, &has_floor) < 0) {
+        goto done;
+    }
+    if (has_floor) {
+        float *floor = (float *)malloc(sizeof(float) * vec_size);
+        if (get_floats(fp, floor, vec_size) < 0) {
+            free(floor);
+            goto done;
+        }
+        free(set->var_floor);
+        set->var_floor = floor;
+    }
+    set->vec_size = vec_size;
+    set->parm_kind = parm_kind;
+
+    // Objects are owned by these arrays until the models and macros take them
+    if (get_int(fp, &gauss_num) < 0) {
+        goto done;
+    }
+    gauss = (Gaussian **)calloc(gauss_num + 1, sizeof(Gaussian *));
+    for (i = 0; i < gauss_num; i++) {
+        gauss[i] = gaussian_new(vec_size);
+        if (get_name(fp, &gauss[i]->name) < 0 || get_floats(fp, gauss[i]->mean, vec_size) < 0 || \
+            get_floats(fp, gauss[i]->var, vec_size) < 0) {
+            goto done;
+        }
+        gaussian_update(gauss[i]);
+    }
+
+    if (get_int(fp, &state_num) < 0) {
+        goto done;
+    }
+    state = (State **)calloc(state_num + 1, sizeof(State *));
+    for (i = 0; i < state_num; i++) {
+        char *name;
+        if (get_name(fp, &name) < 0 || get_int(fp, &n) < 0 || n <= 0) {
+            goto done;
+        }
+        state[i] = state_new(n);
+        state[i]->name = name;
+        if (get_floats(fp, state[i]->weight, n) < 0) {
+            goto done;
+        }
+        for (m = 0; m < n; m++) {
+            int g;
+            if (get_int(fp, &g) < 0 || check_index(g, gauss_num) < 0) {
+                goto done;
+            }
+            gaussian_ref(gauss[g]);
+            state[i]->gauss[m] = gauss[g];
+        }
+    }
+
+    if (get_int(fp, &transp_num) < 0) {
+        goto done;
+    }
+    transp = (TransP **)calloc(transp_num + 1, sizeof(TransP *));
+    for (i = 0; i < transp_num; i++) {
+        char *name;
+        if (get_name(fp, &name) < 0 || get_int(fp, &n) < 0 || n <= 0) {
+            goto done;
+        }
+        transp[i] = transp_new(n);
+        transp[i]->name = name;
+        if (get_floats(fp, transp[i]->prob, n * n) < 0) {
+            goto done;
+        }
+    }
+
+    if (get_int(fp, &hmm_num) < 0) {
+        goto done;
+    }
+    for (i = 0; i < hmm_num; i++) {
+        char *name;
+        int t;
+        Hmm *hmm;
+
+        if (get_name(fp, &name) < 0 || name == NULL || get_int(fp, &n) < 0 || n < 3 || \
+            get_int(fp, &t) < 0 || check_index(t, transp_num) < 0 || transp[t]->state_num != n) {
+            free(name);
+            goto done;
+        }
+        hmm = hmm_new(name, n);
+        free(name);
+        transp_ref(transp[t]);
+        hmm->transp = transp[t];
+        for (m = 1; m < n - 1; m++) {
+            int s;
+            if (get_int(fp, &s) < 0 || check_index(s, state_num) < 0) {
+                hmm_free(hmm);
+                goto done;
+            }
+            state_ref(state[s]);
+            hmm->state[m] = state[s];
+        }
+        if (modelset_find(set, hmm->name) != NULL) {
+            fprintf(stderr, "%s: model %s defined twice\n", filename, hmm->name);
+            hmm_free(hmm);
+            goto done;
+        }
+        modelset_add(set, hmm);
+    }
+
+    if (get_int(fp, &macro_num) < 0) {
+        goto done;
+    }
+    for (i = 0; i < macro_num; i++) {
+        int type = fgetc(fp), index;
+
+        if (type == 'm' || type == 's' || type == 't') {
+            int num = type == 'm' ? gauss_num : type == 's' ? state_num : transp_num;
+            void *obj;
+            if (get_int(fp, &index) < 0 || check_index(index, num) < 0) {
+                goto done;
+            }
+            obj = type == 'm' ? (void *)gauss[index] : type == 's' ? (void *)state[index] : (void *)transp[index];
+            if (*(char **)obj == NULL) {
+                goto done;
+            }
+            modelset_add_macro(set, (char)type, *(char **)obj, obj);
+        } else if (type == 'u' || type == 'v') {
+            Vector *vec = (Vector *)calloc(1, sizeof(Vector));
+            if (get_name(fp, &vec->name) < 0 || vec->name == NULL || get_int(fp, &vec->size) < 0 || vec->size <= 0) {
+                free(vec->name);
+                free(vec);
+                goto done;
+            }
+            vec->data = (float *)malloc(sizeof(float) * vec->size);
+            modelset_add_macro(set, (char)type, vec->name, vec);
+            if (get_floats(fp, vec->data, vec->size) < 0) {
+                goto done;
+            }
+        } else {
+            goto done;
+        }
+    }
+    ret = 0;
+
+done:
+    if (ret < 0) {
+        fprintf(stderr, "%s: corrupted binary model file\n", filename);
+    }
+    for (i = 0; i < gauss_num && gauss != NULL; i++) {
+        gaussian_unref(gauss[i]);
+    }
+    for (i = 0; i < state_num && state != NULL; i++) {
+        state_unref(state[i]);
+    }
+    for (i = 0; i < transp_num && transp != NULL; i++) {
+        transp_unref(transp[i]);
+    }
+    free(gauss);
+    free(state);
+    free(transp);
+    return ret;
+}
+
+void mmf_load_args(ModelSet *set, int argc, char *argv[])
+{
+    int i;
+    for (i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "-H") == 0 && mmf_load(set, argv[i+1]) < 0) {
+            exit(1);
+        }
+    }
+}
+
+int mmf_save_dir(const ModelSet *set, const char *dir, int binary)
+{
+    char path[MAX_NAME * 2];
+
+    snprintf(path, sizeof(path), "%s/macros", dir);
+    if (mmf_save(set, path, MMF_GLOBAL | binary) < 0) {
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s/models", dir);
+    return mmf_save(set, path, MMF_HMMS | binary);
+}
@@ -0,0 +1,44 @@
+#ifndef MMF_HEADER_
+#define MMF_HEADER_
+
+#include "gmm.h"
+
+/**
+ * What mmf_save writes
+ */
+#define MMF_GLOBAL  1   // ~o options and ~v variance floor (HTK "macros" file)
+#define MMF_HMMS    2   // ~h model definitions (HTK "models" file)
+#define MMF_ALL     (MMF_GLOBAL | MMF_HMMS)
+#define MMF_BINARY  4   // Compact binary cache instead of text, like HERest -B
+
+/**
+ * Load an HTK master macro file, or a binary cache written with MMF_BINARY,
+ * into set; may be called repeatedly, e.g. for hmm/macros then hmm/models.
+ * Macros (~m, ~s, ~t) stay shared by the models referring to them, ~u and ~v
+ * references are copied into the Gaussians.
+ * @return 0 on success, -1 on error (reported on stderr)
+ */
+int mmf_load(ModelSet *set, const char *filename);
+
+/**
+ * Write set in HTK text MMF format, shared objects as macros
+ * @param set indexed with modelset_index
+ * @param what MMF_GLOBAL, MMF_HMMS or MMF_ALL, optionally | MMF_BINARY
+ * @return 0 on success, -1 on error
+ */
+int mmf_save(const ModelSet *set, const char *filename, int what);
+
+/**
+ * Load every -H file given on the command line (argv[i] == "-H")
+ * and exit on error
+ */
+void mmf_load_args(ModelSet *set, int argc, char *argv[]);
+
+/**
+ * Write dir/macros and dir/models, like HERest -M dir with -H macros -H models
+ * @param binary 0 or MMF_BINARY
+ * @return 0 on success, -1 on error
+ */
+int mmf_save_dir(const ModelSet *set, const char *dir, int binary);
+
+#endif
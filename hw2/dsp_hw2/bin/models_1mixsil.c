@@ -1,10 +1,8 @@
-#include "stdio.h"
-#include "string.h"
+#include "mmf.h"
+#include "hed.h"
+#include <stdlib.h>
+#include <string.h>
 
-#define FALSE 0
-#define TRUE 1
-
-void silmodel(FILE *, FILE *);
 
 /***********************************************************/
 /****************** Model file Generator   ****************/
@@ -22,6 +20,8 @@ void silmodel(FILE *, FILE *);
 /*    Change History: version 1.1     7th July 1998        */
 /*                    cure of seg fault on sun             */
 /*              char c, entry[9];  ->  char c, entry[90];  */
+/*    - models built in memory with the MMF library        */
+/*      (mmf.h) instead of re-reading hmmdef per digit     */
 /*                                                         */
 /***********************************************************/
 /* 							   */
@@ -49,118 +49,45 @@ void silmodel(FILE *, FILE *);
 /*===================================================================*/
 
 
+static const char *digits[] = {
+    "liN", "#i", "#er", "san", "sy", "#u", "liou", "qi", "ba", "jiou",
+};
+
 int main(int argc, char *argv[])
 {
-	int  CAT=FALSE, i;
-	FILE *fp;
-	FILE *outfile;
-	
-	char c, entry[90];
-		
-	outfile = fopen(argv[2], "w");
-	
-	for (i=1; i<12; i++) 
-	{    
-		 fp = fopen(argv[1], "r");
-	 	CAT=FALSE;
-	 	while(CAT==FALSE)  
-		{
-	  		fscanf(fp,"%s",entry);
-	  		if(strncmp(entry,"\"hmmdef\"",8)==0) 
-	  		
-	  		{	
-				if(i==1) fprintf(outfile,"~h \"liN\"");
-				if(i==2) fprintf(outfile,"~h \"#i\"");
-				if(i==3) fprintf(outfile,"~h \"#er\"");
-				if(i==4) fprintf(outfile,"~h \"san\"");
-				if(i==5) fprintf(outfile,"~h \"sy\"");
-				if(i==6) fprintf(outfile,"~h \"#u\"");
-				if(i==7) fprintf(outfile,"~h \"liou\"");
-				if(i==8) fprintf(outfile,"~h \"qi\"");
-				if(i==9) fprintf(outfile,"~h \"ba\"");
-				if(i==10) fprintf(outfile,"~h \"jiou\"");
-				if(i==11) { silmodel(fp,outfile);
-					     break; }
-				CAT=TRUE;
-			}
-		}
-		if(CAT==TRUE)
-		{
-	        while((c=getc(fp))!=EOF) fprintf(outfile,"%c",c);		
-		fclose(fp);
-		
-		}
-	}
-	return(0);
-}
+    ModelSet proto_set, set;
+    const Hmm *proto;
+    int i;
 
-/***********************************************************/
-/******************  Sil Model Generator    ****************/
-/***********************************************************/
-/*                                                         */
-/*            this function creates a 5 states             */
-/*              10 Mixture silence model                   */
-/*                                                         */
-/*                                                         */
-/***********************************************************/
-/*    Author:	Gary Lee                                   */
-/*    Date:		30 March 1998                      */
-/*    Version:	1                                          */
-/*    Change History:                                      */
-/*                                                         */
-/***********************************************************/
-/***********************************************************/
+    if (argc != 3) {
+        printf("Usage: %s hmmdef outfile\n", argv[0]);
+        exit(1);
+    }
 
-void silmodel(FILE *fp, FILE *outfile)
-{
-	int j=0, k,CAT=FALSE, line_no=0, STOP=FALSE; 
-	char line[1500],buf[7][1500]; /*** ATTENTION: changed from 300 -> 1500***/
-	
-	printf("CREATING SILENCE MODEL\n");
-	fprintf(outfile,"~h \"sil\"\n");
-	fprintf(outfile,"<BEGINHMM>\n<NUMSTATES> 5\n");
-	
-	while(STOP!=TRUE)
-	{
-		fgets(line, 1500, fp); /*** ATTENTION: changed from 300 -> 1500***/
-		if(strncmp(line,"<MEAN>",6)==0) 
-		{
-			if(j==0) CAT=TRUE;
-			else 
-			{
-				CAT=FALSE;
-				STOP=TRUE;
-			}
-			j++;
-		}
-		
-		if(CAT==TRUE)
-			  	
-			{
-				
-				strcpy(buf[line_no++],line); 
-/*				printf("line_no %d ::  %s\n",line_no-1, line);*/
-			}
-		
-	}
-	
-	for(k=2; k<5; k++)
-	{
-	
-		fprintf(outfile,"<STATE> %d\n<NUMMIXES> 1\n",k);
-		
-			
-			for(j=0; j<line_no-1; j++) fputs(buf[j],outfile);
-			/*for(j=0; j<line_no-1; j++) printf("line %d :: %s
-			\n",j,buf[j]);*/
-		
-	}
-	fprintf(outfile,"<TRANSP> 5\n0.000000e+00 1.000000e+00 0.000000e+00 0.000000e+00 0.000000e+00\n");
-	fprintf(outfile,"0.000000e+00 6.000000e-01 4.000000e-01 0.000000e+00 0.000000e+00\n");
- 	fprintf(outfile,"0.000000e+00 0.000000e+00 6.000000e-01 4.000000e-01 0.000000e+00\n");
- 	fprintf(outfile,"0.000000e+00 0.000000e+00 0.000000e+00 7.000000e-01 3.000000e-01\n");
- 	fprintf(outfile,"0.000000e+00 0.000000e+00 0.000000e+00 0.000000e+00 0.000000e+00\n<ENDHMM>\n");
+    modelset_init(&proto_set);
+    if (mmf_load(&proto_set, argv[1]) < 0) {
+        exit(1);
+    }
+    proto = modelset_find(&proto_set, "hmmdef");
+    if (proto == NULL) {
+        fprintf(stderr, "%s has no ~h \"hmmdef\"\n", argv[1]);
+        exit(1);
+    }
 
-}	
-	
-	
+    modelset_init(&set);
+    set.vec_size = proto_set.vec_size;
+    set.parm_kind = proto_set.parm_kind;
+    for (i = 0; i < (int)(sizeof(digits) / sizeof(digits[0])); i++) {
+        modelset_add(&set, hmm_clone(proto, digits[i]));
+    }
+    printf("CREATING SILENCE MODEL\n");
+    modelset_add(&set, hed_silence_model(proto));
+    modelset_index(&set);
+
+    if (mmf_save(&set, argv[2], MMF_HMMS) < 0) {
+        exit(1);
+    }
+    modelset_free(&set);
+    modelset_free(&proto_set);
+    return 0;
+}
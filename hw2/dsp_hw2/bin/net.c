@@ -0,0 +1,508 @@
+#include "net.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static int compare_pron(const void *a, const void *b)
+{
+    const Pron *x = (const Pron *)a, *y = (const Pron *)b;
+    int c = strcmp(x->word, y->word);
+    return c != 0 ? c : x->index - y->index;
+}
+
+int dict_load(Dict *dict, const char *filename)
+{
+    char line[MAX_NAME * 16], *tok, *save;
+    int cap = 64;
+
+    FILE *fp = fopen(filename, "r");
+    if (fp == NULL) {
+        perror(filename);
+        return -1;
+    }
+
+    memset(dict, 0, sizeof(Dict));
+    dict->pron = (Pron *)malloc(sizeof(Pron) * cap);
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        Pron *p;
+
+        tok = strtok_r(line, " \t\r\n", &save);
+        if (tok == NULL) {
+            continue;
+        }
+        if (dict->pron_num == cap) {
+            cap *= 2;
+            dict->pron = (Pron *)realloc(dict->pron, sizeof(Pron) * cap);
+        }
+        p = &dict->pron[dict->pron_num++];
+        memset(p, 0, sizeof(Pron));
+        p->word = strdup(tok);
+        p->index = dict->pron_num - 1;
+        while ((tok = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+            size_t len = strlen(tok);
+            if (p->model_num == 0 && p->out == NULL && tok[0] == '[' && tok[len-1] == ']') {
+                tok[len-1] = '\0';
+                p->out = strdup(tok + 1);
+                continue;
+            }
+            p->model = (char **)realloc(p->model, sizeof(char *) * (p->model_num + 1));
+            p->model[p->model_num++] = strdup(tok);
+        }
+        if (p->out == NULL) {
+            p->out = strdup(p->word);
+        }
+        if (p->model_num == 0) {
+            fprintf(stderr, "%s: %s has no pronunciation\n", filename, p->word);
+            fclose(fp);
+            dict_free(dict);
+            return -1;
+        }
+    }
+    fclose(fp);
+
+    qsort(dict->pron, dict->pron_num, sizeof(Pron), compare_pron);
+    return 0;
+}
+
+void dict_free(Dict *dict)
+{
+    int i, m;
+
+    for (i = 0; i < dict->pron_num; i++) {
+        Pron *p = &dict->pron[i];
+        for (m = 0; m < p->model_num; m++) {
+            free(p->model[m]);
+        }
+        free(p->model);
+        free(p->word);
+        free(p->out);
+    }
+    free(dict->pron);
+    memset(dict, 0, sizeof(Dict));
+}
+
+int dict_find(const Dict *dict, const char *word, int *first)
+{
+    int lo = 0, hi = dict->pron_num, n = 0;
+
+    // Lower bound
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strcmp(dict->pron[mid].word, word) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *first = lo;
+    while (lo + n < dict->pron_num && strcmp(dict->pron[lo+n].word, word) == 0) {
+        n++;
+    }
+    return n;
+}
+
+const char *slf_field(const char *line, const char *key, char *value)
+{
+    size_t len = strlen(key);
+    const char *p = line;
+
+    while (*p) {
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        if (strncmp(p, key, len) == 0 && p[len] == '=') {
+            sscanf(p + len + 1, "%s", value);
+            return value;
+        }
+        while (*p && *p != ' ' && *p != '\t') {
+            p++;
+        }
+    }
+    return NULL;
+}
+
+int slf_load(Slf *slf, const char *filename)
+{
+    char line[MAX_NAME * 4], value[MAX_NAME * 2];
+    int i, *in, *out;
+
+    FILE *fp = fopen(filename, "r");
+    if (fp == NULL) {
+        perror(filename);
+        return -1;
+    }
+
+    memset(slf, 0, sizeof(Slf));
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (slf_field(line, "I", value) != NULL) {
+            int n = atoi(value);
+            if (n < 0 || n >= slf->node_num || slf_field(line, "W", value) == NULL) {
+                fprintf(stderr, "%s: bad node line: %s\n", filename, line);
+                goto fail;
+            }
+            free(slf->word[n]);
+            slf->word[n] = strcmp(value, "!NULL") == 0 ? NULL : strdup(value);
+        } else if (slf_field(line, "J", value) != NULL) {
+            int j = atoi(value);
+            if (j < 0 || j >= slf->link_num || slf_field(line, "S", value) == NULL) {
+                fprintf(stderr, "%s: bad link line: %s\n", filename, line);
+                goto fail;
+            }
+            slf->link_start[j] = atoi(value);
+            if (slf_field(line, "E", value) == NULL) {
+                fprintf(stderr, "%s: bad link line: %s\n", filename, line);
+                goto fail;
+            }
+            slf->link_end[j] = atoi(value);
+            slf->link_lm[j] = slf_field(line, "l", value) != NULL ? (float)atof(value) : 0;
+            if (slf->link_start[j] < 0 || slf->link_start[j] >= slf->node_num || \
+                slf->link_end[j] < 0 || slf->link_end[j] >= slf->node_num) {
+                fprintf(stderr, "%s: link %d refers to a missing node\n", filename, j);
+                goto fail;
+            }
+        } else if (slf_field(line, "N", value) != NULL) {
+            slf->node_num = atoi(value);
+            slf->word = (char **)calloc(slf->node_num + 1, sizeof(char *));
+            if (slf_field(line, "L", value) == NULL) {
+                fprintf(stderr, "%s: N= without L=\n", filename);
+                goto fail;
+            }
+            slf->link_num = atoi(value);
+            slf->link_start = (int *)calloc(slf->link_num + 1, sizeof(int));
+            slf->link_end = (int *)calloc(slf->link_num + 1, sizeof(int));
+            slf->link_lm = (float *)calloc(slf->link_num + 1, sizeof(float));
+        }
+    }
+    fclose(fp);
+    fp = NULL;
+
+    // The network runs from the only node without predecessors to the only
+    // one without successors
+    in = (int *)calloc(slf->node_num + 1, sizeof(int));
+    out = (int *)calloc(slf->node_num + 1, sizeof(int));
+    for (i = 0; i < slf->link_num; i++) {
+        out[slf->link_start[i]]++;
+        in[slf->link_end[i]]++;
+    }
+    slf->start = slf->end = -1;
+    for (i = 0; i < slf->node_num; i++) {
+        if (in[i] == 0) {
+            slf->start = slf->start == -1 ? i : -2;
+        }
+        if (out[i] == 0) {
+            slf->end = slf->end == -1 ? i : -2;
+        }
+    }
+    free(in);
+    free(out);
+    if (slf->start < 0 || slf->end < 0) {
+        fprintf(stderr, "%s: needs exactly one start and one end node\n", filename);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    slf_free(slf);
+    return -1;
+}
+
+void slf_free(Slf *slf)
+{
+    int i;
+    for (i = 0; i < slf->node_num && slf->word != NULL; i++) {
+        free(slf->word[i]);
+    }
+    free(slf->word);
+    free(slf->link_start);
+    free(slf->link_end);
+    free(slf->link_lm);
+    memset(slf, 0, sizeof(Slf));
+}
+
+/**
+ * Walk from node n through !NULL nodes, relaxing pair[from][word] for every
+ * word node reached
+ */
+static void walk_pairs(const Slf *slf, const int *offset, const int *order, float *row, int n, double lm,
+                       int depth)
+{
+    int i;
+
+    if (depth > slf->node_num) {
+        return;
+    }
+    if (n == slf->end && lm > row[SLF_FINISH(slf)]) {
+        row[SLF_FINISH(slf)] = (float)lm;
+    }
+    for (i = offset[n]; i < offset[n+1]; i++) {
+        int j = order[i], e = slf->link_end[j];
+        double v = lm + slf->link_lm[j];
+        if (slf->word[e] != NULL) {
+            if (v > row[e]) {
+                row[e] = (float)v;
+            }
+        } else {
+            walk_pairs(slf, offset, order, row, e, v, depth + 1);
+        }
+    }
+}
+
+float *slf_word_pairs(const Slf *slf)
+{
+    int i, n, w = slf->node_num + 2;
+    float *pair = (float *)malloc(sizeof(float) * w * w);
+    int *offset = (int *)calloc(slf->node_num + 1, sizeof(int));
+    int *order = (int *)malloc(sizeof(int) * (slf->link_num + 1));
+    int *fill = (int *)malloc(sizeof(int) * (slf->node_num + 1));
+
+    for (i = 0; i < w * w; i++) {
+        pair[i] = LZERO;
+    }
+
+    // Links grouped by start node
+    for (i = 0; i < slf->link_num; i++) {
+        offset[slf->link_start[i] + 1]++;
+    }
+    for (n = 0; n < slf->node_num; n++) {
+        offset[n+1] += offset[n];
+    }
+    memcpy(fill, offset, sizeof(int) * (slf->node_num + 1));
+    for (i = 0; i < slf->link_num; i++) {
+        order[fill[slf->link_start[i]]++] = i;
+    }
+
+    for (n = 0; n < slf->node_num; n++) {
+        if (slf->word[n] != NULL) {
+            walk_pairs(slf, offset, order, pair + (size_t)n * w, n, 0, 0);
+        }
+    }
+    if (slf->word[slf->start] != NULL) {
+        pair[SLF_BEGIN(slf) * w + slf->start] = 0;
+    } else {
+        walk_pairs(slf, offset, order, pair + (size_t)SLF_BEGIN(slf) * w, slf->start, 0, 0);
+    }
+
+    free(offset);
+    free(order);
+    free(fill);
+    return pair;
+}
+
+/**
+ * Graph under construction, arcs in any order
+ */
+typedef struct {
+    DecodeNet *net;
+    int node_cap, arc_num, arc_cap;
+    int *from, *to;
+    float *prob;
+} Builder;
+
+static int add_node(Builder *b, const State *state, int word)
+{
+    DecodeNet *net = b->net;
+    if (net->node_num == b->node_cap) {
+        b->node_cap = b->node_cap > 0 ? b->node_cap * 2 : 256;
+        net->state = (const State **)realloc(net->state, sizeof(State *) * b->node_cap);
+        net->word = (int *)realloc(net->word, sizeof(int) * b->node_cap);
+    }
+    net->state[net->node_num] = state;
+    net->word[net->node_num] = word;
+    return net->node_num++;
+}
+
+static void add_arc(Builder *b, int from, int to, double log_prob)
+{
+    if (log_prob <= LSMALL) {
+        return;
+    }
+    if (b->arc_num == b->arc_cap) {
+        b->arc_cap = b->arc_cap > 0 ? b->arc_cap * 2 : 1024;
+        b->from = (int *)realloc(b->from, sizeof(int) * b->arc_cap);
+        b->to = (int *)realloc(b->to, sizeof(int) * b->arc_cap);
+        b->prob = (float *)realloc(b->prob, sizeof(float) * b->arc_cap);
+    }
+    b->from[b->arc_num] = from;
+    b->to[b->arc_num] = to;
+    b->prob[b->arc_num] = (float)log_prob;
+    b->arc_num++;
+}
+
+static double log_prob(float p)
+{
+    return p > 0 ? log(p) : LZERO;
+}
+
+/**
+ * Model hmm between null nodes entry and exit
+ */
+static void add_model(Builder *b, const Hmm *hmm, int entry, int exit)
+{
+    int i, j, band[2], N = hmm->state_num, first = b->net->node_num;
+    const float *a = hmm->transp->prob;
+
+    for (j = 1; j < N - 1; j++) {
+        add_node(b, hmm->state[j], -1);
+    }
+    add_arc(b, entry, exit, log_prob(a[N-1]));
+    for (j = 1; j < N - 1; j++) {
+        add_arc(b, entry, first + j - 1, log_prob(a[j]));
+    }
+    // add_arc drops zero transitions anyway, the band only shortens this loop
+    transp_band(hmm->transp, &band[0], &band[1]);
+    for (i = 1; i < N - 1; i++) {
+        for (j = BAND_TO_FIRST(band, i); j <= BAND_TO_LAST(band, i, N); j++) {
+            add_arc(b, first + i - 1, first + j - 1, log_prob(a[i*N+j]));
+        }
+        add_arc(b, first + i - 1, exit, log_prob(a[i*N+N-1]));
+    }
+}
+
+/**
+ * Topological order of the null nodes over null-to-null arcs
+ * @return 0 on success, -1 if they form a loop
+ */
+static int order_nulls(DecodeNet *net)
+{
+    int n, a, head = 0, tail = 0;
+    int *in = (int *)calloc(net->node_num + 1, sizeof(int));
+
+    for (n = 0; n < net->node_num; n++) {
+        for (a = net->arc_offset[n]; n < net->node_num && net->state[n] == NULL && a < net->arc_offset[n+1]; a++) {
+            if (net->state[net->arc_to[a]] == NULL) {
+                in[net->arc_to[a]]++;
+            }
+        }
+    }
+    net->null_num = 0;
+    for (n = 0; n < net->node_num; n++) {
+        if (net->state[n] == NULL) {
+            net->null_num++;
+        }
+    }
+    net->null_order = (int *)malloc(sizeof(int) * (net->null_num + 1));
+    for (n = 0; n < net->node_num; n++) {
+        if (net->state[n] == NULL && in[n] == 0) {
+            net->null_order[tail++] = n;
+        }
+    }
+    while (head < tail) {
+        n = net->null_order[head++];
+        for (a = net->arc_offset[n]; a < net->arc_offset[n+1]; a++) {
+            int to = net->arc_to[a];
+            if (net->state[to] == NULL && --in[to] == 0) {
+                net->null_order[tail++] = to;
+            }
+        }
+    }
+    free(in);
+    return tail == net->null_num ? 0 : -1;
+}
+
+int net_build(DecodeNet *net, const Slf *slf, const Dict *dict, const ModelSet *set,
+              double lm_scale, double penalty)
+{
+    Builder b;
+    int n, i, k, m, first, pron_num;
+    int *entry = (int *)malloc(sizeof(int) * (slf->node_num + 1));
+    int *exit = (int *)malloc(sizeof(int) * (slf->node_num + 1));
+    int *fill;
+
+    memset(net, 0, sizeof(DecodeNet));
+    memset(&b, 0, sizeof(Builder));
+    b.net = net;
+    net->slf = slf;
+
+    for (n = 0; n < slf->node_num; n++) {
+        entry[n] = add_node(&b, NULL, -1);
+        exit[n] = add_node(&b, NULL, slf->word[n] != NULL ? n : -1);
+        if (slf->word[n] == NULL) {
+            add_arc(&b, entry[n], exit[n], 0);
+            continue;
+        }
+        pron_num = dict_find(dict, slf->word[n], &first);
+        if (pron_num == 0) {
+            fprintf(stderr, "Word %s of the network is not in the dictionary\n", slf->word[n]);
+            goto fail;
+        }
+        for (k = first; k < first + pron_num; k++) {
+            const Pron *p = &dict->pron[k];
+            int prev = entry[n];
+            for (m = 0; m < p->model_num; m++) {
+                const Hmm *hmm = modelset_find(set, p->model[m]);
+                int next = m == p->model_num - 1 ? exit[n] : add_node(&b, NULL, -1);
+                if (hmm == NULL) {
+                    fprintf(stderr, "Model %s of word %s not found\n", p->model[m], p->word);
+                    goto fail;
+                }
+                add_model(&b, hmm, prev, next);
+                prev = next;
+            }
+        }
+    }
+    for (i = 0; i < slf->link_num; i++) {
+        int s = slf->link_start[i];
+        double cost = lm_scale * slf->link_lm[i] + (slf->word[s] != NULL ? penalty : 0);
+        add_arc(&b, exit[s], entry[slf->link_end[i]], cost);
+    }
+    net->start = entry[slf->start];
+    net->end = exit[slf->end];
+
+    // Group the arcs by source node
+    net->arc_offset = (int *)calloc(net->node_num + 1, sizeof(int));
+    net->arc_to = (int *)malloc(sizeof(int) * (b.arc_num + 1));
+    net->arc_prob = (float *)malloc(sizeof(float) * (b.arc_num + 1));
+    for (i = 0; i < b.arc_num; i++) {
+        net->arc_offset[b.from[i] + 1]++;
+    }
+    for (n = 0; n < net->node_num; n++) {
+        net->arc_offset[n+1] += net->arc_offset[n];
+        if (net->state[n] != NULL) {
+            net->emit_num++;
+        }
+    }
+    fill = (int *)malloc(sizeof(int) * (net->node_num + 1));
+    memcpy(fill, net->arc_offset, sizeof(int) * (net->node_num + 1));
+    for (i = 0; i < b.arc_num; i++) {
+        int a = fill[b.from[i]]++;
+        net->arc_to[a] = b.to[i];
+        net->arc_prob[a] = b.prob[i];
+    }
+    free(fill);
+
+    if (order_nulls(net) < 0) {
+        fprintf(stderr, "The network has a loop of non-emitting nodes\n");
+        goto fail;
+    }
+
+    free(b.from);
+    free(b.to);
+    free(b.prob);
+    free(entry);
+    free(exit);
+    return 0;
+
+fail:
+    free(b.from);
+    free(b.to);
+    free(b.prob);
+    free(entry);
+    free(exit);
+    net_free(net);
+    return -1;
+}
+
+void net_free(DecodeNet *net)
+{
+    free(net->state);
+    free(net->word);
+    free(net->arc_offset);
+    free(net->arc_to);
+    free(net->arc_prob);
+    free(net->null_order);
+    memset(net, 0, sizeof(DecodeNet));
+}
@@ -0,0 +1,105 @@
+#ifndef NET_HEADER_
+#define NET_HEADER_
+
+#include "gmm.h"
+
+/**
+ * Recognition network: an HTK standard lattice format (SLF) word network
+ * such as lib/wdnet_sp, expanded through the dictionary into a flat graph
+ * of HMM states for token passing.
+ */
+
+/**
+ * Pronunciation dictionary, "WORD [OUTSYM] model model ..." per line; a
+ * word may have several pronunciations
+ */
+typedef struct {
+    char *word;
+    char *out;          // Output symbol, the word itself unless [OUTSYM] is given
+    int model_num;
+    char **model;
+    int index;          // Entry number in the file
+} Pron;
+
+typedef struct {
+    int pron_num;
+    Pron *pron;         // Sorted by word, pronunciations of a word in file order
+} Dict;
+
+/**
+ * SLF word network; node and link lists as in the file
+ */
+typedef struct {
+    int node_num, link_num;
+    char **word;        // [node_num], NULL for !NULL nodes
+    int *link_start;    // [link_num]
+    int *link_end;      // [link_num]
+    float *link_lm;     // [link_num] l= log probability, 0 if absent
+    int start, end;     // The node without predecessors and the one without successors
+} Slf;
+
+/**
+ * Flat state graph. Emitting nodes hold an HMM state, null nodes are the
+ * non-emitting glue: word entries and ends, model boundaries and !NULL
+ * nodes. Arcs carry log probabilities and are grouped by source node.
+ */
+typedef struct {
+    int node_num;
+    const State **state;  // [node_num], NULL for null nodes
+    int *word;            // [node_num], SLF node of a word end, -1 otherwise
+    int *arc_offset;      // [node_num + 1], arcs of node n are [arc_offset[n], arc_offset[n+1])
+    int *arc_to;
+    float *arc_prob;
+    int null_num;
+    int *null_order;      // [null_num] null nodes in topological order
+    int start;            // Null node holding the initial token
+    int end;              // Null node a complete path must reach
+    const Slf *slf;       // Word names of word ends
+    int emit_num;         // Emitting nodes
+} DecodeNet;
+
+/**
+ * @return 0 on success, -1 on error (reported on stderr)
+ */
+int dict_load(Dict *dict, const char *filename);
+void dict_free(Dict *dict);
+
+/**
+ * @param first receives the index of the word's first pronunciation
+ * @return number of pronunciations of word, 0 if not in the dictionary
+ */
+int dict_find(const Dict *dict, const char *word, int *first);
+
+/**
+ * @return 0 on success, -1 on error (reported on stderr)
+ */
+int slf_load(Slf *slf, const char *filename);
+/**
+ * @param value receives the value of field key ("key=value") of an SLF line
+ * @return value, NULL if line has no such field
+ */
+const char *slf_field(const char *line, const char *key, char *value);
+void slf_free(Slf *slf);
+
+/**
+ * Word-pair table of slf: entry [a * (node_num + 2) + b] is the best sum of
+ * l= weights on a path from word node a to word node b through !NULL nodes
+ * only, LZERO if there is none. Row SLF_BEGIN(slf) stands for the sentence
+ * start, column SLF_FINISH(slf) for the sentence end.
+ * @return table of (node_num + 2)^2 entries, release with free
+ */
+float *slf_word_pairs(const Slf *slf);
+#define SLF_BEGIN(slf) ((slf)->node_num)
+#define SLF_FINISH(slf) ((slf)->node_num + 1)
+
+/**
+ * Expand slf through dict into the models of set. Every link out of a word
+ * node costs lm_scale * l + penalty, like HVite -s and -p.
+ * @return 0 on success, -1 on a missing word or model or a loop of null
+ * nodes (reported on stderr)
+ */
+int net_build(DecodeNet *net, const Slf *slf, const Dict *dict, const ModelSet *set,
+              double lm_scale, double penalty);
+void net_free(DecodeNet *net);
+
+#endif
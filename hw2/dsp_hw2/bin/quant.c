@@ -0,0 +1,298 @@
+#include "quant.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef float v8f __attribute__((vector_size(32)));
+typedef int v8si __attribute__((vector_size(32)));
+typedef signed char v8qi __attribute__((vector_size(8)));
+typedef unsigned char v8uqi __attribute__((vector_size(8)));
+typedef uint16_t v8uhi __attribute__((vector_size(16)));
+
+/**
+ * 8 halves to floats by moving the exponent and mantissa bits. Zero stays
+ * zero; denormals land within 2^-14 of their value, which is below the
+ * resolution that matters for means and precisions.
+ */
+static void half8_to_float(const uint16_t *p, v8f *f)
+{
+    v8uhi raw;
+    v8si h, bits;
+
+    memcpy(&raw, p, sizeof(v8uhi));
+    h = __builtin_convertvector(raw, v8si);
+    bits = ((h & 0x7fff) << 13) + (112 << 23);
+    bits = (bits & ((h & 0x7fff) != 0)) | ((h & 0x8000) << 16);
+    memcpy(f, &bits, sizeof(v8f));
+}
+
+static float lane_sum(const v8f *v)
+{
+    return (((*v)[0] + (*v)[1]) + ((*v)[2] + (*v)[3])) + (((*v)[4] + (*v)[5]) + ((*v)[6] + (*v)[7]));
+}
+
+/**
+ * sum_k ((u_k - m_k) s_k h_k)^2 of one int8 component
+ */
+static float distance_int8(const QuantModel *q, const signed char *m, const unsigned char *p, const float *u)
+{
+    const float *h = q->scale + 2 * q->stride;
+    v8f acc = {0};
+    int k;
+
+    for (k = 0; k < q->stride; k += QUANT_LANE) {
+        v8qi mq;
+        v8uqi pq;
+        v8f uf, hf, e;
+        memcpy(&mq, m + k, sizeof(v8qi));
+        memcpy(&pq, p + k, sizeof(v8uqi));
+        memcpy(&uf, u + k, sizeof(v8f));
+        memcpy(&hf, h + k, sizeof(v8f));
+        e = (uf - __builtin_convertvector(__builtin_convertvector(mq, v8si), v8f)) * \
+            (__builtin_convertvector(__builtin_convertvector(pq, v8si), v8f) * hf);
+        acc += e * e;
+    }
+    return lane_sum(&acc);
+}
+
+/**
+ * sum_k ((x_k - m_k) s_k)^2 of one half-precision component
+ */
+static float distance_f16(const QuantModel *q, const uint16_t *m, const uint16_t *p, const float *x)
+{
+    v8f acc = {0};
+    int k;
+
+    for (k = 0; k < q->stride; k += QUANT_LANE) {
+        v8f xf, mf, pf, e;
+        memcpy(&xf, x + k, sizeof(v8f));
+        half8_to_float(m + k, &mf);
+        half8_to_float(p + k, &pf);
+        e = (xf - mf) * pf;
+        acc += e * e;
+    }
+    return lane_sum(&acc);
+}
+
+static void alloc_tables(QuantModel *q)
+{
+    size_t size = (size_t)q->comp_num * q->stride;
+
+    q->cst = (float *)malloc(sizeof(float) * (q->comp_num + 1));
+    q->scale = (float *)calloc(3 * q->stride, sizeof(float));
+    if (q->type == QUANT_INT8) {
+        q->mean = calloc(size + QUANT_LANE, 1);
+        q->prec = calloc(size + QUANT_LANE, 1);
+    } else {
+        q->mean = calloc(size + QUANT_LANE, sizeof(uint16_t));
+        q->prec = calloc(size + QUANT_LANE, sizeof(uint16_t));
+    }
+}
+
+void quant_build(QuantModel *q, const ModelSet *set, int type)
+{
+    int s, m, k, c, n = set->vec_size;
+    float *lo = (float *)malloc(sizeof(float) * n), *hi = (float *)malloc(sizeof(float) * n);
+
+    memset(q, 0, sizeof(QuantModel));
+    q->type = type;
+    q->vec_size = n;
+    q->stride = (n + QUANT_LANE - 1) / QUANT_LANE * QUANT_LANE;
+    q->state_num = set->state_num;
+    q->comp_offset = (int *)malloc(sizeof(int) * (set->state_num + 1));
+    for (s = 0; s < set->state_num; s++) {
+        q->comp_offset[s] = q->comp_num;
+        q->comp_num += set->state_list[s]->mix_num;
+    }
+    q->comp_offset[set->state_num] = q->comp_num;
+    alloc_tables(q);
+
+    // int8 grid: the means of each dimension span [-127, 127], precisions
+    // in grid units span [0, 255]
+    for (k = 0; k < n; k++) {
+        lo[k] = HUGE_VALF;
+        hi[k] = -HUGE_VALF;
+    }
+    for (s = 0; s < set->state_num; s++) {
+        const State *st = set->state_list[s];
+        for (m = 0; m < st->mix_num; m++) {
+            for (k = 0; k < n; k++) {
+                float v = st->gauss[m]->mean[k];
+                lo[k] = v < lo[k] ? v : lo[k];
+                hi[k] = v > hi[k] ? v : hi[k];
+            }
+        }
+    }
+    for (k = 0; type == QUANT_INT8 && k < n; k++) {
+        double step = (hi[k] - lo[k]) / 254 > 1e-6 ? (hi[k] - lo[k]) / 254 : 1e-6;
+        double top = 0;
+        q->scale[k] = (float)(1 / step);
+        q->scale[q->stride + k] = (float)(-0.5 * (lo[k] + hi[k]) / step);
+        for (s = 0; s < set->state_num; s++) {
+            const State *st = set->state_list[s];
+            for (m = 0; m < st->mix_num; m++) {
+                double p = sqrt(st->gauss[m]->ivar[k]) * step;
+                top = p > top ? p : top;
+            }
+        }
+        q->scale[2 * q->stride + k] = (float)(top > 0 ? top / 255 : 1);
+    }
+
+    for (s = 0; s < set->state_num; s++) {
+        const State *st = set->state_list[s];
+        for (m = 0; m < st->mix_num; m++) {
+            const Gaussian *g = st->gauss[m];
+            size_t base;
+
+            c = q->comp_offset[s] + m;
+            base = (size_t)c * q->stride;
+            q->cst[c] = st->weight[m] > 0 ? (float)(log(st->weight[m]) - 0.5 * g->gconst) : LZERO;
+            for (k = 0; k < n; k++) {
+                if (type == QUANT_INT8) {
+                    double u = g->mean[k] * q->scale[k] + q->scale[q->stride + k];
+                    double p = sqrt(g->ivar[k]) / q->scale[k] / q->scale[2 * q->stride + k];
+                    long mq = lround(u), pq = lround(p);
+                    ((signed char *)q->mean)[base + k] = (signed char)(mq < -127 ? -127 : mq > 127 ? 127 : mq);
+                    ((unsigned char *)q->prec)[base + k] = (unsigned char)(pq < 1 ? 1 : pq > 255 ? 255 : pq);
+                } else {
+                    ((uint16_t *)q->mean)[base + k] = float_to_half(g->mean[k]);
+                    ((uint16_t *)q->prec)[base + k] = float_to_half((float)sqrt(g->ivar[k]));
+                }
+            }
+        }
+    }
+    free(lo);
+    free(hi);
+}
+
+void quant_free(QuantModel *q)
+{
+    free(q->comp_offset);
+    free(q->cst);
+    free(q->scale);
+    free(q->mean);
+    free(q->prec);
+    memset(q, 0, sizeof(QuantModel));
+}
+
+long quant_bytes(const QuantModel *q)
+{
+    return (long)q->comp_num * q->stride * 2 * (q->type == QUANT_INT8 ? 1 : 2);
+}
+
+int quant_write(const QuantModel *q, const char *filename)
+{
+    int magic = QUANT_MAGIC;
+    size_t size = (size_t)q->comp_num * q->stride * (q->type == QUANT_INT8 ? 1 : 2);
+    int err;
+    FILE *fp = fopen(filename, "wb");
+
+    if (fp == NULL) {
+        perror(filename);
+        return -1;
+    }
+    fwrite(&magic, sizeof(int), 1, fp);
+    fwrite(&q->type, sizeof(int), 1, fp);
+    fwrite(&q->vec_size, sizeof(int), 1, fp);
+    fwrite(&q->state_num, sizeof(int), 1, fp);
+    fwrite(q->comp_offset, sizeof(int), q->state_num + 1, fp);
+    fwrite(q->cst, sizeof(float), q->comp_num, fp);
+    fwrite(q->scale, sizeof(float), 3 * q->stride, fp);
+    fwrite(q->mean, 1, size, fp);
+    fwrite(q->prec, 1, size, fp);
+    // A short write, e.g. a full disk, must not leave a file that looks complete
+    err = ferror(fp);
+    if (fclose(fp) != 0 || err) {
+        perror(filename);
+        remove(filename);
+        return -1;
+    }
+    return 0;
+}
+
+int quant_read(QuantModel *q, const char *filename, const ModelSet *set)
+{
+    int s, magic, ok;
+    size_t size;
+    FILE *fp = fopen(filename, "rb");
+
+    memset(q, 0, sizeof(QuantModel));
+    if (fp == NULL) {
+        perror(filename);
+        return -1;
+    }
+    ok = fread(&magic, sizeof(int), 1, fp) == 1 && magic == QUANT_MAGIC && \
+         fread(&q->type, sizeof(int), 1, fp) == 1 && (q->type == QUANT_INT8 || q->type == QUANT_F16) && \
+         fread(&q->vec_size, sizeof(int), 1, fp) == 1 && fread(&q->state_num, sizeof(int), 1, fp) == 1;
+    if (!ok || q->vec_size != set->vec_size || q->state_num != set->state_num) {
+        fprintf(stderr, "%s: not compiled from these models\n", filename);
+        fclose(fp);
+        memset(q, 0, sizeof(QuantModel));
+        return -1;
+    }
+    q->stride = (q->vec_size + QUANT_LANE - 1) / QUANT_LANE * QUANT_LANE;
+    q->comp_offset = (int *)malloc(sizeof(int) * (q->state_num + 1));
+    ok = fread(q->comp_offset, sizeof(int), q->state_num + 1, fp) == (size_t)q->state_num + 1;
+    for (s = 0; ok && s < set->state_num; s++) {
+        ok = q->comp_offset[s+1] - q->comp_offset[s] == set->state_list[s]->mix_num;
+    }
+    if (!ok) {
+        fprintf(stderr, "%s: not compiled from these models\n", filename);
+        fclose(fp);
+        quant_free(q);
+        return -1;
+    }
+    q->comp_num = q->comp_offset[q->state_num];
+    alloc_tables(q);
+    size = (size_t)q->comp_num * q->stride * (q->type == QUANT_INT8 ? 1 : 2);
+    ok = fread(q->cst, sizeof(float), q->comp_num, fp) == (size_t)q->comp_num && \
+         fread(q->scale, sizeof(float), 3 * q->stride, fp) == (size_t)3 * q->stride && \
+         fread(q->mean, 1, size, fp) == size && fread(q->prec, 1, size, fp) == size;
+    fclose(fp);
+    if (!ok) {
+        fprintf(stderr, "%s: truncated\n", filename);
+        quant_free(q);
+        return -1;
+    }
+    return 0;
+}
+
+void quant_frame(const QuantModel *q, const float *x, float *u)
+{
+    int k;
+
+    for (k = 0; k < q->vec_size; k++) {
+        u[k] = q->type == QUANT_INT8 ? x[k] * q->scale[k] + q->scale[q->stride + k] : x[k];
+    }
+    for (; k < q->stride; k++) {
+        u[k] = 0;
+    }
+}
+
+double quant_state_log_prob(const QuantModel *q, const State *s, const float *u)
+{
+    int c, lo = q->comp_offset[s->index], hi = q->comp_offset[s->index + 1];
+    float max = LZERO, sum = 0;
+
+    // Running log-sum-exp, rescaled when a larger component turns up
+    for (c = lo; c < hi; c++) {
+        size_t base = (size_t)c * q->stride;
+        float d, v;
+        if (q->cst[c] <= LSMALL) {
+            continue;
+        }
+        if (q->type == QUANT_INT8) {
+            d = distance_int8(q, (const signed char *)q->mean + base, (const unsigned char *)q->prec + base, u);
+        } else {
+            d = distance_f16(q, (const uint16_t *)q->mean + base, (const uint16_t *)q->prec + base, u);
+        }
+        v = q->cst[c] - 0.5f * d;
+        if (v > max) {
+            sum = sum * expf(max - v) + 1;
+            max = v;
+        } else {
+            sum += expf(v - max);
+        }
+    }
+    return max > LSMALL ? max + logf(sum) : LZERO;
+}
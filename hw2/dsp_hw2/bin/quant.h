@@ -0,0 +1,82 @@
+#ifndef QUANT_HEADER_
+#define QUANT_HEADER_
+
+#include "gmm.h"
+
+/**
+ * Compiled output distributions for decoding: the means and precisions
+ * (inverse standard deviations) of every Gaussian of a model set stored in
+ * 8 or 16 bits instead of 2 floats per dimension, with log weight and
+ * gconst folded into one constant per Gaussian.
+ *
+ *  - QUANT_INT8: means as int8 on a per-dimension grid (offset and step
+ *    spanning the means of that dimension), precisions as uint8 on a
+ *    per-dimension scale. A frame is mapped onto the grid once, then every
+ *    Gaussian is (u - m) * s summed in squares, 2 bytes per dimension.
+ *  - QUANT_F16: means and precisions as IEEE half floats (float_to_half),
+ *    4 bytes per dimension, converted back with integer vector operations
+ *    so no F16C instructions are needed.
+ *
+ * Vectors are padded to QUANT_LANE dimensions with zero precision, so the
+ * kernels run whole vectors. The state order is that of modelset_index.
+ */
+
+#ifndef QUANT_LANE
+    #define QUANT_LANE 8      // Dimensions per kernel step
+#endif
+#ifndef QUANT_MAGIC
+    #define QUANT_MAGIC 0x51464d31    // "QFM1"
+#endif
+
+#define QUANT_INT8 1
+#define QUANT_F16 2
+
+typedef struct {
+    int type;             // QUANT_INT8 or QUANT_F16
+    int vec_size;
+    int stride;           // vec_size rounded up to QUANT_LANE
+    int state_num;        // Indexed states of the model set
+    int comp_num;
+    int *comp_offset;     // [state_num + 1] first component of each state
+    float *cst;           // [comp_num] log w - gconst / 2, LZERO for zero weights
+    float *scale;         // [3][stride] int8: 1 / step, -offset / step, precision scale
+    void *mean;           // [comp_num][stride] int8 or half
+    void *prec;           // [comp_num][stride] uint8 or half
+} QuantModel;
+
+/**
+ * Compile the output distributions of set
+ * @param set indexed by modelset_index
+ */
+void quant_build(QuantModel *q, const ModelSet *set, int type);
+void quant_free(QuantModel *q);
+
+/**
+ * @return bytes of the means and precisions, to compare with the floats
+ */
+long quant_bytes(const QuantModel *q);
+
+/**
+ * @return 0 on success, -1 on error (reported on stderr)
+ */
+int quant_write(const QuantModel *q, const char *filename);
+/**
+ * @param set the model set q must have been compiled from, indexed
+ * @return 0 on success, -1 on error or a mismatch with set
+ */
+int quant_read(QuantModel *q, const char *filename, const ModelSet *set);
+
+/**
+ * Map frame x onto the grid of q, once per frame
+ * @param u receives stride floats
+ */
+void quant_frame(const QuantModel *q, const float *x, float *u);
+
+/**
+ * @param s indexed state of the set q was compiled from
+ * @param u frame from quant_frame
+ * @return log b_s(x)
+ */
+double quant_state_log_prob(const QuantModel *q, const State *s, const float *u);
+
+#endif
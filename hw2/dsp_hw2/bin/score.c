@@ -0,0 +1,175 @@
+#include "score.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef float v4f __attribute__((vector_size(16)));
+
+void score_table_init(ScoreTable *tab, const ModelSet *set)
+{
+    int s, m, k, c, n = set->vec_size;
+    void *mem;
+
+    memset(tab, 0, sizeof(ScoreTable));
+    tab->vec_size = n;
+    tab->width = 2 * n + 1;
+    tab->state_num = set->state_num;
+    tab->comp_offset = (int *)malloc(sizeof(int) * (set->state_num + 1));
+    for (s = 0; s < set->state_num; s++) {
+        tab->comp_offset[s] = tab->comp_num;
+        tab->comp_num += set->state_list[s]->mix_num;
+    }
+    tab->comp_offset[set->state_num] = tab->comp_num;
+
+    tab->panel_num = (tab->comp_num + SCORE_PANEL - 1) / SCORE_PANEL;
+    if (posix_memalign(&mem, 32, sizeof(float) * ((size_t)tab->panel_num * tab->width * SCORE_PANEL + 1)) != 0) {
+        fprintf(stderr, "score table: out of memory for %d components\n", tab->comp_num);
+        exit(1);
+    }
+    tab->panel = (float *)mem;
+    memset(tab->panel, 0, sizeof(float) * tab->panel_num * tab->width * SCORE_PANEL);
+
+    for (s = 0; s < set->state_num; s++) {
+        const State *st = set->state_list[s];
+        for (m = 0; m < st->mix_num; m++) {
+            const Gaussian *g = st->gauss[m];
+            double cst = g->gconst;
+            float *p;
+
+            c = tab->comp_offset[s] + m;
+            p = tab->panel + (size_t)(c / SCORE_PANEL) * tab->width * SCORE_PANEL + c % SCORE_PANEL;
+            for (k = 0; k < n; k++) {
+                p[k * SCORE_PANEL] = -0.5f * g->ivar[k];
+                p[(n + k) * SCORE_PANEL] = g->mean[k] * g->ivar[k];
+                cst += (double)g->mean[k] * g->mean[k] * g->ivar[k];
+            }
+            p[2 * n * SCORE_PANEL] = st->weight[m] > 0 ? (float)(log(st->weight[m]) - 0.5 * cst) : LZERO;
+        }
+    }
+}
+
+void score_table_free(ScoreTable *tab)
+{
+    free(tab->comp_offset);
+    free(tab->panel);
+    memset(tab, 0, sizeof(ScoreTable));
+}
+
+/**
+ * 4 augmented frames times one panel
+ * @param x rows of width floats
+ * @param y receives [4][SCORE_PANEL]
+ */
+static void kernel_4x8(const float *x, int width, const float *panel, float *y)
+{
+    const v4f *w = (const v4f *)panel;
+    const float *x0 = x, *x1 = x + width, *x2 = x + 2 * width, *x3 = x + 3 * width;
+    v4f a00 = {0}, a01 = {0}, a10 = {0}, a11 = {0};
+    v4f a20 = {0}, a21 = {0}, a30 = {0}, a31 = {0};
+    int k;
+
+    for (k = 0; k < width; k++) {
+        v4f w0 = w[2*k], w1 = w[2*k+1];
+        a00 += x0[k] * w0;
+        a01 += x0[k] * w1;
+        a10 += x1[k] * w0;
+        a11 += x1[k] * w1;
+        a20 += x2[k] * w0;
+        a21 += x2[k] * w1;
+        a30 += x3[k] * w0;
+        a31 += x3[k] * w1;
+    }
+    memcpy(y, &a00, sizeof(v4f));
+    memcpy(y + 4, &a01, sizeof(v4f));
+    memcpy(y + 8, &a10, sizeof(v4f));
+    memcpy(y + 12, &a11, sizeof(v4f));
+    memcpy(y + 16, &a20, sizeof(v4f));
+    memcpy(y + 20, &a21, sizeof(v4f));
+    memcpy(y + 24, &a30, sizeof(v4f));
+    memcpy(y + 28, &a31, sizeof(v4f));
+}
+
+void score_frames(const ScoreTable *tab, const float *x, int frame_num, const char *need,
+                  float *comp, float *out)
+{
+    int f0, f, r, p, k, j, s, n = tab->vec_size, width = tab->width;
+    float *aug = (float *)malloc(sizeof(float) * (SCORE_BLOCK + 3) * width);
+    char *panel_need = (char *)calloc(tab->panel_num + 1, 1);
+    float y[4 * SCORE_PANEL];
+
+    for (s = 0; s < tab->state_num; s++) {
+        if (need == NULL || need[s]) {
+            for (p = tab->comp_offset[s] / SCORE_PANEL; p * SCORE_PANEL < tab->comp_offset[s+1]; p++) {
+                panel_need[p] = 1;
+            }
+        }
+    }
+
+    for (f0 = 0; f0 < frame_num; f0 += SCORE_BLOCK) {
+        int block = frame_num - f0 < SCORE_BLOCK ? frame_num - f0 : SCORE_BLOCK;
+        int rows = (block + 3) & ~3;
+
+        // [x^2, x, 1], padded to a multiple of 4 frames
+        for (f = 0; f < rows; f++) {
+            float *a = aug + (size_t)f * width;
+            const float *v = x + (size_t)(f0 + f) * n;
+            if (f >= block) {
+                memset(a, 0, sizeof(float) * width);
+                continue;
+            }
+            for (k = 0; k < n; k++) {
+                a[k] = v[k] * v[k];
+                a[n + k] = v[k];
+            }
+            a[2 * n] = 1;
+        }
+
+        // One panel stays in cache for the whole block of frames
+        for (p = 0; p < tab->panel_num; p++) {
+            const float *panel = tab->panel + (size_t)p * width * SCORE_PANEL;
+            int c0 = p * SCORE_PANEL;
+            int cols = tab->comp_num - c0 < SCORE_PANEL ? tab->comp_num - c0 : SCORE_PANEL;
+            if (!panel_need[p]) {
+                continue;
+            }
+            for (r = 0; r < block; r += 4) {
+                kernel_4x8(aug + (size_t)r * width, width, panel, y);
+                for (f = r; f < r + 4 && f < block; f++) {
+                    float *dst = comp + (size_t)(f0 + f) * tab->comp_num + c0;
+                    for (j = 0; j < cols; j++) {
+                        dst[j] = y[(f - r) * SCORE_PANEL + j];
+                    }
+                }
+            }
+        }
+
+        // Log-sum-exp over the components of each state while the block is in cache
+        for (f = f0; f < f0 + block; f++) {
+            const float *c = comp + (size_t)f * tab->comp_num;
+            float *o = out + (size_t)f * tab->state_num;
+            for (s = 0; s < tab->state_num; s++) {
+                int lo = tab->comp_offset[s], hi = tab->comp_offset[s+1];
+                float max, sum = 0;
+                if (need != NULL && !need[s]) {
+                    continue;
+                }
+                max = c[lo];
+                for (j = lo + 1; j < hi; j++) {
+                    if (c[j] > max) {
+                        max = c[j];
+                    }
+                }
+                if (max <= LSMALL) {
+                    o[s] = LZERO;
+                    continue;
+                }
+                for (j = lo; j < hi; j++) {
+                    sum += expf(c[j] - max);
+                }
+                o[s] = max + logf(sum);
+            }
+        }
+    }
+    free(aug);
+    free(panel_need);
+}
@@ -0,0 +1,56 @@
+#ifndef SCORE_HEADER_
+#define SCORE_HEADER_
+
+#include "gmm.h"
+
+/**
+ * Batched output probabilities. The log density of a diagonal Gaussian is
+ * linear in the augmented vector [x^2, x, 1]:
+ *
+ *   log w + log N(x; m, v) = sum_k (-1/2v_k) x_k^2 + (m_k/v_k) x_k + c,
+ *   c = log w - (gconst + sum_k m_k^2/v_k) / 2
+ *
+ * so every mixture component of every state of a model set, scored over F
+ * frames, is one (F x 2n+1) by (2n+1 x C) matrix product, followed by a
+ * log-sum-exp over the components of each state.
+ *
+ * Components are stored in panels of SCORE_PANEL, transposed, so the
+ * kernel keeps a panel in cache while it runs through a block of frames
+ * and updates SCORE_PANEL components per multiply-add with vector
+ * instructions.
+ */
+
+#define SCORE_PANEL 8         // Components per panel, the two vectors of 4 of kernel_4x8
+#ifndef SCORE_BLOCK
+    #define SCORE_BLOCK 64    // Frames per block
+#endif
+
+typedef struct {
+    int vec_size;
+    int width;            // 2 * vec_size + 1
+    int state_num;        // Indexed states of the model set
+    int comp_num;         // Components of all states, zero-weight ones included
+    int *comp_offset;     // [state_num + 1] first component of each state
+    int panel_num;
+    float *panel;         // [panel_num][width][SCORE_PANEL]
+} ScoreTable;
+
+/**
+ * @param set indexed by modelset_index; the table is a copy, rebuild it
+ * after the models change
+ */
+void score_table_init(ScoreTable *tab, const ModelSet *set);
+void score_table_free(ScoreTable *tab);
+
+/**
+ * Score frame_num frames starting at x (rows of vec_size)
+ * @param need [state_num] nonzero for the states to score, NULL for all;
+ * panels holding none of them are skipped
+ * @param comp [frame_num][comp_num] receives log w_m + log N(x; m) of every
+ * component, the mix_log_prob of state_log_prob
+ * @param out [frame_num][state_num] receives log b_s(x) of every state
+ */
+void score_frames(const ScoreTable *tab, const float *x, int frame_num, const char *need,
+                  float *comp, float *out);
+
+#endif
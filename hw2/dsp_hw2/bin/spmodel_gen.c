@@ -1,10 +1,7 @@
-#include "stdio.h"
-#include "string.h"
-#include "stdlib.h"
-
-#define FALSE 0
-#define TRUE 1
-
+#include "mmf.h"
+#include "hed.h"
+#include <stdlib.h>
+#include <string.h>
 
 
 /***********************************************************/
@@ -21,6 +18,8 @@
 /*    Date:		27 March 1998                      */
 /*    Version:	1                                          */
 /*    Change History:                                      */
+/*    - sp built in memory with the MMF library (mmf.h)    */
+/*      from state 3 of sil instead of copying text lines  */
 /*                                                         */
 /***********************************************************/
 /* 							   */
@@ -49,50 +48,56 @@
 
 int main(int argc, char *argv[])
 {
-	int  CAT=FALSE, STOP=FALSE, START=FALSE;
-	FILE *fp;
-	FILE *outfile;
-	
-	char line[300];
+    ModelSet set, out_set, *out = &set;
+    const Hmm *sil;
+    Hmm *sp;
+    FILE *fp;
+
+    if (argc != 3) {
+        printf("Usage:  infile outfile\n");
+        exit(1);
+    }
 
-	if(argc !=3)
-	{	printf("Usage:  infile outfile\n");
-		exit(1);
-	}
-	
-	
-	
-	fp = fopen(argv[1], "r");	
-	outfile = fopen(argv[2], "a+");
+    modelset_init(&set);
+    if (mmf_load(&set, argv[1]) < 0) {
+        exit(1);
+    }
+    sil = modelset_find(&set, "sil");
+    if (sil == NULL || sil->state_num < 4) {
+        fprintf(stderr, "%s has no sil model with a state 3\n", argv[1]);
+        exit(1);
+    }
 
-	fprintf(outfile,"~h \"sp\"\n");
-	fprintf(outfile,"<BEGINHMM>\n<NUMSTATES> 3\n<STATE> 2\n");
- 	
- 	 		
-	while(STOP==FALSE)
-	{
-		fgets(line, 300, fp); 
-		if(strncmp(line,"~h \"sil\"",8)==0) START=TRUE;
-		if(START==TRUE) 
-		{	if(strncmp(line,"<STATE> 3",9)==0) 
-			{	CAT=TRUE;
-				continue;
-			}
-			if(strncmp(line,"<STATE> 4",9)==0) 
-			{	CAT=FALSE;
-				STOP=TRUE;
-				break;
-			}
-			if(CAT==TRUE)  	fprintf(outfile,"%s",line);
-			
-		}
-	}
+    // 1 emitting state, a copy of the middle state of sil
+    sp = hed_sp_model(sil);
 
+    // sp is appended to outfile, which usually is infile itself
+    if (strcmp(argv[1], argv[2]) != 0 && (fp = fopen(argv[2], "r")) != NULL) {
+        fclose(fp);
+        modelset_init(&out_set);
+        if (mmf_load(&out_set, argv[2]) < 0) {
+            exit(1);
+        }
+        out = &out_set;
+    } else if (strcmp(argv[1], argv[2]) != 0) {
+        modelset_init(&out_set);
+        out_set.vec_size = set.vec_size;
+        out_set.parm_kind = set.parm_kind;
+        out = &out_set;
+    }
+    if (modelset_find(out, "sp") != NULL) {
+        fprintf(stderr, "%s already has an sp model\n", argv[2]);
+        exit(1);
+    }
+    modelset_add(out, sp);
+    modelset_index(out);
 
-	fprintf(outfile,"<TRANSP> 3\n0.000000e+00 1.000000e+00 0.000000e+00\n");
-	fprintf(outfile,"0.000000e+00 5.000000e-01 5.000000e-01\n");
- 	fprintf(outfile,"0.000000e+00 0.000000e+00 0.000000e+00\n<ENDHMM>\n");
-	fclose(fp);
-	fclose(outfile);
-	return(0);
+    if (mmf_save(out, argv[2], MMF_ALL) < 0) {
+        exit(1);
+    }
+    if (out != &set) {
+        modelset_free(out);
+    }
+    modelset_free(&set);
+    return 0;
 }
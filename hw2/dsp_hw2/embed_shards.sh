@@ -0,0 +1,69 @@
+#!/bin/bash
+
+# One pass of embedded re-estimation split over SHARDS processes, like
+# HERest -p: every process runs the E-step over a slice of the -S list and
+# writes its accumulators to the -M directory, then a merge step adds them
+# up and writes the re-estimated models. Takes the HERest options, e.g.
+#
+#	SHARDS=4 ./embed_shards.sh -C lib/config.cfg -I labels/Clean08TR.mlf \
+#		-t 250.0 150.0 1000.0 -S scripts/training.scp \
+#		-H hmm/macros -H hmm/models -M hmm lib/models.lst
+#
+# EMBED is the trainer (bin/gmm_embed, or HERest). LAUNCH is put in front of
+# every slice's command, e.g. a cluster's job submission command that waits
+# for the job, so the slices run on other nodes; they must see the same
+# files, and the slice lists are written under the -M directory for them.
+# Slices run locally when it is empty.
+
+shards=${SHARDS:-$(nproc)}
+embed=${EMBED:-bin/gmm_embed}
+
+args=()
+scp=
+dir=
+while [ $# -gt 0 ]; do
+	case "$1" in
+	-S) scp=$2; shift 2 ;;
+	-M) dir=$2; args+=("$1" "$2"); shift 2 ;;
+	*) args+=("$1"); shift ;;
+	esac
+done
+if [ -z "$scp" ] || [ -z "$dir" ]; then
+	echo "Usage: SHARDS=n [EMBED=trainer] [LAUNCH=command] ./embed_shards.sh [HERest options] -S scp -M dir hmmlist"
+	exit 1
+fi
+if [ "$embed" = bin/gmm_embed ] && [ ! -e bin/gmm_embed ]; then
+	cd bin/; make; cd ..
+fi
+
+# The slices share the machine's cores when they run locally
+threads=
+if [ "$embed" = bin/gmm_embed ] && [ -z "$LAUNCH" ]; then
+	threads="-j $(( ($(nproc) + shards - 1) / shards ))"
+fi
+
+work=$(mktemp -d "$dir/shards.XXXXXX") || exit 1
+trap 'rm -rf "$work"' EXIT
+split -d -a 3 -n l/$shards "$scp" "$work/slice" || exit 1
+
+pids=()
+k=0
+for slice in "$work"/slice*; do
+	k=$((k + 1))
+	[ -s "$slice" ] || continue
+	$LAUNCH $embed $threads -p $k -S "$slice" "${args[@]}" > "$work/log$k" 2>&1 &
+	pids+=($!)
+	echo "$dir/HER$k.acc" >> "$work/acc.scp"
+done
+status=0
+for pid in "${pids[@]}"; do
+	wait $pid || status=1
+done
+cat "$work"/log*
+if [ $status -ne 0 ]; then
+	echo "embed_shards: a slice failed"
+	exit 1
+fi
+
+$embed -p 0 -S "$work/acc.scp" "${args[@]}" || exit 1
+rm -f $(cat "$work/acc.scp")
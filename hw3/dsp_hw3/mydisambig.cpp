@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include "Ngram.h"
 #include "VocabMap.h"
+#include "trace.h"
 
 #ifndef MAX_CANDIDATE
     #define MAX_CANDIDATE 1050 // Maximum number of candidate for one zhuyin is 1014
@@ -77,23 +78,27 @@ int main(int argc, char *argv[])
      * Read language model
      */
     Ngram lm(voc, ngram_order);
+    trace_begin("load LM");
     {
         const char *lm_filename = argv[6];
         File lm_file(lm_filename, "r");
         lm.read(lm_file);
         lm_file.close();
     }
+    trace_end("load LM");
 
     /**
      * Read map
      */
     VocabMap map(zhuyin, big5);	
+    trace_begin("load map");
     {
         const char *map_filename = argv[4];
         File map_file(map_filename, "r");
         map.read(map_file);
         map_file.close();
     }
+    trace_end("load map");
     
     /**
      * Read test data
@@ -106,11 +111,14 @@ int main(int argc, char *argv[])
         VocabString words[maxWordsPerLine];
         unsigned int words_length;
         
+        trace_begin("parse line");
         words_length = Vocab::parseWords(line, &(words[1]), maxWordsPerLine);
         words[0] = Vocab_SentStart; // Vocab_SentStart = "<s>"
         words[words_length+1] = Vocab_SentEnd; // Vocab_SentEnd = "</s>"
         words_length += 2;
         // words = ["<s>", "w_1", "w_2", ..., "w_n", "</s>"]
+        trace_end("parse line");
+        trace_begin("viterbi");
 
         /**
          * Start running Viterbi algorithm
@@ -211,9 +219,12 @@ int main(int argc, char *argv[])
             }
         }
 
+        trace_end("viterbi");
+
         /**
          * Output final sentence
          */
+        trace_begin("output");
         for (t = 0; t < words_length; t++) {
             printf("%s", output_words[t]);
             if (t == words_length - 1) {
@@ -222,6 +233,7 @@ int main(int argc, char *argv[])
                 printf(" ");
             }
         }
+        trace_end("output");
     }
 
     test_file.close();